@@ -0,0 +1,199 @@
+/**
+ * @file arena.c
+ * @brief Implements a fixed size object allocator.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+#include "print.h"
+
+/* Number of objects added each time an unbounded arena grows. */
+#define ARENA_GROW 16
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+struct free_obj {
+	struct free_obj *next;
+};
+
+struct slab {
+	struct slab *next;
+	void *mem;
+	size_t len;
+	int mapped;
+};
+
+struct arena {
+	const char *name;
+	size_t stride;
+	unsigned int size;
+	struct slab *slabs;
+	struct free_obj *free_list;
+	struct arena_stats stats;
+	pthread_mutex_t lock;
+	int shared;
+};
+
+static struct slab *slab_create(struct arena *a, unsigned int count,
+				int hugepages)
+{
+	struct slab *s;
+	unsigned int i;
+	char *obj;
+
+	s = calloc(1, sizeof(*s));
+	if (!s) {
+		return NULL;
+	}
+	s->len = count * a->stride;
+
+	if (hugepages) {
+		s->len = (s->len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		s->mem = mmap(NULL, s->len, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (s->mem == MAP_FAILED) {
+			pr_warning("%s arena: no huge pages, using normal pages",
+				   a->name);
+			s->mem = NULL;
+			s->len = count * a->stride;
+		} else {
+			s->mapped = 1;
+		}
+	}
+	if (!s->mem && posix_memalign(&s->mem, ARENA_ALIGN, s->len)) {
+		free(s);
+		return NULL;
+	}
+	if (!s->mapped) {
+		/* Fault in the pages now rather than on the hot path. */
+		memset(s->mem, 0, s->len);
+	}
+
+	for (i = count; i > 0; i--) {
+		obj = (char *) s->mem + (i - 1) * a->stride;
+		((struct free_obj *) obj)->next = a->free_list;
+		a->free_list = (struct free_obj *) obj;
+	}
+	s->next = a->slabs;
+	a->slabs = s;
+	a->stats.total += count;
+	return s;
+}
+
+struct arena *arena_create(const char *name, size_t obj_size,
+			   unsigned int count, int hugepages)
+{
+	struct arena *a;
+
+	a = calloc(1, sizeof(*a));
+	if (!a) {
+		return NULL;
+	}
+	a->name = name;
+	a->stride = (obj_size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	a->size = count;
+	a->stats.size = count;
+	pthread_mutex_init(&a->lock, NULL);
+
+	if (count && !slab_create(a, count, hugepages)) {
+		pr_err("%s arena: failed to allocate %u objects", name, count);
+		free(a);
+		return NULL;
+	}
+	return a;
+}
+
+void arena_destroy(struct arena *a)
+{
+	struct slab *s;
+
+	while ((s = a->slabs) != NULL) {
+		a->slabs = s->next;
+		if (s->mapped) {
+			munmap(s->mem, s->len);
+		} else {
+			free(s->mem);
+		}
+		free(s);
+	}
+	pthread_mutex_destroy(&a->lock);
+	free(a);
+}
+
+static void arena_lock(struct arena *a)
+{
+	if (a->shared) {
+		pthread_mutex_lock(&a->lock);
+	}
+}
+
+static void arena_unlock(struct arena *a)
+{
+	if (a->shared) {
+		pthread_mutex_unlock(&a->lock);
+	}
+}
+
+void *arena_alloc(struct arena *a)
+{
+	struct free_obj *obj;
+
+	arena_lock(a);
+	if (!a->free_list && (a->size || !slab_create(a, ARENA_GROW, 0))) {
+		a->stats.failures++;
+		arena_unlock(a);
+		return NULL;
+	}
+	obj = a->free_list;
+	a->free_list = obj->next;
+
+	a->stats.in_use++;
+	if (a->stats.in_use > a->stats.high_water) {
+		a->stats.high_water = a->stats.in_use;
+	}
+	arena_unlock(a);
+
+	memset(obj, 0, a->stride);
+	return obj;
+}
+
+void arena_free(struct arena *a, void *obj)
+{
+	struct free_obj *f = obj;
+
+	arena_lock(a);
+	f->next = a->free_list;
+	a->free_list = f;
+	a->stats.in_use--;
+	arena_unlock(a);
+}
+
+void arena_share(struct arena *a)
+{
+	a->shared = 1;
+}
+
+void arena_stats(struct arena *a, struct arena_stats *stats)
+{
+	arena_lock(a);
+	*stats = a->stats;
+	arena_unlock(a);
+}
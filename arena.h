@@ -0,0 +1,95 @@
+/**
+ * @file arena.h
+ * @brief Implements a fixed size object allocator.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_ARENA_H
+#define HAVE_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Every object handed out by an arena starts on this boundary. */
+#define ARENA_ALIGN 64
+
+struct arena;
+
+/**
+ * Usage counters of an arena.
+ * @size:        Capacity of a bounded arena, or zero if unbounded.
+ * @total:       Number of objects carved out of the arena so far.
+ * @in_use:      Number of objects currently allocated.
+ * @high_water:  Largest value ever seen in 'in_use'.
+ * @failures:    Number of allocation requests that could not be served.
+ */
+struct arena_stats {
+	unsigned int size;
+	unsigned int total;
+	unsigned int in_use;
+	unsigned int high_water;
+	uint64_t failures;
+};
+
+/**
+ * Create a new arena.
+ * @param name       Name of the arena, used in log messages.
+ * @param obj_size   The size of each object in bytes.
+ * @param count      The number of objects to preallocate. The arena will
+ *                   never hold more than this. If zero, the arena starts
+ *                   out empty and grows on demand.
+ * @param hugepages  If non-zero, try to back a bounded arena with huge
+ *                   pages, falling back to normal pages when none are
+ *                   available.
+ * @return  A pointer to a new arena on success, NULL otherwise.
+ */
+struct arena *arena_create(const char *name, size_t obj_size,
+			   unsigned int count, int hugepages);
+
+/**
+ * Destroy an arena, releasing the memory of all its objects.
+ * @param a  Pointer to an arena obtained via @ref arena_create().
+ */
+void arena_destroy(struct arena *a);
+
+/**
+ * Allocate an object from an arena.
+ * @param a  The arena to allocate from.
+ * @return   A pointer to a zeroed object, or NULL if none is available.
+ */
+void *arena_alloc(struct arena *a);
+
+/**
+ * Return an object to its arena.
+ * @param a    The arena the object was allocated from.
+ * @param obj  A pointer obtained via @ref arena_alloc().
+ */
+void arena_free(struct arena *a, void *obj);
+
+/**
+ * Make an arena safe to use from several threads at once.
+ * @param a  The arena to share.
+ */
+void arena_share(struct arena *a);
+
+/**
+ * Obtain the usage counters of an arena.
+ * @param a      The arena of interest.
+ * @param stats  Buffer to hold the result.
+ */
+void arena_stats(struct arena *a, struct arena_stats *stats);
+
+#endif
@@ -18,11 +18,13 @@
  */
 #include <errno.h>
 #include <linux/net_tstamp.h>
-#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 #include <sys/queue.h>
+#include <sys/timerfd.h>
 
 #include "address.h"
 #include "bmc.h"
@@ -31,6 +33,7 @@
 #include "clockcheck.h"
 #include "foreign.h"
 #include "filter.h"
+#include "holdover.h"
 #include "missing.h"
 #include "msg.h"
 #include "phc.h"
@@ -39,18 +42,46 @@
 #include "stats.h"
 #include "print.h"
 #include "rtnl.h"
+#include "status.h"
 #include "tlv.h"
+#include "trace.h"
 #include "tsproc.h"
 #include "uds.h"
 #include "util.h"
+#include "wheel.h"
 
-#define N_CLOCK_PFD (N_POLLFD + 1) /* one extra per port, for the fault timer */
+#define N_CLOCK_PFD N_PORT_EVENTS /* the descriptors and timers of a port */
 #define POW2_41 ((double)(1ULL << 41))
+#define HOLDOVER_EVENT UINT64_MAX /* epoll user data of the holdover timer */
+#define WHEEL_EVENT (UINT64_MAX - 1) /* epoll user data of the timer wheel */
 
 struct port {
 	LIST_ENTRY(port) list;
 };
 
+/*
+ * Each port owns a block of N_CLOCK_PFD slots, indexed by port number.
+ * The slot index is the epoll user data of the descriptors and the
+ * wheel data of the timers.
+ */
+struct clock_fd {
+	struct port *port;
+	int fd;
+};
+
+/*
+ * What the last state decision saw of each port, indexed by port
+ * number, so that the next one only needs to look at the ports whose
+ * inputs have changed.
+ */
+struct clock_bmca {
+	struct foreign_clock *fc;	/* Erbest */
+	struct dataset erbest;		/* its data set, valid if fc is set */
+	enum port_state state;		/* port state after the decision */
+	int rs;				/* recommended state, or -1 */
+	int dirty;
+};
+
 struct freq_estimator {
 	tmv_t origin1;
 	tmv_t ingress1;
@@ -83,6 +114,7 @@ struct clock {
 	int (*dscmp)(struct dataset *a, struct dataset *b);
 	struct defaultDS dds;
 	struct dataset default_dataset;
+	struct ClockQuality quality; /* as configured, outside of holdover */
 	struct currentDS cur;
 	struct parent_ds dad;
 	struct timePropertiesDS tds;
@@ -91,11 +123,18 @@ struct clock {
 	struct ClockIdentity best_id;
 	LIST_HEAD(ports_head, port) ports;
 	struct port *uds_port;
-	struct pollfd *pollfd;
-	int pollfd_valid;
+	int epoll_fd;
+	struct clock_fd *cfd;
+	struct epoll_event *events;
+	int nevents;
+	int ncfd;
+	struct wheel *wheel;
+	struct clock_bmca *bmca;
+	struct dataset bmca_dds; /* defaultDS at the last state decision */
 	int nports; /* does not include the UDS port */
 	int last_port_number;
 	int sde;
+	int sde_all; /* every port needs a new state decision */
 	int free_running;
 	int freq_est_interval;
 	int grand_master_capable; /* for 802.1AS only */
@@ -121,14 +160,21 @@ struct clock {
 	struct clock_stats stats;
 	int stats_interval;
 	struct clockcheck *sanity_check;
+	struct holdover *holdover;
+	int holdover_fd;
+	struct trace *trace;
+	struct status *status_export;
+	double freq; /* current frequency adjustment of the clock */
+	int log_sync_interval;
+	int holdover_class_in_spec;
+	int holdover_class_out_of_spec;
 	struct interface uds_interface;
 	LIST_HEAD(clock_subscribers_head, clock_subscriber) subscribers;
 };
 
-struct clock the_clock;
-
 static void handle_state_decision_event(struct clock *c);
-static int clock_resize_pollfd(struct clock *c, int new_nports);
+static int clock_resize_cfd(struct clock *c, int max_port_number);
+static void clock_unwatch_port(struct clock *c, struct port *p);
 static void clock_remove_port(struct clock *c, struct port *p);
 
 static int cid_eq(struct ClockIdentity *a, struct ClockIdentity *b)
@@ -267,8 +313,15 @@ void clock_destroy(struct clock *c)
 	LIST_FOREACH_SAFE(p, &c->ports, list, tmp) {
 		clock_remove_port(c, p);
 	}
+	clock_unwatch_port(c, c->uds_port);
 	port_close(c->uds_port);
-	free(c->pollfd);
+	if (c->wheel) {
+		wheel_destroy(c->wheel);
+	}
+	close(c->epoll_fd);
+	free(c->cfd);
+	free(c->events);
+	free(c->bmca);
 	if (c->clkid != CLOCK_REALTIME) {
 		phc_close(c->clkid);
 	}
@@ -280,9 +333,17 @@ void clock_destroy(struct clock *c)
 	if (c->sanity_check) {
 		clockcheck_destroy(c->sanity_check);
 	}
-	memset(c, 0, sizeof(*c));
-	msg_cleanup();
-	tc_cleanup();
+	if (c->holdover) {
+		close(c->holdover_fd);
+		holdover_destroy(c->holdover);
+	}
+	if (c->trace) {
+		trace_destroy(c->trace);
+	}
+	if (c->status_export) {
+		status_destroy(c->status_export);
+	}
+	free(c);
 }
 
 static int clock_fault_timeout(struct port *port, int set)
@@ -317,6 +378,166 @@ static void clock_freq_est_reset(struct clock *c)
 	c->fest.count = 0;
 }
 
+static uint64_t clock_monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+/* Map a time error in nanoseconds to the clockAccuracy enumeration. */
+static Enumeration8 clock_accuracy(double te)
+{
+	static const double limit[] = {
+		25e0, 100e0, 250e0, 1e3, 2.5e3, 10e3, 25e3, 100e3, 250e3,
+		1e6, 2.5e6, 10e6, 25e6, 100e6, 250e6, 1e9, 10e9,
+	};
+	int i;
+
+	for (i = 0; i < sizeof(limit) / sizeof(limit[0]); i++) {
+		if (te <= limit[i])
+			return 0x20 + i;
+	}
+	return 0x31;
+}
+
+static enum holdover_state clock_holdover_state(struct clock *c, uint64_t ts)
+{
+	return c->holdover ? holdover_state(c->holdover, ts) :
+		HOLDOVER_UNAVAILABLE;
+}
+
+static int clock_in_holdover(struct clock *c, uint64_t ts)
+{
+	switch (clock_holdover_state(c, ts)) {
+	case HOLDOVER_IN_SPEC:
+	case HOLDOVER_OUT_OF_SPEC:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Update the local clock quality according to the holdover state.
+ * Returns non-zero if the quality has changed.
+ */
+static int clock_holdover_quality(struct clock *c, uint64_t ts)
+{
+	struct ClockQuality q = c->quality;
+	Enumeration8 accuracy;
+	int class = 0;
+
+	switch (clock_holdover_state(c, ts)) {
+	case HOLDOVER_UNAVAILABLE:
+	case HOLDOVER_AVAILABLE:
+		break;
+	case HOLDOVER_IN_SPEC:
+		class = c->holdover_class_in_spec;
+		break;
+	case HOLDOVER_OUT_OF_SPEC:
+		class = c->holdover_class_out_of_spec;
+		break;
+	}
+	if (clock_in_holdover(c, ts)) {
+		if (class && q.clockClass != 255)
+			q.clockClass = class;
+		accuracy = clock_accuracy(holdover_time_error(c->holdover, ts));
+		if (accuracy > q.clockAccuracy)
+			q.clockAccuracy = accuracy;
+	}
+
+	if (!memcmp(&q, &c->dds.clockQuality, sizeof(q)))
+		return 0;
+
+	c->dds.clockQuality = q;
+	if (cid_eq(&c->dad.pds.grandmasterIdentity, &c->dds.clockIdentity))
+		c->dad.pds.grandmasterClockQuality = q;
+	return 1;
+}
+
+static void clock_holdover_timer(struct clock *c, int enable)
+{
+	struct itimerspec tmo = {
+		{ enable ? 1 : 0, 0 }, { enable ? 1 : 0, 0 }
+	};
+
+	if (timerfd_settime(c->holdover_fd, 0, &tmo, NULL))
+		pr_err("failed to set the holdover timer: %m");
+}
+
+static void clock_holdover_start(struct clock *c)
+{
+	uint64_t ts = clock_monotonic_ns();
+
+	if (holdover_state(c->holdover, ts) != HOLDOVER_AVAILABLE)
+		return;
+	if (holdover_start(c->holdover, ts, tmv_dbl(c->master_offset)))
+		return;
+
+	pr_notice("entering holdover, freq %+.0f aging %+.6f",
+		  holdover_freq(c->holdover, ts), holdover_aging(c->holdover));
+	c->freq = holdover_freq(c->holdover, ts);
+	clockadj_set_freq(c->clkid, c->freq);
+	clock_holdover_timer(c, 1);
+	clock_holdover_quality(c, ts);
+}
+
+static void clock_holdover_stop(struct clock *c)
+{
+	uint64_t ts = clock_monotonic_ns();
+
+	if (!clock_in_holdover(c, ts))
+		return;
+
+	pr_notice("leaving holdover after %.0f seconds, time error %.0f",
+		  holdover_duration(c->holdover, ts),
+		  holdover_time_error(c->holdover, ts));
+	holdover_stop(c->holdover);
+	clock_holdover_timer(c, 0);
+	clock_holdover_quality(c, ts);
+}
+
+/* Apply the predicted frequency once per second during the holdover. */
+static void clock_holdover_update(struct clock *c)
+{
+	uint64_t expirations, ts;
+	double freq;
+
+	if (read(c->holdover_fd, &expirations, sizeof(expirations)) < 0)
+		return;
+
+	ts = clock_monotonic_ns();
+	if (!clock_in_holdover(c, ts))
+		return;
+
+	freq = holdover_freq(c->holdover, ts);
+	clockadj_set_freq(c->clkid, freq);
+	c->freq = freq;
+	if (c->sanity_check)
+		clockcheck_set_freq(c->sanity_check, freq);
+
+	pr_info("holdover %6.0f s freq %+7.0f time error %9.0f%s",
+		holdover_duration(c->holdover, ts), freq,
+		holdover_time_error(c->holdover, ts),
+		clock_holdover_state(c, ts) == HOLDOVER_OUT_OF_SPEC ?
+		" out of spec" : "");
+
+	/* A degraded quality may change the recommended port states. */
+	if (clock_holdover_quality(c, ts))
+		c->sde = 1;
+}
+
+static void pool_usage_fill(struct pool_usage_np *pu, struct arena_stats *s)
+{
+	pu->size = s->size;
+	pu->total = s->total;
+	pu->in_use = s->in_use;
+	pu->high_water = s->high_water;
+	pu->failures = s->failures > UINT32_MAX ? UINT32_MAX : s->failures;
+}
+
 static void clock_management_send_error(struct port *p,
 					struct ptp_message *msg, int error_id)
 {
@@ -337,6 +558,12 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 	struct subscribe_events_np *sen;
 	struct management_tlv *tlv;
 	struct time_status_np *tsn;
+	struct pool_stats_np *psn;
+	struct servo_status_np *ssn;
+	struct servo_status status;
+	struct holdover_status_np *hsn;
+	uint64_t ts;
+	struct arena_stats stats;
 	struct tlv_extra *extra;
 	struct PTPText *text;
 	int datalen = 0;
@@ -443,6 +670,40 @@ static int clock_management_fill_response(struct clock *c, struct port *p,
 		sen = (struct subscribe_events_np *)tlv->data;
 		clock_get_subscription(c, req, sen->bitmask, &sen->duration);
 		break;
+	case TLV_POOL_STATS_NP:
+		psn = (struct pool_stats_np *) tlv->data;
+		msg_pool_stats(&stats);
+		pool_usage_fill(&psn->message, &stats);
+		tlv_extra_pool_stats(&stats);
+		pool_usage_fill(&psn->tlv, &stats);
+		tc_pool_stats(&stats);
+		pool_usage_fill(&psn->tc, &stats);
+		datalen = sizeof(*psn);
+		break;
+	case TLV_SERVO_STATUS_NP:
+		ssn = (struct servo_status_np *) tlv->data;
+		servo_status(c->servo, &status);
+		ssn->kp = status.kp * 1e9;
+		ssn->ki = status.ki * 1e9;
+		ssn->gain_scale = status.gain_scale * 1e9;
+		ssn->offset_stddev = status.offset_stddev;
+		ssn->freq_stddev = status.freq_stddev * 1e9;
+		ssn->servo_state = c->servo_state;
+		datalen = sizeof(*ssn);
+		break;
+	case TLV_HOLDOVER_STATUS_NP:
+		hsn = (struct holdover_status_np *) tlv->data;
+		memset(hsn, 0, sizeof(*hsn));
+		ts = clock_monotonic_ns();
+		hsn->state = clock_holdover_state(c, ts);
+		if (clock_in_holdover(c, ts)) {
+			hsn->freq = holdover_freq(c->holdover, ts) * 1e9;
+			hsn->aging = holdover_aging(c->holdover) * 1e9;
+			hsn->time_error = holdover_time_error(c->holdover, ts);
+			hsn->duration = holdover_duration(c->holdover, ts);
+		}
+		datalen = sizeof(*hsn);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		return 0;
@@ -503,7 +764,9 @@ static int clock_management_set(struct clock *c, struct port *p,
 		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		gsn = (struct grandmaster_settings_np *) tlv->data;
+		c->quality = gsn->clockQuality;
 		c->dds.clockQuality = gsn->clockQuality;
+		clock_holdover_quality(c, clock_monotonic_ns());
 		c->utc_offset = gsn->utc_offset;
 		c->time_flags = gsn->time_flags;
 		c->time_source = gsn->time_source;
@@ -639,9 +902,13 @@ static void clock_update_grandmaster(struct clock *c)
 static void clock_update_slave(struct clock *c)
 {
 	struct parentDS *pds = &c->dad.pds;
-	struct ptp_message *msg        = TAILQ_FIRST(&c->best->messages);
+	struct ptp_message *msg        = c->best->latest;
 	c->cur.stepsRemoved            = 1 + c->best->dataset.stepsRemoved;
 	pds->parentPortIdentity        = c->best->dataset.sender;
+	if (!msg) {
+		/* The announce messages have expired, keep the last data. */
+		return;
+	}
 	pds->grandmasterIdentity       = msg->announce.grandmasterIdentity;
 	pds->grandmasterClockQuality   = msg->announce.grandmasterClockQuality;
 	pds->grandmasterPriority1      = msg->announce.grandmasterPriority1;
@@ -775,12 +1042,12 @@ static int clock_add_port(struct clock *c, int phc_index,
 {
 	struct port *p, *piter, *lastp = NULL;
 
-	if (clock_resize_pollfd(c, c->nports + 1)) {
+	if (clock_resize_cfd(c, c->last_port_number + 1)) {
 		return -1;
 	}
 	p = port_open(phc_index, timestamping, ++c->last_port_number, iface, c);
 	if (!p) {
-		/* No need to shrink pollfd */
+		/* No need to shrink the descriptor slots */
 		return -1;
 	}
 	LIST_FOREACH(piter, &c->ports, list) {
@@ -792,21 +1059,21 @@ static int clock_add_port(struct clock *c, int phc_index,
 		LIST_INSERT_HEAD(&c->ports, p, list);
 	}
 	c->nports++;
-	clock_fda_changed(c);
+	clock_fda_changed(c, p);
 
 	return 0;
 }
 
 static void clock_remove_port(struct clock *c, struct port *p)
 {
-	/* Do not call clock_resize_pollfd, it's pointless to shrink
+	/* Do not call clock_resize_cfd, it's pointless to shrink
 	 * the allocated memory at this point, clock_destroy will free
 	 * it all anyway. This function is usable from other parts of
-	 * the code, but even then we don't mind if pollfd is larger
-	 * than necessary. */
+	 * the code, but even then we don't mind if the slot array is
+	 * larger than necessary. */
 	LIST_REMOVE(p, list);
 	c->nports--;
-	clock_fda_changed(c);
+	clock_unwatch_port(c, p);
 	port_close(p);
 }
 
@@ -849,28 +1116,23 @@ static void ensure_ts_label(struct interface *iface)
 		strncpy(iface->ts_label, iface->name, MAX_IFNAME_SIZE);
 }
 
-struct clock *clock_create(enum clock_type type, struct config *config,
-			   const char *phc_device)
+static int clock_init(struct clock *c, enum clock_type type,
+		      struct config *config, const char *phc_device)
 {
 	enum servo_type servo = config_get_int(config, NULL, "clock_servo");
 	enum timestamp_type timestamping;
 	int fadj = 0, max_adj = 0, sw_ts;
 	int phc_index, required_modes = 0;
-	struct clock *c = &the_clock;
 	struct port *p;
 	unsigned char oui[OUI_LEN];
 	char phc[32], *tmp;
 	struct interface *iface, *udsif = &c->uds_interface;
 	struct timespec ts;
-	int sfl;
+	int history, sfl;
 
 	clock_gettime(CLOCK_REALTIME, &ts);
 	srandom(ts.tv_sec ^ ts.tv_nsec);
 
-	if (c->nports) {
-		clock_destroy(c);
-	}
-
 	switch (type) {
 	case CLOCK_TYPE_ORDINARY:
 	case CLOCK_TYPE_BOUNDARY:
@@ -879,7 +1141,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		c->type = type;
 		break;
 	case CLOCK_TYPE_MANAGEMENT:
-		return NULL;
+		return -1;
 	}
 
 	/* Initialize the defaultDS. */
@@ -898,23 +1160,23 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	if (count_char(tmp, ';') != 2 ||
 	    static_ptp_text_set(&c->desc.productDescription, tmp)) {
 		pr_err("invalid productDescription '%s'", tmp);
-		return NULL;
+		return -1;
 	}
 	tmp = config_get_string(config, NULL, "revisionData");
 	if (count_char(tmp, ';') != 2 ||
 	    static_ptp_text_set(&c->desc.revisionData, tmp)) {
 		pr_err("invalid revisionData '%s'", tmp);
-		return NULL;
+		return -1;
 	}
 	tmp = config_get_string(config, NULL, "userDescription");
 	if (static_ptp_text_set(&c->desc.userDescription, tmp)) {
 		pr_err("invalid userDescription '%s'", tmp);
-		return NULL;
+		return -1;
 	}
 	tmp = config_get_string(config, NULL, "manufacturerIdentity");
 	if (OUI_LEN != sscanf(tmp, "%hhx:%hhx:%hhx", &oui[0], &oui[1], &oui[2])) {
 		pr_err("invalid manufacturerIdentity '%s'", tmp);
-		return NULL;
+		return -1;
 	}
 	memcpy(c->desc.manufacturerIdentity, oui, OUI_LEN);
 
@@ -926,18 +1188,19 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	if (!config_get_int(config, NULL, "gmCapable") &&
 	    c->dds.flags & DDS_SLAVE_ONLY) {
 		pr_err("Cannot mix 1588 slaveOnly with 802.1AS !gmCapable");
-		return NULL;
+		return -1;
 	}
 	if (!config_get_int(config, NULL, "gmCapable") ||
 	    c->dds.flags & DDS_SLAVE_ONLY) {
 		c->dds.clockQuality.clockClass = 255;
 	}
+	c->quality = c->dds.clockQuality;
 	c->default_dataset.localPriority =
 		config_get_int(config, NULL, "G.8275.defaultDS.localPriority");
 
 	/* Harmonize the twoStepFlag with the time_stamping option. */
 	if (config_harmonize_onestep(config)) {
-		return NULL;
+		return -1;
 	}
 	if (config_get_int(config, NULL, "twoStepFlag")) {
 		c->dds.flags |= DDS_TWO_STEP_FLAG;
@@ -963,7 +1226,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		    ((iface->ts_info.so_timestamping & required_modes) != required_modes)) {
 			pr_err("interface '%s' does not support "
 			       "requested timestamping mode", iface->name);
-			return NULL;
+			return -1;
 		}
 	}
 
@@ -977,14 +1240,14 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	} else if (phc_device) {
 		if (1 != sscanf(phc_device, "/dev/ptp%d", &phc_index)) {
 			pr_err("bad ptp device string");
-			return NULL;
+			return -1;
 		}
 	} else if (iface->ts_info.valid) {
 		phc_index = iface->ts_info.phc_index;
 	} else {
 		pr_err("PTP device not specified and automatic determination"
 		       " is not supported. Please specify PTP device.");
-		return NULL;
+		return -1;
 	}
 	if (phc_index >= 0) {
 		pr_info("selected /dev/ptp%d as PTP clock", phc_index);
@@ -992,7 +1255,7 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 
 	if (generate_clock_identity(&c->dds.clockIdentity, iface->name)) {
 		pr_err("failed to generate a clock identity");
-		return NULL;
+		return -1;
 	}
 
 	/* Configure the UDS. */
@@ -1000,18 +1263,18 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		 config_get_string(config, NULL, "uds_address"));
 	if (config_set_section_int(config, udsif->name,
 				   "announceReceiptTimeout", 0)) {
-		return NULL;
+		return -1;
 	}
 	if (config_set_section_int(config, udsif->name,
 				    "delay_mechanism", DM_AUTO)) {
-		return NULL;
+		return -1;
 	}
 	if (config_set_section_int(config, udsif->name,
 				    "network_transport", TRANS_UDS)) {
-		return NULL;
+		return -1;
 	}
 	if (config_set_section_int(config, udsif->name, "delay_filter_length", 1)) {
-		return NULL;
+		return -1;
 	}
 
 	c->config = config;
@@ -1032,12 +1295,12 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		c->clkid = phc_open(phc);
 		if (c->clkid == CLOCK_INVALID) {
 			pr_err("Failed to open %s: %m", phc);
-			return NULL;
+			return -1;
 		}
 		max_adj = phc_max_adj(c->clkid);
 		if (!max_adj) {
 			pr_err("clock is not adjustable");
-			return NULL;
+			return -1;
 		}
 		clockadj_init(c->clkid);
 	} else {
@@ -1058,10 +1321,11 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		   the actual frequency of the clock. */
 		clockadj_set_freq(c->clkid, fadj);
 	}
+	c->freq = fadj;
 	c->servo = servo_create(c->config, servo, -fadj, max_adj, sw_ts);
 	if (!c->servo) {
 		pr_err("Failed to create clock servo");
-		return NULL;
+		return -1;
 	}
 	c->servo_state = SERVO_UNLOCKED;
 	c->servo_type = servo;
@@ -1072,10 +1336,17 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	}
 	c->tsproc = tsproc_create(config_get_int(config, NULL, "tsproc_mode"),
 				  config_get_int(config, NULL, "delay_filter"),
-				  config_get_int(config, NULL, "delay_filter_length"));
+				  config_get_int(config, NULL, "delay_filter_length"),
+				  config_get_int(config, NULL, "delay_filter_percentile"));
 	if (!c->tsproc) {
 		pr_err("Failed to create time stamp processor");
-		return NULL;
+		return -1;
+	}
+	if (tsproc_set_selection(c->tsproc,
+				 config_get_int(config, NULL, "tsproc_select_window"),
+				 config_get_int(config, NULL, "tsproc_select_percentile"))) {
+		pr_err("Failed to create the sync selection window");
+		return -1;
 	}
 	c->initial_delay = dbl_tmv(config_get_int(config, NULL, "initial_delay"));
 	c->master_local_rr = 1.0;
@@ -1086,15 +1357,51 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	c->stats.delay = stats_create();
 	if (!c->stats.offset || !c->stats.freq || !c->stats.delay) {
 		pr_err("failed to create stats");
-		return NULL;
+		return -1;
 	}
 	sfl = config_get_int(config, NULL, "sanity_freq_limit");
 	if (sfl) {
 		c->sanity_check = clockcheck_create(sfl);
 		if (!c->sanity_check) {
 			pr_err("Failed to create clock sanity check");
-			return NULL;
+			return -1;
+		}
+	}
+	tmp = config_get_string(config, NULL, "trace_file");
+	if (tmp && tmp[0]) {
+		c->trace = trace_create(tmp, config_get_int(config, NULL,
+							    "trace_records"));
+		if (!c->trace) {
+			pr_err("Failed to create the trace");
+			return -1;
+		}
+	}
+	tmp = config_get_string(config, NULL, "status_file");
+	if (tmp && tmp[0]) {
+		c->status_export = status_create(tmp);
+		if (!c->status_export) {
+			pr_err("Failed to create the status file");
+			return -1;
+		}
+	}
+	history = config_get_int(config, NULL, "holdover_history");
+	if (history && !c->free_running) {
+		c->holdover = holdover_create(history,
+			config_get_int(config, NULL, "holdover_error_limit"));
+		if (!c->holdover) {
+			pr_err("Failed to create holdover, "
+			       "holdover_history must be at least 4 seconds");
+			return -1;
 		}
+		c->holdover_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+		if (c->holdover_fd < 0) {
+			pr_err("timerfd_create failed: %m");
+			return -1;
+		}
+		c->holdover_class_in_spec =
+			config_get_int(config, NULL, "holdover_class_in_spec");
+		c->holdover_class_out_of_spec =
+			config_get_int(config, NULL, "holdover_class_out_of_spec");
 	}
 
 	/* Initialize the parentDS. */
@@ -1110,24 +1417,51 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 	LIST_INIT(&c->ports);
 	c->last_port_number = 0;
 
-	if (clock_resize_pollfd(c, 0)) {
-		pr_err("failed to allocate pollfd");
-		return NULL;
+	c->epoll_fd = epoll_create1(0);
+	if (c->epoll_fd < 0) {
+		pr_err("epoll_create1 failed: %m");
+		return -1;
+	}
+	if (clock_resize_cfd(c, 0)) {
+		pr_err("failed to allocate descriptor slots");
+		return -1;
+	}
+	c->wheel = wheel_create();
+	if (!c->wheel) {
+		pr_err("failed to create the timer wheel");
+		return -1;
+	} else {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = WHEEL_EVENT;
+		if (epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, wheel_fd(c->wheel), &ev)) {
+			pr_err("epoll_ctl failed for the timer wheel: %m");
+			return -1;
+		}
+	}
+	if (c->holdover) {
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = HOLDOVER_EVENT;
+		if (epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, c->holdover_fd, &ev)) {
+			pr_err("epoll_ctl failed for the holdover timer: %m");
+			return -1;
+		}
 	}
 
 	/* Create the UDS interface. */
 	c->uds_port = port_open(phc_index, timestamping, 0, udsif, c);
 	if (!c->uds_port) {
 		pr_err("failed to open the UDS port");
-		return NULL;
+		return -1;
 	}
-	clock_fda_changed(c);
+	clock_fda_changed(c, c->uds_port);
 
 	/* Create the ports. */
 	STAILQ_FOREACH(iface, &config->interfaces, list) {
 		if (clock_add_port(c, phc_index, timestamping, iface)) {
 			pr_err("failed to open port %s", iface->name);
-			return NULL;
+			return -1;
 		}
 	}
 
@@ -1137,7 +1471,24 @@ struct clock *clock_create(enum clock_type type, struct config *config,
 		port_dispatch(p, EV_INITIALIZE, 0);
 	}
 	port_dispatch(c->uds_port, EV_INITIALIZE, 0);
+	wheel_arm(c->wheel);
+
+	return 0;
+}
 
+struct clock *clock_create(enum clock_type type, struct config *config,
+			   const char *phc_device)
+{
+	struct clock *c;
+
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		return NULL;
+	}
+	if (clock_init(c, type, config, phc_device)) {
+		free(c);
+		return NULL;
+	}
 	return c;
 }
 
@@ -1203,54 +1554,121 @@ struct ClockIdentity clock_identity(struct clock *c)
 	return c->dds.clockIdentity;
 }
 
-static int clock_resize_pollfd(struct clock *c, int new_nports)
+static int clock_resize_cfd(struct clock *c, int max_port_number)
 {
-	struct pollfd *new_pollfd;
+	int i, n = (max_port_number + 1) * N_CLOCK_PFD;
+	struct epoll_event *events;
+	struct clock_bmca *bmca;
+	struct clock_fd *cfd;
 
-	/* Need to allocate one whole extra block of fds for UDS. */
-	new_pollfd = realloc(c->pollfd,
-			     (new_nports + 1) * N_CLOCK_PFD *
-			     sizeof(struct pollfd));
-	if (!new_pollfd) {
+	if (n <= c->ncfd) {
+		return 0;
+	}
+	/*
+	 * The slots are registered with epoll by index rather than by
+	 * address, so that moving them around here is harmless.
+	 */
+	cfd = realloc(c->cfd, n * sizeof(*cfd));
+	if (!cfd) {
+		return -1;
+	}
+	c->cfd = cfd;
+	for (i = c->ncfd; i < n; i++) {
+		cfd[i].port = NULL;
+		cfd[i].fd = -1;
+	}
+	/* Room for every slot, plus the wheel and the holdover timer. */
+	events = realloc(c->events, (n + 2) * sizeof(*events));
+	if (!events) {
+		return -1;
+	}
+	c->events = events;
+	bmca = realloc(c->bmca, (max_port_number + 1) * sizeof(*bmca));
+	if (!bmca) {
 		return -1;
 	}
-	c->pollfd = new_pollfd;
+	c->bmca = bmca;
+	for (i = c->ncfd / N_CLOCK_PFD; i <= max_port_number; i++) {
+		memset(&bmca[i], 0, sizeof(bmca[i]));
+		bmca[i].rs = -1;
+		bmca[i].dirty = 1;
+	}
+	c->ncfd = n;
 	return 0;
 }
 
-static void clock_fill_pollfd(struct pollfd *dest, struct port *p)
+static void clock_watch_fd(struct clock *c, struct port *p, int slot, int fd)
 {
-	struct fdarray *fda;
-	int i;
+	struct clock_fd *cfd = &c->cfd[slot];
+	struct epoll_event ev;
 
-	fda = port_fda(p);
-	for (i = 0; i < N_POLLFD; i++) {
-		dest[i].fd = fda->fd[i];
-		dest[i].events = POLLIN|POLLPRI;
+	ev.events = EPOLLIN|EPOLLPRI;
+	ev.data.u64 = slot;
+
+	if (cfd->fd >= 0 && cfd->fd == fd) {
+		/*
+		 * Ports remove their descriptors before closing them, see
+		 * clock_fda_closing(), so this is the same descriptor.
+		 */
+		if (!epoll_ctl(c->epoll_fd, EPOLL_CTL_MOD, fd, &ev)) {
+			cfd->port = p;
+			return;
+		}
+		pr_err("epoll_ctl failed to modify descriptor %d: %m", fd);
+	} else if (cfd->fd >= 0) {
+		if (epoll_ctl(c->epoll_fd, EPOLL_CTL_DEL, cfd->fd, NULL)) {
+			pr_err("epoll_ctl failed to remove descriptor %d: %m",
+			       cfd->fd);
+		}
 	}
-	dest[i].fd = port_fault_fd(p);
-	dest[i].events = POLLIN|POLLPRI;
+	cfd->port = NULL;
+	cfd->fd = -1;
+	if (fd < 0) {
+		return;
+	}
+	if (epoll_ctl(c->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+		pr_err("epoll_ctl failed for descriptor %d: %m", fd);
+		return;
+	}
+	cfd->port = p;
+	cfd->fd = fd;
 }
 
-static void clock_check_pollfd(struct clock *c)
+static void clock_unwatch_port(struct clock *c, struct port *p)
 {
-	struct port *p;
-	struct pollfd *dest = c->pollfd;
+	int i, slot = port_number(p) * N_CLOCK_PFD;
 
-	if (c->pollfd_valid) {
-		return;
+	for (i = 0; i < N_CLOCK_PFD; i++) {
+		clock_watch_fd(c, p, slot + i, -1);
 	}
-	LIST_FOREACH(p, &c->ports, list) {
-		clock_fill_pollfd(dest, p);
-		dest += N_CLOCK_PFD;
+}
+
+void clock_fda_closing(struct clock *c, struct port *p)
+{
+	int i, slot = port_number(p) * N_CLOCK_PFD;
+
+	for (i = 0; i < N_POLLFD; i++) {
+		clock_watch_fd(c, p, slot + i, -1);
 	}
-	clock_fill_pollfd(dest, c->uds_port);
-	c->pollfd_valid = 1;
 }
 
-void clock_fda_changed(struct clock *c)
+void clock_fda_changed(struct clock *c, struct port *p)
 {
-	c->pollfd_valid = 0;
+	int i, slot = port_number(p) * N_CLOCK_PFD;
+	struct fdarray *fda = port_fda(p);
+
+	for (i = 0; i < N_POLLFD; i++) {
+		clock_watch_fd(c, p, slot + i, fda->fd[i]);
+	}
+}
+
+void clock_timer_init(struct clock *c, struct port *p, struct wheel_timer *t,
+		      int index)
+{
+	int slot = port_number(p) * N_CLOCK_PFD + index;
+
+	c->cfd[slot].port = p;
+	wheel_timer_init(t, c->wheel, slot);
 }
 
 static int clock_do_forward_mgmt(struct clock *c,
@@ -1401,6 +1819,9 @@ int clock_manage(struct clock *c, struct port *p, struct ptp_message *msg)
 	case TLV_TIME_STATUS_NP:
 	case TLV_GRANDMASTER_SETTINGS_NP:
 	case TLV_SUBSCRIBE_EVENTS_NP:
+	case TLV_POOL_STATS_NP:
+	case TLV_SERVO_STATUS_NP:
+	case TLV_HOLDOVER_STATUS_NP:
 		clock_management_send_error(p, msg, TLV_NOT_SUPPORTED);
 		break;
 	default:
@@ -1463,17 +1884,84 @@ struct PortIdentity clock_parent_identity(struct clock *c)
 void clock_set_sde(struct clock *c, int sde)
 {
 	c->sde = sde;
+	if (sde) {
+		c->sde_all = 1;
+	}
 }
 
-int clock_poll(struct clock *c)
+static void clock_port_sde(struct clock *c, struct port *p)
 {
-	int cnt, i;
-	enum fsm_event event;
-	struct pollfd *cur;
+	c->bmca[port_number(p)].dirty = 1;
+	c->sde = 1;
+}
+
+static int clock_cmp_event(const void *a, const void *b)
+{
+	const struct epoll_event *x = a, *y = b;
+
+	if (x->data.u64 == y->data.u64) {
+		return 0;
+	}
+	return x->data.u64 < y->data.u64 ? -1 : 1;
+}
+
+int clock_fd(struct clock *c)
+{
+	return c->epoll_fd;
+}
+
+static void clock_timer_expired(void *ctx, uint64_t slot)
+{
+	struct clock *c = ctx;
+	struct epoll_event *ev = &c->events[c->nevents++];
+
+	ev->events = EPOLLIN;
+	ev->data.u64 = slot;
+}
+
+static void clock_status_update(struct clock *c)
+{
+	struct status_data d;
 	struct port *p;
+	int n = 0;
+
+	memset(&d, 0, sizeof(d));
+	d.update = clock_monotonic_ns();
+	d.master_offset = tmv_to_nanoseconds(c->master_offset);
+	d.ingress_time = tmv_to_nanoseconds(c->ingress_ts);
+	d.path_delay = tmv_to_nanoseconds(c->path_delay);
+	d.freq = c->freq;
+	d.clock_identity = c->dds.clockIdentity;
+	d.grandmaster_identity = c->dad.pds.grandmasterIdentity;
+	d.steps_removed = c->cur.stepsRemoved;
+	d.current_utc_offset = c->tds.currentUtcOffset;
+	d.time_flags = c->tds.flags;
+	d.time_source = c->tds.timeSource;
+	d.servo_state = c->servo_state;
+	d.domain = c->dds.domainNumber;
+	d.clock_class = c->dad.pds.grandmasterClockQuality.clockClass;
+	d.clock_accuracy = c->dad.pds.grandmasterClockQuality.clockAccuracy;
+	d.gm_present = !cid_eq(&c->dad.pds.grandmasterIdentity,
+			       &c->dds.clockIdentity);
+	LIST_FOREACH(p, &c->ports, list) {
+		if (n == STATUS_MAX_PORTS)
+			break;
+		port_status(p, &d.port[n++]);
+	}
+	d.num_ports = n;
+	status_write(c->status_export, &d);
+}
+
+static int clock_wait(struct clock *c, int timeout)
+{
+	struct port *p, *faulty = NULL;
+	enum fsm_event event;
+	uint32_t revents;
+	int cnt, i, k;
 
-	clock_check_pollfd(c);
-	cnt = poll(c->pollfd, (c->nports + 1) * N_CLOCK_PFD, -1);
+	wheel_arm(c->wheel);
+
+	cnt = epoll_wait(c->epoll_fd, c->events, c->ncfd, timeout);
 	if (cnt < 0) {
 		if (EINTR == errno) {
 			return 0;
@@ -1485,49 +1973,102 @@ int clock_poll(struct clock *c)
 		return 0;
 	}
 
-	cur = c->pollfd;
+	/*
+	 * The expired timers take the place of the wheel event.  There
+	 * is room for all of them, as each slot appears at most once.
+	 */
+	for (k = 0; k < cnt; k++) {
+		if (c->events[k].data.u64 == WHEEL_EVENT) {
+			c->events[k] = c->events[--cnt];
+			c->nevents = cnt;
+			wheel_run(c->wheel, clock_timer_expired, c);
+			cnt = c->nevents;
+			break;
+		}
+	}
 
-	LIST_FOREACH(p, &c->ports, list) {
-		/* Let the ports handle their events. */
-		for (i = 0; i < N_POLLFD; i++) {
-			if (cur[i].revents & (POLLIN|POLLPRI)) {
+	/*
+	 * Service the ready descriptors and timers of each port in the
+	 * order of their event index, so that the DELAY timer is handled
+	 * before the ANNOUNCE and SYNC_RX timers.
+	 */
+	if (cnt > 1) {
+		qsort(c->events, cnt, sizeof(*c->events), clock_cmp_event);
+	}
+
+	for (k = 0; k < cnt; k++) {
+		/* The holdover timer sorts after all of the ports. */
+		if (c->events[k].data.u64 == HOLDOVER_EVENT) {
+			clock_holdover_update(c);
+			continue;
+		}
+		p = c->cfd[c->events[k].data.u64].port;
+		i = c->events[k].data.u64 % N_CLOCK_PFD;
+		revents = c->events[k].events;
+
+		/* The descriptor may have been closed in the meantime. */
+		if (!p) {
+			continue;
+		}
+
+		/* Check the UDS port. */
+		if (p == c->uds_port) {
+			if (i != FD_FAULT_TIMER &&
+			    revents & (EPOLLIN|EPOLLPRI)) {
 				event = port_event(p, i);
 				if (EV_STATE_DECISION_EVENT == event) {
-					c->sde = 1;
-				}
-				if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
-					c->sde = 1;
-				}
-				port_dispatch(p, event, 0);
-				/* Clear any fault after a little while. */
-				if (PS_FAULTY == port_state(p)) {
-					clock_fault_timeout(p, 1);
-					break;
+					clock_set_sde(c, 1);
 				}
 			}
+			continue;
 		}
 
 		/*
 		 * When the fault timer expires we clear the fault,
 		 * but only if the link is up.
 		 */
-		if (cur[N_POLLFD].revents & (POLLIN|POLLPRI)) {
-			clock_fault_timeout(p, 0);
-			if (port_link_status_get(p)) {
-				port_dispatch(p, EV_FAULT_CLEARED, 0);
+		if (i == FD_FAULT_TIMER) {
+			if (revents & (EPOLLIN|EPOLLPRI)) {
+				clock_fault_timeout(p, 0);
+				if (port_link_status_get(p)) {
+					port_dispatch(p, EV_FAULT_CLEARED, 0);
+				}
 			}
+			continue;
 		}
 
-		cur += N_CLOCK_PFD;
-	}
-
-	/* Check the UDS port. */
-	for (i = 0; i < N_POLLFD; i++) {
-		if (cur[i].revents & (POLLIN|POLLPRI)) {
-			event = port_event(c->uds_port, i);
+		/* Let the ports handle their events. */
+		if (p == faulty) {
+			continue;
+		}
+		if (i == FD_EVENT && revents & EPOLLERR && port_txts_async(p)) {
+			/* The error queue holds transmit time stamps. */
+			event = port_txts_event(p);
+		} else if (revents & (EPOLLIN|EPOLLPRI)) {
+			event = port_event(p, i);
+		} else {
+			continue;
+		}
+		for (;;) {
 			if (EV_STATE_DECISION_EVENT == event) {
-				c->sde = 1;
+				clock_port_sde(c, p);
+			}
+			if (EV_ANNOUNCE_RECEIPT_TIMEOUT_EXPIRES == event) {
+				clock_port_sde(c, p);
+			}
+			port_dispatch(p, event, 0);
+			/* Clear any fault after a little while. */
+			if (PS_FAULTY == port_state(p)) {
+				clock_fault_timeout(p, 1);
+				c->bmca[port_number(p)].dirty = 1;
+				faulty = p;
+				break;
+			}
+			/* A batch of messages stops at each event it raises. */
+			if (!port_rx_pending(p)) {
+				break;
 			}
+			event = port_event(p, i);
 		}
 	}
 
@@ -1536,9 +2077,23 @@ int clock_poll(struct clock *c)
 		c->sde = 0;
 	}
 	clock_prune_subscriptions(c);
+	if (c->status_export) {
+		clock_status_update(c);
+	}
+	wheel_arm(c->wheel);
 	return 0;
 }
 
+int clock_poll(struct clock *c)
+{
+	return clock_wait(c, -1);
+}
+
+int clock_service(struct clock *c)
+{
+	return clock_wait(c, 0);
+}
+
 void clock_path_delay(struct clock *c, tmv_t req, tmv_t rx)
 {
 	tsproc_up_ts(c->tsproc, req, rx);
@@ -1606,11 +2161,18 @@ int clock_switch_phc(struct clock *c, int phc_index)
 	servo_destroy(c->servo);
 	c->clkid = clkid;
 	c->servo = servo;
+	c->freq = fadj;
 	c->servo_state = SERVO_UNLOCKED;
+	if (c->holdover) {
+		/* The history belongs to the old clock. */
+		clock_holdover_stop(c);
+		holdover_reset(c->holdover);
+	}
 	return 0;
 }
 
-enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
+static enum servo_state clock_sync_sample(struct clock *c, tmv_t ingress,
+					  tmv_t origin)
 {
 	double adj, weight;
 	enum servo_state state = SERVO_UNLOCKED;
@@ -1656,6 +2218,7 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 	case SERVO_UNLOCKED:
 		break;
 	case SERVO_JUMP:
+		c->freq = -adj;
 		clockadj_set_freq(c->clkid, -adj);
 		clockadj_step(c->clkid, -tmv_to_nanoseconds(c->master_offset));
 		c->ingress_ts = tmv_zero();
@@ -1667,6 +2230,7 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		tsproc_reset(c->tsproc, 0);
 		break;
 	case SERVO_LOCKED:
+		c->freq = -adj;
 		clockadj_set_freq(c->clkid, -adj);
 		if (c->clkid == CLOCK_REALTIME) {
 			sysclk_set_sync();
@@ -1674,15 +2238,68 @@ enum servo_state clock_synchronize(struct clock *c, tmv_t ingress, tmv_t origin)
 		if (c->sanity_check) {
 			clockcheck_set_freq(c->sanity_check, -adj);
 		}
+		if (c->holdover) {
+			holdover_sample(c->holdover, clock_monotonic_ns(), -adj);
+		}
 		break;
 	}
 	return state;
 }
 
+void clock_trace(struct clock *c, struct trace_record *rec)
+{
+	if (!c->trace)
+		return;
+
+	rec->offset = tmv_to_nanoseconds(c->master_offset);
+	rec->freq = c->freq;
+	rec->log_interval = c->log_sync_interval;
+	rec->timestamping = c->timestamping;
+	trace_add(c->trace, rec);
+}
+
+static void clock_trace_sync(struct clock *c, tmv_t ingress, tmv_t origin,
+			     tmv_t correction, enum servo_state state)
+{
+	struct trace_record rec;
+
+	if (!c->trace)
+		return;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_SYNC;
+	rec.t1 = tmv_to_nanoseconds(origin);
+	rec.t2 = tmv_to_nanoseconds(ingress);
+	rec.correction = tmv_to_nanoseconds(correction);
+	rec.state = state;
+	if (c->best)
+		rec.port = port_number(c->best->port);
+	clock_trace(c, &rec);
+}
+
+enum servo_state clock_synchronize(struct clock *c, tmv_t ingress,
+				   tmv_t origin, tmv_t correction)
+{
+	enum servo_state state;
+
+	state = clock_sync_sample(c, ingress, tmv_add(origin, correction));
+	/*
+	 * While the updates are suspended for a leap second, the state
+	 * of the previous sample is returned.  Only a step made by this
+	 * sample, which clears the ingress time, must be traced.
+	 */
+	clock_trace_sync(c, ingress, origin, correction,
+			 state == SERVO_JUMP && !tmv_is_zero(c->ingress_ts) ?
+			 SERVO_UNLOCKED : state);
+	return state;
+}
+
 void clock_sync_interval(struct clock *c, int n)
 {
 	int shift;
 
+	c->log_sync_interval = n;
+
 	shift = c->freq_est_interval - n;
 	if (shift < 0)
 		shift = 0;
@@ -1701,7 +2318,9 @@ void clock_sync_interval(struct clock *c, int n)
 	}
 	c->stats.max_count = (1 << shift);
 
-	servo_sync_interval(c->servo, n < 0 ? 1.0 / (1 << -n) : 1 << n);
+	/* The servo only sees one sample in each selection window. */
+	servo_sync_interval(c->servo, (n < 0 ? 1.0 / (1 << -n) : 1 << n) *
+			    tsproc_window(c->tsproc));
 }
 
 struct timePropertiesDS *clock_time_properties(struct clock *c)
@@ -1714,15 +2333,62 @@ void clock_update_time_properties(struct clock *c, struct timePropertiesDS tds)
 	c->tds = tds;
 }
 
+/*
+ * Brings the Erbest of a dirty port up to date.  Returns one if it
+ * differs from the one seen by the last state decision.
+ */
+static int clock_update_erbest(struct clock *c, struct port *p)
+{
+	struct clock_bmca *b = &c->bmca[port_number(p)];
+	struct foreign_clock *fc;
+
+	fc = port_compute_best(p);
+	if (fc == b->fc &&
+	    (!fc || !memcmp(&fc->dataset, &b->erbest, sizeof(b->erbest)))) {
+		return 0;
+	}
+	b->fc = fc;
+	if (fc) {
+		b->erbest = fc->dataset;
+	}
+	return 1;
+}
+
 static void handle_state_decision_event(struct clock *c)
 {
 	struct foreign_clock *best = NULL, *fc;
 	struct ClockIdentity best_id;
+	struct clock_bmca *b;
+	struct dataset *dds;
 	struct port *piter;
-	int fresh_best = 0;
+	int changed, fresh_best = 0, slave = 0;
+
+	/*
+	 * Only the ports whose inputs have changed since the last
+	 * decision are looked at again, unless the local clock itself
+	 * or Ebest has changed, since that affects every port.
+	 */
+	dds = clock_default_ds(c);
+	changed = c->sde_all || memcmp(dds, &c->bmca_dds, sizeof(*dds));
+	c->bmca_dds = *dds;
+
+	LIST_FOREACH(piter, &c->ports, list) {
+		b = &c->bmca[port_number(piter)];
+		if (c->sde_all || b->state != port_state(piter))
+			b->dirty = 1;
+		if (b->dirty && clock_update_erbest(c, piter))
+			changed = 1;
+	}
+	c->sde_all = 0;
+
+	if (!changed) {
+		best = c->best;
+		best_id = c->best_id;
+		goto decide;
+	}
 
 	LIST_FOREACH(piter, &c->ports, list) {
-		fc = port_compute_best(piter);
+		fc = port_erbest(piter);
 		if (!fc)
 			continue;
 		if (!best || c->dscmp(&fc->dataset, &best->dataset) > 0)
@@ -1756,10 +2422,13 @@ static void handle_state_decision_event(struct clock *c)
 
 	c->best = best;
 	c->best_id = best_id;
-
+decide:
 	LIST_FOREACH(piter, &c->ports, list) {
 		enum port_state ps;
 		enum fsm_event event;
+		b = &c->bmca[port_number(piter)];
+		if (!changed && !b->dirty)
+			continue;
 		ps = bmc_state_decision(c, piter, c->dscmp);
 		switch (ps) {
 		case PS_LISTENING:
@@ -1784,7 +2453,25 @@ static void handle_state_decision_event(struct clock *c)
 			event = EV_FAULT_DETECTED;
 			break;
 		}
-		port_dispatch(piter, event, fresh_best);
+		/* A port whose recommended state stands needs no event. */
+		if (b->dirty || fresh_best || (int) ps != b->rs)
+			port_dispatch(piter, event, fresh_best);
+		b->rs = ps;
+		b->state = port_state(piter);
+		b->dirty = 0;
+	}
+
+	LIST_FOREACH(piter, &c->ports, list) {
+		if (c->bmca[port_number(piter)].rs == PS_SLAVE)
+			slave = 1;
+	}
+
+	/* Keep predicting the frequency while there is no master. */
+	if (c->holdover) {
+		if (slave)
+			clock_holdover_stop(c);
+		else
+			clock_holdover_start(c);
 	}
 }
 
@@ -27,9 +27,11 @@
 #include "servo.h"
 #include "tlv.h"
 #include "tmv.h"
+#include "trace.h"
 #include "transport.h"
 
 struct ptp_message; /*forward declaration*/
+struct wheel_timer; /*forward declaration*/
 
 /** Opaque type. */
 struct clock;
@@ -95,14 +97,16 @@ int (*clock_dscmp(struct clock *c))(struct dataset *a, struct dataset *b);
 int clock_required_modes(struct clock *c);
 
 /**
- * Create a clock instance. There can only be one clock in any system,
- * so subsequent calls will destroy the previous clock instance.
+ * Create a clock instance. Several clocks may run side by side, one
+ * for each PTP domain, provided that each one has its own configuration
+ * with a distinct domainNumber and uds_address.
  *
  * @param type         Specifies which type of clock to create.
  * @param config       Pointer to the configuration database.
  * @param phc_device   PTP hardware clock device to use. Pass NULL for automatic
  *                     selection based on the network interface.
- * @return             A pointer to the single global clock instance.
+ * @return             A pointer to a new clock instance on success,
+ *                     NULL otherwise.
  */
 struct clock *clock_create(enum clock_type type, struct config *config,
 			   const char *phc_device);
@@ -165,10 +169,34 @@ struct ClockIdentity clock_identity(struct clock *c);
 
 /**
  * Informs clock that a file descriptor of one of its ports changed. The
- * clock will rebuild its array of file descriptors to poll.
+ * clock will update the registration of that port's descriptors with
+ * its event loop.
  * @param c    The clock instance.
+ * @param p    The port whose descriptors changed.
  */
-void clock_fda_changed(struct clock *c);
+void clock_fda_changed(struct clock *c, struct port *p);
+
+/**
+ * Informs clock that a port is about to close its file descriptors. The
+ * clock removes them from its event loop while they are still open, so
+ * that a number reused by a new descriptor is never taken for an old
+ * one. Call @ref clock_fda_changed() once the port has new descriptors.
+ * @param c    The clock instance.
+ * @param p    The port whose descriptors will be closed.
+ */
+void clock_fda_closing(struct clock *c, struct port *p);
+
+/**
+ * Prepare one of the timers of a port to run on the timer wheel of the
+ * clock.  When the timer expires, the clock passes 'index' to
+ * port_event(), just as it does for the descriptors of the port.
+ * @param c      The clock instance.
+ * @param p      The port owning the timer.
+ * @param t      The timer to prepare.
+ * @param index  The event index of the timer, one of the FD_*_TIMER values.
+ */
+void clock_timer_init(struct clock *c, struct port *p, struct wheel_timer *t,
+		      int index);
 
 /**
  * Obtains the time of the latest synchronization.
@@ -247,6 +275,14 @@ void clock_peer_delay(struct clock *c, tmv_t ppd, tmv_t req, tmv_t rx,
  */
 void clock_set_sde(struct clock *c, int sde);
 
+/**
+ * Obtain a descriptor that becomes readable whenever the clock has
+ * events to dispatch, for running several clocks in one event loop.
+ * @param c A pointer to a clock instance obtained with clock_create().
+ * @return  The clock's epoll descriptor.
+ */
+int clock_fd(struct clock *c);
+
 /**
  * Poll for events and dispatch them.
  * @param c A pointer to a clock instance obtained with clock_create().
@@ -254,6 +290,13 @@ void clock_set_sde(struct clock *c, int sde);
  */
 int clock_poll(struct clock *c);
 
+/**
+ * Dispatch the events that are pending, without waiting for new ones.
+ * @param c A pointer to a clock instance obtained with clock_create().
+ * @return  Zero on success, non-zero otherwise.
+ */
+int clock_service(struct clock *c);
+
 /**
  * Obtain the slave-only flag from a clock's default data set.
  * @param c  The clock instance.
@@ -280,15 +323,22 @@ int clock_switch_phc(struct clock *c, int phc_index);
  * Provide a data point to synchronize the clock.
  * @param c            The clock instance to synchronize.
  * @param ingress      The ingress time stamp on the sync message.
- * @param origin       The reported transmission time of the sync message,
-                       including any corrections.
- * @param correction1  The correction field of the sync message.
- * @param correction2  The correction field of the follow up message.
- *                     Pass zero in the case of one step operation.
+ * @param origin       The reported transmission time of the sync message.
+ * @param correction   The sum of the correction fields of the sync and
+ *                     the follow up messages.
  * @return             The state of the clock's servo.
  */
 enum servo_state clock_synchronize(struct clock *c, tmv_t ingress,
-				   tmv_t origin);
+				   tmv_t origin, tmv_t correction);
+
+/**
+ * Append a record to the time stamp trace of the clock, if enabled.
+ * @param c    The clock instance.
+ * @param rec  The record, with the type, time stamps, correction and
+ *             port filled in.  The clock adds the offset and frequency
+ *             of its servo, the sync interval and the time stamping.
+ */
+void clock_trace(struct clock *c, struct trace_record *rec);
 
 /**
  * Inform a slaved clock about the master's sync interval.
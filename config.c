@@ -29,11 +29,14 @@
 #include "ether.h"
 #include "hash.h"
 #include "print.h"
+#include "sk.h"
 #include "util.h"
 
 enum config_section {
 	GLOBAL_SECTION,
 	PORT_SECTION,
+	DOMAIN_SECTION,
+	UC_MTAB_SECTION,
 	UNKNOWN_SECTION,
 };
 
@@ -133,6 +136,7 @@ static struct config_enum clock_servo_enu[] = {
 	{ "linreg", CLOCK_SERVO_LINREG },
 	{ "ntpshm", CLOCK_SERVO_NTPSHM },
 	{ "nullf",  CLOCK_SERVO_NULLF  },
+	{ "kalman", CLOCK_SERVO_KALMAN },
 	{ NULL, 0 },
 };
 
@@ -151,8 +155,10 @@ static struct config_enum dataset_comp_enu[] = {
 };
 
 static struct config_enum delay_filter_enu[] = {
-	{ "moving_average", FILTER_MOVING_AVERAGE },
-	{ "moving_median",  FILTER_MOVING_MEDIAN  },
+	{ "moving_average",    FILTER_MOVING_AVERAGE    },
+	{ "moving_median",     FILTER_MOVING_MEDIAN     },
+	{ "heap_median",       FILTER_HEAP_MEDIAN       },
+	{ "moving_percentile", FILTER_MOVING_PERCENTILE },
 	{ NULL, 0 },
 };
 
@@ -184,6 +190,7 @@ static struct config_enum tsproc_enu[] = {
 	{ "raw",           TSPROC_RAW           },
 	{ "filter_weight", TSPROC_FILTER_WEIGHT },
 	{ "raw_weight",    TSPROC_RAW_WEIGHT    },
+	{ "select",        TSPROC_SELECT        },
 	{ NULL, 0 },
 };
 
@@ -200,6 +207,7 @@ struct config_item config_tab[] = {
 	PORT_ITEM_INT("delayAsymmetry", 0, INT_MIN, INT_MAX),
 	PORT_ITEM_ENU("delay_filter", FILTER_MOVING_MEDIAN, delay_filter_enu),
 	PORT_ITEM_INT("delay_filter_length", 10, 1, INT_MAX),
+	PORT_ITEM_INT("delay_filter_percentile", 50, 0, 100),
 	PORT_ITEM_ENU("delay_mechanism", DM_E2E, delay_mech_enu),
 	GLOB_ITEM_INT("dscp_event", 0, 0, 63),
 	GLOB_ITEM_INT("dscp_general", 0, 0, 63),
@@ -214,10 +222,18 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_INT("G.8275.defaultDS.localPriority", 128, 1, UINT8_MAX),
 	PORT_ITEM_INT("G.8275.portDS.localPriority", 128, 1, UINT8_MAX),
 	GLOB_ITEM_INT("gmCapable", 1, 0, 1),
+	GLOB_ITEM_INT("holdover_class_in_spec", 0, 0, UINT8_MAX),
+	GLOB_ITEM_INT("holdover_class_out_of_spec", 0, 0, UINT8_MAX),
+	GLOB_ITEM_INT("holdover_error_limit", 1000, 1, INT_MAX),
+	GLOB_ITEM_INT("holdover_history", 0, 0, 86400),
 	PORT_ITEM_INT("hybrid_e2e", 0, 0, 1),
 	PORT_ITEM_INT("ignore_transport_specific", 0, 0, 1),
 	PORT_ITEM_INT("ingressLatency", 0, INT_MIN, INT_MAX),
 	GLOB_ITEM_INT("initial_delay", 0, 0, INT_MAX),
+	GLOB_ITEM_DBL("kalman_drift_noise", 0.0, 0.0, DBL_MAX),
+	GLOB_ITEM_DBL("kalman_frequency_noise", 1.0, 0.0, DBL_MAX),
+	GLOB_ITEM_DBL("kalman_measurement_noise", 0.0, 0.0, DBL_MAX),
+	GLOB_ITEM_DBL("kalman_phase_noise", 1.0, 0.0, DBL_MAX),
 	GLOB_ITEM_INT("kernel_leap", 1, 0, 1),
 	PORT_ITEM_INT("logAnnounceInterval", 1, INT8_MIN, INT8_MAX),
 	PORT_ITEM_INT("logMinDelayReqInterval", 0, INT8_MIN, INT8_MAX),
@@ -229,12 +245,15 @@ struct config_item config_tab[] = {
 	GLOB_ITEM_STR("manufacturerIdentity", "00:00:00"),
 	GLOB_ITEM_INT("max_frequency", 900000000, 0, INT_MAX),
 	PORT_ITEM_INT("min_neighbor_prop_delay", -20000000, INT_MIN, -1),
+	GLOB_ITEM_INT("msg_pool_hugepages", 0, 0, 1),
+	GLOB_ITEM_INT("msg_pool_size", 0, 0, INT_MAX),
 	PORT_ITEM_INT("neighborPropDelayThresh", 20000000, 0, INT_MAX),
 	PORT_ITEM_INT("net_sync_monitor", 0, 0, 1),
 	PORT_ITEM_ENU("network_transport", TRANS_UDP_IPV4, nw_trans_enu),
 	GLOB_ITEM_INT("ntpshm_segment", 0, INT_MIN, INT_MAX),
 	GLOB_ITEM_INT("offsetScaledLogVariance", 0xffff, 0, UINT16_MAX),
 	PORT_ITEM_INT("path_trace_enabled", 0, 0, 1),
+	GLOB_ITEM_INT("pi_adaptive", 0, 0, 1),
 	GLOB_ITEM_DBL("pi_integral_const", 0.0, 0.0, DBL_MAX),
 	GLOB_ITEM_DBL("pi_integral_exponent", 0.4, -DBL_MAX, DBL_MAX),
 	GLOB_ITEM_DBL("pi_integral_norm_max", 0.3, DBL_MIN, 2.0),
@@ -249,19 +268,32 @@ struct config_item config_tab[] = {
 	PORT_ITEM_STR("ptp_dst_mac", "01:1B:19:00:00:00"),
 	PORT_ITEM_STR("p2p_dst_mac", "01:80:C2:00:00:0E"),
 	GLOB_ITEM_STR("revisionData", ";;"),
+	PORT_ITEM_INT("rx_batch_size", 1, 1, SK_RX_BATCH_MAX),
+	PORT_ITEM_INT("rx_thread", 0, 0, 1),
+	PORT_ITEM_INT("rx_thread_cpu", -1, -1, INT_MAX),
 	GLOB_ITEM_INT("sanity_freq_limit", 200000000, 0, INT_MAX),
 	GLOB_ITEM_INT("slaveOnly", 0, 0, 1),
+	GLOB_ITEM_STR("status_file", ""),
 	GLOB_ITEM_DBL("step_threshold", 0.0, 0.0, DBL_MAX),
 	GLOB_ITEM_INT("summary_interval", 0, INT_MIN, INT_MAX),
 	PORT_ITEM_INT("syncReceiptTimeout", 0, 0, UINT8_MAX),
 	GLOB_ITEM_INT("tc_spanning_tree", 0, 1, 1),
 	GLOB_ITEM_INT("timeSource", INTERNAL_OSCILLATOR, 0x10, 0xfe),
+	GLOB_ITEM_STR("trace_file", ""),
+	GLOB_ITEM_INT("trace_records", 65536, 1, INT_MAX),
 	GLOB_ITEM_ENU("time_stamping", TS_HARDWARE, timestamping_enu),
 	PORT_ITEM_INT("transportSpecific", 0, 0, 0x0F),
 	PORT_ITEM_ENU("tsproc_mode", TSPROC_FILTER, tsproc_enu),
+	GLOB_ITEM_INT("tsproc_select_percentile", 0, 0, 100),
+	GLOB_ITEM_INT("tsproc_select_window", 16, 1, INT_MAX),
 	GLOB_ITEM_INT("twoStepFlag", 1, 0, 1),
+	GLOB_ITEM_INT("tx_timestamp_async", 0, 0, 1),
 	GLOB_ITEM_INT("tx_timestamp_timeout", 1, 1, INT_MAX),
 	PORT_ITEM_INT("udp_ttl", 1, 1, 255),
+	PORT_ITEM_INT("unicast_listen", 0, 0, 1),
+	PORT_ITEM_INT("unicast_max_clients", 1000, 1, INT_MAX),
+	PORT_ITEM_INT("unicast_master_table", 0, 0, INT_MAX),
+	PORT_ITEM_INT("unicast_req_duration", 3600, 10, INT_MAX),
 	PORT_ITEM_INT("udp6_scope", 0x0E, 0x00, 0x0F),
 	GLOB_ITEM_STR("uds_address", "/var/run/ptp4l"),
 	GLOB_ITEM_INT("use_syslog", 1, 0, 1),
@@ -274,9 +306,9 @@ static enum parser_result
 parse_fault_interval(struct config *cfg, const char *section,
 		     const char *option, const char *value);
 
-static struct config_item *config_section_item(struct config *cfg,
-					       const char *section,
-					       const char *name)
+static struct config_item *config_local_item(struct config *cfg,
+					     const char *section,
+					     const char *name)
 {
 	char buf[CONFIG_LABEL_SIZE + MAX_IFNAME_SIZE];
 
@@ -284,6 +316,25 @@ static struct config_item *config_section_item(struct config *cfg,
 	return hash_lookup(cfg->htab, buf);
 }
 
+/*
+ * A domain configuration only holds the items set in its own section
+ * and falls back to the configuration it was read from.
+ */
+static struct config_item *config_section_item(struct config *cfg,
+					       const char *section,
+					       const char *name)
+{
+	struct config_item *ci;
+
+	for (; cfg; cfg = cfg->parent) {
+		ci = config_local_item(cfg, section, name);
+		if (ci) {
+			return ci;
+		}
+	}
+	return NULL;
+}
+
 static struct config_item *config_global_item(struct config *cfg,
 					      const char *name)
 {
@@ -330,6 +381,39 @@ static struct config_item *config_item_alloc(struct config *cfg,
 	return ci;
 }
 
+/* Returns the global item of this very configuration, for updating. */
+static struct config_item *config_own_item(struct config *cfg,
+					   const char *name)
+{
+	char buf[CONFIG_LABEL_SIZE + 8];
+	struct config_item *ci, *cgi;
+
+	ci = config_local_item(cfg, "global", name);
+	if (ci || !cfg->parent) {
+		return ci;
+	}
+	cgi = config_global_item(cfg->parent, name);
+	if (!cgi) {
+		return NULL;
+	}
+	ci = malloc(sizeof(*ci));
+	if (!ci) {
+		fprintf(stderr, "low memory\n");
+		return NULL;
+	}
+	/* The caller replaces the value, so a string need not be copied. */
+	*ci = *cgi;
+	ci->flags &= ~(CFG_ITEM_STATIC | CFG_ITEM_LOCKED | CFG_ITEM_DYNSTR);
+
+	snprintf(buf, sizeof(buf), "global.%s", ci->label);
+	if (hash_insert(cfg->htab, buf, ci)) {
+		fprintf(stderr, "low memory or duplicate item %s\n", name);
+		free(ci);
+		return NULL;
+	}
+	return ci;
+}
+
 static void config_item_free(void *ptr)
 {
 	struct config_item *ci = ptr;
@@ -344,6 +428,10 @@ static enum parser_result parse_section_line(char *s, enum config_section *secti
 {
 	if (!strcasecmp(s, "[global]")) {
 		*section = GLOBAL_SECTION;
+	} else if (!strncasecmp(s, "[domain ", 8)) {
+		*section = DOMAIN_SECTION;
+	} else if (!strcasecmp(s, "[unicast_master_table]")) {
+		*section = UC_MTAB_SECTION;
 	} else if (s[0] == '[') {
 		char c;
 		*section = PORT_SECTION;
@@ -411,7 +499,7 @@ static enum parser_result parse_item(struct config *cfg,
 			return NOT_PARSED;
 		}
 		/* Create or update this port specific item. */
-		dst = config_section_item(cfg, section, option);
+		dst = config_local_item(cfg, section, option);
 		if (!dst) {
 			dst = config_item_alloc(cfg, section, option, cgi->type);
 			if (!dst) {
@@ -423,7 +511,10 @@ static enum parser_result parse_item(struct config *cfg,
 		return PARSED_OK;
 	} else {
 		/* Update the global default value. */
-		dst = cgi;
+		dst = config_own_item(cfg, option);
+		if (!dst) {
+			return NOT_PARSED;
+		}
 	}
 
 	switch (dst->type) {
@@ -544,15 +635,147 @@ static struct option *config_alloc_longopts(struct config *cfg)
 	return opts;
 }
 
+static struct config *config_create_domain(struct config *cfg, int domain)
+{
+	struct config_item *ci;
+	struct config *dom;
+
+	ci = config_global_item(cfg, "domainNumber");
+	if (domain < ci->min.i || domain > ci->max.i) {
+		fprintf(stderr, "domain %d is out of range\n", domain);
+		return NULL;
+	}
+
+	/* only create each domain once (by number) */
+	STAILQ_FOREACH(dom, &cfg->domains, list) {
+		if (config_get_int(dom, NULL, "domainNumber") == domain)
+			return dom;
+	}
+
+	dom = calloc(1, sizeof(*dom));
+	if (!dom) {
+		fprintf(stderr, "cannot allocate memory for a domain\n");
+		return NULL;
+	}
+	STAILQ_INIT(&dom->interfaces);
+	STAILQ_INIT(&dom->domains);
+	STAILQ_INIT(&dom->unicast_master_tables);
+	dom->parent = cfg;
+	dom->opts = cfg->opts;
+
+	dom->htab = hash_create();
+	if (!dom->htab) {
+		free(dom);
+		return NULL;
+	}
+	ci = config_own_item(dom, "domainNumber");
+	if (!ci) {
+		hash_destroy(dom->htab, NULL);
+		free(dom);
+		return NULL;
+	}
+	/* The section header decides the domain, not the command line. */
+	ci->val.i = domain;
+	ci->flags |= CFG_ITEM_LOCKED;
+
+	STAILQ_INSERT_TAIL(&cfg->domains, dom, list);
+	cfg->n_domains++;
+
+	return dom;
+}
+
+static struct unicast_master_table *config_create_unicast_table(struct config *cfg)
+{
+	struct unicast_master_table *table;
+
+	table = calloc(1, sizeof(*table));
+	if (!table) {
+		fprintf(stderr, "cannot allocate memory for a unicast master table\n");
+		return NULL;
+	}
+	STAILQ_INIT(&table->addrs);
+	STAILQ_INSERT_TAIL(&cfg->unicast_master_tables, table, list);
+	return table;
+}
+
+static enum parser_result parse_unicast_mtab_line(struct unicast_master_table *table,
+						  const char *option,
+						  const char *value)
+{
+	struct unicast_master_address *address;
+	enum parser_result r;
+	int val;
+
+	if (!strcmp(option, "table_id")) {
+		r = get_ranged_int(value, &val, 1, INT_MAX);
+		if (r == PARSED_OK) {
+			table->table_id = val;
+		}
+		return r;
+	}
+	if (!strcmp(option, "logQueryInterval")) {
+		r = get_ranged_int(value, &val, -7, 12);
+		if (r == PARSED_OK) {
+			table->logQueryInterval = val;
+		}
+		return r;
+	}
+
+	address = calloc(1, sizeof(*address));
+	if (!address) {
+		fprintf(stderr, "cannot allocate memory for a unicast master\n");
+		return BAD_VALUE;
+	}
+	if (!strcasecmp(option, "UDPv4")) {
+		address->type = TRANS_UDP_IPV4;
+	} else if (!strcasecmp(option, "UDPv6")) {
+		address->type = TRANS_UDP_IPV6;
+	} else if (!strcasecmp(option, "L2")) {
+		address->type = TRANS_IEEE_802_3;
+	} else {
+		free(address);
+		return NOT_PARSED;
+	}
+	if (str2addr(address->type, value, &address->address)) {
+		free(address);
+		return BAD_VALUE;
+	}
+	STAILQ_INSERT_TAIL(&table->addrs, address, list);
+	table->count++;
+	return PARSED_OK;
+}
+
+static int check_unicast_tables(struct config *cfg)
+{
+	struct unicast_master_table *table, *t;
+
+	STAILQ_FOREACH(table, &cfg->unicast_master_tables, list) {
+		if (!table->table_id) {
+			fprintf(stderr, "unicast master table without table_id\n");
+			return -1;
+		}
+		for (t = STAILQ_NEXT(table, list); t; t = STAILQ_NEXT(t, list)) {
+			if (t->table_id == table->table_id) {
+				fprintf(stderr, "duplicate unicast master table %d\n",
+					table->table_id);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
 int config_read(char *name, struct config *cfg)
 {
 	enum config_section current_section = UNKNOWN_SECTION;
 	enum parser_result parser_res;
 	FILE *fp;
-	char buf[1024], *line, *c;
-	const char *option, *value;
+	char buf[1024], domain_name[16], *line, *c;
+	const char *option, *value, *section_name = NULL;
+	struct config *current_cfg = cfg, *dom;
+	struct unicast_master_table *current_table = NULL;
 	struct interface *current_port = NULL;
-	int line_num;
+	int domain, line_num;
 
 	fp = 0 == strncmp(name, "-", 2) ? stdin : fopen(name, "r");
 
@@ -590,6 +813,29 @@ int config_read(char *name, struct config *cfg)
 				current_port = config_create_interface(port, cfg);
 				if (!current_port)
 					goto parse_error;
+				section_name = current_port->name;
+				current_cfg = cfg;
+			} else if (current_section == DOMAIN_SECTION) {
+				if (1 != sscanf(line + 8, "%d", &domain)) {
+					fprintf(stderr, "could not parse domain number on line %d\n",
+							line_num);
+					goto parse_error;
+				}
+				current_cfg = config_create_domain(cfg, domain);
+				if (!current_cfg)
+					goto parse_error;
+				snprintf(domain_name, sizeof(domain_name),
+					 "domain %d", domain);
+				section_name = domain_name;
+			} else if (current_section == UC_MTAB_SECTION) {
+				current_table = config_create_unicast_table(cfg);
+				if (!current_table)
+					goto parse_error;
+				section_name = "unicast_master_table";
+				current_cfg = cfg;
+			} else {
+				section_name = "global";
+				current_cfg = cfg;
 			}
 			continue;
 		}
@@ -601,24 +847,28 @@ int config_read(char *name, struct config *cfg)
 
 		if (parse_setting_line(line, &option, &value)) {
 			fprintf(stderr, "could not parse line %d in %s section\n",
-				line_num, current_section == GLOBAL_SECTION ?
-				"global" : current_port->name);
+				line_num, section_name);
 			goto parse_error;
 		}
 
 		check_deprecated_options(&option);
 
-		parser_res = parse_item(cfg, 0, current_section == GLOBAL_SECTION ?
-					NULL : current_port->name, option, value);
+		if (current_section == UC_MTAB_SECTION) {
+			parser_res = parse_unicast_mtab_line(current_table,
+							     option, value);
+		} else {
+			parser_res = parse_item(current_cfg, 0,
+						current_section == PORT_SECTION ?
+						current_port->name : NULL,
+						option, value);
+		}
 
 		switch (parser_res) {
 		case PARSED_OK:
 			break;
 		case NOT_PARSED:
 			fprintf(stderr, "unknown option %s at line %d in %s section\n",
-				option, line_num,
-				current_section == GLOBAL_SECTION ? "global" :
-				current_port->name);
+				option, line_num, section_name);
 			goto parse_error;
 		case BAD_VALUE:
 			fprintf(stderr, "%s is a bad value for option %s at line %d\n",
@@ -635,6 +885,15 @@ int config_read(char *name, struct config *cfg)
 		}
 	}
 
+	/* The domains run on all of the interfaces. */
+	STAILQ_FOREACH(dom, &cfg->domains, list) {
+		dom->interfaces = cfg->interfaces;
+		dom->n_interfaces = cfg->n_interfaces;
+	}
+
+	if (check_unicast_tables(cfg))
+		goto parse_error;
+
 	fclose(fp);
 	return 0;
 
@@ -679,6 +938,8 @@ struct config *config_create(void)
 		return NULL;
 	}
 	STAILQ_INIT(&cfg->interfaces);
+	STAILQ_INIT(&cfg->domains);
+	STAILQ_INIT(&cfg->unicast_master_tables);
 
 	cfg->opts = config_alloc_longopts(cfg);
 	if (!cfg->opts) {
@@ -724,8 +985,25 @@ fail:
 
 void config_destroy(struct config *cfg)
 {
+	struct unicast_master_address *address;
+	struct unicast_master_table *table;
 	struct interface *iface;
+	struct config *dom;
+
+	while ((table = STAILQ_FIRST(&cfg->unicast_master_tables))) {
+		while ((address = STAILQ_FIRST(&table->addrs))) {
+			STAILQ_REMOVE_HEAD(&table->addrs, list);
+			free(address);
+		}
+		STAILQ_REMOVE_HEAD(&cfg->unicast_master_tables, list);
+		free(table);
+	}
 
+	while ((dom = STAILQ_FIRST(&cfg->domains))) {
+		STAILQ_REMOVE_HEAD(&cfg->domains, list);
+		hash_destroy(dom->htab, config_item_free);
+		free(dom);
+	}
 	while ((iface = STAILQ_FIRST(&cfg->interfaces))) {
 		STAILQ_REMOVE_HEAD(&cfg->interfaces, list);
 		free(iface);
@@ -735,6 +1013,23 @@ void config_destroy(struct config *cfg)
 	free(cfg);
 }
 
+struct unicast_master_table *config_unicast_master_table(struct config *cfg,
+							 int table_id)
+{
+	struct unicast_master_table *table;
+
+	/* The tables are only read into the top level configuration. */
+	while (cfg->parent) {
+		cfg = cfg->parent;
+	}
+	STAILQ_FOREACH(table, &cfg->unicast_master_tables, list) {
+		if (table->table_id == table_id) {
+			return table;
+		}
+	}
+	return NULL;
+}
+
 double config_get_double(struct config *cfg, const char *section,
 			 const char *option)
 {
@@ -849,7 +1144,7 @@ int config_parse_option(struct config *cfg, const char *opt, const char *val)
 
 int config_set_double(struct config *cfg, const char *option, double val)
 {
-	struct config_item *ci = config_find_item(cfg, NULL, option);
+	struct config_item *ci = config_own_item(cfg, option);
 
 	if (!ci || ci->type != CFG_TYPE_DOUBLE) {
 		pr_err("bug: config option %s missing or invalid!", option);
@@ -881,13 +1176,17 @@ int config_set_section_int(struct config *cfg, const char *section,
 		break;
 	}
 	if (!section) {
+		cgi = config_own_item(cfg, option);
+		if (!cgi) {
+			return -1;
+		}
 		cgi->flags |= CFG_ITEM_LOCKED;
 		cgi->val.i = val;
 		pr_debug("locked item global.%s as %d", option, cgi->val.i);
 		return 0;
 	}
 	/* Create or update this port specific item. */
-	dst = config_section_item(cfg, section, option);
+	dst = config_local_item(cfg, section, option);
 	if (!dst) {
 		dst = config_item_alloc(cfg, section, option, cgi->type);
 		if (!dst) {
@@ -902,7 +1201,7 @@ int config_set_section_int(struct config *cfg, const char *section,
 int config_set_string(struct config *cfg, const char *option,
 		      const char *val)
 {
-	struct config_item *ci = config_find_item(cfg, NULL, option);
+	struct config_item *ci = config_own_item(cfg, option);
 
 	if (!ci || ci->type != CFG_TYPE_STRING) {
 		pr_err("bug: config option %s missing or invalid!", option);
@@ -44,6 +44,22 @@ struct interface {
 	struct sk_ts_info ts_info;
 };
 
+/** Defines a master in a unicast master table. */
+struct unicast_master_address {
+	STAILQ_ENTRY(unicast_master_address) list;
+	enum transport_type type;
+	struct address address;
+};
+
+/** Defines a table of unicast masters, from a [unicast_master_table] section. */
+struct unicast_master_table {
+	STAILQ_ENTRY(unicast_master_table) list;
+	STAILQ_HEAD(masters_head, unicast_master_address) addrs;
+	int count;
+	int table_id;
+	int logQueryInterval;
+};
+
 struct config {
 	/* configured interfaces */
 	STAILQ_HEAD(interfaces_head, interface) interfaces;
@@ -54,6 +70,17 @@ struct config {
 
 	/* hash of all non-legacy items */
 	struct hash *htab;
+
+	/* additional domains, each from a [domain N] section */
+	STAILQ_HEAD(domains_head, config) domains;
+	int n_domains;
+
+	/* for a domain, its list entry and the configuration it overrides */
+	STAILQ_ENTRY(config) list;
+	struct config *parent;
+
+	/* unicast master tables */
+	STAILQ_HEAD(ucmtab_head, unicast_master_table) unicast_master_tables;
 };
 
 int config_read(char *name, struct config *cfg);
@@ -96,4 +123,7 @@ static inline int config_set_int(struct config *cfg,
 int config_set_string(struct config *cfg, const char *option,
 		      const char *val);
 
+struct unicast_master_table *config_unicast_master_table(struct config *cfg,
+							 int table_id);
+
 #endif
@@ -34,12 +34,12 @@ void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		return;
 	}
 
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_RX_TIMER));
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_tmo(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_TX_TIMER));
 
 	/*
 	 * Handle the side effects of the state transition.
@@ -76,7 +76,7 @@ void e2e_dispatch(struct port *p, enum fsm_event event, int mdiff)
 
 enum fsm_event e2e_event(struct port *p, int fd_index)
 {
-	int cnt, fd = p->fda.fd[fd_index];
+	int cnt, fd = fd_index < N_POLLFD ? p->fda.fd[fd_index] : -1;
 	enum fsm_event event = EV_NONE;
 	struct ptp_message *msg, *dup;
 
@@ -116,6 +116,8 @@ enum fsm_event e2e_event(struct port *p, int fd_index)
 
 	case FD_MANNO_TIMER:
 	case FD_SYNC_TX_TIMER:
+	case FD_UNICAST_TIMER:
+	case FD_UNICAST_REQ_TIMER:
 		pr_err("unexpected timer expiration");
 		return EV_NONE;
 
@@ -158,7 +160,7 @@ enum fsm_event e2e_event(struct port *p, int fd_index)
 		msg_put(msg);
 		return EV_NONE;
 	}
-	if (tc_ignore(p, dup)) {
+	if (tc_ignore(p, dup) || msg_post_recv_body(dup)) {
 		msg_put(dup);
 		dup = NULL;
 	}
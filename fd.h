@@ -20,28 +20,39 @@
 #ifndef HAVE_FD_H
 #define HAVE_FD_H
 
-#define N_TIMER_FDS 6
+/*
+ * The descriptors of a port.  The timers of the port run on the timer
+ * wheel of its clock and are numbered after these, so that the clock
+ * can hand out a single event index to port_event().
+ */
+enum {
+	FD_EVENT,
+	FD_GENERAL,
+	FD_RTNL,
+	N_POLLFD,
+};
 
 /*
  * The order matters here.  The DELAY timer must appear before the
  * ANNOUNCE and SYNC_RX timers in order to correctly handle the case
  * when the DELAY timer and one of the other two expire during the
- * same call to poll().
+ * same call to poll().  The FAULT timer is handled by the clock.
  */
 enum {
-	FD_EVENT,
-	FD_GENERAL,
-	FD_DELAY_TIMER,
+	FD_DELAY_TIMER = N_POLLFD,
 	FD_ANNOUNCE_TIMER,
 	FD_SYNC_RX_TIMER,
 	FD_QUALIFICATION_TIMER,
 	FD_MANNO_TIMER,
 	FD_SYNC_TX_TIMER,
-	FD_RTNL,
-	N_POLLFD,
+	FD_UNICAST_TIMER,
+	FD_UNICAST_REQ_TIMER,
+	FD_FAULT_TIMER,
+	N_PORT_EVENTS,
 };
 
 #define FD_FIRST_TIMER FD_DELAY_TIMER
+#define N_PORT_TIMERS (N_PORT_EVENTS - FD_FIRST_TIMER)
 
 struct fdarray {
 	int fd[N_POLLFD];
@@ -20,14 +20,20 @@
 #include "filter_private.h"
 #include "mave.h"
 #include "mmedian.h"
+#include "mquantile.h"
 
-struct filter *filter_create(enum filter_type type, int length)
+struct filter *filter_create(enum filter_type type, int length,
+			     int percentile)
 {
 	switch (type) {
 	case FILTER_MOVING_AVERAGE:
 		return mave_create(length);
 	case FILTER_MOVING_MEDIAN:
 		return mmedian_create(length);
+	case FILTER_HEAP_MEDIAN:
+		return mquantile_create(length, -1);
+	case FILTER_MOVING_PERCENTILE:
+		return mquantile_create(length, percentile);
 	default:
 		return NULL;
 	}
@@ -31,15 +31,20 @@ struct filter;
 enum filter_type {
 	FILTER_MOVING_AVERAGE,
 	FILTER_MOVING_MEDIAN,
+	FILTER_HEAP_MEDIAN,
+	FILTER_MOVING_PERCENTILE,
 };
 
 /**
  * Create a new instance of a filter.
- * @param type    The type of the filter to create.
- * @param length  The filter's length.
+ * @param type        The type of the filter to create.
+ * @param length      The filter's length.
+ * @param percentile  The percentile output by FILTER_MOVING_PERCENTILE,
+ *                    from 0 to 100. Ignored by the other filters.
  * @return A pointer to a new filter on success, NULL otherwise.
  */
-struct filter *filter_create(enum filter_type type, int length);
+struct filter *filter_create(enum filter_type type, int length,
+			     int percentile);
 
 /**
  * Destroy an instance of a filter.
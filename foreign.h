@@ -26,6 +26,7 @@
 #include "port.h"
 
 #define FOREIGN_MASTER_THRESHOLD 2
+#define FOREIGN_HASH_SIZE 64
 
 struct foreign_clock {
 	/**
@@ -34,15 +35,27 @@ struct foreign_clock {
 	LIST_ENTRY(foreign_clock) list;
 
 	/**
-	 * A list of received announce messages.
-	 *
-	 * The data set field, foreignMasterPortIdentity, is the
-	 * sourcePortIdentity of the first message.
+	 * Pointer to next foreign_clock in the same hash bucket of the
+	 * port, which is indexed by foreignMasterPortIdentity.
 	 */
-	TAILQ_HEAD(messages, ptp_message) messages;
+	LIST_ENTRY(foreign_clock) hash;
 
 	/**
-	 * Number of elements in the message list,
+	 * The latest announce message received, or NULL if the
+	 * messages have been cleared.
+	 */
+	struct ptp_message *latest;
+
+	/**
+	 * A ring holding the time, in nanoseconds on CLOCK_MONOTONIC,
+	 * at which each of the counted announce messages leaves the
+	 * foreign master time window.  The oldest entry is at 'head'.
+	 */
+	int64_t expiry[FOREIGN_MASTER_THRESHOLD];
+	unsigned int head;
+
+	/**
+	 * Number of entries in the ring,
 	 * aka foreignMasterAnnounceMessages.
 	 */
 	unsigned int n_messages;
@@ -54,7 +67,8 @@ struct foreign_clock {
 
 	/**
 	 * Contains the information from the latest announce message
-	 * in a form suitable for comparision in the BMCA.
+	 * in a form suitable for comparision in the BMCA.  The data
+	 * set field, foreignMasterPortIdentity, is the sender.
 	 */
 	struct dataset dataset;
 };
@@ -0,0 +1,277 @@
+/**
+ * @file holdover.c
+ * @brief Predicts the frequency of a clock which has lost its master.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include "holdover.h"
+
+#define NS_PER_SEC 1000000000LL
+
+/* Minimum number of one second bins needed for a prediction */
+#define MIN_BINS 4
+/* The aging is only applied when it exceeds its standard error this much */
+#define AGING_SIGNIFICANCE 2.0
+/* Number of standard errors covered by the estimated time error */
+#define ERROR_SIGMAS 2.0
+
+/* Mean time and frequency of the samples in one second */
+struct bin {
+	double t;
+	double freq;
+};
+
+struct holdover {
+	/* Circular buffer of bins, one per second of history */
+	struct bin *bins;
+	int size;
+	int num_bins;
+	int last_bin;
+	/* Time of the first sample, the origin of the bin times */
+	uint64_t origin;
+	int have_origin;
+	/* The bin which is being filled */
+	uint64_t bin_start;
+	double bin_t;
+	double bin_freq;
+	int bin_samples;
+	/* The prediction made when the holdover started */
+	int active;
+	uint64_t start;
+	double freq;
+	double aging;
+	double offset;
+	double freq_err;
+	double aging_err;
+	double error_limit;
+};
+
+struct holdover *holdover_create(int history, int error_limit)
+{
+	struct holdover *h;
+
+	if (history < MIN_BINS)
+		return NULL;
+
+	h = calloc(1, sizeof(*h));
+	if (!h)
+		return NULL;
+
+	h->bins = calloc(history, sizeof(*h->bins));
+	if (!h->bins) {
+		free(h);
+		return NULL;
+	}
+	h->size = history;
+	h->error_limit = error_limit;
+	return h;
+}
+
+void holdover_destroy(struct holdover *h)
+{
+	free(h->bins);
+	free(h);
+}
+
+static double holdover_time(struct holdover *h, uint64_t ts)
+{
+	return (int64_t)(ts - h->origin) / 1e9;
+}
+
+static void holdover_close_bin(struct holdover *h)
+{
+	struct bin *b;
+
+	if (!h->bin_samples)
+		return;
+
+	h->last_bin = (h->last_bin + 1) % h->size;
+	if (h->num_bins < h->size)
+		h->num_bins++;
+
+	b = &h->bins[h->last_bin];
+	b->t = h->bin_t / h->bin_samples;
+	b->freq = h->bin_freq / h->bin_samples;
+
+	h->bin_samples = 0;
+}
+
+void holdover_sample(struct holdover *h, uint64_t ts, double freq)
+{
+	if (h->active)
+		return;
+
+	if (!h->have_origin) {
+		h->origin = ts;
+		h->have_origin = 1;
+	}
+
+	if (h->bin_samples && ts - h->bin_start >= NS_PER_SEC)
+		holdover_close_bin(h);
+
+	if (!h->bin_samples) {
+		h->bin_start = ts;
+		h->bin_t = 0.0;
+		h->bin_freq = 0.0;
+	}
+	h->bin_t += holdover_time(h, ts);
+	h->bin_freq += freq;
+	h->bin_samples++;
+}
+
+void holdover_reset(struct holdover *h)
+{
+	h->num_bins = 0;
+	h->last_bin = 0;
+	h->have_origin = 0;
+	h->bin_samples = 0;
+	h->active = 0;
+}
+
+/* Count the bins which are not older than the length of the history. */
+static int holdover_recent_bins(struct holdover *h, uint64_t ts)
+{
+	double oldest = holdover_time(h, ts) - h->size;
+	int i, n;
+
+	for (n = 0; n < h->num_bins; n++) {
+		i = (h->last_bin - n + h->size) % h->size;
+		if (h->bins[i].t < oldest)
+			break;
+	}
+	return n;
+}
+
+int holdover_start(struct holdover *h, uint64_t ts, double offset)
+{
+	double t, tm, fm, f, sxx, sxy, res, s2, now;
+	int i, j, n;
+
+	if (h->active)
+		return 0;
+
+	holdover_close_bin(h);
+
+	n = h->have_origin ? holdover_recent_bins(h, ts) : 0;
+	if (n < MIN_BINS)
+		return -1;
+
+	tm = fm = 0.0;
+	for (j = 0; j < n; j++) {
+		i = (h->last_bin - j + h->size) % h->size;
+		tm += h->bins[i].t;
+		fm += h->bins[i].freq;
+	}
+	tm /= n;
+	fm /= n;
+
+	sxx = sxy = 0.0;
+	for (j = 0; j < n; j++) {
+		i = (h->last_bin - j + h->size) % h->size;
+		t = h->bins[i].t - tm;
+		sxx += t * t;
+		sxy += t * (h->bins[i].freq - fm);
+	}
+
+	/*
+	 * Fit a line to the frequency, its slope being the aging of
+	 * the clock.  The standard errors of the fit give the expected
+	 * error of the prediction.
+	 */
+	h->aging = sxx > 0.0 ? sxy / sxx : 0.0;
+
+	s2 = 0.0;
+	for (j = 0; j < n; j++) {
+		i = (h->last_bin - j + h->size) % h->size;
+		res = h->bins[i].freq - fm - h->aging * (h->bins[i].t - tm);
+		s2 += res * res;
+	}
+	s2 /= n - 2;
+
+	now = holdover_time(h, ts);
+	h->aging_err = sxx > 0.0 ? sqrt(s2 / sxx) : 0.0;
+	h->freq_err = sqrt(s2 * (1.0 / n +
+				 (sxx > 0.0 ? (now - tm) * (now - tm) / sxx : 0.0)));
+
+	/*
+	 * An insignificant aging would only add noise to the prediction,
+	 * but it still limits the accuracy of the prediction.
+	 */
+	if (fabs(h->aging) < AGING_SIGNIFICANCE * h->aging_err) {
+		h->aging = 0.0;
+		h->aging_err *= AGING_SIGNIFICANCE;
+		h->freq_err = sqrt(s2 / n);
+	}
+
+	f = fm + h->aging * (now - tm);
+
+	h->freq = f;
+	h->offset = fabs(offset);
+	h->start = ts;
+	h->active = 1;
+	return 0;
+}
+
+void holdover_stop(struct holdover *h)
+{
+	h->active = 0;
+	h->bin_samples = 0;
+}
+
+enum holdover_state holdover_state(struct holdover *h, uint64_t ts)
+{
+	if (h->active) {
+		if (holdover_time_error(h, ts) > h->error_limit)
+			return HOLDOVER_OUT_OF_SPEC;
+		return HOLDOVER_IN_SPEC;
+	}
+	if (h->have_origin && holdover_recent_bins(h, ts) +
+	    (h->bin_samples ? 1 : 0) >= MIN_BINS)
+		return HOLDOVER_AVAILABLE;
+	return HOLDOVER_UNAVAILABLE;
+}
+
+double holdover_freq(struct holdover *h, uint64_t ts)
+{
+	return h->freq + h->aging * holdover_duration(h, ts);
+}
+
+double holdover_aging(struct holdover *h)
+{
+	return h->aging;
+}
+
+double holdover_time_error(struct holdover *h, uint64_t ts)
+{
+	double t = holdover_duration(h, ts);
+
+	if (!h->active)
+		return 0.0;
+
+	/* Integrate the errors of the frequency and the aging. */
+	return h->offset +
+		ERROR_SIGMAS * (h->freq_err * t + 0.5 * h->aging_err * t * t);
+}
+
+double holdover_duration(struct holdover *h, uint64_t ts)
+{
+	if (!h->active)
+		return 0.0;
+	return (int64_t)(ts - h->start) / 1e9;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file holdover.h
+ * @brief Predicts the frequency of a clock which has lost its master.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_HOLDOVER_H
+#define HAVE_HOLDOVER_H
+
+#include <stdint.h>
+
+/** Opaque type */
+struct holdover;
+
+/**
+ * Defines the states of the holdover engine.
+ */
+enum holdover_state {
+	/** Not enough history to predict the frequency. */
+	HOLDOVER_UNAVAILABLE,
+	/** The frequency can be predicted if the master is lost. */
+	HOLDOVER_AVAILABLE,
+	/** In holdover, estimated time error within the limit. */
+	HOLDOVER_IN_SPEC,
+	/** In holdover, estimated time error beyond the limit. */
+	HOLDOVER_OUT_OF_SPEC,
+};
+
+/**
+ * Create a new instance of the holdover engine.
+ * @param history     Length of the frequency history in seconds.
+ * @param error_limit Maximum estimated time error in nanoseconds for
+ *                    the holdover to be considered within specification.
+ * @return A pointer to a new holdover engine on success, NULL otherwise.
+ */
+struct holdover *holdover_create(int history, int error_limit);
+
+/**
+ * Destroy an instance of the holdover engine.
+ * @param h Pointer to a holdover engine obtained via @ref holdover_create().
+ */
+void holdover_destroy(struct holdover *h);
+
+/**
+ * Record the frequency applied to the clock by the locked servo.
+ * Samples are ignored while the holdover is active.
+ * @param h    Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts   Time of the sample on the system monotonic clock in nanoseconds.
+ * @param freq Frequency adjustment of the clock in ppb.
+ */
+void holdover_sample(struct holdover *h, uint64_t ts, double freq);
+
+/**
+ * Discard the frequency history, e.g. when a different clock is controlled.
+ * @param h Pointer to a holdover engine obtained via @ref holdover_create().
+ */
+void holdover_reset(struct holdover *h);
+
+/**
+ * Fit the frequency and the aging of the clock to the history and
+ * enter the holdover.
+ * @param h      Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts     Current time on the system monotonic clock in nanoseconds.
+ * @param offset Last measured offset from the master in nanoseconds.
+ * @return Zero on success, non-zero if there is not enough history.
+ */
+int holdover_start(struct holdover *h, uint64_t ts, double offset);
+
+/**
+ * Leave the holdover.
+ * @param h Pointer to a holdover engine obtained via @ref holdover_create().
+ */
+void holdover_stop(struct holdover *h);
+
+/**
+ * Obtain the current state of the holdover engine.
+ * @param h  Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts Current time on the system monotonic clock in nanoseconds.
+ * @return The state of the holdover.
+ */
+enum holdover_state holdover_state(struct holdover *h, uint64_t ts);
+
+/**
+ * Predict the frequency adjustment of the clock during the holdover.
+ * @param h  Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts Current time on the system monotonic clock in nanoseconds.
+ * @return The frequency adjustment in ppb.
+ */
+double holdover_freq(struct holdover *h, uint64_t ts);
+
+/**
+ * Obtain the rate of change of the predicted frequency.
+ * @param h Pointer to a holdover engine obtained via @ref holdover_create().
+ * @return The aging of the clock in ppb per second.
+ */
+double holdover_aging(struct holdover *h);
+
+/**
+ * Estimate the time error accumulated since the start of the holdover.
+ * @param h  Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts Current time on the system monotonic clock in nanoseconds.
+ * @return The estimated time error in nanoseconds, or zero when the
+ *         holdover is not active.
+ */
+double holdover_time_error(struct holdover *h, uint64_t ts);
+
+/**
+ * Obtain the time spent in the holdover.
+ * @param h  Pointer to a holdover engine obtained via @ref holdover_create().
+ * @param ts Current time on the system monotonic clock in nanoseconds.
+ * @return The duration of the holdover in seconds, or zero when the
+ *         holdover is not active.
+ */
+double holdover_duration(struct holdover *h, uint64_t ts);
+
+#endif
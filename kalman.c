@@ -0,0 +1,303 @@
+/**
+ * @file kalman.c
+ * @brief Implements a clock servo based on a Kalman filter.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "config.h"
+#include "kalman.h"
+#include "print.h"
+#include "servo_private.h"
+
+/* Default measurement noise in ns for hardware and software time stamps */
+#define HWTS_MEASUREMENT_NOISE 20.0
+#define SWTS_MEASUREMENT_NOISE 2000.0
+
+/* Standard deviations of the initial frequency and drift estimates */
+#define FREQ_INITIAL_DEV 100000.0
+#define DRIFT_INITIAL_DEV 1.0
+
+/* Number of update intervals over which the phase offset is corrected */
+#define CORR_INTERVALS 2.0
+
+enum {
+	PHASE,	/* offset from the master in ns */
+	FREQ,	/* frequency offset of the uncorrected clock in ppb */
+	DRIFT,	/* rate of change of the frequency offset in ppb/s */
+	N_STATES,
+};
+
+struct kalman_servo {
+	struct servo servo;
+	/* State estimate and its covariance */
+	double x[N_STATES];
+	double p[N_STATES][N_STATES];
+	/* Spectral densities of the process noise */
+	double q[N_STATES];
+	/* Variance of a measurement with weight 1 */
+	double r;
+	/* Local time stamp of the last sample */
+	uint64_t last_ts;
+	/* Number of samples since reset, up to 2 */
+	int count;
+	/* Current frequency offset of the clock */
+	double clock_freq;
+	/* Expected interval between updates */
+	double update_interval;
+	/* Current ratio between remote and local frequency */
+	double frequency_ratio;
+	/* Upcoming leap second */
+	int leap;
+};
+
+static void kalman_destroy(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	free(s);
+}
+
+static void kalman_init_state(struct kalman_servo *s, int64_t offset,
+			      double r)
+{
+	memset(s->x, 0, sizeof(s->x));
+	memset(s->p, 0, sizeof(s->p));
+
+	/* Assume the current frequency adjustment is correct. */
+	s->x[PHASE] = offset;
+	s->x[FREQ] = -s->clock_freq / (1.0 + s->clock_freq / 1e9);
+
+	s->p[PHASE][PHASE] = r;
+	s->p[FREQ][FREQ] = FREQ_INITIAL_DEV * FREQ_INITIAL_DEV;
+	if (s->q[DRIFT])
+		s->p[DRIFT][DRIFT] = DRIFT_INITIAL_DEV * DRIFT_INITIAL_DEV;
+}
+
+/*
+ * Advances the state by 'dt' seconds, during which the clock was running
+ * with the frequency adjustment s->clock_freq.
+ */
+static void kalman_predict(struct kalman_servo *s, double dt)
+{
+	double f[N_STATES][N_STATES], fp[N_STATES][N_STATES], g, dt2, dt3;
+	int i, j, k;
+
+	/* The adjustment scales the frequency of the uncorrected clock. */
+	g = 1.0 + s->clock_freq / 1e9;
+	dt2 = dt * dt;
+	dt3 = dt2 * dt;
+
+	memset(f, 0, sizeof(f));
+	f[PHASE][PHASE] = 1.0;
+	f[PHASE][FREQ] = g * dt;
+	f[PHASE][DRIFT] = g * dt2 / 2.0;
+	f[FREQ][FREQ] = 1.0;
+	f[FREQ][DRIFT] = dt;
+	f[DRIFT][DRIFT] = 1.0;
+
+	s->x[PHASE] += s->clock_freq * dt +
+		f[PHASE][FREQ] * s->x[FREQ] + f[PHASE][DRIFT] * s->x[DRIFT];
+	s->x[FREQ] += dt * s->x[DRIFT];
+
+	/* P = F * P * F' + Q */
+	for (i = 0; i < N_STATES; i++) {
+		for (j = 0; j < N_STATES; j++) {
+			fp[i][j] = 0.0;
+			for (k = 0; k < N_STATES; k++)
+				fp[i][j] += f[i][k] * s->p[k][j];
+		}
+	}
+	for (i = 0; i < N_STATES; i++) {
+		for (j = 0; j < N_STATES; j++) {
+			s->p[i][j] = 0.0;
+			for (k = 0; k < N_STATES; k++)
+				s->p[i][j] += fp[i][k] * f[j][k];
+		}
+	}
+
+	s->p[PHASE][PHASE] += s->q[PHASE] * dt + s->q[FREQ] * dt3 / 3.0 +
+		s->q[DRIFT] * dt3 * dt2 / 20.0;
+	s->p[PHASE][FREQ] += s->q[FREQ] * dt2 / 2.0 +
+		s->q[DRIFT] * dt2 * dt2 / 8.0;
+	s->p[PHASE][DRIFT] += s->q[DRIFT] * dt3 / 6.0;
+	s->p[FREQ][FREQ] += s->q[FREQ] * dt + s->q[DRIFT] * dt3 / 3.0;
+	s->p[FREQ][DRIFT] += s->q[DRIFT] * dt2 / 2.0;
+	s->p[DRIFT][DRIFT] += s->q[DRIFT] * dt;
+
+	s->p[FREQ][PHASE] = s->p[PHASE][FREQ];
+	s->p[DRIFT][PHASE] = s->p[PHASE][DRIFT];
+	s->p[DRIFT][FREQ] = s->p[FREQ][DRIFT];
+}
+
+/* Corrects the state with a measured offset of variance 'r'. */
+static void kalman_update(struct kalman_servo *s, int64_t offset, double r)
+{
+	double k[N_STATES], p0[N_STATES], innovation, variance;
+	int i, j;
+
+	innovation = offset - s->x[PHASE];
+	variance = s->p[PHASE][PHASE] + r;
+
+	for (i = 0; i < N_STATES; i++) {
+		p0[i] = s->p[PHASE][i];
+		k[i] = s->p[i][PHASE] / variance;
+		s->x[i] += k[i] * innovation;
+	}
+	for (i = 0; i < N_STATES; i++) {
+		for (j = 0; j < N_STATES; j++)
+			s->p[i][j] -= k[i] * p0[j];
+	}
+}
+
+static double kalman_sample(struct servo *servo,
+			    int64_t offset,
+			    uint64_t local_ts,
+			    double weight,
+			    enum servo_state *state)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+	double dt, freq, r, tau;
+
+	/* The weight is the inverse of the relative measurement variance. */
+	r = weight > 0.0 ? s->r / weight : 0.0;
+
+	if (!s->count || local_ts <= s->last_ts) {
+		if (!r) {
+			*state = SERVO_UNLOCKED;
+			return -s->clock_freq;
+		}
+		kalman_init_state(s, offset, r);
+		s->last_ts = local_ts;
+		s->count = 1;
+		*state = SERVO_UNLOCKED;
+		return -s->clock_freq;
+	}
+
+	dt = (local_ts - s->last_ts) / 1e9;
+	s->last_ts = local_ts;
+
+	kalman_predict(s, dt);
+	if (r)
+		kalman_update(s, offset, r);
+
+	pr_debug("kalman: offset %.0f +/- %.0f freq %.3f +/- %.3f drift %.6f",
+		 s->x[PHASE], sqrt(s->p[PHASE][PHASE]),
+		 s->x[FREQ], sqrt(s->p[FREQ][FREQ]), s->x[DRIFT]);
+
+	if ((servo->first_update &&
+	     servo->first_step_threshold &&
+	     servo->first_step_threshold < fabs(s->x[PHASE])) ||
+	    (servo->step_threshold &&
+	     servo->step_threshold < fabs(s->x[PHASE]))) {
+		/* The clock will be stepped by offset */
+		s->x[PHASE] -= offset;
+		*state = SERVO_JUMP;
+	} else {
+		*state = SERVO_LOCKED;
+	}
+	s->count = 2;
+
+	/*
+	 * Cancel the expected frequency offset in the middle of the next
+	 * interval and correct the phase offset over a few intervals.
+	 */
+	freq = s->x[FREQ] + s->x[DRIFT] * s->update_interval / 2.0;
+	tau = CORR_INTERVALS * s->update_interval;
+	if (tau < dt)
+		tau = dt;
+	s->clock_freq = -(freq + s->x[PHASE] / tau) / (1.0 + freq / 1e9);
+
+	/* Clamp the frequency to the allowed maximum */
+	if (s->clock_freq > servo->max_frequency)
+		s->clock_freq = servo->max_frequency;
+	else if (s->clock_freq < -servo->max_frequency)
+		s->clock_freq = -servo->max_frequency;
+
+	s->frequency_ratio = 1.0 /
+		((1.0 + freq / 1e9) * (1.0 + s->clock_freq / 1e9));
+
+	return -s->clock_freq;
+}
+
+static void kalman_sync_interval(struct servo *servo, double interval)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->update_interval = interval;
+}
+
+static void kalman_reset(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	s->count = 0;
+	s->frequency_ratio = 1.0;
+}
+
+static double kalman_rate_ratio(struct servo *servo)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	return s->frequency_ratio;
+}
+
+static void kalman_leap(struct servo *servo, int leap)
+{
+	struct kalman_servo *s = container_of(servo, struct kalman_servo, servo);
+
+	/*
+	 * Move the phase estimate when the leap second is applied to the
+	 * clock as if the clock was stepped by the leap second
+	 */
+	if (s->leap && !leap)
+		s->x[PHASE] += s->leap * 1e9;
+
+	s->leap = leap;
+}
+
+struct servo *kalman_servo_create(struct config *cfg, int fadj, int sw_ts)
+{
+	struct kalman_servo *s;
+	double noise;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->servo.destroy = kalman_destroy;
+	s->servo.sample = kalman_sample;
+	s->servo.sync_interval = kalman_sync_interval;
+	s->servo.reset = kalman_reset;
+	s->servo.rate_ratio = kalman_rate_ratio;
+	s->servo.leap = kalman_leap;
+
+	s->clock_freq = -fadj;
+	s->frequency_ratio = 1.0;
+
+	noise = config_get_double(cfg, NULL, "kalman_measurement_noise");
+	if (!noise)
+		noise = sw_ts ? SWTS_MEASUREMENT_NOISE : HWTS_MEASUREMENT_NOISE;
+	s->r = noise * noise;
+
+	s->q[PHASE] = config_get_double(cfg, NULL, "kalman_phase_noise");
+	s->q[FREQ] = config_get_double(cfg, NULL, "kalman_frequency_noise");
+	s->q[DRIFT] = config_get_double(cfg, NULL, "kalman_drift_noise");
+
+	return &s->servo;
+}
@@ -19,6 +19,7 @@
  */
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 #include "linreg.h"
 #include "print.h"
@@ -37,6 +38,8 @@
 #define ERR_INITIAL_UPDATES 10
 /* Maximum ratio of two err values to be considered equal */
 #define ERR_EQUALS 1.05
+/* Number of samples after which the running sums are recalculated */
+#define RECENTER_INTERVAL MAX_POINTS
 
 /* Uncorrected local time vs remote time */
 struct point {
@@ -45,7 +48,18 @@ struct point {
 	double w;
 };
 
+/* Weighted sums of the points in a window */
+struct sums {
+	double x;
+	double y;
+	double xy;
+	double x2;
+	double w;
+};
+
 struct result {
+	/* Sums of the newest points, relative to the origin */
+	struct sums sums;
 	/* Slope and intercept from latest regression */
 	double slope;
 	double intercept;
@@ -65,6 +79,10 @@ struct linreg_servo {
 	unsigned int num_points;
 	/* Index of the newest point */
 	unsigned int last_point;
+	/* Point to which the running sums are relative */
+	struct point origin;
+	/* Number of samples since the sums were recalculated */
+	unsigned int origin_age;
 	/* Remainder from last update of reference.x */
 	double x_remainder;
 	/* Local time stamp of last update */
@@ -123,29 +141,100 @@ static void update_reference(struct linreg_servo *s, uint64_t local_ts)
 	s->last_update = local_ts;
 }
 
+static void sums_update(struct sums *sums, struct linreg_servo *s,
+			struct point *p, double sign)
+{
+	double x, y, w;
+
+	x = (int64_t)(p->x - s->origin.x);
+	y = (int64_t)(p->y - s->origin.y);
+	w = sign * p->w;
+
+	sums->x += x * w;
+	sums->y += y * w;
+	sums->xy += x * y * w;
+	sums->x2 += x * x * w;
+	sums->w += w;
+}
+
+/*
+ * Calculates the sums of all windows from scratch with the origin
+ * moved to the current reference. Rounding errors of the running sums
+ * accumulate and the terms of the sums grow as the reference moves
+ * away from the origin, so this is done periodically.
+ */
+static void recenter(struct linreg_servo *s)
+{
+	struct sums sums = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+	unsigned int i, l, n, size;
+
+	s->origin = s->reference;
+	s->origin_age = 0;
+	i = 0;
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			n = s->num_points;
+
+		for (; i < n; i++) {
+			/* Iterate points from newest to oldest */
+			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
+			sums_update(&sums, s, &s->points[l], 1.0);
+		}
+
+		s->results[size - MIN_SIZE].sums = sums;
+	}
+}
+
 static void add_sample(struct linreg_servo *s, int64_t offset, double weight)
 {
+	unsigned int l, n, size;
+	struct point *p;
+
 	s->last_point = (s->last_point + 1) % MAX_POINTS;
 
-	s->points[s->last_point].x = s->reference.x;
-	s->points[s->last_point].y = s->reference.y - offset;
-	s->points[s->last_point].w = weight;
+	/* Remove the oldest point from each full window */
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+		l = (MAX_POINTS + s->last_point - n) % MAX_POINTS;
+		sums_update(&s->results[size - MIN_SIZE].sums, s,
+			    &s->points[l], -1.0);
+	}
+
+	p = &s->points[s->last_point];
+	p->x = s->reference.x;
+	p->y = s->reference.y - offset;
+	p->w = weight;
 
 	if (s->num_points < MAX_POINTS)
 		s->num_points++;
+
+	if (++s->origin_age >= RECENTER_INTERVAL) {
+		recenter(s);
+		return;
+	}
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		sums_update(&s->results[size - MIN_SIZE].sums, s, p, 1.0);
+	}
 }
 
 static void regress(struct linreg_servo *s)
 {
-	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
-	unsigned int i, l, n, size;
+	double dx, dy, y0, e, x_sum, y_sum, xy_sum, x2_sum, w_sum;
+	unsigned int n, size;
 	struct result *res;
-
-	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
-	i = 0;
+	struct sums *sums;
 
 	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
 
+	/* Offset of the origin from the current reference */
+	dx = (int64_t)(s->origin.x - s->reference.x);
+	dy = (int64_t)(s->origin.y - s->reference.y);
+
 	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
 		n = 1 << size;
 		if (n > s->num_points)
@@ -167,20 +256,14 @@ static void regress(struct linreg_servo *s)
 			}
 		}
 
-		for (; i < n; i++) {
-			/* Iterate points from newest to oldest */
-			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
-
-			x = (int64_t)(s->points[l].x - s->reference.x);
-			y = (int64_t)(s->points[l].y - s->reference.y);
-			w = s->points[l].w;
-
-			x_sum += x * w;
-			y_sum += y * w;
-			xy_sum += x * y * w;
-			x2_sum += x * x * w;
-			w_sum += w;
-		}
+		/* Translate the sums from the origin to the reference */
+		sums = &res->sums;
+		w_sum = sums->w;
+		x_sum = sums->x + dx * w_sum;
+		y_sum = sums->y + dy * w_sum;
+		xy_sum = sums->xy + dy * sums->x + dx * sums->y +
+			dx * dy * w_sum;
+		x2_sum = sums->x2 + 2.0 * dx * sums->x + dx * dx * w_sum;
 
 		/* Get new intercept and slope */
 		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
@@ -255,6 +338,7 @@ static double linreg_sample(struct servo *servo,
 	     servo->step_threshold < fabs(res->intercept))) {
 		/* The clock will be stepped by offset */
 		move_reference(s, 0, -offset);
+		recenter(s);
 		s->last_update -= offset;
 		*state = SERVO_JUMP;
 	} else {
@@ -299,11 +383,14 @@ static void linreg_reset(struct servo *servo)
 	unsigned int i;
 
 	s->num_points = 0;
+	s->origin = s->reference;
+	s->origin_age = 0;
 	s->last_update = 0;
 	s->size = 0;
 	s->frequency_ratio = 1.0;
 
 	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+		memset(&s->results[i - MIN_SIZE].sums, 0, sizeof(struct sums));
 		s->results[i - MIN_SIZE].slope = 0.0;
 		s->results[i - MIN_SIZE].err_updates = 0;
 	}
@@ -324,8 +411,10 @@ static void linreg_leap(struct servo *servo, int leap)
 	 * Move reference when leap second is applied to the reference
 	 * time as if the clock was stepped in the opposite direction
 	 */
-	if (s->leap && !leap)
+	if (s->leap && !leap) {
 		move_reference(s, 0, s->leap * 1000000000);
+		recenter(s);
+	}
 
 	s->leap = leap;
 }
@@ -0,0 +1,482 @@
+/**
+ * @file linreg_bench.c
+ * @brief Compares the linear regression servo with the implementation
+ *        which summed all of the points on every sample, and measures
+ *        the cost of a sample in both.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "linreg.h"
+#include "print.h"
+#include "servo_private.h"
+
+#define RATE		128
+#define NS_PER_SEC	1000000000LL
+
+/*
+ * Limits for the check against the reference implementation.  The
+ * frequency limit is below the resolution of clock_adjtime().
+ */
+#define MAX_FREQ_DIFF	1e-2	/* ppb */
+#define MAX_RATIO_DIFF	1e-11
+
+/*
+ * The reference implementation, as it was before the running sums.
+ * Apart from the names, add_sample() and regress() are unchanged.
+ */
+
+#define MAX_SIZE 6
+#define MIN_SIZE 2
+#define MAX_POINTS (1 << MAX_SIZE)
+#define ERR_SMOOTH 0.02
+#define ERR_INITIAL_UPDATES 10
+#define ERR_EQUALS 1.05
+
+struct ref_point {
+	uint64_t x;
+	uint64_t y;
+	double w;
+};
+
+struct ref_result {
+	double slope;
+	double intercept;
+	double err;
+	int err_updates;
+};
+
+struct ref_servo {
+	struct servo servo;
+	struct ref_point points[MAX_POINTS];
+	struct ref_point reference;
+	unsigned int num_points;
+	unsigned int last_point;
+	double x_remainder;
+	uint64_t last_update;
+	struct ref_result results[MAX_SIZE - MIN_SIZE + 1];
+	unsigned int size;
+	double clock_freq;
+	double update_interval;
+	double frequency_ratio;
+};
+
+static void ref_move_reference(struct ref_servo *s, int64_t x, int64_t y)
+{
+	struct ref_result *res;
+	unsigned int i;
+
+	s->reference.x += x;
+	s->reference.y += y;
+
+	for (i = MIN_SIZE; i <= MAX_SIZE; i++) {
+		res = &s->results[i - MIN_SIZE];
+		res->intercept += x * res->slope - y;
+	}
+}
+
+static void ref_update_reference(struct ref_servo *s, uint64_t local_ts)
+{
+	double x_interval;
+	int64_t y_interval;
+
+	if (s->last_update) {
+		y_interval = local_ts - s->last_update;
+		x_interval = y_interval / (1.0 + s->clock_freq / 1e9);
+		x_interval += s->x_remainder;
+		s->x_remainder = x_interval - (int64_t)x_interval;
+		ref_move_reference(s, (int64_t)x_interval, y_interval);
+	}
+	s->last_update = local_ts;
+}
+
+static void ref_add_sample(struct ref_servo *s, int64_t offset, double weight)
+{
+	s->last_point = (s->last_point + 1) % MAX_POINTS;
+
+	s->points[s->last_point].x = s->reference.x;
+	s->points[s->last_point].y = s->reference.y - offset;
+	s->points[s->last_point].w = weight;
+
+	if (s->num_points < MAX_POINTS)
+		s->num_points++;
+}
+
+static void ref_regress(struct ref_servo *s)
+{
+	double x, y, y0, e, x_sum, y_sum, xy_sum, x2_sum, w, w_sum;
+	unsigned int i, l, n, size;
+	struct ref_result *res;
+
+	x_sum = 0.0, y_sum = 0.0, xy_sum = 0.0, x2_sum = 0.0; w_sum = 0.0;
+	i = 0;
+
+	y0 = (int64_t)(s->points[s->last_point].y - s->reference.y);
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		n = 1 << size;
+		if (n > s->num_points)
+			break;
+
+		res = &s->results[size - MIN_SIZE];
+
+		if (res->slope) {
+			e = fabs(res->intercept - y0);
+			if (res->err_updates < ERR_INITIAL_UPDATES) {
+				res->err *= res->err_updates;
+				res->err += e;
+				res->err_updates++;
+				res->err /= res->err_updates;
+			} else {
+				res->err += ERR_SMOOTH * (e - res->err);
+			}
+		}
+
+		for (; i < n; i++) {
+			l = (MAX_POINTS + s->last_point - i) % MAX_POINTS;
+
+			x = (int64_t)(s->points[l].x - s->reference.x);
+			y = (int64_t)(s->points[l].y - s->reference.y);
+			w = s->points[l].w;
+
+			x_sum += x * w;
+			y_sum += y * w;
+			xy_sum += x * y * w;
+			x2_sum += x * x * w;
+			w_sum += w;
+		}
+
+		res->slope = (xy_sum - x_sum * y_sum / w_sum) /
+				(x2_sum - x_sum * x_sum / w_sum);
+		res->intercept = (y_sum - res->slope * x_sum) / w_sum;
+	}
+}
+
+static void ref_update_size(struct ref_servo *s)
+{
+	struct ref_result *res;
+	double best_err;
+	int size, best_size;
+
+	best_size = 0;
+	best_err = 0.0;
+
+	for (size = MIN_SIZE; size <= MAX_SIZE; size++) {
+		res = &s->results[size - MIN_SIZE];
+		if ((!best_size && res->slope) ||
+		    (best_err * ERR_EQUALS > res->err &&
+		     res->err_updates >= ERR_INITIAL_UPDATES)) {
+			best_size = size;
+			best_err = res->err;
+		}
+	}
+
+	s->size = best_size;
+}
+
+static double ref_sample(struct servo *servo, int64_t offset,
+			 uint64_t local_ts, double weight,
+			 enum servo_state *state)
+{
+	struct ref_servo *s = container_of(servo, struct ref_servo, servo);
+	struct ref_result *res;
+	int corr_interval;
+
+	ref_update_reference(s, local_ts);
+	ref_add_sample(s, offset, weight);
+	ref_regress(s);
+	ref_update_size(s);
+
+	if (s->size < MIN_SIZE) {
+		*state = SERVO_UNLOCKED;
+		return -s->clock_freq;
+	}
+
+	res = &s->results[s->size - MIN_SIZE];
+
+	pr_debug("linreg: points %d slope %.9f intercept %.0f err %.0f",
+		 1 << s->size, res->slope, res->intercept, res->err);
+
+	if ((servo->first_update &&
+	     servo->first_step_threshold &&
+	     servo->first_step_threshold < fabs(res->intercept)) ||
+	    (servo->step_threshold &&
+	     servo->step_threshold < fabs(res->intercept))) {
+		ref_move_reference(s, 0, -offset);
+		s->last_update -= offset;
+		*state = SERVO_JUMP;
+	} else {
+		*state = SERVO_LOCKED;
+	}
+
+	s->clock_freq = 1e9 * (res->slope - 1.0);
+	corr_interval = s->size <= 4 ? 1 : s->size / 2;
+	s->clock_freq += res->intercept / s->update_interval / corr_interval;
+
+	if (s->clock_freq > servo->max_frequency)
+		s->clock_freq = servo->max_frequency;
+	else if (s->clock_freq < -servo->max_frequency)
+		s->clock_freq = -servo->max_frequency;
+
+	s->frequency_ratio = res->slope / (1.0 + s->clock_freq / 1e9);
+
+	return -s->clock_freq;
+}
+
+static void ref_destroy(struct servo *servo)
+{
+	free(container_of(servo, struct ref_servo, servo));
+}
+
+static void ref_sync_interval(struct servo *servo, double interval)
+{
+	container_of(servo, struct ref_servo, servo)->update_interval = interval;
+}
+
+static double ref_rate_ratio(struct servo *servo)
+{
+	return container_of(servo, struct ref_servo, servo)->frequency_ratio;
+}
+
+static struct servo *ref_servo_create(int fadj)
+{
+	struct ref_servo *s;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+
+	s->servo.destroy = ref_destroy;
+	s->servo.sample = ref_sample;
+	s->servo.sync_interval = ref_sync_interval;
+	s->servo.rate_ratio = ref_rate_ratio;
+	s->clock_freq = -fadj;
+	s->frequency_ratio = 1.0;
+
+	return &s->servo;
+}
+
+/*
+ * The simulation.
+ */
+
+struct input {
+	int64_t offset;
+	uint64_t local_ts;
+};
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+static double uniform(void)
+{
+	rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((rng_state >> 11) + 0.5) / 9007199254740992.0;
+}
+
+static double gaussian(void)
+{
+	return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+/* Mimics servo_sample(), which lives with the configuration code. */
+static double sample(struct servo *servo, int64_t offset, uint64_t local_ts,
+		     enum servo_state *state)
+{
+	double r = servo->sample(servo, offset, local_ts, 1.0, state);
+
+	if (*state != SERVO_UNLOCKED)
+		servo->first_update = 0;
+	return r;
+}
+
+static struct servo *setup(struct servo *servo)
+{
+	if (!servo) {
+		fprintf(stderr, "failed to create a servo\n");
+		exit(1);
+	}
+	servo->max_frequency = 900000000;
+	servo->first_step_threshold = 20000;
+	servo->step_threshold = 0.0;
+	servo->first_update = 1;
+	servo->sync_interval(servo, 1.0 / RATE);
+	return servo;
+}
+
+/*
+ * Runs the new servo in a closed loop with a clock which has a
+ * wandering frequency error and noisy offsets, and hands the same
+ * offsets to the reference servo.  Returns the number of samples
+ * whose results differ by more than the limits.
+ */
+static int compare(struct input *in, int n, double noise)
+{
+	double f_new, f_ref, r_new, r_ref, freq_err = 10000.0;
+	double max_freq = 0.0, max_ratio = 0.0, phase = 0.0;
+	struct servo *new = setup(linreg_servo_create(0));
+	struct servo *ref = setup(ref_servo_create(0));
+	enum servo_state s_new, s_ref;
+	uint64_t local_ts = 1000 * NS_PER_SEC;
+	int i, bad = 0;
+
+	for (i = 0; i < n; i++) {
+		in[i].offset = llround(phase + noise * gaussian());
+		in[i].local_ts = local_ts;
+
+		f_new = sample(new, in[i].offset, local_ts, &s_new);
+		f_ref = sample(ref, in[i].offset, local_ts, &s_ref);
+		r_new = new->rate_ratio(new);
+		r_ref = ref->rate_ratio(ref);
+
+		if (s_new != s_ref ||
+		    fabs(f_new - f_ref) > MAX_FREQ_DIFF ||
+		    fabs(r_new - r_ref) > MAX_RATIO_DIFF) {
+			if (!bad)
+				fprintf(stderr, "sample %d: %.9f vs %.9f ppb\n",
+					i, f_new, f_ref);
+			bad++;
+		}
+		if (fabs(f_new - f_ref) > max_freq)
+			max_freq = fabs(f_new - f_ref);
+		if (fabs(r_new - r_ref) > max_ratio)
+			max_ratio = fabs(r_new - r_ref);
+
+		/*
+		 * Both servos move their reference by the frequency they
+		 * set.  Let the reference servo use the exact value of the
+		 * new one, or else a difference in the last digit would
+		 * eventually shift the truncated reference by a nanosecond,
+		 * and the two would go their own ways from there on.
+		 */
+		container_of(ref, struct ref_servo, servo)->clock_freq = -f_new;
+
+		if (s_new == SERVO_JUMP)
+			phase -= in[i].offset;
+		/* A random walk of the frequency, around 1 ppb per second. */
+		freq_err += gaussian() / sqrt(RATE);
+		/* The servo returns the negated frequency adjustment. */
+		phase += (freq_err - f_new) / RATE;
+		local_ts += NS_PER_SEC / RATE;
+	}
+	printf("noise %4.0f ns: %d samples, max difference %.3g ppb, "
+	       "%.3g in the rate ratio, %d beyond the limits\n",
+	       noise, n, max_freq, max_ratio, bad);
+
+	new->destroy(new);
+	ref->destroy(ref);
+	return bad;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double timing(struct servo *servo, struct input *in, int n, int loops)
+{
+	enum servo_state state;
+	double t, sum = 0.0;
+	uint64_t base = 0;
+	int i, j;
+
+	setup(servo);
+	t = now_ns();
+	for (j = 0; j < loops; j++) {
+		for (i = 0; i < n; i++) {
+			sum += sample(servo, in[i].offset,
+				      base + in[i].local_ts, &state);
+		}
+		base += in[n - 1].local_ts;
+	}
+	t = now_ns() - t;
+	servo->destroy(servo);
+	/* Keep the compiler from dropping the loop. */
+	if (sum == 1.0)
+		printf(" ");
+	return t / ((double) n * loops);
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\n"
+		"usage: %s [options]\n\n"
+		" -n [num]  number of samples, default 65536\n"
+		" -l [num]  timing loops over the samples, default 16\n"
+		" -h        prints this message and exits\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	static const double noise[] = { 20.0, 1000.0 };
+	int c, i, loops = 16, n = 65536, bad = 0;
+	double t_new, t_ref;
+	char *progname;
+	struct input *in;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1 + progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "n:l:h"))) {
+		switch (c) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'h':
+			usage(progname);
+			return 0;
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (n < 1 || loops < 1) {
+		usage(progname);
+		return -1;
+	}
+	print_set_syslog(0);
+	print_set_verbose(1);
+
+	in = calloc(n, sizeof(*in));
+	if (!in) {
+		fprintf(stderr, "low memory\n");
+		return -1;
+	}
+	for (i = 0; i < sizeof(noise) / sizeof(noise[0]); i++) {
+		bad += compare(in, n, noise[i]);
+	}
+
+	t_new = timing(linreg_servo_create(0), in, n, loops);
+	t_ref = timing(ref_servo_create(0), in, n, loops);
+	printf("%d Hz samples: %.1f ns per sample, %.1f ns before\n",
+	       RATE, t_new, t_ref);
+
+	free(in);
+	return bad ? 1 : 0;
+}
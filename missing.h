@@ -134,6 +134,14 @@ static inline int clock_nanosleep(clockid_t clock_id, int flags,
 	return syscall(__NR_clock_nanosleep, clock_id, flags, request, remain);
 }
 
+#ifndef TFD_TIMER_ABSTIME
+#define TFD_TIMER_ABSTIME (1 << 0)
+#endif
+
+#ifndef TFD_NONBLOCK
+#define TFD_NONBLOCK O_NONBLOCK
+#endif
+
 static inline int timerfd_create(int clockid, int flags)
 {
 	return syscall(__NR_timerfd_create, clockid, flags);
@@ -0,0 +1,205 @@
+/**
+ * @file mquantile.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+
+#include "filter_private.h"
+#include "mquantile.h"
+
+/*
+ * The samples of the window are split between two binary heaps. The
+ * LOW heap is a max-heap holding the samples up to and including the
+ * wanted quantile, and the HIGH heap is a min-heap holding the rest,
+ * so that the quantile is always at the top of the LOW heap. The heaps
+ * store indices into the circular buffer of samples, and each sample
+ * remembers its heap position, so that the oldest sample may be removed
+ * in O(log n) time when the window slides.
+ */
+enum { LOW, HIGH };
+
+struct mquantile {
+	struct filter filter;
+	int cnt;
+	int len;
+	int index;
+	int percentile;
+	/* Values stored in circular buffer. */
+	tmv_t *samples;
+	/* Indices of the samples below and above the quantile. */
+	int *heap[2];
+	int size[2];
+	/* Heap and heap position of each sample. */
+	int *side;
+	int *pos;
+};
+
+static int heap_before(struct mquantile *m, int h, int a, int b)
+{
+	int cmp = tmv_cmp(m->samples[a], m->samples[b]);
+
+	return h == LOW ? cmp > 0 : cmp < 0;
+}
+
+static void heap_set(struct mquantile *m, int h, int i, int idx)
+{
+	m->heap[h][i] = idx;
+	m->side[idx] = h;
+	m->pos[idx] = i;
+}
+
+static void heap_sift_up(struct mquantile *m, int h, int i)
+{
+	int idx = m->heap[h][i], parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!heap_before(m, h, idx, m->heap[h][parent]))
+			break;
+		heap_set(m, h, i, m->heap[h][parent]);
+		i = parent;
+	}
+	heap_set(m, h, i, idx);
+}
+
+static void heap_sift_down(struct mquantile *m, int h, int i)
+{
+	int idx = m->heap[h][i], child;
+
+	while ((child = 2 * i + 1) < m->size[h]) {
+		if (child + 1 < m->size[h] &&
+		    heap_before(m, h, m->heap[h][child + 1], m->heap[h][child]))
+			child++;
+		if (!heap_before(m, h, m->heap[h][child], idx))
+			break;
+		heap_set(m, h, i, m->heap[h][child]);
+		i = child;
+	}
+	heap_set(m, h, i, idx);
+}
+
+static void heap_push(struct mquantile *m, int h, int idx)
+{
+	int i = m->size[h]++;
+
+	heap_set(m, h, i, idx);
+	heap_sift_up(m, h, i);
+}
+
+static int heap_remove(struct mquantile *m, int h, int i)
+{
+	int idx = m->heap[h][i], last = --m->size[h], moved;
+
+	if (i != last) {
+		/* Fill the hole with the last leaf and restore the order. */
+		moved = m->heap[h][last];
+		heap_set(m, h, i, moved);
+		heap_sift_up(m, h, i);
+		if (m->pos[moved] == i)
+			heap_sift_down(m, h, i);
+	}
+	return idx;
+}
+
+static tmv_t heap_top(struct mquantile *m, int h)
+{
+	return m->samples[m->heap[h][0]];
+}
+
+static void mquantile_destroy(struct filter *filter)
+{
+	struct mquantile *m = container_of(filter, struct mquantile, filter);
+	free(m->samples);
+	free(m->heap[LOW]);
+	free(m->heap[HIGH]);
+	free(m->side);
+	free(m->pos);
+	free(m);
+}
+
+static tmv_t mquantile_sample(struct filter *filter, tmv_t sample)
+{
+	struct mquantile *m = container_of(filter, struct mquantile, filter);
+	int idx = m->index, wanted;
+
+	if (m->cnt < m->len) {
+		m->cnt++;
+	} else {
+		/* Remove the replaced value from its heap. */
+		heap_remove(m, m->side[idx], m->pos[idx]);
+	}
+
+	m->samples[idx] = sample;
+	if (m->size[LOW] && tmv_cmp(sample, heap_top(m, LOW)) <= 0)
+		heap_push(m, LOW, idx);
+	else
+		heap_push(m, HIGH, idx);
+
+	/* Move samples across until the quantile is at the top of LOW. */
+	if (m->percentile < 0)
+		wanted = (m->cnt + 1) / 2;
+	else
+		wanted = m->percentile * (m->cnt - 1) / 100 + 1;
+
+	while (m->size[LOW] > wanted)
+		heap_push(m, HIGH, heap_remove(m, LOW, 0));
+	while (m->size[LOW] < wanted)
+		heap_push(m, LOW, heap_remove(m, HIGH, 0));
+
+	m->index = (1 + m->index) % m->len;
+
+	if (m->percentile < 0 && m->cnt % 2 == 0)
+		return tmv_div(tmv_add(heap_top(m, LOW), heap_top(m, HIGH)), 2);
+	else
+		return heap_top(m, LOW);
+}
+
+static void mquantile_reset(struct filter *filter)
+{
+	struct mquantile *m = container_of(filter, struct mquantile, filter);
+	m->cnt = 0;
+	m->index = 0;
+	m->size[LOW] = 0;
+	m->size[HIGH] = 0;
+}
+
+struct filter *mquantile_create(int length, int percentile)
+{
+	struct mquantile *m;
+
+	if (length < 1 || percentile < -1 || percentile > 100)
+		return NULL;
+	m = calloc(1, sizeof(*m));
+	if (!m)
+		return NULL;
+	m->filter.destroy = mquantile_destroy;
+	m->filter.sample = mquantile_sample;
+	m->filter.reset = mquantile_reset;
+	m->samples = calloc(length, sizeof(*m->samples));
+	m->heap[LOW] = calloc(length, sizeof(*m->heap[LOW]));
+	m->heap[HIGH] = calloc(length, sizeof(*m->heap[HIGH]));
+	m->side = calloc(length, sizeof(*m->side));
+	m->pos = calloc(length, sizeof(*m->pos));
+	if (!m->samples || !m->heap[LOW] || !m->heap[HIGH] ||
+	    !m->side || !m->pos) {
+		mquantile_destroy(&m->filter);
+		return NULL;
+	}
+	m->len = length;
+	m->percentile = percentile;
+	return &m->filter;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file mquantile.h
+ * @brief Implements a moving median or percentile with logarithmic updates.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_MQUANTILE_H
+#define HAVE_MQUANTILE_H
+
+#include "filter.h"
+
+/**
+ * Create a moving quantile filter.
+ * @param length      The number of samples in the window.
+ * @param percentile  The percentile to output, from 0 (the smallest sample)
+ *                    to 100 (the largest), or -1 for the median, which is
+ *                    the mean of the two middle samples in even windows.
+ * @return A pointer to a new filter on success, NULL otherwise.
+ */
+struct filter *mquantile_create(int length, int percentile);
+
+#endif
@@ -24,6 +24,7 @@
 
 #include <asm/byteorder.h>
 
+#include "arena.h"
 #include "contain.h"
 #include "msg.h"
 #include "print.h"
@@ -36,6 +37,7 @@ int assume_two_step = 0;
 
 /*
  * Head room fits a VLAN Ethernet header, and 'msg' is 64 bit aligned.
+ * Each message_storage instance starts on a cache line boundary.
  */
 #define MSG_HEADROOM 24
 
@@ -44,25 +46,16 @@ struct message_storage {
 	struct ptp_message msg;
 } PACKED;
 
-static TAILQ_HEAD(msg_pool, ptp_message) msg_pool = TAILQ_HEAD_INITIALIZER(msg_pool);
+static struct arena *msg_arena;
 
-static struct {
-	int total;
-	int count;
-} pool_stats;
-
-#ifdef DEBUG_POOL
-static void pool_debug(const char *str, void *addr)
-{
-	fprintf(stderr, "*** %p %10s total %d count %d used %d\n",
-		addr, str, pool_stats.total, pool_stats.count,
-		pool_stats.total - pool_stats.count);
-}
-#else
-static void pool_debug(const char *str, void *addr)
+static struct arena *msg_pool(void)
 {
+	if (!msg_arena) {
+		msg_arena = arena_create("message", sizeof(struct message_storage),
+					 0, 0);
+	}
+	return msg_arena;
 }
-#endif
 
 static void announce_pre_send(struct announce_msg *m)
 {
@@ -257,41 +250,63 @@ static void timestamp_pre_send(struct Timestamp *ts)
 
 struct ptp_message *msg_allocate(void)
 {
+	struct arena *pool = msg_pool();
 	struct message_storage *s;
-	struct ptp_message *m = TAILQ_FIRST(&msg_pool);
+	struct ptp_message *m;
 
-	if (m) {
-		TAILQ_REMOVE(&msg_pool, m, list);
-		pool_stats.count--;
-		pool_debug("dequeue", m);
-	} else {
-		s = malloc(sizeof(*s));
-		if (s) {
-			m = &s->msg;
-			pool_stats.total++;
-			pool_debug("allocate", m);
-		}
+	if (!pool) {
+		return NULL;
 	}
-	if (m) {
-		memset(m, 0, sizeof(*m));
-		m->refcnt = 1;
-		TAILQ_INIT(&m->tlv_list);
+	s = arena_alloc(pool);
+	if (!s) {
+		return NULL;
 	}
+	m = &s->msg;
+	m->refcnt = 1;
+	TAILQ_INIT(&m->tlv_list);
 
 	return m;
 }
 
 void msg_cleanup(void)
 {
-	struct message_storage *s;
-	struct ptp_message *m;
-
 	tlv_extra_cleanup();
 
-	while ((m = TAILQ_FIRST(&msg_pool)) != NULL) {
-		TAILQ_REMOVE(&msg_pool, m, list);
-		s = container_of(m, struct message_storage, msg);
-		free(s);
+	if (msg_arena) {
+		arena_destroy(msg_arena);
+		msg_arena = NULL;
+	}
+}
+
+int msg_pool_init(unsigned int count, int hugepages)
+{
+	if (msg_arena) {
+		arena_destroy(msg_arena);
+	}
+	msg_arena = arena_create("message", sizeof(struct message_storage),
+				 count, hugepages);
+	return msg_arena ? 0 : -1;
+}
+
+int msg_pool_share(void)
+{
+	struct arena *pool = msg_pool();
+
+	if (!pool || tlv_extra_pool_share()) {
+		return -1;
+	}
+	arena_share(pool);
+	return 0;
+}
+
+void msg_pool_stats(struct arena_stats *stats)
+{
+	struct arena *pool = msg_pool();
+
+	if (pool) {
+		arena_stats(pool, stats);
+	} else {
+		memset(stats, 0, sizeof(*stats));
 	}
 }
 
@@ -309,7 +324,7 @@ struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt)
 	TAILQ_INIT(&dup->tlv_list);
 	dup->tlv_count = 0;
 
-	err = msg_post_recv(dup, cnt);
+	err = msg_post_recv_header(dup, cnt);
 	if (err) {
 		switch (err) {
 		case -EBADMSG:
@@ -337,58 +352,74 @@ void msg_get(struct ptp_message *m)
 	m->refcnt++;
 }
 
-int msg_post_recv(struct ptp_message *m, int cnt)
+static int msg_pdulen(int type)
 {
-	int pdulen, type, err;
-
-	if (cnt < sizeof(struct ptp_header))
-		return -EBADMSG;
-
-	err = hdr_post_recv(&m->header);
-	if (err)
-		return err;
-
-	type = msg_type(m);
-
 	switch (type) {
 	case SYNC:
-		pdulen = sizeof(struct sync_msg);
-		break;
+		return sizeof(struct sync_msg);
 	case DELAY_REQ:
-		pdulen = sizeof(struct delay_req_msg);
-		break;
+		return sizeof(struct delay_req_msg);
 	case PDELAY_REQ:
-		pdulen = sizeof(struct pdelay_req_msg);
-		break;
+		return sizeof(struct pdelay_req_msg);
 	case PDELAY_RESP:
-		pdulen = sizeof(struct pdelay_resp_msg);
-		break;
+		return sizeof(struct pdelay_resp_msg);
 	case FOLLOW_UP:
-		pdulen = sizeof(struct follow_up_msg);
-		break;
+		return sizeof(struct follow_up_msg);
 	case DELAY_RESP:
-		pdulen = sizeof(struct delay_resp_msg);
-		break;
+		return sizeof(struct delay_resp_msg);
 	case PDELAY_RESP_FOLLOW_UP:
-		pdulen = sizeof(struct pdelay_resp_fup_msg);
-		break;
+		return sizeof(struct pdelay_resp_fup_msg);
 	case ANNOUNCE:
-		pdulen = sizeof(struct announce_msg);
-		break;
+		return sizeof(struct announce_msg);
 	case SIGNALING:
-		pdulen = sizeof(struct signaling_msg);
-		break;
+		return sizeof(struct signaling_msg);
 	case MANAGEMENT:
-		pdulen = sizeof(struct management_msg);
-		break;
-	default:
-		return -EBADMSG;
+		return sizeof(struct management_msg);
 	}
+	return -1;
+}
+
+int msg_post_recv(struct ptp_message *m, int cnt)
+{
+	int err;
+
+	err = msg_post_recv_header(m, cnt);
+	if (err)
+		return err;
+
+	return msg_post_recv_body(m);
+}
+
+int msg_post_recv_header(struct ptp_message *m, int cnt)
+{
+	int pdulen, err;
 
-	if (cnt < pdulen)
+	if (cnt < sizeof(struct ptp_header))
 		return -EBADMSG;
 
-	switch (type) {
+	err = hdr_post_recv(&m->header);
+	if (err)
+		return err;
+
+	pdulen = msg_pdulen(msg_type(m));
+	if (pdulen < 0 || cnt < pdulen)
+		return -EBADMSG;
+
+	m->body_pending = cnt;
+	return 0;
+}
+
+int msg_post_recv_body(struct ptp_message *m)
+{
+	int cnt = m->body_pending, err, pdulen;
+
+	if (!cnt)
+		return 0;
+
+	m->body_pending = 0;
+	pdulen = msg_pdulen(msg_type(m));
+
+	switch (msg_type(m)) {
 	case SYNC:
 		timestamp_post_recv(m, &m->sync.originTimestamp);
 		break;
@@ -417,6 +448,7 @@ int msg_post_recv(struct ptp_message *m, int cnt)
 		announce_post_recv(&m->announce);
 		break;
 	case SIGNALING:
+		port_id_post_recv(&m->signaling.targetPortIdentity);
 		break;
 	case MANAGEMENT:
 		port_id_post_recv(&m->management.targetPortIdentity);
@@ -467,6 +499,7 @@ int msg_pre_send(struct ptp_message *m)
 		announce_pre_send(&m->announce);
 		break;
 	case SIGNALING:
+		port_id_pre_send(&m->signaling.targetPortIdentity);
 		break;
 	case MANAGEMENT:
 		port_id_pre_send(&m->management.targetPortIdentity);
@@ -565,13 +598,11 @@ void msg_put(struct ptp_message *m)
 	if (m->refcnt) {
 		return;
 	}
-	pool_stats.count++;
-	pool_debug("recycle", m);
 	while ((extra = TAILQ_FIRST(&m->tlv_list)) != NULL) {
 		TAILQ_REMOVE(&m->tlv_list, extra, list);
 		tlv_extra_recycle(extra);
 	}
-	TAILQ_INSERT_HEAD(&msg_pool, m, list);
+	arena_free(msg_arena, container_of(m, struct message_storage, msg));
 }
 
 int msg_sots_missing(struct ptp_message *m)
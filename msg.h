@@ -25,6 +25,7 @@
 #include <time.h>
 
 #include "address.h"
+#include "arena.h"
 #include "ddt.h"
 #include "tlv.h"
 #include "tmv.h"
@@ -231,6 +232,11 @@ struct ptp_message {
 	 * Contains the number of TLVs in the suffix.
 	 */
 	int tlv_count;
+	/**
+	 * Size of a received message whose body and suffix are still in
+	 * network byte order, or zero once they have been processed.
+	 */
+	int body_pending;
 };
 
 /**
@@ -316,6 +322,31 @@ struct ptp_message *msg_allocate(void);
  */
 void msg_cleanup(void);
 
+/**
+ * Replace the message cache with a preallocated one of fixed size.
+ * This must be called before the first message is allocated. Without
+ * it, the cache grows on demand.
+ *
+ * @param count      The number of messages to preallocate, or zero for
+ *                   an unbounded cache.
+ * @param hugepages  Non-zero to back the cache with huge pages.
+ * @return           Zero on success, non-zero otherwise.
+ */
+int msg_pool_init(unsigned int count, int hugepages);
+
+/**
+ * Make the message and TLV caches safe to use from several threads.
+ * This must be called before a second thread starts using them.
+ * @return  Zero on success, non-zero otherwise.
+ */
+int msg_pool_share(void);
+
+/**
+ * Obtain the usage counters of the message cache.
+ * @param stats  Buffer to hold the result.
+ */
+void msg_pool_stats(struct arena_stats *stats);
+
 /**
  * Duplicate a message instance.
  *
@@ -331,8 +362,9 @@ void msg_cleanup(void);
  *             having been passed to @ref msg_post_recv().
  *
  * @return     Pointer to a message on success, NULL otherwise.
- *             The returned message will be in host byte order, having
- *             been passed to @ref msg_post_recv().
+ *             The returned message will have been passed to
+ *             @ref msg_post_recv_header(), and so the caller must
+ *             call @ref msg_post_recv_body() before using the body.
  */
 struct ptp_message *msg_duplicate(struct ptp_message *msg, int cnt);
 
@@ -350,6 +382,26 @@ void msg_get(struct ptp_message *m);
  */
 int msg_post_recv(struct ptp_message *m, int cnt);
 
+/**
+ * Process the header of a message after reception, leaving the body
+ * and the TLVs in network byte order. This is enough to decide whether
+ * the message is to be dropped, for example because it belongs to
+ * another domain.
+ * @param m    A message obtained using @ref msg_allocate().
+ * @param cnt  The size of 'm' in bytes.
+ * @return   Zero on success, non-zero if the message is invalid.
+ */
+int msg_post_recv_header(struct ptp_message *m, int cnt);
+
+/**
+ * Complete the processing of a message whose header was processed by
+ * @ref msg_post_recv_header(). Does nothing if the body has already
+ * been processed.
+ * @param m    A message obtained using @ref msg_allocate().
+ * @return   Zero on success, non-zero if the message is invalid.
+ */
+int msg_post_recv_body(struct ptp_message *m);
+
 /**
  * Prepare messages for transmission.
  * @param m  A message obtained using @ref msg_allocate().
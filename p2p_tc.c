@@ -53,12 +53,12 @@ void p2p_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		return;
 	}
 
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_RX_TIMER));
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_tmo(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_TX_TIMER));
 
 	/*
 	 * Handle the side effects of the state transition.
@@ -92,7 +92,7 @@ void p2p_dispatch(struct port *p, enum fsm_event event, int mdiff)
 
 enum fsm_event p2p_event(struct port *p, int fd_index)
 {
-	int cnt, fd = p->fda.fd[fd_index];
+	int cnt, fd = fd_index < N_POLLFD ? p->fda.fd[fd_index] : -1;
 	enum fsm_event event = EV_NONE;
 	struct ptp_message *msg, *dup;
 
@@ -119,6 +119,8 @@ enum fsm_event p2p_event(struct port *p, int fd_index)
 
 	case FD_MANNO_TIMER:
 	case FD_SYNC_TX_TIMER:
+	case FD_UNICAST_TIMER:
+	case FD_UNICAST_REQ_TIMER:
 		pr_err("unexpected timer expiration");
 		return EV_NONE;
 
@@ -161,7 +163,7 @@ enum fsm_event p2p_event(struct port *p, int fd_index)
 		msg_put(msg);
 		return EV_NONE;
 	}
-	if (tc_ignore(p, dup)) {
+	if (tc_ignore(p, dup) || msg_post_recv_body(dup)) {
 		msg_put(dup);
 		dup = NULL;
 	}
@@ -22,6 +22,7 @@
 #include <float.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <math.h>
 #include <net/if.h>
 #include <poll.h>
 #include <stdint.h>
@@ -51,8 +52,10 @@
 #include "servo.h"
 #include "sk.h"
 #include "stats.h"
+#include "status.h"
 #include "sysoff.h"
 #include "tlv.h"
+#include "trace.h"
 #include "uds.h"
 #include "util.h"
 #include "version.h"
@@ -83,6 +86,7 @@ struct clock {
 	int utc_offset_set;
 	struct servo *servo;
 	enum servo_state servo_state;
+	double freq;
 	char *device;
 	const char *source_label;
 	struct stats *offset_stats;
@@ -118,6 +122,9 @@ struct node {
 	LIST_HEAD(port_head, port) ports;
 	LIST_HEAD(clock_head, clock) clocks;
 	struct clock *master;
+	struct trace *trace;
+	struct status *status;
+	char *status_file;
 };
 
 static struct config *phc2sys_config;
@@ -126,6 +133,7 @@ static int update_pmc(struct node *node, int subscribe);
 static int clock_handle_leap(struct node *node, struct clock *clock,
 			     int64_t offset, uint64_t ts);
 static int run_pmc_get_utc_offset(struct node *node, int timeout);
+static int get_utc_offset(struct node *node, int timeout);
 static void run_pmc_events(struct node *node);
 
 static int normalize_state(int state);
@@ -197,6 +205,7 @@ static struct servo *servo_add(struct node *node, struct clock *clock)
 	}
 
 	servo_sync_interval(servo, node->phc_interval);
+	clock->freq = ppb;
 
 	return servo;
 }
@@ -567,6 +576,23 @@ static void update_clock_stats(struct clock *clock, unsigned int max_count,
 	stats_reset(clock->delay_stats);
 }
 
+static void trace_clock(struct node *node, struct clock *clock,
+			int64_t offset, uint64_t ts, enum servo_state state)
+{
+	struct trace_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = TRACE_PHC2SYS;
+	rec.t1 = ts - offset;
+	rec.t2 = ts;
+	rec.offset = offset;
+	rec.freq = clock->freq;
+	rec.port = clock->phc_index < 0 ? TRACE_NO_PHC : clock->phc_index;
+	rec.state = state;
+	rec.log_interval = lround(log2(node->phc_interval));
+	trace_add(node->trace, &rec);
+}
+
 static void update_clock(struct node *node, struct clock *clock,
 			 int64_t offset, uint64_t ts, int64_t delay)
 {
@@ -594,6 +620,7 @@ static void update_clock(struct node *node, struct clock *clock,
 		/* Fall through. */
 	case SERVO_LOCKED:
 		clockadj_set_freq(clock->clkid, -ppb);
+		clock->freq = -ppb;
 		if (clock->clkid == CLOCK_REALTIME)
 			sysclk_set_sync();
 		if (clock->sanity_check)
@@ -601,6 +628,9 @@ static void update_clock(struct node *node, struct clock *clock,
 		break;
 	}
 
+	if (node->trace)
+		trace_clock(node, clock, offset, ts, state);
+
 	if (clock->offset_stats) {
 		update_clock_stats(clock, node->stats_max_count, offset, ppb, delay);
 	} else {
@@ -731,11 +761,12 @@ static int do_loop(struct node *node, int subscriptions)
 			continue;
 
 		if (subscriptions) {
-			run_pmc_events(node);
+			if (node->pmc)
+				run_pmc_events(node);
 			if (node->state_changed) {
 				/* force getting offset, as it may have
 				 * changed after the port state change */
-				if (run_pmc_get_utc_offset(node, 1000) <= 0) {
+				if (get_utc_offset(node, 1000) <= 0) {
 					pr_err("failed to get UTC offset");
 					continue;
 				}
@@ -851,13 +882,30 @@ static int clock_compute_state(struct node *node, struct clock *clock)
 	return state;
 }
 
+static void port_set_state(struct node *node, struct port *port, int state)
+{
+	struct clock *clock;
+
+	state = normalize_state(state);
+	if (port->state == state)
+		return;
+
+	pr_info("port %u changed state", port->number);
+	port->state = state;
+	clock = port->clock;
+	state = clock_compute_state(node, clock);
+	if (clock->state != state || clock->new_state) {
+		clock->new_state = state;
+		node->state_changed = 1;
+	}
+}
+
 static int recv_subscribed(struct node *node, struct ptp_message *msg,
 			   int excluded)
 {
-	int mgt_id, state;
 	struct portDS *pds;
 	struct port *port;
-	struct clock *clock;
+	int mgt_id;
 
 	mgt_id = get_mgt_id(msg);
 	if (mgt_id == excluded)
@@ -871,18 +919,7 @@ static int recv_subscribed(struct node *node, struct ptp_message *msg,
 				pid2str(&pds->portIdentity));
 			return 1;
 		}
-		state = normalize_state(pds->portState);
-		if (port->state != state) {
-			pr_info("port %s changed state",
-				pid2str(&pds->portIdentity));
-			port->state = state;
-			clock = port->clock;
-			state = clock_compute_state(node, clock);
-			if (clock->state != state || clock->new_state) {
-				clock->new_state = state;
-				node->state_changed = 1;
-			}
-		}
+		port_set_state(node, port, pds->portState);
 		return 1;
 	}
 	return 0;
@@ -915,6 +952,25 @@ static int init_pmc(struct config *cfg, struct node *node)
 	return 0;
 }
 
+static void set_time_properties(struct node *node, int utc_offset, int flags)
+{
+	if (flags & PTP_TIMESCALE) {
+		node->sync_offset = utc_offset;
+		if (flags & LEAP_61)
+			node->leap = 1;
+		else if (flags & LEAP_59)
+			node->leap = -1;
+		else
+			node->leap = 0;
+		node->utc_offset_traceable = flags & UTC_OFF_VALID &&
+					     flags & TIME_TRACEABLE;
+	} else {
+		node->sync_offset = 0;
+		node->leap = 0;
+		node->utc_offset_traceable = 0;
+	}
+}
+
 /* Return values:
  * 1: success
  * 0: timeout
@@ -1026,21 +1082,7 @@ static int run_pmc_get_utc_offset(struct node *node, int timeout)
 		return res;
 
 	tds = (struct timePropertiesDS *)get_mgt_data(msg);
-	if (tds->flags & PTP_TIMESCALE) {
-		node->sync_offset = tds->currentUtcOffset;
-		if (tds->flags & LEAP_61)
-			node->leap = 1;
-		else if (tds->flags & LEAP_59)
-			node->leap = -1;
-		else
-			node->leap = 0;
-		node->utc_offset_traceable = tds->flags & UTC_OFF_VALID &&
-					     tds->flags & TIME_TRACEABLE;
-	} else {
-		node->sync_offset = 0;
-		node->leap = 0;
-		node->utc_offset_traceable = 0;
-	}
+	set_time_properties(node, tds->currentUtcOffset, tds->flags);
 	msg_put(msg);
 	return 1;
 }
@@ -1141,6 +1183,121 @@ static void close_pmc(struct node *node)
 	node->pmc = NULL;
 }
 
+/* Return values:
+ * 1: success
+ * 0: the status of ptp4l is not available
+ */
+static int read_status(struct node *node, struct status_data *d)
+{
+	if (!node->status) {
+		node->status = status_open(node->status_file);
+		if (!node->status)
+			return 0;
+	}
+	if (status_read(node->status, d)) {
+		if (status_orphaned(node->status)) {
+			/* ptp4l has died, and a new one may not use the file. */
+			pr_warning("status file %s is orphaned, "
+				   "falling back to management messages",
+				   node->status_file);
+			if (node->pmc || !init_pmc(phc2sys_config, node))
+				node->status_file = NULL;
+		}
+		/* ptp4l has gone away, open the file again next time. */
+		status_destroy(node->status);
+		node->status = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+static void update_status_ports(struct node *node, struct status_data *d)
+{
+	struct port *port;
+	int i;
+
+	for (i = 0; i < d->num_ports; i++) {
+		port = port_get(node, d->port[i].number);
+		if (port)
+			port_set_state(node, port, d->port[i].state);
+	}
+}
+
+static int run_status_wait_sync(struct node *node, int timeout)
+{
+	struct timespec interval;
+	struct status_data d;
+	int i;
+
+	if (read_status(node, &d)) {
+		for (i = 0; i < d.num_ports; i++) {
+			switch (d.port[i].state) {
+			case PS_MASTER:
+			case PS_SLAVE:
+				return 1;
+			}
+		}
+	}
+	interval.tv_sec = timeout / 1000;
+	interval.tv_nsec = (timeout % 1000) * 1000000;
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &interval, NULL);
+	return 0;
+}
+
+static int run_status_get_utc_offset(struct node *node)
+{
+	struct status_data d;
+
+	if (!read_status(node, &d))
+		return 0;
+	set_time_properties(node, d.current_utc_offset, d.time_flags);
+	return 1;
+}
+
+static int get_utc_offset(struct node *node, int timeout)
+{
+	if (node->status_file)
+		return run_status_get_utc_offset(node);
+	return run_pmc_get_utc_offset(node, timeout);
+}
+
+/* Return values:
+ * 1: the status file was abandoned, use management messages instead
+ * 0: success
+ * -1: error
+ */
+static int auto_init_status_ports(struct node *node)
+{
+	struct status_data d;
+	struct status_port *sp;
+	struct port *port;
+	int i;
+
+	while (!read_status(node, &d)) {
+		if (!is_running())
+			return -1;
+		/* Go on with management messages. */
+		if (!node->status_file)
+			return 1;
+		pr_notice("Waiting for ptp4l...");
+		sleep(1);
+	}
+
+	for (i = 0; i < d.num_ports; i++) {
+		sp = &d.port[i];
+		if (sp->timestamping == TS_SOFTWARE) {
+			/* ignore ports with software time stamping */
+			continue;
+		}
+		port = port_add(node, sp->number, sp->name);
+		if (!port)
+			return -1;
+		port->state = normalize_state(sp->state);
+	}
+	set_time_properties(node, d.current_utc_offset, d.time_flags);
+	return 0;
+}
+
 static int auto_init_ports(struct node *node, int add_rt)
 {
 	struct port *port;
@@ -1150,6 +1307,14 @@ static int auto_init_ports(struct node *node, int add_rt)
 	int state, timestamping;
 	char iface[IFNAMSIZ];
 
+	if (node->status_file) {
+		res = auto_init_status_ports(node);
+		if (res < 0)
+			return -1;
+		if (!res)
+			goto ports_added;
+	}
+
 	while (1) {
 		if (!is_running())
 			return -1;
@@ -1194,6 +1359,7 @@ static int auto_init_ports(struct node *node, int add_rt)
 			return -1;
 		port->state = normalize_state(state);
 	}
+ports_added:
 	if (LIST_EMPTY(&node->clocks)) {
 		pr_err("no suitable ports available");
 		return -1;
@@ -1212,19 +1378,36 @@ static int auto_init_ports(struct node *node, int add_rt)
 	}
 
 	/* get initial offset */
-	if (run_pmc_get_utc_offset(node, 1000) <= 0) {
+	if (get_utc_offset(node, 1000) <= 0) {
 		pr_err("failed to get UTC offset");
 		return -1;
 	}
 	return 0;
 }
 
+/* Returns: -1 in case of error, 0 otherwise */
+static int update_status(struct node *node, int subscribe)
+{
+	struct status_data d;
+
+	/* Reading the snapshot is cheap, so do it on every update. */
+	if (!read_status(node, &d))
+		return 0;
+	set_time_properties(node, d.current_utc_offset, d.time_flags);
+	if (subscribe)
+		update_status_ports(node, &d);
+	return 0;
+}
+
 /* Returns: -1 in case of error, 0 otherwise */
 static int update_pmc(struct node *node, int subscribe)
 {
 	struct timespec tp;
 	uint64_t ts;
 
+	if (node->status_file)
+		return update_status(node, subscribe);
+
 	if (clock_gettime(CLOCK_MONOTONIC, &tp)) {
 		pr_err("failed to read clock: %m");
 		return -1;
@@ -1318,7 +1501,7 @@ static void usage(char *progname)
 		" -w             wait for ptp4l\n"
 		" common options:\n"
 		" -f [file]      configuration file\n"
-		" -E [pi|linreg] clock servo (pi)\n"
+		" -E [pi|linreg|kalman] clock servo (pi)\n"
 		" -P [kp]        proportional constant (0.7)\n"
 		" -I [ki]        integration constant (0.3)\n"
 		" -S [step]      step threshold (disabled)\n"
@@ -1344,6 +1527,7 @@ static void usage(char *progname)
 int main(int argc, char *argv[])
 {
 	char *config = NULL, *dst_name = NULL, *progname, *src_name = NULL;
+	char *status_file, *trace_file;
 	struct clock *src, *dst;
 	struct config *cfg;
 	struct option *opts;
@@ -1415,6 +1599,9 @@ int main(int argc, char *argv[])
 			} else if (!strcasecmp(optarg, "ntpshm")) {
 				config_set_int(cfg, "clock_servo",
 					       CLOCK_SERVO_NTPSHM);
+			} else if (!strcasecmp(optarg, "kalman")) {
+				config_set_int(cfg, "clock_servo",
+					       CLOCK_SERVO_KALMAN);
 			} else {
 				fprintf(stderr,
 					"invalid servo name %s\n", optarg);
@@ -1571,8 +1758,20 @@ int main(int argc, char *argv[])
 	node.kernel_leap = config_get_int(cfg, NULL, "kernel_leap");
 	node.sanity_freq_limit = config_get_int(cfg, NULL, "sanity_freq_limit");
 
+	trace_file = config_get_string(cfg, NULL, "trace_file");
+	if (trace_file[0]) {
+		node.trace = trace_create(trace_file,
+				config_get_int(cfg, NULL, "trace_records"));
+		if (!node.trace)
+			goto end;
+	}
+
+	status_file = config_get_string(cfg, NULL, "status_file");
+
 	if (autocfg) {
-		if (init_pmc(cfg, &node))
+		if (status_file[0])
+			node.status_file = status_file;
+		else if (init_pmc(cfg, &node))
 			goto end;
 		if (auto_init_ports(&node, rt) < 0)
 			goto end;
@@ -1608,11 +1807,16 @@ int main(int argc, char *argv[])
 	r = -1;
 
 	if (wait_sync) {
-		if (init_pmc(cfg, &node))
+		if (status_file[0])
+			node.status_file = status_file;
+		else if (init_pmc(cfg, &node))
 			goto end;
 
 		while (is_running()) {
-			r = run_pmc_wait_sync(&node, 1000);
+			if (node.status_file)
+				r = run_status_wait_sync(&node, 1000);
+			else
+				r = run_pmc_wait_sync(&node, 1000);
 			if (r < 0)
 				goto end;
 			if (r > 0)
@@ -1622,7 +1826,7 @@ int main(int argc, char *argv[])
 		}
 
 		if (!node.forced_sync_offset) {
-			r = run_pmc_get_utc_offset(&node, 1000);
+			r = get_utc_offset(&node, 1000);
 			if (r <= 0) {
 				pr_err("failed to get UTC offset");
 				goto end;
@@ -1631,8 +1835,11 @@ int main(int argc, char *argv[])
 
 		if (node.forced_sync_offset ||
 		    (src->clkid != CLOCK_REALTIME && dst->clkid != CLOCK_REALTIME) ||
-		    src->clkid == CLOCK_INVALID)
-			close_pmc(&node);
+		    src->clkid == CLOCK_INVALID) {
+			if (node.pmc)
+				close_pmc(&node);
+			node.status_file = NULL;
+		}
 	}
 
 	if (pps_fd >= 0) {
@@ -1647,8 +1854,12 @@ int main(int argc, char *argv[])
 end:
 	if (node.pmc)
 		close_pmc(&node);
+	if (node.status)
+		status_destroy(node.status);
 	clock_cleanup(&node);
 	port_cleanup(&node);
+	if (node.trace)
+		trace_destroy(node.trace);
 	config_destroy(cfg);
 	msg_cleanup();
 	return r;
@@ -24,6 +24,7 @@
 #include "pi.h"
 #include "print.h"
 #include "servo_private.h"
+#include "stats.h"
 
 #define HWTS_KP_SCALE 0.7
 #define HWTS_KI_SCALE 0.3
@@ -35,6 +36,18 @@
 
 #define FREQ_EST_MARGIN 0.001
 
+/* Number of samples in each window of the adaptive gain scheduling */
+#define ADAPT_WINDOW 16
+/* Limits of the factor applied to the gains */
+#define ADAPT_MIN_SCALE 0.125
+#define ADAPT_MAX_SCALE 2.0
+/* Factor by which the gains shrink after each quiet window */
+#define ADAPT_SHRINK 0.7
+/* Number of standard deviations making an offset an outlier */
+#define ADAPT_OUTLIER 5.0
+/* Number of consecutive outliers detected as a transient */
+#define ADAPT_TRANSIENT 2
+
 struct pi_servo {
 	struct servo servo;
 	int64_t offset[2];
@@ -42,8 +55,18 @@ struct pi_servo {
 	double drift;
 	double kp;
 	double ki;
+	double kp_max;
+	double ki_max;
 	double last_freq;
 	int count;
+	/* adaptive gain scheduling: */
+	int adaptive;
+	double gain_scale;
+	struct stats *offset_stats;
+	struct stats *freq_stats;
+	double offset_stddev;
+	double freq_stddev;
+	int outliers;
 	/* configuration: */
 	double configured_pi_kp;
 	double configured_pi_ki;
@@ -58,9 +81,100 @@ struct pi_servo {
 static void pi_destroy(struct servo *servo)
 {
 	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
+	if (s->offset_stats)
+		stats_destroy(s->offset_stats);
+	if (s->freq_stats)
+		stats_destroy(s->freq_stats);
 	free(s);
 }
 
+/*
+ * Scaling both gains keeps the damping of the loop while changing its
+ * bandwidth by the scale, as long as the gains stay within the limits
+ * of stability for the sync interval.
+ */
+static void pi_gains(struct pi_servo *s, double *kp, double *ki)
+{
+	*kp = s->kp * s->gain_scale;
+	*ki = s->ki * s->gain_scale * s->gain_scale;
+
+	if (s->gain_scale > 1.0) {
+		if (*kp > s->kp_max)
+			*kp = s->kp > s->kp_max ? s->kp : s->kp_max;
+		if (*ki > s->ki_max)
+			*ki = s->ki > s->ki_max ? s->ki : s->ki_max;
+	}
+}
+
+static void pi_adapt_reset(struct pi_servo *s, double gain_scale)
+{
+	s->gain_scale = gain_scale;
+	s->offset_stddev = 0.0;
+	s->freq_stddev = 0.0;
+	s->outliers = 0;
+	stats_reset(s->offset_stats);
+	stats_reset(s->freq_stats);
+}
+
+/*
+ * Tracks the variance of the locked offset and frequency in windows of
+ * ADAPT_WINDOW samples. In the adaptive mode the gains are scheduled
+ * from these statistics. They shrink while the offset stays centered
+ * in its noise to reduce the wander, and they are raised when a run of
+ * outliers shows that the clock has to follow a transient, e.g. after
+ * a change of grandmaster.
+ */
+static void pi_adapt(struct pi_servo *s, int64_t offset, double ppb)
+{
+	struct stats_result offset_res, freq_res;
+	double kp, ki;
+
+	if (s->adaptive && s->offset_stddev &&
+	    fabs(offset) > ADAPT_OUTLIER * s->offset_stddev) {
+		if (++s->outliers >= ADAPT_TRANSIENT) {
+			pi_adapt_reset(s, ADAPT_MAX_SCALE);
+			pr_debug("PI servo: transient, gain scale %.3f",
+				 s->gain_scale);
+			return;
+		}
+	} else {
+		s->outliers = 0;
+	}
+
+	stats_add_value(s->offset_stats, offset);
+	stats_add_value(s->freq_stats, ppb);
+	if (stats_get_num_values(s->offset_stats) < ADAPT_WINDOW)
+		return;
+
+	stats_get_result(s->offset_stats, &offset_res);
+	stats_get_result(s->freq_stats, &freq_res);
+	stats_reset(s->offset_stats);
+	stats_reset(s->freq_stats);
+
+	s->offset_stddev = offset_res.stddev;
+	s->freq_stddev = freq_res.stddev;
+
+	if (!s->adaptive)
+		return;
+
+	if (fabs(offset_res.mean) < offset_res.stddev) {
+		s->gain_scale *= ADAPT_SHRINK;
+	} else {
+		/* The offset is biased, the loop is too slow. */
+		s->gain_scale /= ADAPT_SHRINK;
+	}
+	if (s->gain_scale < ADAPT_MIN_SCALE)
+		s->gain_scale = ADAPT_MIN_SCALE;
+	else if (s->gain_scale > ADAPT_MAX_SCALE)
+		s->gain_scale = ADAPT_MAX_SCALE;
+
+	pi_gains(s, &kp, &ki);
+	pr_debug("PI servo: offset mean %.0f stddev %.0f freq stddev %.3f "
+		 "gain scale %.3f kp %.3f ki %.6f",
+		 offset_res.mean, offset_res.stddev, freq_res.stddev,
+		 s->gain_scale, kp, ki);
+}
+
 static double pi_sample(struct servo *servo,
 			int64_t offset,
 			uint64_t local_ts,
@@ -69,7 +183,7 @@ static double pi_sample(struct servo *servo,
 {
 	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
 	double ki_term, ppb = s->last_freq;
-	double freq_est_interval, localdiff;
+	double freq_est_interval, localdiff, kp, ki;
 
 	switch (s->count) {
 	case 0:
@@ -137,8 +251,9 @@ static double pi_sample(struct servo *servo,
 			break;
 		}
 
-		ki_term = s->ki * offset * weight;
-		ppb = s->kp * offset * weight + s->drift + ki_term;
+		pi_gains(s, &kp, &ki);
+		ki_term = ki * offset * weight;
+		ppb = kp * offset * weight + s->drift + ki_term;
 		if (ppb < -servo->max_frequency) {
 			ppb = -servo->max_frequency;
 		} else if (ppb > servo->max_frequency) {
@@ -147,6 +262,7 @@ static double pi_sample(struct servo *servo,
 			s->drift += ki_term;
 		}
 		*state = SERVO_LOCKED;
+		pi_adapt(s, offset, ppb);
 		break;
 	}
 
@@ -166,6 +282,9 @@ static void pi_sync_interval(struct servo *servo, double interval)
 	if (s->ki > s->configured_pi_ki_norm_max / interval)
 		s->ki = s->configured_pi_ki_norm_max / interval;
 
+	s->kp_max = s->configured_pi_kp_norm_max / interval;
+	s->ki_max = s->configured_pi_ki_norm_max / interval;
+
 	pr_debug("PI servo: sync interval %.3f kp %.3f ki %.6f",
 		 interval, s->kp, s->ki);
 }
@@ -175,6 +294,17 @@ static void pi_reset(struct servo *servo)
 	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
 
 	s->count = 0;
+	pi_adapt_reset(s, 1.0);
+}
+
+static void pi_status(struct servo *servo, struct servo_status *status)
+{
+	struct pi_servo *s = container_of(servo, struct pi_servo, servo);
+
+	pi_gains(s, &status->kp, &status->ki);
+	status->gain_scale = s->gain_scale;
+	status->offset_stddev = s->offset_stddev;
+	status->freq_stddev = s->freq_stddev;
 }
 
 struct servo *pi_servo_create(struct config *cfg, int fadj, int sw_ts)
@@ -189,10 +319,12 @@ struct servo *pi_servo_create(struct config *cfg, int fadj, int sw_ts)
 	s->servo.sample  = pi_sample;
 	s->servo.sync_interval = pi_sync_interval;
 	s->servo.reset   = pi_reset;
+	s->servo.status  = pi_status;
 	s->drift         = fadj;
 	s->last_freq     = fadj;
 	s->kp            = 0.0;
 	s->ki            = 0.0;
+	s->gain_scale    = 1.0;
 	s->configured_pi_kp = config_get_double(cfg, NULL, "pi_proportional_const");
 	s->configured_pi_ki = config_get_double(cfg, NULL, "pi_integral_const");
 	s->configured_pi_kp_scale = config_get_double(cfg, NULL, "pi_proportional_scale");
@@ -227,5 +359,13 @@ struct servo *pi_servo_create(struct config *cfg, int fadj, int sw_ts)
 		}
 	}
 
+	s->adaptive = config_get_int(cfg, NULL, "pi_adaptive");
+	s->offset_stats = stats_create();
+	s->freq_stats = stats_create();
+	if (!s->offset_stats || !s->freq_stats) {
+		pi_destroy(&s->servo);
+		return NULL;
+	}
+
 	return &s->servo;
 }
@@ -88,6 +88,9 @@ struct management_id idtab[] = {
 	{ "PRIMARY_DOMAIN", TLV_PRIMARY_DOMAIN, not_supported },
 	{ "TIME_STATUS_NP", TLV_TIME_STATUS_NP, do_get_action },
 	{ "GRANDMASTER_SETTINGS_NP", TLV_GRANDMASTER_SETTINGS_NP, do_set_action },
+	{ "POOL_STATS_NP", TLV_POOL_STATS_NP, do_get_action },
+	{ "SERVO_STATUS_NP", TLV_SERVO_STATUS_NP, do_get_action },
+	{ "HOLDOVER_STATUS_NP", TLV_HOLDOVER_STATUS_NP, do_get_action },
 /* Port management ID values */
 	{ "NULL_MANAGEMENT", TLV_NULL_MANAGEMENT, null_management },
 	{ "CLOCK_DESCRIPTION", TLV_CLOCK_DESCRIPTION, do_get_action },
@@ -99,7 +102,7 @@ struct management_id idtab[] = {
 	{ "ENABLE_PORT", TLV_ENABLE_PORT, not_supported },
 	{ "DISABLE_PORT", TLV_DISABLE_PORT, not_supported },
 	{ "UNICAST_NEGOTIATION_ENABLE", TLV_UNICAST_NEGOTIATION_ENABLE, not_supported },
-	{ "UNICAST_MASTER_TABLE", TLV_UNICAST_MASTER_TABLE, not_supported },
+	{ "UNICAST_MASTER_TABLE", TLV_UNICAST_MASTER_TABLE, do_get_action },
 	{ "UNICAST_MASTER_MAX_TABLE_SIZE", TLV_UNICAST_MASTER_MAX_TABLE_SIZE, not_supported },
 	{ "ACCEPTABLE_MASTER_TABLE_ENABLED", TLV_ACCEPTABLE_MASTER_TABLE_ENABLED, not_supported },
 	{ "ALTERNATE_MASTER", TLV_ALTERNATE_MASTER, not_supported },
@@ -117,8 +120,22 @@ static const char *action_string[] = {
 	"ACKNOWLEDGE",
 };
 
+static const char *holdover_state_string[] = {
+	"UNAVAILABLE",
+	"AVAILABLE",
+	"IN_SPEC",
+	"OUT_OF_SPEC",
+};
+
 #define IFMT "\n\t\t"
 
+static const char *holdover_state_str(UInteger8 state)
+{
+	if (state >= sizeof(holdover_state_string) / sizeof(char *))
+		return "unknown";
+	return holdover_state_string[state];
+}
+
 static char *text2str(struct PTPText *text)
 {
 	static struct static_ptp_text s;
@@ -133,6 +150,15 @@ static char *bin2str(Octet *data, int len)
 	return bin2str_impl(data, len, buf, sizeof(buf));
 }
 
+static void pmc_show_pool_usage(const char *name, struct pool_usage_np *pu,
+				FILE *fp)
+{
+	fprintf(fp,
+		IFMT "%-8s size %u total %u in_use %u high_water %u failures %u",
+		name, pu->size, pu->total, pu->in_use, pu->high_water,
+		pu->failures);
+}
+
 static void pmc_show(struct ptp_message *msg, FILE *fp)
 {
 	int action;
@@ -144,11 +170,18 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 	struct parentDS *pds;
 	struct timePropertiesDS *tp;
 	struct time_status_np *tsn;
+	struct pool_stats_np *psn;
+	struct servo_status_np *ssn;
+	struct holdover_status_np *hsn;
 	struct grandmaster_settings_np *gsn;
 	struct mgmt_clock_description *cd;
 	struct tlv_extra *extra;
+	struct unicast_master_table_np *umt;
+	struct PortAddress *pa;
 	struct portDS *p;
 	struct port_ds_np *pnp;
+	uint8_t *buf;
+	int i;
 
 	if (msg_type(msg) != MANAGEMENT) {
 		return;
@@ -346,6 +379,37 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 			tsn->gmPresent ? "true" : "false",
 			cid2str(&tsn->gmIdentity));
 		break;
+	case TLV_POOL_STATS_NP:
+		psn = (struct pool_stats_np *) mgt->data;
+		fprintf(fp, "POOL_STATS_NP ");
+		pmc_show_pool_usage("message", &psn->message, fp);
+		pmc_show_pool_usage("tlv", &psn->tlv, fp);
+		pmc_show_pool_usage("tc", &psn->tc, fp);
+		break;
+	case TLV_SERVO_STATUS_NP:
+		ssn = (struct servo_status_np *) mgt->data;
+		fprintf(fp, "SERVO_STATUS_NP "
+			IFMT "servo_state   s%hhu"
+			IFMT "kp            %.9f"
+			IFMT "ki            %.9f"
+			IFMT "gain_scale    %.9f"
+			IFMT "offset_stddev %" PRId64
+			IFMT "freq_stddev   %.9f",
+			ssn->servo_state,
+			ssn->kp / 1e9, ssn->ki / 1e9, ssn->gain_scale / 1e9,
+			ssn->offset_stddev, ssn->freq_stddev / 1e9);
+		break;
+	case TLV_HOLDOVER_STATUS_NP:
+		hsn = (struct holdover_status_np *) mgt->data;
+		fprintf(fp, "HOLDOVER_STATUS_NP "
+			IFMT "state      %s"
+			IFMT "duration   %u"
+			IFMT "freq       %+.3f"
+			IFMT "aging      %+.9f"
+			IFMT "time_error %" PRId64,
+			holdover_state_str(hsn->state), hsn->duration,
+			hsn->freq / 1e9, hsn->aging / 1e9, hsn->time_error);
+		break;
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		gsn = (struct grandmaster_settings_np *) mgt->data;
 		fprintf(fp, "GRANDMASTER_SETTINGS_NP "
@@ -432,6 +496,20 @@ static void pmc_show(struct ptp_message *msg, FILE *fp)
 		fprintf(fp, "LOG_MIN_PDELAY_REQ_INTERVAL "
 			IFMT "logMinPdelayReqInterval %hhd", mtd->val);
 		break;
+	case TLV_UNICAST_MASTER_TABLE:
+		umt = (struct unicast_master_table_np *) mgt->data;
+		fprintf(fp, "UNICAST_MASTER_TABLE "
+			IFMT "logQueryInterval %hhd"
+			IFMT "actualTableSize  %hu",
+			umt->logQueryInterval, umt->actualTableSize);
+		buf = umt->unicastMasterTable;
+		for (i = 0; i < umt->actualTableSize; i++) {
+			pa = (struct PortAddress *) buf;
+			fprintf(fp, IFMT "unicastMasterAddress %hu %s",
+				pa->networkProtocol, portaddr2str(pa));
+			buf += sizeof(*pa) + pa->addressLength;
+		}
+		break;
 	}
 out:
 	fprintf(fp, "\n");
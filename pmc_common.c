@@ -202,6 +202,15 @@ static int pmc_tlv_datalen(struct pmc *pmc, int id)
 	case TLV_GRANDMASTER_SETTINGS_NP:
 		len += sizeof(struct grandmaster_settings_np);
 		break;
+	case TLV_POOL_STATS_NP:
+		len += sizeof(struct pool_stats_np);
+		break;
+	case TLV_SERVO_STATUS_NP:
+		len += sizeof(struct servo_status_np);
+		break;
+	case TLV_HOLDOVER_STATUS_NP:
+		len += sizeof(struct holdover_status_np);
+		break;
 	case TLV_NULL_MANAGEMENT:
 		break;
 	case TLV_CLOCK_DESCRIPTION:
@@ -36,10 +36,13 @@
 #include "print.h"
 #include "rtnl.h"
 #include "sk.h"
+#include "status.h"
 #include "tc.h"
 #include "tlv.h"
 #include "tmv.h"
 #include "tsproc.h"
+#include "unicast_client.h"
+#include "unicast_service.h"
 #include "util.h"
 
 #define ALLOWED_LOST_RESPONSES 3
@@ -119,24 +122,27 @@ static void extract_address(struct ptp_message *m, struct PortAddress *paddr)
 	paddr->addressLength = len;
 }
 
-static int msg_current(struct ptp_message *m, struct timespec now)
+/*
+ * Returns the time at which an announce message leaves the foreign
+ * master time window of four announce intervals.
+ */
+static int64_t msg_expiry(struct ptp_message *m)
 {
-	int64_t t1, t2, tmo;
+	int64_t t1, tmo;
 
 	t1 = m->ts.host.tv_sec * NSEC2SEC + m->ts.host.tv_nsec;
-	t2 = now.tv_sec * NSEC2SEC + now.tv_nsec;
 
 	if (m->header.logMessageInterval < -63) {
 		tmo = 0;
 	} else if (m->header.logMessageInterval > 31) {
-		tmo = INT64_MAX;
+		return INT64_MAX;
 	} else if (m->header.logMessageInterval < 0) {
 		tmo = 4LL * NSEC2SEC / (1 << -m->header.logMessageInterval);
 	} else {
 		tmo = 4LL * (1 << m->header.logMessageInterval) * NSEC2SEC;
 	}
 
-	return t2 - t1 < tmo;
+	return t1 + tmo;
 }
 
 static int msg_source_equal(struct ptp_message *m1, struct foreign_clock *fc)
@@ -170,21 +176,23 @@ void fault_interval(struct port *port, enum fault_type ft,
 	i->val = port->flt_interval_pertype[ft].val;
 }
 
-int port_fault_fd(struct port *port)
-{
-	return port->fault_fd;
-}
-
 struct fdarray *port_fda(struct port *port)
 {
-	return &port->fda;
+	int i;
+
+	if (!port->rxt[0]) {
+		return &port->fda;
+	}
+	/* The clock waits on the receive threads instead of the sockets. */
+	port->rx_fda = port->fda;
+	for (i = 0; i < N_RX_THREADS; i++) {
+		port->rx_fda.fd[FD_EVENT + i] = rxthread_fd(port->rxt[i]);
+	}
+	return &port->rx_fda;
 }
 
-int set_tmo_log(int fd, unsigned int scale, int log_seconds)
+int set_tmo_log(struct wheel_timer *t, unsigned int scale, int log_seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 	uint64_t ns;
 	int i;
 
@@ -194,35 +202,31 @@ int set_tmo_log(int fd, unsigned int scale, int log_seconds)
 		for (i = 1, ns = scale * 500000000ULL; i < log_seconds; i++) {
 			ns >>= 1;
 		}
-		tmo.it_value.tv_nsec = ns;
-
-		while (tmo.it_value.tv_nsec >= NS_PER_SEC) {
-			tmo.it_value.tv_nsec -= NS_PER_SEC;
-			tmo.it_value.tv_sec++;
-		}
 
 	} else
-		tmo.it_value.tv_sec = scale * (1 << log_seconds);
+		ns = scale * (1ULL << log_seconds) * NS_PER_SEC;
 
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	if (ns) {
+		wheel_timer_set(t, ns);
+	} else {
+		wheel_timer_clear(t);
+	}
+	return 0;
 }
 
-int set_tmo_lin(int fd, int seconds)
+int set_tmo_lin(struct wheel_timer *t, int seconds)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-
-	tmo.it_value.tv_sec = seconds;
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	if (seconds) {
+		wheel_timer_set(t, seconds * NS_PER_SEC);
+	} else {
+		wheel_timer_clear(t);
+	}
+	return 0;
 }
 
-int set_tmo_random(int fd, int min, int span, int log_seconds)
+int set_tmo_random(struct wheel_timer *t, int min, int span, int log_seconds)
 {
 	uint64_t value_ns, min_ns, span_ns;
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
 
 	if (log_seconds >= 0) {
 		min_ns = min * NS_PER_SEC << log_seconds;
@@ -234,57 +238,86 @@ int set_tmo_random(int fd, int min, int span, int log_seconds)
 
 	value_ns = min_ns + (span_ns * (random() % (1 << 15) + 1) >> 15);
 
-	tmo.it_value.tv_sec = value_ns / NS_PER_SEC;
-	tmo.it_value.tv_nsec = value_ns % NS_PER_SEC;
-
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	if (value_ns) {
+		wheel_timer_set(t, value_ns);
+	} else {
+		wheel_timer_clear(t);
+	}
+	return 0;
 }
 
 int port_set_fault_timer_log(struct port *port,
 			     unsigned int scale, int log_seconds)
 {
-	return set_tmo_log(port->fault_fd, scale, log_seconds);
+	return set_tmo_log(port_tmo(port, FD_FAULT_TIMER), scale, log_seconds);
 }
 
 int port_set_fault_timer_lin(struct port *port, int seconds)
 {
-	return set_tmo_lin(port->fault_fd, seconds);
+	return set_tmo_lin(port_tmo(port, FD_FAULT_TIMER), seconds);
 }
 
 void fc_clear(struct foreign_clock *fc)
 {
-	struct ptp_message *m;
-
-	while (fc->n_messages) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
-		fc->n_messages--;
-		msg_put(m);
+	fc->head = 0;
+	fc->n_messages = 0;
+	if (fc->latest) {
+		msg_put(fc->latest);
+		fc->latest = NULL;
 	}
 }
 
 static void fc_prune(struct foreign_clock *fc)
 {
 	struct timespec now;
-	struct ptp_message *m;
+	int64_t t;
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
+	t = now.tv_sec * NSEC2SEC + now.tv_nsec;
 
-	while (fc->n_messages > FOREIGN_MASTER_THRESHOLD) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		TAILQ_REMOVE(&fc->messages, m, list);
+	while (fc->n_messages && fc->expiry[fc->head] <= t) {
+		fc->head = (fc->head + 1) % FOREIGN_MASTER_THRESHOLD;
 		fc->n_messages--;
-		msg_put(m);
 	}
+	/* Do not hold on to the pool for a master which went quiet. */
+	if (!fc->n_messages && fc->latest) {
+		msg_put(fc->latest);
+		fc->latest = NULL;
+	}
+}
 
-	while (!TAILQ_EMPTY(&fc->messages)) {
-		m = TAILQ_LAST(&fc->messages, messages);
-		if (msg_current(m, now))
-			break;
-		TAILQ_REMOVE(&fc->messages, m, list);
+/*
+ * Counts an announce message, letting the oldest one go when the ring
+ * is full, and keeps the message as the latest one.
+ */
+static void fc_add(struct foreign_clock *fc, struct ptp_message *m)
+{
+	if (fc->n_messages == FOREIGN_MASTER_THRESHOLD) {
+		fc->head = (fc->head + 1) % FOREIGN_MASTER_THRESHOLD;
 		fc->n_messages--;
-		msg_put(m);
 	}
+	fc->expiry[(fc->head + fc->n_messages) % FOREIGN_MASTER_THRESHOLD] =
+		msg_expiry(m);
+	fc->n_messages++;
+
+	msg_get(m);
+	if (fc->latest) {
+		msg_put(fc->latest);
+	}
+	fc->latest = m;
+}
+
+static struct fmh *fc_bucket(struct port *p, struct PortIdentity *pid)
+{
+	uint32_t h = 2166136261u;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(pid->clockIdentity.id); i++) {
+		h = (h ^ pid->clockIdentity.id[i]) * 16777619u;
+	}
+	h = (h ^ pid->portNumber) * 16777619u;
+
+	return &p->foreign_hash[h % FOREIGN_HASH_SIZE];
 }
 
 static int delay_req_current(struct ptp_message *m, struct timespec now)
@@ -326,11 +359,11 @@ void ts_add(tmv_t *ts, Integer64 correction)
  */
 static int add_foreign_master(struct port *p, struct ptp_message *m)
 {
+	struct fmh *bucket = fc_bucket(p, &m->header.sourcePortIdentity);
 	struct foreign_clock *fc;
-	struct ptp_message *tmp;
 	int broke_threshold = 0, diff = 0;
 
-	LIST_FOREACH(fc, &p->foreign_masters, list) {
+	LIST_FOREACH(fc, bucket, hash) {
 		if (msg_source_equal(m, fc)) {
 			break;
 		}
@@ -345,8 +378,8 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 			return 0;
 		}
 		memset(fc, 0, sizeof(*fc));
-		TAILQ_INIT(&fc->messages);
 		LIST_INSERT_HEAD(&p->foreign_masters, fc, list);
+		LIST_INSERT_HEAD(bucket, fc, hash);
 		fc->port = p;
 		fc->dataset.sender = m->header.sourcePortIdentity;
 		/* We do not count this first message, see 9.5.3(b) */
@@ -362,19 +395,16 @@ static int add_foreign_master(struct port *p, struct ptp_message *m)
 	}
 
 	/*
-	 * Okay, go ahead and add this announcement.
+	 * Test if this announcement contains changed information.
 	 */
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
+	if (fc->n_messages) {
+		diff = announce_compare(m, fc->latest);
+	}
 
 	/*
-	 * Test if this announcement contains changed information.
+	 * Okay, go ahead and add this announcement.
 	 */
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
-		diff = announce_compare(m, tmp);
-	}
+	fc_add(fc, m);
 
 	return broke_threshold || diff;
 }
@@ -423,8 +453,8 @@ static int net_sync_resp_append(struct port *p, struct ptp_message *m)
 		paddr->networkProtocol = transport_type(best->trp);
 		paddr->addressLength =
 			transport_protocol_addr(best->trp, paddr->address);
-		if (best->best) {
-			tmp = TAILQ_FIRST(&best->best->messages);
+		if (best->best && best->best->latest) {
+			tmp = best->best->latest;
 			extract_address(tmp, paddr);
 		}
 	} else {
@@ -483,6 +513,7 @@ static void free_foreign_masters(struct port *p)
 	struct foreign_clock *fc;
 	while ((fc = LIST_FIRST(&p->foreign_masters)) != NULL) {
 		LIST_REMOVE(fc, list);
+		LIST_REMOVE(fc, hash);
 		fc_clear(fc);
 		free(fc);
 	}
@@ -649,24 +680,20 @@ not_capable:
 	return 0;
 }
 
-int port_clr_tmo(int fd)
+int port_clr_tmo(struct wheel_timer *t)
 {
-	struct itimerspec tmo = {
-		{0, 0}, {0, 0}
-	};
-	return timerfd_settime(fd, 0, &tmo, NULL);
+	wheel_timer_clear(t);
+	return 0;
 }
 
+/*
+ * Checks that depend only on the configuration of the port, and so may
+ * be made from the receive threads. The clock's identity and domain are
+ * taken from the copies in the port, which are set before the threads
+ * start and never change. See also bc_process().
+ */
 static int port_ignore(struct port *p, struct ptp_message *m)
 {
-	struct ClockIdentity c1, c2;
-
-	if (incapable_ignore(p, m)) {
-		return 1;
-	}
-	if (path_trace_ignore(p, m)) {
-		return 1;
-	}
 	if (p->match_transport_specific &&
 	    msg_transport_specific(m) != p->transportSpecific) {
 		return 1;
@@ -674,14 +701,12 @@ static int port_ignore(struct port *p, struct ptp_message *m)
 	if (pid_eq(&m->header.sourcePortIdentity, &p->portIdentity)) {
 		return 1;
 	}
-	if (m->header.domainNumber != clock_domain_number(p->clock)) {
+	if (m->header.domainNumber != p->rx_domain) {
 		return 1;
 	}
-
-	c1 = clock_identity(p->clock);
-	c2 = m->header.sourcePortIdentity.clockIdentity;
-
-	if (0 == memcmp(&c1, &c2, sizeof(c1))) {
+	if (0 == memcmp(&m->header.sourcePortIdentity.clockIdentity,
+			&p->portIdentity.clockIdentity,
+			sizeof(struct ClockIdentity))) {
 		return 1;
 	}
 	return 0;
@@ -754,6 +779,7 @@ static int port_management_fill_response(struct port *target,
 	struct mgmt_clock_description *cd;
 	struct management_tlv_datum *mtd;
 	struct clock_description *desc;
+	struct unicast_master_table_np *umt;
 	struct port_properties_np *ppn;
 	struct management_tlv *tlv;
 	struct port_ds_np *pdsnp;
@@ -910,6 +936,17 @@ static int port_management_fill_response(struct port *target,
 		ptp_text_set(&ppn->interface, target->iface->ts_label);
 		datalen = sizeof(*ppn) + ppn->interface.length;
 		break;
+	case TLV_UNICAST_MASTER_TABLE:
+		if (!target->unicast_client) {
+			tlv_extra_recycle(extra);
+			return 0;
+		}
+		umt = (struct unicast_master_table_np *) tlv->data;
+		/* Leave room for the pad byte. */
+		datalen = (uint8_t *) &rsp->tail_room - tlv->data - 1;
+		datalen = unicast_client_table(target->unicast_client, umt,
+					       datalen);
+		break;
 	default:
 		/* The caller should *not* respond to this message. */
 		return 0;
@@ -1027,7 +1064,7 @@ static void port_nrate_initialize(struct port *p)
 
 int port_set_announce_tmo(struct port *p)
 {
-	return set_tmo_random(p->fda.fd[FD_ANNOUNCE_TIMER],
+	return set_tmo_random(port_tmo(p, FD_ANNOUNCE_TIMER),
 			      p->announceReceiptTimeout,
 			      p->announce_span, p->logAnnounceInterval);
 }
@@ -1035,34 +1072,34 @@ int port_set_announce_tmo(struct port *p)
 int port_set_delay_tmo(struct port *p)
 {
 	if (p->delayMechanism == DM_P2P) {
-		return set_tmo_log(p->fda.fd[FD_DELAY_TIMER], 1,
+		return set_tmo_log(port_tmo(p, FD_DELAY_TIMER), 1,
 			       p->logMinPdelayReqInterval);
 	} else {
-		return set_tmo_random(p->fda.fd[FD_DELAY_TIMER], 0, 2,
+		return set_tmo_random(port_tmo(p, FD_DELAY_TIMER), 0, 2,
 				p->logMinDelayReqInterval);
 	}
 }
 
 static int port_set_manno_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, p->logAnnounceInterval);
+	return set_tmo_log(port_tmo(p, FD_MANNO_TIMER), 1, p->logAnnounceInterval);
 }
 
 int port_set_qualification_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_QUALIFICATION_TIMER],
+	return set_tmo_log(port_tmo(p, FD_QUALIFICATION_TIMER),
 		       1+clock_steps_removed(p->clock), p->logAnnounceInterval);
 }
 
 static int port_set_sync_rx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_RX_TIMER],
+	return set_tmo_log(port_tmo(p, FD_SYNC_RX_TIMER),
 			   p->syncReceiptTimeout, p->logSyncInterval);
 }
 
 static int port_set_sync_tx_tmo(struct port *p)
 {
-	return set_tmo_log(p->fda.fd[FD_SYNC_TX_TIMER], 1, p->logSyncInterval);
+	return set_tmo_log(port_tmo(p, FD_SYNC_TX_TIMER), 1, p->logSyncInterval);
 }
 
 void port_show_transition(struct port *p, enum port_state next,
@@ -1085,13 +1122,29 @@ static void port_slave_priority_warning(struct port *p)
 	pr_warning("port %hu: defaultDS.priority1 probably misconfigured", n);
 }
 
+static void port_trace(struct port *p, enum trace_type type,
+		       tmv_t t1, tmv_t t2, tmv_t t3, tmv_t t4, tmv_t correction)
+{
+	struct trace_record rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = type;
+	rec.port = portnum(p);
+	rec.t1 = tmv_to_nanoseconds(t1);
+	rec.t2 = tmv_to_nanoseconds(t2);
+	rec.t3 = tmv_to_nanoseconds(t3);
+	rec.t4 = tmv_to_nanoseconds(t4);
+	rec.correction = tmv_to_nanoseconds(correction);
+	clock_trace(p->clock, &rec);
+}
+
 static void port_synchronize(struct port *p,
 			     tmv_t ingress_ts,
 			     struct timestamp origin_ts,
 			     Integer64 correction1, Integer64 correction2)
 {
 	enum servo_state state;
-	tmv_t t1, t1c, t2, c1, c2;
+	tmv_t t1, t2, c1, c2;
 
 	port_set_sync_rx_tmo(p);
 
@@ -1099,9 +1152,8 @@ static void port_synchronize(struct port *p,
 	t2 = ingress_ts;
 	c1 = correction_to_tmv(correction1);
 	c2 = correction_to_tmv(correction2);
-	t1c = tmv_add(t1, tmv_add(c1, c2));
 
-	state = clock_synchronize(p->clock, t2, t1c);
+	state = clock_synchronize(p->clock, t2, t1, tmv_add(c1, c2));
 	switch (state) {
 	case SERVO_UNLOCKED:
 		port_dispatch(p, EV_SYNCHRONIZATION_FAULT, 0);
@@ -1257,9 +1309,84 @@ out:
 	return -1;
 }
 
+static struct ptp_message *txts_pop(struct port *p)
+{
+	struct ptp_message *msg;
+
+	msg = p->txts_pending[p->txts_head].msg;
+	p->txts_head = (p->txts_head + 1) % p->txts_size;
+	p->txts_count--;
+	return msg;
+}
+
+/*
+ * Doubles the size of the pending queue. A unicast master may have a
+ * Sync in flight for each of its clients at once.
+ */
+static int txts_grow(struct port *p)
+{
+	unsigned int size = p->txts_size ? 2 * p->txts_size : TXTS_PENDING_MIN;
+	struct txts_pending *tp;
+
+	tp = realloc(p->txts_pending, size * sizeof(*tp));
+	if (!tp) {
+		return -1;
+	}
+	/* Unwrap the entries which ran past the end of the old ring. */
+	if (p->txts_head + p->txts_count > p->txts_size) {
+		memcpy(tp + p->txts_size, tp,
+		       (p->txts_head + p->txts_count - p->txts_size) *
+		       sizeof(*tp));
+	}
+	p->txts_pending = tp;
+	p->txts_size = size;
+	return 0;
+}
+
+static void txts_push(struct port *p, struct ptp_message *msg)
+{
+	struct txts_pending *tp;
+
+	if (p->txts_count == p->txts_size && txts_grow(p)) {
+		if (!p->txts_count) {
+			pr_err("port %hu: no memory for pending tx timestamps",
+			       portnum(p));
+			return;
+		}
+		pr_err("port %hu: dropping oldest pending tx timestamp",
+		       portnum(p));
+		msg_put(txts_pop(p));
+	}
+	tp = &p->txts_pending[(p->txts_head + p->txts_count) % p->txts_size];
+	msg_get(msg);
+	tp->msg = msg;
+	tp->key = p->txts_key++;
+	p->txts_count++;
+}
+
+static void txts_flush(struct port *p)
+{
+	while (p->txts_count) {
+		msg_put(txts_pop(p));
+	}
+	p->txts_head = 0;
+	/* The OPT_ID counter restarts along with the socket. */
+	p->txts_key = 0;
+}
+
+static void bc_batch_flush(struct port *p)
+{
+	while (p->rx_left_n) {
+		msg_put(p->rx_left[p->rx_left_head++]);
+		p->rx_left_n--;
+	}
+	p->rx_pending = 0;
+}
+
 int port_delay_request(struct port *p)
 {
 	struct ptp_message *msg;
+	int event;
 
 	/* Time to send a new request, forget current pdelay resp and fup */
 	if (p->peer_delay_resp) {
@@ -1292,17 +1419,26 @@ int port_delay_request(struct port *p)
 	msg->header.control            = CTL_DELAY_REQ;
 	msg->header.logMessageInterval = 0x7f;
 
-	if (p->hybrid_e2e) {
-		struct ptp_message *dst = TAILQ_FIRST(&p->best->messages);
+	if (p->hybrid_e2e || p->unicast_client) {
+		struct ptp_message *dst = p->best ? p->best->latest : NULL;
+		if (!dst) {
+			/* The master has gone quiet, there is nobody to ask. */
+			msg_put(msg);
+			return 0;
+		}
 		msg->address = dst->address;
 		msg->header.flagField[0] |= UNICAST;
 	}
 
-	if (port_prepare_and_send(p, msg, TRANS_EVENT)) {
+	event = p->txts_async ? TRANS_DEFER_EVENT : TRANS_EVENT;
+
+	if (port_prepare_and_send(p, msg, event)) {
 		pr_err("port %hu: send delay request failed", portnum(p));
 		goto out;
 	}
-	if (msg_sots_missing(msg)) {
+	if (p->txts_async) {
+		txts_push(p, msg);
+	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted delay request");
 		goto out;
 	}
@@ -1315,7 +1451,7 @@ out:
 	return -1;
 }
 
-static int port_tx_announce(struct port *p)
+int port_tx_announce(struct port *p, struct address *dst)
 {
 	struct timePropertiesDS *tp = clock_time_properties(p->clock);
 	struct parent_ds *dad = clock_parent_ds(p->clock);
@@ -1351,6 +1487,10 @@ static int port_tx_announce(struct port *p)
 	msg->announce.stepsRemoved            = clock_steps_removed(p->clock);
 	msg->announce.timeSource              = tp->timeSource;
 
+	if (dst) {
+		msg->address = *dst;
+		msg->header.flagField[0] |= UNICAST;
+	}
 	if (p->path_trace_enabled && path_trace_append(p, msg, dad)) {
 		pr_err("port %hu: append path trace failed", portnum(p));
 	}
@@ -1363,9 +1503,51 @@ static int port_tx_announce(struct port *p)
 	return err;
 }
 
-static int port_tx_sync(struct port *p, struct address *dst)
+static int port_tx_fup(struct port *p, struct ptp_message *msg)
 {
-	struct ptp_message *msg, *fup;
+	struct ptp_message *fup;
+	int err;
+
+	fup = msg_allocate();
+	if (!fup) {
+		return -1;
+	}
+
+	fup->hwts.type = p->timestamping;
+
+	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
+	fup->header.ver                = PTP_VERSION;
+	fup->header.messageLength      = sizeof(struct follow_up_msg);
+	fup->header.domainNumber       = clock_domain_number(p->clock);
+	fup->header.sourcePortIdentity = p->portIdentity;
+	fup->header.sequenceId         = ntohs(msg->header.sequenceId);
+	fup->header.control            = CTL_FOLLOW_UP;
+	fup->header.logMessageInterval = p->logSyncInterval;
+
+	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
+
+	if (msg->header.flagField[0] & UNICAST) {
+		fup->address = msg->address;
+		fup->header.flagField[0] |= UNICAST;
+	}
+	if (p->follow_up_info && follow_up_info_append(p, fup)) {
+		pr_err("port %hu: append fup info failed", portnum(p));
+		err = -1;
+		goto out;
+	}
+
+	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send follow up failed", portnum(p));
+	}
+out:
+	msg_put(fup);
+	return err;
+}
+
+int port_tx_sync(struct port *p, struct address *dst)
+{
+	struct ptp_message *msg;
 	int err, event;
 
 	switch (p->timestamping) {
@@ -1394,11 +1576,6 @@ static int port_tx_sync(struct port *p, struct address *dst)
 	if (!msg) {
 		return -1;
 	}
-	fup = msg_allocate();
-	if (!fup) {
-		msg_put(msg);
-		return -1;
-	}
 
 	msg->hwts.type = p->timestamping;
 
@@ -1419,6 +1596,9 @@ static int port_tx_sync(struct port *p, struct address *dst)
 		msg->address = *dst;
 		msg->header.flagField[0] |= UNICAST;
 	}
+	if (p->txts_async && event == TRANS_EVENT) {
+		event = TRANS_DEFER_EVENT;
+	}
 	err = port_prepare_and_send(p, msg, event);
 	if (err) {
 		pr_err("port %hu: send sync failed", portnum(p));
@@ -1426,6 +1606,10 @@ static int port_tx_sync(struct port *p, struct address *dst)
 	}
 	if (p->timestamping == TS_ONESTEP || p->timestamping == TS_P2P1STEP) {
 		goto out;
+	} else if (event == TRANS_DEFER_EVENT) {
+		/* The follow up goes out once the time stamp arrives. */
+		txts_push(p, msg);
+		goto out;
 	} else if (msg_sots_missing(msg)) {
 		pr_err("missing timestamp on transmitted sync");
 		err = -1;
@@ -1435,36 +1619,9 @@ static int port_tx_sync(struct port *p, struct address *dst)
 	/*
 	 * Send the follow up message right away.
 	 */
-	fup->hwts.type = p->timestamping;
-
-	fup->header.tsmt               = FOLLOW_UP | p->transportSpecific;
-	fup->header.ver                = PTP_VERSION;
-	fup->header.messageLength      = sizeof(struct follow_up_msg);
-	fup->header.domainNumber       = clock_domain_number(p->clock);
-	fup->header.sourcePortIdentity = p->portIdentity;
-	fup->header.sequenceId         = p->seqnum.sync - 1;
-	fup->header.control            = CTL_FOLLOW_UP;
-	fup->header.logMessageInterval = p->logSyncInterval;
-
-	fup->follow_up.preciseOriginTimestamp = tmv_to_Timestamp(msg->hwts.ts);
-
-	if (dst) {
-		fup->address = *dst;
-		fup->header.flagField[0] |= UNICAST;
-	}
-	if (p->follow_up_info && follow_up_info_append(p, fup)) {
-		pr_err("port %hu: append fup info failed", portnum(p));
-		err = -1;
-		goto out;
-	}
-
-	err = port_prepare_and_send(p, fup, TRANS_GENERAL);
-	if (err) {
-		pr_err("port %hu: send follow up failed", portnum(p));
-	}
+	err = port_tx_fup(p, msg);
 out:
 	msg_put(msg);
-	msg_put(fup);
 	return err;
 }
 
@@ -1531,32 +1688,152 @@ static void port_clear_fda(struct port *p, int count)
 		p->fda.fd[i] = -1;
 }
 
+/*
+ * Decodes and checks a received message. Returns non-zero if the message
+ * is to be dropped. This is safe to call from the receive threads.
+ */
+static int port_rx_validate(struct port *p, struct ptp_message *msg, int cnt)
+{
+	int err;
+
+	/* Only decode the body of the messages that are not dropped. */
+	err = msg_post_recv_header(msg, cnt);
+	if (!err) {
+		if (port_ignore(p, msg)) {
+			return -1;
+		}
+		err = msg_post_recv_body(msg);
+	}
+	if (err) {
+		switch (err) {
+		case -EBADMSG:
+			pr_err("port %hu: bad message", portnum(p));
+			break;
+		case -EPROTO:
+			pr_debug("port %hu: ignoring message", portnum(p));
+			break;
+		}
+		return -1;
+	}
+	if (msg_sots_missing(msg) &&
+	    !(p->timestamping == TS_P2P1STEP && msg_type(msg) == PDELAY_REQ)) {
+		pr_err("port %hu: received %s without timestamp",
+		       portnum(p), msg_type_string(msg_type(msg)));
+		return -1;
+	}
+	if (msg_sots_valid(msg)) {
+		ts_add(&msg->hwts.ts, -p->rx_timestamp_offset);
+	}
+	return 0;
+}
+
+static int port_rx_thread_recv(void *ctx, int fd, struct ptp_message **msg,
+			       int n)
+{
+	int cnt[SK_RX_BATCH_MAX], i, num, valid = 0;
+	struct port *p = ctx;
+
+	if (n > p->rx_batch_size) {
+		n = p->rx_batch_size;
+	}
+	for (num = 0; num < n; num++) {
+		msg[num] = msg_allocate();
+		if (!msg[num]) {
+			break;
+		}
+		msg[num]->hwts.type = p->timestamping;
+	}
+	if (!num) {
+		pr_err("port %hu: rx thread: out of messages", portnum(p));
+		return -1;
+	}
+
+	n = transport_recv_batch(p->trp, fd, msg, cnt, num);
+	if (n <= 0) {
+		pr_err("port %hu: recv message failed", portnum(p));
+		for (i = 0; i < num; i++) {
+			msg_put(msg[i]);
+		}
+		return -1;
+	}
+	for (i = 0; i < num; i++) {
+		if (i >= n || cnt[i] <= 0 || port_rx_validate(p, msg[i], cnt[i])) {
+			msg_put(msg[i]);
+			continue;
+		}
+		msg[valid++] = msg[i];
+	}
+	return valid;
+}
+
+static void port_rx_threads_stop(struct port *p)
+{
+	int i;
+
+	for (i = 0; i < N_RX_THREADS; i++) {
+		if (p->rxt[i]) {
+			p->rx_thread_drops += rxthread_drops(p->rxt[i]);
+			rxthread_destroy(p->rxt[i]);
+			p->rxt[i] = NULL;
+		}
+	}
+}
+
+static int port_rx_threads_start(struct port *p)
+{
+	int i;
+
+	if (!p->rx_thread) {
+		return 0;
+	}
+	for (i = 0; i < N_RX_THREADS; i++) {
+		p->rxt[i] = rxthread_create(p->fda.fd[FD_EVENT + i],
+					    p->rx_thread_cpu,
+					    port_rx_thread_recv, p);
+		if (!p->rxt[i]) {
+			port_rx_threads_stop(p);
+			return -1;
+		}
+	}
+	return 0;
+}
+
 void port_disable(struct port *p)
 {
 	int i;
 
 	tc_flush(p);
+	txts_flush(p);
+	bc_batch_flush(p);
+	if (p->unicast_service) {
+		unicast_service_clear(p->unicast_service);
+	}
+	if (p->unicast_client) {
+		unicast_client_disable(p->unicast_client);
+	}
 	flush_last_sync(p);
 	flush_delay_req(p);
 	flush_peer_delay(p);
 
 	p->best = NULL;
 	free_foreign_masters(p);
+	clock_fda_closing(p->clock, p);
+	port_rx_threads_stop(p);
 	transport_close(p->trp, &p->fda);
 
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		close(p->fda.fd[FD_FIRST_TIMER + i]);
+	/* The fault timer stays, it brings the port back up. */
+	for (i = FD_FIRST_TIMER; i < FD_FAULT_TIMER; i++) {
+		port_clr_tmo(port_tmo(p, i));
 	}
 
 	/* Keep rtnl socket to get link status info. */
 	port_clear_fda(p, FD_RTNL);
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 }
 
 int port_initialize(struct port *p)
 {
 	struct config *cfg = clock_config(p->clock);
-	int fd[N_TIMER_FDS], i;
 
 	p->multiple_seq_pdr_count  = 0;
 	p->multiple_pdr_detected   = 0;
@@ -1576,26 +1853,15 @@ int port_initialize(struct port *p)
 	p->neighborPropDelayThresh = config_get_int(cfg, p->name, "neighborPropDelayThresh");
 	p->min_neighbor_prop_delay = config_get_int(cfg, p->name, "min_neighbor_prop_delay");
 
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = -1;
-	}
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		fd[i] = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (fd[i] < 0) {
-			pr_err("timerfd_create: %s", strerror(errno));
-			goto no_timers;
-		}
-	}
 	if (transport_open(p->trp, p->iface, &p->fda, p->timestamping))
-		goto no_tropen;
-
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		p->fda.fd[FD_FIRST_TIMER + i] = fd[i];
-	}
+		return -1;
 
 	if (port_set_announce_tmo(p))
 		goto no_tmo;
 
+	if (port_rx_threads_start(p))
+		goto no_tmo;
+
 	/* No need to open rtnl socket on UDS port. */
 	if (transport_type(p->trp) != TRANS_UDS) {
 		if (p->fda.fd[FD_RTNL] == -1)
@@ -1606,17 +1872,16 @@ int port_initialize(struct port *p)
 
 	port_nrate_initialize(p);
 
-	clock_fda_changed(p->clock);
+	if (p->unicast_client) {
+		unicast_client_enable(p->unicast_client);
+	}
+
+	clock_fda_changed(p->clock, p);
 	return 0;
 
 no_tmo:
+	port_clr_tmo(port_tmo(p, FD_ANNOUNCE_TIMER));
 	transport_close(p->trp, &p->fda);
-no_tropen:
-no_timers:
-	for (i = 0; i < N_TIMER_FDS; i++) {
-		if (fd[i] >= 0)
-			close(fd[i]);
-	}
 	return -1;
 }
 
@@ -1627,12 +1892,17 @@ static int port_renew_transport(struct port *p)
 	if (!port_is_enabled(p)) {
 		return 0;
 	}
+	clock_fda_closing(p->clock, p);
+	port_rx_threads_stop(p);
 	transport_close(p->trp, &p->fda);
-	port_clear_fda(p, FD_FIRST_TIMER);
+	port_clear_fda(p, FD_RTNL);
 	res = transport_open(p->trp, p->iface, &p->fda, p->timestamping);
+	if (!res) {
+		res = port_rx_threads_start(p);
+	}
 	/* Need to call clock_fda_changed even if transport_open failed in
 	 * order to update clock to the now closed descriptors. */
-	clock_fda_changed(p->clock);
+	clock_fda_changed(p->clock, p);
 	return res;
 }
 
@@ -1642,8 +1912,8 @@ static int port_renew_transport(struct port *p)
 static int update_current_master(struct port *p, struct ptp_message *m)
 {
 	struct foreign_clock *fc = p->best;
-	struct ptp_message *tmp;
 	struct parent_ds *dad;
+	int diff = 0;
 	struct path_trace_tlv *ptt;
 	struct timePropertiesDS tds;
 
@@ -1664,14 +1934,11 @@ static int update_current_master(struct port *p, struct ptp_message *m)
 	}
 	port_set_announce_tmo(p);
 	fc_prune(fc);
-	msg_get(m);
-	fc->n_messages++;
-	TAILQ_INSERT_HEAD(&fc->messages, m, list);
-	if (fc->n_messages > 1) {
-		tmp = TAILQ_NEXT(m, list);
-		return announce_compare(m, tmp);
+	if (fc->n_messages) {
+		diff = announce_compare(m, fc->latest);
 	}
-	return 0;
+	fc_add(fc, m);
+	return diff;
 }
 
 struct dataset *port_best_foreign(struct port *port)
@@ -1679,6 +1946,11 @@ struct dataset *port_best_foreign(struct port *port)
 	return port->best ? &port->best->dataset : NULL;
 }
 
+struct foreign_clock *port_erbest(struct port *port)
+{
+	return port->best;
+}
+
 /* message processing routines */
 
 /*
@@ -1715,10 +1987,55 @@ int process_announce(struct port *p, struct ptp_message *m)
 	return result;
 }
 
+/*
+ * Sends the queued general messages using as few system calls as the
+ * transport allows.
+ */
+static int port_txq_flush(struct port *p)
+{
+	int cnt, err = 0, i;
+
+	if (!p->txq_count) {
+		return 0;
+	}
+	cnt = transport_send_batch(p->trp, &p->fda, p->txq, p->txq_count);
+	if (cnt < p->txq_count) {
+		pr_err("port %hu: sent %d of %d queued messages",
+		       portnum(p), cnt < 0 ? 0 : cnt, p->txq_count);
+		err = -1;
+	}
+	for (i = 0; i < p->txq_count; i++) {
+		msg_put(p->txq[i]);
+	}
+	p->txq_count = 0;
+	return err;
+}
+
+/*
+ * Like port_prepare_and_send(TRANS_GENERAL), but defers the transmission
+ * until the end of the current receive batch.
+ */
+static int port_txq_send(struct port *p, struct ptp_message *msg)
+{
+	if (!p->txq_active) {
+		return port_prepare_and_send(p, msg, TRANS_GENERAL);
+	}
+	if (p->txq_count == SK_TX_BATCH_MAX && port_txq_flush(p)) {
+		return -1;
+	}
+	if (msg_pre_send(msg)) {
+		return -1;
+	}
+	msg_get(msg);
+	p->txq[p->txq_count++] = msg;
+	return 0;
+}
+
 static int process_delay_req(struct port *p, struct ptp_message *m)
 {
 	int err, nsm, saved_seqnum_sync;
 	struct ptp_message *msg;
+	Integer8 log_period;
 
 	nsm = port_nsm_reply(p, m);
 
@@ -1756,13 +2073,23 @@ static int process_delay_req(struct port *p, struct ptp_message *m)
 		msg->address = m->address;
 		msg->header.flagField[0] |= UNICAST;
 		msg->header.logMessageInterval = 0x7f;
+	} else if (p->unicast_service && m->header.flagField[0] & UNICAST &&
+		   unicast_service_delay_resp(p->unicast_service, m,
+					      &log_period)) {
+		msg->address = m->address;
+		msg->header.flagField[0] |= UNICAST;
+		msg->header.logMessageInterval = log_period;
 	}
 	if (nsm && net_sync_resp_append(p, msg)) {
 		pr_err("port %hu: append NSM failed", portnum(p));
 		err = -1;
 		goto out;
 	}
-	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
+	if (nsm) {
+		err = port_prepare_and_send(p, msg, TRANS_GENERAL);
+	} else {
+		err = port_txq_send(p, msg);
+	}
 	if (err) {
 		pr_err("port %hu: send delay response failed", portnum(p));
 		goto out;
@@ -1804,6 +2131,10 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	if (!req) {
 		return;
 	}
+	if (!msg_sots_valid(req)) {
+		/* The transmit time stamp is still outstanding. */
+		return;
+	}
 
 	c3 = correction_to_tmv(m->header.correction);
 	t3 = req->hwts.ts;
@@ -1811,6 +2142,7 @@ void process_delay_resp(struct port *p, struct ptp_message *m)
 	t4c = tmv_sub(t4, c3);
 
 	clock_path_delay(p->clock, t3, t4c);
+	port_trace(p, TRACE_DELAY, tmv_zero(), tmv_zero(), t3, t4, c3);
 
 	TAILQ_REMOVE(&p->delay_req, req, list);
 	msg_put(req);
@@ -2061,6 +2393,7 @@ calc:
 	if (p->state == PS_UNCALIBRATED || p->state == PS_SLAVE) {
 		clock_peer_delay(p->clock, p->peer_delay, t1, t2,
 				 p->nrate.ratio);
+		port_trace(p, TRACE_PDELAY, t1, t2, t3, t4, tmv_add(c1, c2));
 	}
 
 	msg_put(p->peer_delay_req);
@@ -2177,19 +2510,44 @@ void process_sync(struct port *p, struct ptp_message *m)
 
 void port_close(struct port *p)
 {
+	int i;
+
 	if (port_is_enabled(p)) {
 		port_disable(p);
 	}
 
+	if (p->rx_batch_calls) {
+		pr_info("port %hu: received %" PRIu64 " messages in %" PRIu64
+			" batches, %.2f on average", portnum(p),
+			p->rx_batch_msgs, p->rx_batch_calls,
+			(double) p->rx_batch_msgs / p->rx_batch_calls);
+	}
+	if (p->rx_thread_drops) {
+		pr_info("port %hu: receive threads dropped %" PRIu64
+			" messages", portnum(p), p->rx_thread_drops);
+	}
+	if (p->tc_txts_timeouts || p->tc_txts_failures) {
+		pr_info("port %hu: forwarding lost %" PRIu64 " tx time stamps "
+			"to timeouts and %" PRIu64 " to errors", portnum(p),
+			p->tc_txts_timeouts, p->tc_txts_failures);
+	}
+
 	if (p->fda.fd[FD_RTNL] >= 0) {
 		rtnl_close(p->fda.fd[FD_RTNL]);
 	}
 
+	if (p->unicast_service) {
+		unicast_service_destroy(p->unicast_service);
+	}
+	if (p->unicast_client) {
+		unicast_client_destroy(p->unicast_client);
+	}
 	transport_destroy(p->trp);
 	tsproc_destroy(p->tsproc);
-	if (p->fault_fd >= 0) {
-		close(p->fault_fd);
+	for (i = FD_FIRST_TIMER; i < N_PORT_EVENTS; i++) {
+		port_clr_tmo(port_tmo(p, i));
 	}
+	free(p->txts_pending);
 	free(p);
 }
 
@@ -2197,7 +2555,6 @@ struct foreign_clock *port_compute_best(struct port *p)
 {
 	int (*dscmp)(struct dataset *a, struct dataset *b);
 	struct foreign_clock *fc;
-	struct ptp_message *tmp;
 
 	dscmp = clock_dscmp(p->clock);
 	p->best = NULL;
@@ -2206,11 +2563,10 @@ struct foreign_clock *port_compute_best(struct port *p)
 		return p->best;
 
 	LIST_FOREACH(fc, &p->foreign_masters, list) {
-		tmp = TAILQ_FIRST(&fc->messages);
-		if (!tmp)
+		if (!fc->latest)
 			continue;
 
-		announce_to_dataset(tmp, p, &fc->dataset);
+		announce_to_dataset(fc->latest, p, &fc->dataset);
 
 		fc_prune(fc);
 
@@ -2230,12 +2586,12 @@ struct foreign_clock *port_compute_best(struct port *p)
 
 static void port_e2e_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_DELAY_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_RX_TIMER));
+	port_clr_tmo(port_tmo(p, FD_DELAY_TIMER));
+	port_clr_tmo(port_tmo(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_tmo(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_TX_TIMER));
 
 	switch (next) {
 	case PS_INITIALIZING:
@@ -2252,7 +2608,7 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 		break;
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
-		set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+		set_tmo_log(port_tmo(p, FD_MANNO_TIMER), 1, -10); /*~1ms*/
 		port_set_sync_tx_tmo(p);
 		break;
 	case PS_PASSIVE:
@@ -2271,12 +2627,12 @@ static void port_e2e_transition(struct port *p, enum port_state next)
 
 static void port_p2p_transition(struct port *p, enum port_state next)
 {
-	port_clr_tmo(p->fda.fd[FD_ANNOUNCE_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_RX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_ANNOUNCE_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_RX_TIMER));
 	/* Leave FD_DELAY_TIMER running. */
-	port_clr_tmo(p->fda.fd[FD_QUALIFICATION_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_MANNO_TIMER]);
-	port_clr_tmo(p->fda.fd[FD_SYNC_TX_TIMER]);
+	port_clr_tmo(port_tmo(p, FD_QUALIFICATION_TIMER));
+	port_clr_tmo(port_tmo(p, FD_MANNO_TIMER));
+	port_clr_tmo(port_tmo(p, FD_SYNC_TX_TIMER));
 
 	switch (next) {
 	case PS_INITIALIZING:
@@ -2294,7 +2650,7 @@ static void port_p2p_transition(struct port *p, enum port_state next)
 		break;
 	case PS_MASTER:
 	case PS_GRAND_MASTER:
-		set_tmo_log(p->fda.fd[FD_MANNO_TIMER], 1, -10); /*~1ms*/
+		set_tmo_log(port_tmo(p, FD_MANNO_TIMER), 1, -10); /*~1ms*/
 		port_set_sync_tx_tmo(p);
 		break;
 	case PS_PASSIVE:
@@ -2317,13 +2673,21 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff)
 
 static void bc_dispatch(struct port *p, enum fsm_event event, int mdiff)
 {
+	int changed;
+
 	if (clock_slave_only(p->clock)) {
 		if (event == EV_RS_MASTER || event == EV_RS_GRAND_MASTER) {
 			port_slave_priority_warning(p);
 		}
 	}
 
-	if (!port_state_update(p, event, mdiff)) {
+	changed = port_state_update(p, event, mdiff);
+
+	/* The best master may change without a change of the state. */
+	if (p->unicast_client) {
+		unicast_client_state_changed(p->unicast_client);
+	}
+	if (!changed) {
 		return;
 	}
 
@@ -2333,6 +2697,12 @@ static void bc_dispatch(struct port *p, enum fsm_event event, int mdiff)
 		port_e2e_transition(p, p->state);
 	}
 
+	/* Only a master grants unicast transmission. */
+	if (p->unicast_service && p->state != PS_MASTER &&
+	    p->state != PS_GRAND_MASTER) {
+		unicast_service_clear(p->unicast_service);
+	}
+
 	if (p->jbod && p->state == PS_UNCALIBRATED) {
 		if (clock_switch_phc(p->clock, p->phc_index)) {
 			p->last_fault_type = FT_SWITCH_PHC;
@@ -2404,11 +2774,173 @@ enum fsm_event port_event(struct port *p, int fd_index)
 	return p->event(p, fd_index);
 }
 
-static enum fsm_event bc_event(struct port *p, int fd_index)
+int port_txts_async(struct port *p)
+{
+	return p->txts_async;
+}
+
+int port_rx_pending(struct port *p)
+{
+	return p->rx_pending;
+}
+
+static int port_txts_complete(struct port *p, struct ptp_message *msg)
+{
+	ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
+
+	switch (msg_type(msg)) {
+	case SYNC:
+		return port_tx_fup(p, msg);
+	case DELAY_REQ:
+		/* The request waits in the delay_req list for its response. */
+		break;
+	}
+	return 0;
+}
+
+enum fsm_event port_txts_event(struct port *p)
+{
+	struct txts_pending *tp = NULL;
+	struct ptp_message *msg;
+	struct hw_timestamp hwts;
+	int cnt, err = 0;
+	uint32_t key;
+
+	memset(&hwts, 0, sizeof(hwts));
+	hwts.type = p->timestamping;
+
+	while ((cnt = transport_txts_async(p->trp, &p->fda, &hwts, &key)) > 0) {
+		/*
+		 * Time stamps arrive in order of transmission. Any message
+		 * sent before the one just completed has lost its time stamp.
+		 */
+		while (p->txts_count) {
+			tp = &p->txts_pending[p->txts_head];
+			if ((int32_t) (key - tp->key) <= 0) {
+				break;
+			}
+			pr_err("port %hu: missing timestamp on transmitted %s",
+			       portnum(p), msg_type_string(msg_type(tp->msg)));
+			msg_put(txts_pop(p));
+		}
+		if (!p->txts_count || tp->key != key) {
+			continue;
+		}
+		msg = txts_pop(p);
+		if (tmv_is_zero(hwts.ts)) {
+			pr_err("port %hu: missing timestamp on transmitted %s",
+			       portnum(p), msg_type_string(msg_type(msg)));
+			msg_put(msg);
+			continue;
+		}
+		msg->hwts.ts = hwts.ts;
+		if (port_txts_complete(p, msg)) {
+			err = -1;
+		}
+		msg_put(msg);
+	}
+	return cnt < 0 || err ? EV_FAULT_DETECTED : EV_NONE;
+}
+
+static enum fsm_event bc_recv(struct port *p, struct ptp_message *msg, int cnt);
+static enum fsm_event bc_process(struct port *p, struct ptp_message *msg);
+
+/*
+ * Handles the messages handed off by a receive thread.
+ */
+static enum fsm_event bc_event_thread(struct port *p, struct rxthread *rt)
 {
 	enum fsm_event event = EV_NONE;
 	struct ptp_message *msg;
-	int cnt, fd = p->fda.fd[fd_index], err;
+
+	p->rx_pending = 0;
+	if (rxthread_ack(rt)) {
+		pr_err("port %hu: receive thread failed", portnum(p));
+		event = EV_FAULT_DETECTED;
+	}
+	p->txq_active = 1;
+	while (event == EV_NONE && (msg = rxthread_pop(rt)) != NULL) {
+		event = bc_process(p, msg);
+	}
+	/* The rest of the queue waits until the event is dispatched. */
+	if (event != EV_NONE) {
+		p->rx_pending = 1;
+	}
+	p->txq_active = 0;
+	if (port_txq_flush(p)) {
+		event = EV_FAULT_DETECTED;
+	}
+	return event;
+}
+
+/*
+ * Handles the messages of a batch in order, stopping at the first one
+ * which raises an event. The rest wait in the port until the clock has
+ * dispatched that event and calls port_event() again.
+ */
+static enum fsm_event bc_event_batch(struct port *p, int fd)
+{
+	struct ptp_message **msg = p->rx_left;
+	enum fsm_event event = EV_NONE;
+	int *cnt = p->rx_left_cnt;
+	int i, n, num;
+
+	if (p->rx_left_n) {
+		goto process;
+	}
+	for (num = 0; num < p->rx_batch_size; num++) {
+		msg[num] = msg_allocate();
+		if (!msg[num]) {
+			break;
+		}
+		msg[num]->hwts.type = p->timestamping;
+	}
+	if (!num) {
+		return EV_FAULT_DETECTED;
+	}
+
+	n = transport_recv_batch(p->trp, fd, msg, cnt, num);
+	if (n <= 0) {
+		pr_err("port %hu: recv message failed", portnum(p));
+		event = EV_FAULT_DETECTED;
+		n = 0;
+	}
+	p->rx_batch_calls++;
+	p->rx_batch_msgs += n;
+
+	for (i = n; i < num; i++) {
+		msg_put(msg[i]);
+	}
+	p->rx_left_head = 0;
+	p->rx_left_n = n;
+	if (event != EV_NONE) {
+		bc_batch_flush(p);
+		return event;
+	}
+process:
+	p->txq_active = 1;
+	while (event == EV_NONE && p->rx_left_n) {
+		i = p->rx_left_head++;
+		p->rx_left_n--;
+		if (cnt[i] <= 0) {
+			pr_err("port %hu: recv message failed", portnum(p));
+			msg_put(msg[i]);
+			continue;
+		}
+		event = bc_recv(p, msg[i], cnt[i]);
+	}
+	p->rx_pending = p->rx_left_n > 0;
+	p->txq_active = 0;
+	if (port_txq_flush(p)) {
+		event = EV_FAULT_DETECTED;
+	}
+	return event;
+}
+
+static enum fsm_event bc_event(struct port *p, int fd_index)
+{
+	struct ptp_message *msg;
+	int cnt, fd = fd_index < N_POLLFD ? p->fda.fd[fd_index] : -1;
 
 	switch (fd_index) {
 	case FD_ANNOUNCE_TIMER:
@@ -2438,13 +2970,26 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 	case FD_MANNO_TIMER:
 		pr_debug("port %hu: master tx announce timeout", portnum(p));
 		port_set_manno_tmo(p);
-		return port_tx_announce(p) ? EV_FAULT_DETECTED : EV_NONE;
+		return port_tx_announce(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
 
 	case FD_SYNC_TX_TIMER:
 		pr_debug("port %hu: master sync timeout", portnum(p));
 		port_set_sync_tx_tmo(p);
 		return port_tx_sync(p, NULL) ? EV_FAULT_DETECTED : EV_NONE;
 
+	case FD_UNICAST_TIMER:
+		/*
+		 * A client which cannot be reached must not take the
+		 * port down, the failures have been logged already.
+		 */
+		unicast_service_timer(p->unicast_service);
+		return EV_NONE;
+
+	case FD_UNICAST_REQ_TIMER:
+		pr_debug("port %hu: unicast request timeout", portnum(p));
+		unicast_client_timer(p->unicast_client);
+		return EV_NONE;
+
 	case FD_RTNL:
 		pr_debug("port %hu: received link status notification", portnum(p));
 		rtnl_link_status(fd, p->name, port_link_status, p);
@@ -2457,6 +3002,13 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			return EV_NONE;
 	}
 
+	if (p->rxt[0]) {
+		return bc_event_thread(p, p->rxt[fd_index - FD_EVENT]);
+	}
+	if (p->rx_batch_size > 1) {
+		return bc_event_batch(p, fd);
+	}
+
 	msg = msg_allocate();
 	if (!msg)
 		return EV_FAULT_DETECTED;
@@ -2469,31 +3021,21 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 		msg_put(msg);
 		return EV_FAULT_DETECTED;
 	}
-	err = msg_post_recv(msg, cnt);
-	if (err) {
-		switch (err) {
-		case -EBADMSG:
-			pr_err("port %hu: bad message", portnum(p));
-			break;
-		case -EPROTO:
-			pr_debug("port %hu: ignoring message", portnum(p));
-			break;
-		}
-		msg_put(msg);
-		return EV_NONE;
-	}
-	if (msg_sots_missing(msg) &&
-	    !(p->timestamping == TS_P2P1STEP && msg_type(msg) == PDELAY_REQ)) {
-		pr_err("port %hu: received %s without timestamp",
-		       portnum(p), msg_type_string(msg_type(msg)));
-		msg_put(msg);
-		return EV_NONE;
-	}
+	return bc_recv(p, msg, cnt);
+}
+
+/*
+ * Handles one received message that passed port_rx_validate(),
+ * consuming the caller's reference.
+ */
+static enum fsm_event bc_process(struct port *p, struct ptp_message *msg)
+{
+	enum fsm_event event = EV_NONE;
+
 	if (msg_sots_valid(msg)) {
-		ts_add(&msg->hwts.ts, -p->rx_timestamp_offset);
 		clock_check_ts(p->clock, tmv_to_nanoseconds(msg->hwts.ts));
 	}
-	if (port_ignore(p, msg)) {
+	if (incapable_ignore(p, msg) || path_trace_ignore(p, msg)) {
 		msg_put(msg);
 		return EV_NONE;
 	}
@@ -2528,6 +3070,8 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 			event = EV_STATE_DECISION_EVENT;
 		break;
 	case SIGNALING:
+		if (process_signaling(p, msg))
+			event = EV_FAULT_DETECTED;
 		break;
 	case MANAGEMENT:
 		if (clock_manage(p->clock, p, msg))
@@ -2539,6 +3083,18 @@ static enum fsm_event bc_event(struct port *p, int fd_index)
 	return event;
 }
 
+/*
+ * Handles one received message, consuming the caller's reference.
+ */
+static enum fsm_event bc_recv(struct port *p, struct ptp_message *msg, int cnt)
+{
+	if (port_rx_validate(p, msg, cnt)) {
+		msg_put(msg);
+		return EV_NONE;
+	}
+	return bc_process(p, msg);
+}
+
 int port_forward(struct port *p, struct ptp_message *msg)
 {
 	int cnt;
@@ -2585,6 +3141,16 @@ int port_number(struct port *p)
 	return portnum(p);
 }
 
+void port_status(struct port *p, struct status_port *sp)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->number = portnum(p);
+	sp->state = p->state == PS_GRAND_MASTER ? PS_MASTER : p->state;
+	sp->timestamping = p->timestamping;
+	sp->peer_delay = tmv_to_nanoseconds(p->peer_delay);
+	strncpy(sp->name, p->iface->ts_label, sizeof(sp->name) - 1);
+}
+
 int port_link_status_get(struct port *p)
 {
 	return !!(p->link_status & LINK_UP);
@@ -2771,8 +3337,9 @@ struct port *port_open(int phc_index,
 	enum clock_type type = clock_type(clock);
 	struct config *cfg = clock_config(clock);
 	struct port *p = malloc(sizeof(*p));
+	struct unicast_master_table *table;
 	enum transport_type transport;
-	int i;
+	int i, table_id;
 
 	if (!p) {
 		return NULL;
@@ -2780,6 +3347,13 @@ struct port *port_open(int phc_index,
 
 	memset(p, 0, sizeof(*p));
 	TAILQ_INIT(&p->tc_transmitted);
+	for (i = 0; i < TC_HASH_SIZE; i++) {
+		LIST_INIT(&p->tc_hash[i]);
+	}
+	LIST_INIT(&p->foreign_masters);
+	for (i = 0; i < FOREIGN_HASH_SIZE; i++) {
+		LIST_INIT(&p->foreign_hash[i]);
+	}
 
 	switch (type) {
 	case CLOCK_TYPE_ORDINARY:
@@ -2830,6 +3404,9 @@ struct port *port_open(int phc_index,
 	p->hybrid_e2e = config_get_int(cfg, p->name, "hybrid_e2e");
 	p->net_sync_monitor = config_get_int(cfg, p->name, "net_sync_monitor");
 	p->path_trace_enabled = config_get_int(cfg, p->name, "path_trace_enabled");
+	p->rx_batch_size = config_get_int(cfg, p->name, "rx_batch_size");
+	p->rx_thread = number ? config_get_int(cfg, p->name, "rx_thread") : 0;
+	p->rx_thread_cpu = config_get_int(cfg, p->name, "rx_thread_cpu");
 	p->tc_spanning_tree = config_get_int(cfg, p->name, "tc_spanning_tree");
 	p->rx_timestamp_offset = config_get_int(cfg, p->name, "ingressLatency");
 	p->rx_timestamp_offset <<= 16;
@@ -2841,12 +3418,20 @@ struct port *port_open(int phc_index,
 	if (!p->trp) {
 		goto err_port;
 	}
+	if (type == CLOCK_TYPE_ORDINARY || type == CLOCK_TYPE_BOUNDARY) {
+		/* Let the kernel drop the messages of other domains. */
+		transport_set_domain(p->trp, clock_domain_number(clock));
+	}
 	p->timestamping = timestamping;
+	p->rx_domain = clock_domain_number(clock);
 	p->portIdentity.clockIdentity = clock_identity(clock);
 	p->portIdentity.portNumber = number;
 	p->state = PS_INITIALIZING;
 	p->delayMechanism = config_get_int(cfg, p->name, "delay_mechanism");
 	p->versionNumber = PTP_VERSION;
+	for (i = FD_FIRST_TIMER; i < N_PORT_EVENTS; i++) {
+		clock_timer_init(clock, p, port_tmo(p, i), i);
+	}
 
 	if (number && type == CLOCK_TYPE_P2P && p->delayMechanism != DM_P2P) {
 		pr_err("port %d: P2P TC needs P2P ports", number);
@@ -2862,6 +3447,41 @@ struct port *port_open(int phc_index,
 	if (p->net_sync_monitor && !p->hybrid_e2e) {
 		pr_warning("port %d: net_sync_monitor needs hybrid_e2e", number);
 	}
+	if (number && sk_tx_async) {
+		switch (timestamping) {
+		case TS_SOFTWARE:
+		case TS_HARDWARE:
+		case TS_LEGACY_HW:
+			p->txts_async = 1;
+			break;
+		default:
+			break;
+		}
+		if (type != CLOCK_TYPE_ORDINARY && type != CLOCK_TYPE_BOUNDARY) {
+			p->txts_async = 0;
+		}
+		if (p->delayMechanism != DM_E2E) {
+			p->txts_async = 0;
+		}
+		if (!p->txts_async) {
+			pr_warning("port %d: tx_timestamp_async needs a two-step "
+				   "E2E boundary or ordinary clock", number);
+		}
+	}
+	if (p->rx_thread) {
+		if (type != CLOCK_TYPE_ORDINARY && type != CLOCK_TYPE_BOUNDARY) {
+			pr_warning("port %d: rx_thread needs a boundary or "
+				   "ordinary clock", number);
+			p->rx_thread = 0;
+		} else if (msg_pool_share()) {
+			goto err_transport;
+		}
+	}
+	if (p->rx_thread && p->txts_async) {
+		pr_warning("port %d: tx_timestamp_async is not supported "
+			   "with rx_thread", number);
+		p->txts_async = 0;
+	}
 
 	/* Set fault timeouts to a default value */
 	for (i = 0; i < FT_CNT; i++) {
@@ -2877,24 +3497,57 @@ struct port *port_open(int phc_index,
 
 	p->tsproc = tsproc_create(config_get_int(cfg, p->name, "tsproc_mode"),
 				  config_get_int(cfg, p->name, "delay_filter"),
-				  config_get_int(cfg, p->name, "delay_filter_length"));
+				  config_get_int(cfg, p->name, "delay_filter_length"),
+				  config_get_int(cfg, p->name, "delay_filter_percentile"));
 	if (!p->tsproc) {
 		pr_err("Failed to create time stamp processor");
 		goto err_transport;
 	}
 	p->nrate.ratio = 1.0;
 
-	port_clear_fda(p, N_POLLFD);
-	p->fault_fd = -1;
-	if (number) {
-		p->fault_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-		if (p->fault_fd < 0) {
-			pr_err("timerfd_create failed: %m");
-			goto err_tsproc;
+	if (number && config_get_int(cfg, p->name, "unicast_listen")) {
+		if (type != CLOCK_TYPE_ORDINARY && type != CLOCK_TYPE_BOUNDARY) {
+			pr_warning("port %d: unicast_listen needs a boundary or "
+				   "ordinary clock", number);
+		} else {
+			p->unicast_service = unicast_service_create(p,
+				config_get_int(cfg, p->name, "unicast_max_clients"));
+			if (!p->unicast_service) {
+				goto err_tsproc;
+			}
+		}
+	}
+
+	table_id = number ? config_get_int(cfg, p->name, "unicast_master_table") : 0;
+	if (table_id) {
+		table = config_unicast_master_table(cfg, table_id);
+		if (!table) {
+			pr_err("port %d: no unicast master table %d",
+			       number, table_id);
+			goto err_unicast;
+		}
+		if (type != CLOCK_TYPE_ORDINARY && type != CLOCK_TYPE_BOUNDARY) {
+			pr_warning("port %d: unicast_master_table needs a "
+				   "boundary or ordinary clock", number);
+		} else {
+			p->unicast_client = unicast_client_create(p, table,
+				config_get_int(cfg, p->name, "unicast_req_duration"));
+			if (!p->unicast_client) {
+				goto err_unicast;
+			}
 		}
 	}
+
+	port_clear_fda(p, N_POLLFD);
 	return p;
 
+err_unicast:
+	if (p->unicast_client) {
+		unicast_client_destroy(p->unicast_client);
+	}
+	if (p->unicast_service) {
+		unicast_service_destroy(p->unicast_service);
+	}
 err_tsproc:
 	tsproc_destroy(p->tsproc);
 err_transport:
@@ -29,6 +29,8 @@
 /* forward declarations */
 struct interface;
 struct clock;
+struct status_port;
+struct wheel_timer;
 
 /** Opaque type. */
 struct port;
@@ -62,6 +64,15 @@ void port_close(struct port *port);
  */
 struct foreign_clock *port_compute_best(struct port *port);
 
+/**
+ * Returns the best foreign master found by the last call to
+ * port_compute_best(), without bringing it up to date.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return A pointer to the port's best foreign master, or NULL.
+ */
+struct foreign_clock *port_erbest(struct port *port);
+
 /**
  * Dispatch a port event. This may cause a state transition on the
  * port, with the associated side effect.
@@ -82,6 +93,34 @@ void port_dispatch(struct port *p, enum fsm_event event, int mdiff);
  */
 enum fsm_event port_event(struct port *port, int fd_index);
 
+/**
+ * Query whether a port collects its transmit time stamps from the
+ * main poll loop, rather than waiting for them right after sending.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return One if the time stamps are collected asynchronously, zero otherwise.
+ */
+int port_txts_async(struct port *port);
+
+/**
+ * Query whether a port stopped handling a batch of received messages
+ * at an event, so that port_event() must be called again with the same
+ * index once that event has been dispatched.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return One if messages are waiting, zero otherwise.
+ */
+int port_rx_pending(struct port *port);
+
+/**
+ * Completes the transmission of messages whose time stamps have
+ * arrived on the error queue of the port's event socket.
+ *
+ * @param port A pointer previously obtained via port_open().
+ * @return One of the @a fsm_event codes.
+ */
+enum fsm_event port_txts_event(struct port *port);
+
 /**
  * Forward a message on a given port.
  * @param port    A pointer previously obtained via port_open().
@@ -124,6 +163,13 @@ struct PortIdentity port_identity(struct port *p);
  */
 int port_number(struct port *p);
 
+/**
+ * Fill in the status of a port for the shared memory status export.
+ * @param p        A port instance.
+ * @param sp       Returns the status of the port.
+ */
+void port_status(struct port *p, struct status_port *sp);
+
 /**
  * Obtain the link status of a port.
  * @param p        A port instance.
@@ -222,8 +268,8 @@ enum port_state port_state(struct port *port);
 int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 
 /**
- * Return array of file descriptors for this port. The fault fd is not
- * included.
+ * Return array of file descriptors for this port. The timers of the
+ * port run on the timer wheel of the clock and are not included.
  * @param port	A port instance
  * @return	Array of file descriptors. Unused descriptors are guranteed
  *		to be set to -1.
@@ -231,55 +277,48 @@ int port_state_update(struct port *p, enum fsm_event event, int mdiff);
 struct fdarray *port_fda(struct port *port);
 
 /**
- * Return file descriptor of the port.
- * @param port	A port instance.
- * @return	File descriptor or -1 if not applicable.
- */
-int port_fault_fd(struct port *port);
-
-/**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value M(2^N), where M is
+ * This function sets the timer 't' to the value M(2^N), where M is
  * the value of the 'scale' parameter and N in the value of the
  * 'log_seconds' parameter.
  *
  * Passing both 'scale' and 'log_seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously prepared with clock_timer_init().
  * @param scale The multiplicative factor for the timer.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_log(int fd, unsigned int scale, int log_seconds);
+int set_tmo_log(struct wheel_timer *t, unsigned int scale, int log_seconds);
 
 /**
- * Utility function for setting a file descriptor timer.
+ * Utility function for setting a port timer.
  *
- * This function sets the timer 'fd' to a random value between M * 2^N and
+ * This function sets the timer 't' to a random value between M * 2^N and
  * (M + S) * 2^N, where M is the value of the 'min' parameter, S is the value
  * of the 'span' parameter, and N in the value of the 'log_seconds' parameter.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously prepared with clock_timer_init().
  * @param min The minimum value for the timer.
  * @param span The span value for the timer. Must be a positive value.
  * @param log_seconds The exponential factor for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_random(int fd, int min, int span, int log_seconds);
+int set_tmo_random(struct wheel_timer *t, int min, int span, int log_seconds);
 
 /**
- * Utility function for setting or resetting a file descriptor timer.
+ * Utility function for setting or resetting a port timer.
  *
- * This function sets the timer 'fd' to the value of the 'seconds' parameter.
+ * This function sets the timer 't' to the value of the 'seconds' parameter.
  *
  * Passing 'seconds' as zero disables the timer.
  *
- * @param fd A file descriptor previously opened with timerfd_create(2).
+ * @param t A timer previously prepared with clock_timer_init().
  * @param seconds The timeout value for the timer.
  * @return Zero on success, non-zero otherwise.
  */
-int set_tmo_lin(int fd, int seconds);
+int set_tmo_lin(struct wheel_timer *t, int seconds);
 
 /**
  * Sets port's fault file descriptor timer.
@@ -327,4 +366,20 @@ void fault_interval(struct port *port, enum fault_type ft,
  */
 void tc_cleanup(void);
 
+/**
+ * Replace the TC transmit descriptor cache with a preallocated one of
+ * fixed size.
+ * @param count      The number of descriptors to preallocate, or zero
+ *                   for an unbounded cache.
+ * @param hugepages  Non-zero to back the cache with huge pages.
+ * @return           Zero on success, non-zero otherwise.
+ */
+int tc_pool_init(unsigned int count, int hugepages);
+
+/**
+ * Obtain the usage counters of the TC transmit descriptor cache.
+ * @param stats  Buffer to hold the result.
+ */
+void tc_pool_stats(struct arena_stats *stats);
+
 #endif
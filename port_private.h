@@ -24,10 +24,16 @@
 #include "clock.h"
 #include "fsm.h"
 #include "msg.h"
+#include "rxthread.h"
+#include "sk.h"
 #include "tmv.h"
+#include "wheel.h"
 
 #define NSEC2SEC 1000000000LL
 
+/* The timer of a port for the given FD_*_TIMER event index. */
+#define port_tmo(p, index) (&(p)->timer[(index) - FD_FIRST_TIMER])
+
 enum syfu_state {
 	SF_EMPTY,
 	SF_HAVE_SYNC,
@@ -50,13 +56,27 @@ struct nrate_estimator {
 	int ratio_valid;
 };
 
+#define TC_HASH_SIZE 256
+
 struct tc_txd {
 	TAILQ_ENTRY(tc_txd) list;
+	LIST_ENTRY(tc_txd) hash;
 	struct ptp_message *msg;
 	tmv_t residence;
 	int ingress_port;
 };
 
+/* One receive thread for each of FD_EVENT and FD_GENERAL. */
+#define N_RX_THREADS 2
+
+/* Initial size of the pending queue, which grows as needed. */
+#define TXTS_PENDING_MIN 16
+
+struct txts_pending {
+	struct ptp_message *msg;
+	uint32_t key;
+};
+
 struct port {
 	LIST_ENTRY(port) list;
 	char *name;
@@ -65,7 +85,7 @@ struct port {
 	struct transport *trp;
 	enum timestamp_type timestamping;
 	struct fdarray fda;
-	int fault_fd;
+	struct wheel_timer timer[N_PORT_TIMERS];
 	int phc_index;
 
 	void (*dispatch)(struct port *p, enum fsm_event event, int mdiff);
@@ -84,6 +104,7 @@ struct port {
 	struct {
 		UInteger16 announce;
 		UInteger16 delayreq;
+		UInteger16 signaling;
 		UInteger16 sync;
 	} seqnum;
 	tmv_t peer_delay;
@@ -120,17 +141,52 @@ struct port {
 	int                 min_neighbor_prop_delay;
 	int                 net_sync_monitor;
 	int                 path_trace_enabled;
+	int                 rx_batch_size;
+	uint64_t            rx_batch_calls;
+	uint64_t            rx_batch_msgs;
+	/* The rest of a batch or thread queue waits behind an event. */
+	int                 rx_pending;
+	int                 rx_left_head;
+	int                 rx_left_n;
+	int                 rx_left_cnt[SK_RX_BATCH_MAX];
+	struct ptp_message  *rx_left[SK_RX_BATCH_MAX];
+	int                 rx_thread;
+	int                 rx_thread_cpu;
+	/* copy of the clock's domain for the receive threads */
+	UInteger8           rx_domain;
+	uint64_t            rx_thread_drops;
+	struct rxthread     *rxt[N_RX_THREADS];
+	struct fdarray      rx_fda;
+	/* general messages queued while handling a receive batch */
+	int                 txq_active;
+	int                 txq_count;
+	struct ptp_message *txq[SK_TX_BATCH_MAX];
 	int                 tc_spanning_tree;
+	uint64_t            tc_txts_timeouts;
+	uint64_t            tc_txts_failures;
 	Integer64           rx_timestamp_offset;
 	Integer64           tx_timestamp_offset;
 	enum link_state     link_status;
 	struct fault_interval flt_interval_pertype[FT_CNT];
 	enum fault_type     last_fault_type;
 	unsigned int        versionNumber; /*UInteger4*/
-	/* foreignMasterDS */
+	/* foreignMasterDS, also hashed by foreignMasterPortIdentity */
 	LIST_HEAD(fm, foreign_clock) foreign_masters;
-	/* TC book keeping */
+	LIST_HEAD(fmh, foreign_clock) foreign_hash[FOREIGN_HASH_SIZE];
+	/* TC book keeping, in order of transmission and hashed by key */
 	TAILQ_HEAD(tct, tc_txd) tc_transmitted;
+	LIST_HEAD(tch, tc_txd) tc_hash[TC_HASH_SIZE];
+	/* deferred transmit time stamps, in order of transmission */
+	int                 txts_async;
+	uint32_t            txts_key;
+	unsigned int        txts_head;
+	unsigned int        txts_count;
+	unsigned int        txts_size;
+	struct txts_pending *txts_pending;
+	/* unicast service to the clients holding grants */
+	struct unicast_service *unicast_service;
+	/* unicast negotiation with the masters of a unicast master table */
+	struct unicast_client *unicast_client;
 };
 
 #define portnum(p) (p->portIdentity.portNumber)
@@ -146,7 +202,7 @@ void delay_req_prune(struct port *p);
 void fc_clear(struct foreign_clock *fc);
 void flush_delay_req(struct port *p);
 void flush_last_sync(struct port *p);
-int port_clr_tmo(int fd);
+int port_clr_tmo(struct wheel_timer *t);
 int port_delay_request(struct port *p);
 void port_disable(struct port *p);
 int port_initialize(struct port *p);
@@ -157,6 +213,12 @@ int port_set_delay_tmo(struct port *p);
 int port_set_qualification_tmo(struct port *p);
 void port_show_transition(struct port *p, enum port_state next,
 			  enum fsm_event event);
+int port_tx_announce(struct port *p, struct address *dst);
+int port_tx_sync(struct port *p, struct address *dst);
+int process_signaling(struct port *p, struct ptp_message *m);
+struct ptp_message *port_signaling_construct(struct port *p,
+					     struct address *address,
+					     struct PortIdentity *tpid);
 int process_announce(struct port *p, struct ptp_message *m);
 void process_delay_resp(struct port *p, struct ptp_message *m);
 void process_follow_up(struct port *p, struct ptp_message *m);
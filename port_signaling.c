@@ -0,0 +1,161 @@
+/**
+ * @file port_signaling.c
+ * @brief Implements the handling of signaling messages on a port.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <string.h>
+
+#include "port.h"
+#include "port_private.h"
+#include "print.h"
+#include "unicast_client.h"
+#include "unicast_service.h"
+
+struct ptp_message *port_signaling_construct(struct port *p,
+					     struct address *address,
+					     struct PortIdentity *tpid)
+{
+	struct ptp_message *msg;
+
+	msg = msg_allocate();
+	if (!msg) {
+		return NULL;
+	}
+	msg->hwts.type = p->timestamping;
+
+	msg->header.tsmt               = SIGNALING | p->transportSpecific;
+	msg->header.ver                = PTP_VERSION;
+	msg->header.messageLength      = sizeof(struct signaling_msg);
+	msg->header.domainNumber       = clock_domain_number(p->clock);
+	msg->header.sourcePortIdentity = p->portIdentity;
+	msg->header.sequenceId         = p->seqnum.signaling++;
+	msg->header.control            = CTL_OTHER;
+	msg->header.logMessageInterval = 0x7F;
+	msg->header.flagField[0]      |= UNICAST;
+
+	msg->signaling.targetPortIdentity = *tpid;
+	msg->address = *address;
+
+	return msg;
+}
+
+static int port_signaling_target(struct port *p, struct ptp_message *m)
+{
+	struct PortIdentity wildcard;
+
+	memset(&wildcard, 0xff, sizeof(wildcard));
+
+	if (pid_eq(&m->signaling.targetPortIdentity, &wildcard) ||
+	    pid_eq(&m->signaling.targetPortIdentity, &p->portIdentity)) {
+		return 1;
+	}
+	return 0;
+}
+
+int process_signaling(struct port *p, struct ptp_message *m)
+{
+	struct cancel_unicast_xmit_tlv *cancel, *ack;
+	struct request_unicast_xmit_tlv *req;
+	struct grant_unicast_xmit_tlv *grant;
+	struct ptp_message *rsp = NULL;
+	struct tlv_extra *extra, *out;
+
+	if (!p->unicast_service && !p->unicast_client) {
+		return 0;
+	}
+	if (!(m->header.flagField[0] & UNICAST)) {
+		return 0;
+	}
+	if (!port_signaling_target(p, m)) {
+		return 0;
+	}
+
+	TAILQ_FOREACH(extra, &m->tlv_list, list) {
+		switch (extra->tlv->type) {
+		case TLV_REQUEST_UNICAST_TRANSMISSION:
+			if (!p->unicast_service) {
+				continue;
+			}
+			break;
+		case TLV_CANCEL_UNICAST_TRANSMISSION:
+			break;
+		case TLV_GRANT_UNICAST_TRANSMISSION:
+			if (p->unicast_client) {
+				grant = (struct grant_unicast_xmit_tlv *) extra->tlv;
+				unicast_client_grant(p->unicast_client, m, grant);
+			}
+			continue;
+		default:
+			continue;
+		}
+		if (!rsp) {
+			rsp = port_signaling_construct(p, &m->address,
+						       &m->header.sourcePortIdentity);
+			if (!rsp) {
+				return -1;
+			}
+		}
+		switch (extra->tlv->type) {
+		case TLV_REQUEST_UNICAST_TRANSMISSION:
+			req = (struct request_unicast_xmit_tlv *) extra->tlv;
+			out = msg_tlv_append(rsp, sizeof(*grant));
+			if (!out) {
+				break;
+			}
+			grant = (struct grant_unicast_xmit_tlv *) out->tlv;
+			grant->type = TLV_GRANT_UNICAST_TRANSMISSION;
+			grant->length = sizeof(*grant) - sizeof(grant->type) -
+				sizeof(grant->length);
+			unicast_service_add(p->unicast_service, m, req, grant);
+			break;
+		case TLV_CANCEL_UNICAST_TRANSMISSION:
+			cancel = (struct cancel_unicast_xmit_tlv *) extra->tlv;
+			if (p->unicast_service) {
+				unicast_service_remove(p->unicast_service, m,
+						       cancel);
+			}
+			if (p->unicast_client) {
+				unicast_client_cancel(p->unicast_client, m,
+						      cancel);
+			}
+			out = msg_tlv_append(rsp, sizeof(*ack));
+			if (!out) {
+				break;
+			}
+			ack = (struct cancel_unicast_xmit_tlv *) out->tlv;
+			ack->type = TLV_ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION;
+			ack->length = sizeof(*ack) - sizeof(ack->type) -
+				sizeof(ack->length);
+			ack->message_type_flags = cancel->message_type_flags;
+			ack->reserved = 0;
+			break;
+		}
+	}
+
+	/*
+	 * A requester which cannot be reached must not take the port
+	 * down, so only a local lack of resources counts as a fault.
+	 */
+	if (rsp) {
+		if (rsp->tlv_count &&
+		    port_prepare_and_send(p, rsp, TRANS_GENERAL)) {
+			pr_err("port %hu: send signaling failed", portnum(p));
+		}
+		msg_put(rsp);
+	}
+	return 0;
+}
@@ -17,19 +17,24 @@
  * with this program; if not, write to the Free Software Foundation, Inc.,
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include "clock.h"
 #include "config.h"
+#include "msg.h"
 #include "ntpshm.h"
 #include "pi.h"
+#include "port.h"
 #include "print.h"
 #include "raw.h"
 #include "sk.h"
+#include "tlv.h"
 #include "transport.h"
 #include "udp6.h"
 #include "uds.h"
@@ -69,14 +74,180 @@ static void usage(char *progname)
 		progname);
 }
 
+static int check_clock_type(struct config *cfg, enum clock_type *type)
+{
+	*type = config_get_int(cfg, NULL, "clock_type");
+	switch (*type) {
+	case CLOCK_TYPE_ORDINARY:
+		if (cfg->n_interfaces > 1) {
+			*type = CLOCK_TYPE_BOUNDARY;
+		}
+		break;
+	case CLOCK_TYPE_BOUNDARY:
+		if (cfg->n_interfaces < 2) {
+			fprintf(stderr, "BC needs at least two interfaces\n");
+			return -1;
+		}
+		break;
+	case CLOCK_TYPE_P2P:
+		if (cfg->n_interfaces < 2) {
+			fprintf(stderr, "TC needs at least two interfaces\n");
+			return -1;
+		}
+		if (DM_P2P != config_get_int(cfg, NULL, "delay_mechanism")) {
+			fprintf(stderr, "P2P_TC needs P2P delay mechanism\n");
+			return -1;
+		}
+		break;
+	case CLOCK_TYPE_E2E:
+		if (cfg->n_interfaces < 2) {
+			fprintf(stderr, "TC needs at least two interfaces\n");
+			return -1;
+		}
+		if (DM_E2E != config_get_int(cfg, NULL, "delay_mechanism")) {
+			fprintf(stderr, "E2E_TC needs E2E delay mechanism\n");
+			return -1;
+		}
+		break;
+	case CLOCK_TYPE_MANAGEMENT:
+		return -1;
+	}
+	return 0;
+}
+
+/* Each domain needs its own domainNumber and management socket. */
+/*
+ * The sockets of the domains are bound to the same UDP ports, and the
+ * kernel hands a unicast message to only one of them, whose domain
+ * filter then drops it if it belongs to another domain.
+ */
+static int check_unicast(struct config *cfg)
+{
+	static const char *opts[] = {
+		"hybrid_e2e", "unicast_listen", "unicast_master_table",
+	};
+	struct interface *iface;
+	unsigned int i;
+
+	STAILQ_FOREACH(iface, &cfg->interfaces, list) {
+		for (i = 0; i < sizeof(opts) / sizeof(opts[0]); i++) {
+			if (config_get_int(cfg, iface->name, opts[i])) {
+				fprintf(stderr, "%s is not supported together "
+					"with domain sections\n", opts[i]);
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Checks that a domain does not share the given path with the global
+ * clock or with an earlier domain. An empty path may be shared when
+ * 'empty_ok' is set.
+ */
+static int check_own_path(struct config *cfg, struct config *dom,
+			  const char *option, int empty_ok)
+{
+	char *path = config_get_string(dom, NULL, option);
+	struct config *prev;
+
+	if (empty_ok && !path[0]) {
+		return 0;
+	}
+	if (!strcmp(path, config_get_string(cfg, NULL, option))) {
+		goto shared;
+	}
+	STAILQ_FOREACH(prev, &cfg->domains, list) {
+		if (prev == dom) {
+			break;
+		}
+		if (!strcmp(path, config_get_string(prev, NULL, option))) {
+			goto shared;
+		}
+	}
+	return 0;
+shared:
+	fprintf(stderr, "domain %d needs its own %s\n",
+		config_get_int(dom, NULL, "domainNumber"), option);
+	return -1;
+}
+
+static int check_domain(struct config *cfg, struct config *dom)
+{
+	int domain = config_get_int(dom, NULL, "domainNumber");
+
+	if (domain == config_get_int(cfg, NULL, "domainNumber")) {
+		fprintf(stderr, "domain %d is already the global domain\n",
+			domain);
+		return -1;
+	}
+	if (check_own_path(cfg, dom, "uds_address", 0) ||
+	    check_own_path(cfg, dom, "trace_file", 1) ||
+	    check_own_path(cfg, dom, "status_file", 1)) {
+		return -1;
+	}
+	if (check_unicast(cfg) || check_unicast(dom)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Runs the clocks of all of the domains in one event loop. */
+static int run_clocks(struct clock **clocks, int n)
+{
+	struct epoll_event ev, *events;
+	int cnt, epfd, err = -1, i;
+
+	events = calloc(n, sizeof(*events));
+	if (!events) {
+		return -1;
+	}
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		pr_err("epoll_create1 failed: %m");
+		goto no_epoll;
+	}
+	for (i = 0; i < n; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, clock_fd(clocks[i]), &ev)) {
+			pr_err("epoll_ctl failed: %m");
+			goto out;
+		}
+	}
+	err = 0;
+	while (is_running()) {
+		cnt = epoll_wait(epfd, events, n, -1);
+		if (cnt < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			pr_emerg("poll failed");
+			break;
+		}
+		for (i = 0; i < cnt; i++) {
+			if (clock_service(clocks[events[i].data.u32])) {
+				goto out;
+			}
+		}
+	}
+out:
+	close(epfd);
+no_epoll:
+	free(events);
+	return err;
+}
+
 int main(int argc, char *argv[])
 {
 	char *config = NULL, *req_phc = NULL, *progname;
 	enum clock_type type = CLOCK_TYPE_ORDINARY;
-	int c, err = -1, index, print_level;
-	struct clock *clock = NULL;
+	int c, err = -1, hugepages, i, index, nclocks = 0, pool_size, print_level;
+	struct clock **clocks = NULL;
+	struct config *cfg, *dom;
 	struct option *opts;
-	struct config *cfg;
 
 	if (handle_term_signals())
 		return -1;
@@ -191,6 +362,16 @@ int main(int argc, char *argv[])
 	assume_two_step = config_get_int(cfg, NULL, "assume_two_step");
 	sk_check_fupsync = config_get_int(cfg, NULL, "check_fup_sync");
 	sk_tx_timeout = config_get_int(cfg, NULL, "tx_timestamp_timeout");
+	sk_tx_async = config_get_int(cfg, NULL, "tx_timestamp_async");
+
+	pool_size = config_get_int(cfg, NULL, "msg_pool_size");
+	hugepages = config_get_int(cfg, NULL, "msg_pool_hugepages");
+	if (msg_pool_init(pool_size, hugepages) ||
+	    tlv_extra_pool_init(pool_size, hugepages) ||
+	    tc_pool_init(pool_size, hugepages)) {
+		fprintf(stderr, "failed to allocate the message pool\n");
+		goto out;
+	}
 
 	if (config_get_int(cfg, NULL, "clock_servo") == CLOCK_SERVO_NTPSHM) {
 		config_set_int(cfg, "kernel_leap", 0);
@@ -203,58 +384,54 @@ int main(int argc, char *argv[])
 		goto out;
 	}
 
-	type = config_get_int(cfg, NULL, "clock_type");
-	switch (type) {
-	case CLOCK_TYPE_ORDINARY:
-		if (cfg->n_interfaces > 1) {
-			type = CLOCK_TYPE_BOUNDARY;
-		}
-		break;
-	case CLOCK_TYPE_BOUNDARY:
-		if (cfg->n_interfaces < 2) {
-			fprintf(stderr, "BC needs at least two interfaces\n");
-			goto out;
-		}
-		break;
-	case CLOCK_TYPE_P2P:
-		if (cfg->n_interfaces < 2) {
-			fprintf(stderr, "TC needs at least two interfaces\n");
-			goto out;
-		}
-		if (DM_P2P != config_get_int(cfg, NULL, "delay_mechanism")) {
-			fprintf(stderr, "P2P_TC needs P2P delay mechanism\n");
-			goto out;
-		}
-		break;
-	case CLOCK_TYPE_E2E:
-		if (cfg->n_interfaces < 2) {
-			fprintf(stderr, "TC needs at least two interfaces\n");
-			goto out;
-		}
-		if (DM_E2E != config_get_int(cfg, NULL, "delay_mechanism")) {
-			fprintf(stderr, "E2E_TC needs E2E delay mechanism\n");
-			goto out;
-		}
-		break;
-	case CLOCK_TYPE_MANAGEMENT:
+	if (check_clock_type(cfg, &type)) {
 		goto out;
 	}
-
-	clock = clock_create(type, cfg, req_phc);
-	if (!clock) {
+	clocks = calloc(1 + cfg->n_domains, sizeof(*clocks));
+	if (!clocks) {
+		fprintf(stderr, "low memory\n");
+		goto out;
+	}
+	clocks[0] = clock_create(type, cfg, req_phc);
+	if (!clocks[0]) {
 		fprintf(stderr, "failed to create a clock\n");
 		goto out;
 	}
+	nclocks = 1;
 
-	err = 0;
+	STAILQ_FOREACH(dom, &cfg->domains, list) {
+		if (check_domain(cfg, dom) || check_clock_type(dom, &type)) {
+			goto out;
+		}
+		if (config_get_int(dom, NULL, "clock_servo") == CLOCK_SERVO_NTPSHM) {
+			config_set_int(dom, "kernel_leap", 0);
+			config_set_int(dom, "sanity_freq_limit", 0);
+		}
+		clocks[nclocks] = clock_create(type, dom, req_phc);
+		if (!clocks[nclocks]) {
+			fprintf(stderr, "failed to create a clock for domain %d\n",
+				config_get_int(dom, NULL, "domainNumber"));
+			goto out;
+		}
+		nclocks++;
+	}
 
-	while (is_running()) {
-		if (clock_poll(clock))
-			break;
+	if (nclocks == 1) {
+		err = 0;
+		while (is_running()) {
+			if (clock_poll(clocks[0]))
+				break;
+		}
+	} else {
+		err = run_clocks(clocks, nclocks);
 	}
 out:
-	if (clock)
-		clock_destroy(clock);
+	for (i = 0; i < nclocks; i++) {
+		clock_destroy(clocks[i]);
+	}
+	free(clocks);
+	msg_cleanup();
+	tc_cleanup();
 	config_destroy(cfg);
 	return err;
 }
@@ -50,37 +50,38 @@ struct raw {
 	struct address src_addr;
 	struct address ptp_addr;
 	struct address p2p_addr;
-	int vlan;
 };
 
 #define OP_AND  (BPF_ALU | BPF_AND | BPF_K)
 #define OP_JEQ  (BPF_JMP | BPF_JEQ | BPF_K)
-#define OP_JUN  (BPF_JMP | BPF_JA)
-#define OP_LDB  (BPF_LD  | BPF_B   | BPF_ABS)
+#define OP_LDB  (BPF_LD  | BPF_B   | BPF_IND)
 #define OP_LDH  (BPF_LD  | BPF_H   | BPF_ABS)
+#define OP_LDX  (BPF_LDX | BPF_W   | BPF_IMM)
 #define OP_RETK (BPF_RET | BPF_K)
 
 #define PTP_GEN_BIT 0x08 /* indicates general message, if set in message type */
 
-#define N_RAW_FILTER    12
-#define RAW_FILTER_TEST 9
+#define N_RAW_FILTER      13
+#define RAW_FILTER_TEST   8
+#define RAW_FILTER_DOMAIN 10
 
 static struct sock_filter raw_filter[N_RAW_FILTER] = {
-	{OP_LDH,  0, 0, OFF_ETYPE   },
-	{OP_JEQ,  0, 4, ETH_P_8021Q          }, /*f goto non-vlan block*/
-	{OP_LDH,  0, 0, OFF_ETYPE + 4        },
-	{OP_JEQ,  0, 7, ETH_P_1588           }, /*f goto reject*/
-	{OP_LDB,  0, 0, ETH_HLEN + VLAN_HLEN },
-	{OP_JUN,  0, 0, 2                    }, /*goto test general bit*/
-	{OP_JEQ,  0, 4, ETH_P_1588  }, /*f goto reject*/
-	{OP_LDB,  0, 0, ETH_HLEN    },
-	{OP_AND,  0, 0, PTP_GEN_BIT }, /*test general bit*/
-	{OP_JEQ,  0, 1, 0           }, /*0,1=accept event; 1,0=accept general*/
-	{OP_RETK, 0, 0, 1500        }, /*accept*/
-	{OP_RETK, 0, 0, 0           }, /*reject*/
+	{OP_LDX,  0, 0, 0                    }, /*X = length of the VLAN tag*/
+	{OP_LDH,  0, 0, OFF_ETYPE            },
+	{OP_JEQ,  0, 2, ETH_P_8021Q          }, /*f goto test ethertype*/
+	{OP_LDX,  0, 0, VLAN_HLEN            },
+	{OP_LDH,  0, 0, OFF_ETYPE + VLAN_HLEN},
+	{OP_JEQ,  0, 6, ETH_P_1588           }, /*f goto reject*/
+	{OP_LDB,  0, 0, ETH_HLEN             },
+	{OP_AND,  0, 0, PTP_GEN_BIT          }, /*test general bit*/
+	{OP_JEQ,  0, 3, 0                    }, /*0,3=accept event; 3,0=accept general*/
+	{OP_LDB,  0, 0, ETH_HLEN + 4         }, /*domainNumber*/
+	{OP_JEQ,  0, 1, 0                    }, /*0,1=accept one domain; 0,0=accept all*/
+	{OP_RETK, 0, 0, 1500                 }, /*accept*/
+	{OP_RETK, 0, 0, 0                    }, /*reject*/
 };
 
-static int raw_configure(int fd, int event, int index,
+static int raw_configure(int fd, int event, int index, int domain,
 			 unsigned char *addr1, unsigned char *addr2, int enable)
 {
 	int err1, err2, filter_test, option;
@@ -90,11 +91,17 @@ static int raw_configure(int fd, int event, int index,
 	filter_test = RAW_FILTER_TEST;
 	if (event) {
 		raw_filter[filter_test].jt = 0;
-		raw_filter[filter_test].jf = 1;
+		raw_filter[filter_test].jf = 3;
 	} else {
-		raw_filter[filter_test].jt = 1;
+		raw_filter[filter_test].jt = 3;
 		raw_filter[filter_test].jf = 0;
 	}
+	if (domain < 0) {
+		raw_filter[RAW_FILTER_DOMAIN].jf = 0;
+	} else {
+		raw_filter[RAW_FILTER_DOMAIN].k = domain;
+		raw_filter[RAW_FILTER_DOMAIN].jf = 1;
+	}
 
 	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prg, sizeof(prg))) {
 		pr_err("setsockopt SO_ATTACH_FILTER failed: %m");
@@ -149,8 +156,8 @@ static int raw_close(struct transport *t, struct fdarray *fda)
 	return 0;
 }
 
-static int open_socket(const char *name, int event, unsigned char *ptp_dst_mac,
-		       unsigned char *p2p_dst_mac)
+static int open_socket(const char *name, int event, int domain,
+		       unsigned char *ptp_dst_mac, unsigned char *p2p_dst_mac)
 {
 	struct sockaddr_ll addr;
 	int fd, index;
@@ -176,7 +183,7 @@ static int open_socket(const char *name, int event, unsigned char *ptp_dst_mac,
 		pr_err("setsockopt SO_BINDTODEVICE failed: %m");
 		goto no_option;
 	}
-	if (raw_configure(fd, event, index, ptp_dst_mac, p2p_dst_mac, 1))
+	if (raw_configure(fd, event, index, domain, ptp_dst_mac, p2p_dst_mac, 1))
 		goto no_option;
 
 	return fd;
@@ -225,11 +232,11 @@ static int raw_open(struct transport *t, struct interface *iface,
 	if (sk_interface_macaddr(name, &raw->src_addr))
 		goto no_mac;
 
-	efd = open_socket(name, 1, ptp_dst_mac, p2p_dst_mac);
+	efd = open_socket(name, 1, t->domain, ptp_dst_mac, p2p_dst_mac);
 	if (efd < 0)
 		goto no_event;
 
-	gfd = open_socket(name, 0, ptp_dst_mac, p2p_dst_mac);
+	gfd = open_socket(name, 0, t->domain, ptp_dst_mac, p2p_dst_mac);
 	if (gfd < 0)
 		goto no_general;
 
@@ -252,40 +259,57 @@ no_mac:
 	return -1;
 }
 
+/*
+ * Frames are received behind room for a VLAN header, and the payload of
+ * an untagged frame is then moved into place. So each frame yields its
+ * own header length, and the receive threads share no state here.
+ */
+static int raw_strip_hdr(unsigned char *buf, int cnt)
+{
+	unsigned char *ptr = buf - sizeof(struct vlan_hdr);
+	struct eth_hdr *hdr = (struct eth_hdr *) ptr;
+
+	if (ETH_P_8021Q == ntohs(hdr->type))
+		return cnt - sizeof(struct vlan_hdr);
+
+	cnt -= sizeof(struct eth_hdr);
+	if (cnt > 0)
+		memmove(buf, ptr + sizeof(struct eth_hdr), cnt);
+	return cnt;
+}
+
 static int raw_recv(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts)
 {
-	int cnt, hlen;
 	unsigned char *ptr = buf;
-	struct eth_hdr *hdr;
-	struct raw *raw = container_of(t, struct raw, t);
+	int cnt;
 
-	if (raw->vlan) {
-		hlen = sizeof(struct vlan_hdr);
-	} else {
-		hlen = sizeof(struct eth_hdr);
-	}
-	ptr    -= hlen;
-	buflen += hlen;
-	hdr = (struct eth_hdr *) ptr;
+	ptr    -= sizeof(struct vlan_hdr);
+	buflen += sizeof(struct vlan_hdr);
 
 	cnt = sk_receive(fd, ptr, buflen, addr, hwts, 0);
-
-	if (cnt >= 0)
-		cnt -= hlen;
 	if (cnt < 0)
 		return cnt;
 
-	if (raw->vlan) {
-		if (ETH_P_1588 == ntohs(hdr->type)) {
-			pr_notice("raw: disabling VLAN mode");
-			raw->vlan = 0;
-		}
-	} else {
-		if (ETH_P_8021Q == ntohs(hdr->type)) {
-			pr_notice("raw: switching to VLAN mode");
-			raw->vlan = 1;
-		}
+	return raw_strip_hdr(buf, cnt);
+}
+
+static int raw_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	int cnt, i;
+
+	for (i = 0; i < n; i++) {
+		rx[i].buf = (unsigned char *) rx[i].buf - sizeof(struct vlan_hdr);
+		rx[i].buflen += sizeof(struct vlan_hdr);
+	}
+
+	cnt = sk_receive_batch(fd, rx, n);
+
+	for (i = 0; i < cnt; i++) {
+		if (rx[i].cnt >= 0)
+			rx[i].cnt = raw_strip_hdr((unsigned char *) rx[i].buf +
+						  sizeof(struct vlan_hdr),
+						  rx[i].cnt);
 	}
 	return cnt;
 }
@@ -335,6 +359,26 @@ static int raw_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, pkt, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int raw_send_batch(struct transport *t, struct fdarray *fda,
+			  struct sk_tx *tx, int n)
+{
+	struct raw *raw = container_of(t, struct raw, t);
+	struct eth_hdr *hdr;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		hdr = (struct eth_hdr *) ((unsigned char *) tx[i].buf - sizeof(*hdr));
+		addr_to_mac(&hdr->dst, tx[i].addr ? tx[i].addr : &raw->ptp_addr);
+		addr_to_mac(&hdr->src, &raw->src_addr);
+		hdr->type = htons(ETH_P_1588);
+
+		tx[i].buf = hdr;
+		tx[i].len += sizeof(*hdr);
+		tx[i].addr = NULL;
+	}
+	return sk_send_batch(fda->fd[FD_GENERAL], tx, n);
+}
+
 static void raw_release(struct transport *t)
 {
 	struct raw *raw = container_of(t, struct raw, t);
@@ -364,7 +408,9 @@ struct transport *raw_transport_create(void)
 	raw->t.close   = raw_close;
 	raw->t.open    = raw_open;
 	raw->t.recv    = raw_recv;
+	raw->t.recv_batch = raw_recv_batch;
 	raw->t.send    = raw_send;
+	raw->t.send_batch = raw_send_batch;
 	raw->t.release = raw_release;
 	raw->t.physical_addr = raw_physical_addr;
 	raw->t.protocol_addr = raw_protocol_addr;
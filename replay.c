@@ -0,0 +1,406 @@
+/**
+ * @file replay.c
+ * @brief Replays time stamp traces through the time stamp processor and servo.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "msg.h"
+#include "print.h"
+#include "replay.h"
+#include "tmv.h"
+#include "tsproc.h"
+
+#define MAX_FREQUENCY 900000000
+
+struct replay {
+	struct servo *servo;
+	struct tsproc *tsproc;
+	struct tsproc *peer;
+	int64_t utc_offset;
+	/* Offset of the simulated clock from the recorded clock in ns */
+	double clock_offset;
+	/* Frequency adjustments of the simulated and the recorded clock */
+	double sim_freq;
+	double rec_freq;
+	int64_t first_ts;
+	int64_t last_ts;
+	int have_ts;
+	int log_interval;
+	int have_interval;
+	double interval;
+	tmv_t path_delay;
+	struct stats *offset;
+	struct stats *freq;
+	struct stats *delay;
+	unsigned int updates;
+	unsigned int jumps;
+	/* Offsets of the locked clock, for the TDEV and MTIE */
+	double *x;
+	unsigned int nx;
+	unsigned int x_size;
+};
+
+static tmv_t ns_to_tmv(int64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / NS_PER_SEC;
+	ts.tv_nsec = ns % NS_PER_SEC;
+	return timespec_to_tmv(ts);
+}
+
+struct replay *replay_create(struct config *cfg, int utc_offset)
+{
+	struct replay *r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	r->servo = servo_create(cfg, config_get_int(cfg, NULL, "clock_servo"),
+				0, MAX_FREQUENCY,
+				config_get_int(cfg, NULL, "time_stamping") ==
+				TS_SOFTWARE);
+	r->tsproc = tsproc_create(config_get_int(cfg, NULL, "tsproc_mode"),
+				  config_get_int(cfg, NULL, "delay_filter"),
+				  config_get_int(cfg, NULL, "delay_filter_length"),
+				  config_get_int(cfg, NULL, "delay_filter_percentile"));
+	r->peer = tsproc_create(config_get_int(cfg, NULL, "tsproc_mode"),
+				config_get_int(cfg, NULL, "delay_filter"),
+				config_get_int(cfg, NULL, "delay_filter_length"),
+				config_get_int(cfg, NULL, "delay_filter_percentile"));
+	r->offset = stats_create();
+	r->freq = stats_create();
+	r->delay = stats_create();
+	if (!r->servo || !r->tsproc || !r->peer ||
+	    !r->offset || !r->freq || !r->delay)
+		goto failed;
+
+	if (tsproc_set_selection(r->tsproc,
+				 config_get_int(cfg, NULL, "tsproc_select_window"),
+				 config_get_int(cfg, NULL, "tsproc_select_percentile")))
+		goto failed;
+
+	r->path_delay = dbl_tmv(config_get_int(cfg, NULL, "initial_delay"));
+	if (!tmv_is_zero(r->path_delay))
+		tsproc_set_delay(r->tsproc, r->path_delay);
+	r->utc_offset = utc_offset * NS_PER_SEC;
+	return r;
+
+failed:
+	replay_destroy(r);
+	return NULL;
+}
+
+void replay_destroy(struct replay *r)
+{
+	if (r->servo)
+		servo_destroy(r->servo);
+	if (r->tsproc)
+		tsproc_destroy(r->tsproc);
+	if (r->peer)
+		tsproc_destroy(r->peer);
+	if (r->offset)
+		stats_destroy(r->offset);
+	if (r->freq)
+		stats_destroy(r->freq);
+	if (r->delay)
+		stats_destroy(r->delay);
+	free(r->x);
+	free(r);
+}
+
+/*
+ * Advance the simulated clock to the given recorded local time.  Both
+ * clocks are driven by the same oscillator, so the simulated clock
+ * gains on the recorded one at the ratio of their adjustments.
+ */
+static void replay_advance(struct replay *r, int64_t ts)
+{
+	if (!r->have_ts) {
+		r->first_ts = ts;
+		r->have_ts = 1;
+	} else {
+		r->clock_offset += (ts - r->last_ts) *
+			(r->sim_freq - r->rec_freq) / (1e9 + r->rec_freq);
+	}
+	r->last_ts = ts;
+}
+
+/* Follow the adjustments made to the recorded clock after a sample. */
+static void replay_follow(struct replay *r, struct trace_record *rec)
+{
+	r->rec_freq = rec->freq;
+	if (rec->state == SERVO_JUMP) {
+		/* The recorded clock was stepped, the simulated one not. */
+		r->clock_offset += rec->offset;
+		r->last_ts -= rec->offset;
+	}
+}
+
+static void replay_sync_interval(struct replay *r, int n)
+{
+	if (r->have_interval && r->log_interval == n)
+		return;
+
+	r->log_interval = n;
+	r->have_interval = 1;
+	r->interval = (n < 0 ? 1.0 / (1 << -n) : 1 << n) *
+		tsproc_window(r->tsproc);
+	servo_sync_interval(r->servo, r->interval);
+}
+
+static int replay_add_x(struct replay *r, double x)
+{
+	unsigned int size;
+	double *p;
+
+	if (r->nx == r->x_size) {
+		size = r->x_size ? 2 * r->x_size : 1024;
+		p = realloc(r->x, size * sizeof(*p));
+		if (!p)
+			return -1;
+		r->x = p;
+		r->x_size = size;
+	}
+	r->x[r->nx++] = x;
+	return 0;
+}
+
+static void replay_servo(struct replay *r, int64_t offset, int64_t ts,
+			 double weight, struct replay_update *update)
+{
+	enum servo_state state;
+	double adj;
+
+	adj = servo_sample(r->servo, offset, ts, weight, &state);
+	r->updates++;
+
+	switch (state) {
+	case SERVO_UNLOCKED:
+		break;
+	case SERVO_JUMP:
+		r->sim_freq = -adj;
+		r->clock_offset -= offset;
+		tsproc_reset(r->tsproc, 0);
+		r->jumps++;
+		break;
+	case SERVO_LOCKED:
+		r->sim_freq = -adj;
+		stats_add_value(r->offset, offset);
+		stats_add_value(r->freq, adj);
+		if (replay_add_x(r, offset))
+			pr_err("low memory, dropping offset");
+		break;
+	}
+
+	update->time = (ts - r->first_ts) / 1e9;
+	update->offset = offset;
+	update->freq = adj;
+	update->delay = tmv_to_nanoseconds(r->path_delay);
+	update->state = state;
+}
+
+static int replay_sync(struct replay *r, struct trace_record *rec,
+		       struct replay_update *update)
+{
+	tmv_t ingress, origin, offset;
+	double weight;
+
+	replay_sync_interval(r, rec->log_interval);
+	replay_advance(r, rec->t2);
+
+	ingress = tmv_add(ns_to_tmv(rec->t2), dbl_tmv(r->clock_offset));
+	origin = ns_to_tmv(rec->t1 + rec->correction - r->utc_offset);
+
+	tsproc_down_ts(r->tsproc, origin, ingress);
+	if (tsproc_update_offset(r->tsproc, &offset, &weight))
+		return 0;
+
+	replay_servo(r, tmv_to_nanoseconds(offset),
+		     tmv_to_nanoseconds(ingress), weight, update);
+	tsproc_set_clock_rate_ratio(r->tsproc, servo_rate_ratio(r->servo));
+	return 1;
+}
+
+static void replay_delay(struct replay *r, struct trace_record *rec)
+{
+	tmv_t t3, t4c;
+
+	replay_advance(r, rec->t3);
+
+	t3 = tmv_add(ns_to_tmv(rec->t3), dbl_tmv(r->clock_offset));
+	t4c = ns_to_tmv(rec->t4 - rec->correction - r->utc_offset);
+
+	tsproc_up_ts(r->tsproc, t3, t4c);
+	if (tsproc_update_delay(r->tsproc, &r->path_delay))
+		return;
+	stats_add_value(r->delay, tmv_dbl(r->path_delay));
+}
+
+static void replay_pdelay(struct replay *r, struct trace_record *rec)
+{
+	tmv_t t1, t2, t3c, t4;
+
+	replay_advance(r, rec->t1);
+
+	t1 = tmv_add(ns_to_tmv(rec->t1), dbl_tmv(r->clock_offset));
+	t2 = ns_to_tmv(rec->t2);
+	t3c = ns_to_tmv(rec->t3 + rec->correction);
+	t4 = tmv_add(ns_to_tmv(rec->t4), dbl_tmv(r->clock_offset));
+
+	tsproc_set_clock_rate_ratio(r->peer, servo_rate_ratio(r->servo));
+	tsproc_up_ts(r->peer, t1, t2);
+	tsproc_down_ts(r->peer, t3c, t4);
+	if (tsproc_update_delay(r->peer, &r->path_delay))
+		return;
+
+	tsproc_set_delay(r->tsproc, r->path_delay);
+	tsproc_up_ts(r->tsproc, t1, t2);
+	stats_add_value(r->delay, tmv_dbl(r->path_delay));
+}
+
+static int replay_phc2sys(struct replay *r, struct trace_record *rec,
+			  struct replay_update *update)
+{
+	replay_sync_interval(r, rec->log_interval);
+	replay_advance(r, rec->t2);
+
+	replay_servo(r, rec->t2 - rec->t1 + (int64_t) r->clock_offset,
+		     rec->t2 + (int64_t) r->clock_offset, 1.0, update);
+	return 1;
+}
+
+int replay_record(struct replay *r, struct trace_record *rec,
+		  struct replay_update *update)
+{
+	int updated = 0;
+
+	switch (rec->type) {
+	case TRACE_SYNC:
+		updated = replay_sync(r, rec, update);
+		break;
+	case TRACE_DELAY:
+		replay_delay(r, rec);
+		break;
+	case TRACE_PDELAY:
+		replay_pdelay(r, rec);
+		break;
+	case TRACE_PHC2SYS:
+		updated = replay_phc2sys(r, rec, update);
+		break;
+	default:
+		return 0;
+	}
+	replay_follow(r, rec);
+	return updated;
+}
+
+/*
+ * Calculate the time deviation of the offsets at n times the update
+ * interval, using the prefix sums s of the offsets.
+ */
+static double replay_tdev(double *s, unsigned int nx, unsigned int n)
+{
+	double sum = 0.0, v;
+	unsigned int j;
+
+	for (j = 0; j + 3 * n <= nx; j++) {
+		v = (s[j + 3 * n] - s[j + 2 * n]) - 2 * (s[j + 2 * n] - s[j + n]) +
+			(s[j + n] - s[j]);
+		sum += v * v;
+	}
+	return sqrt(sum / (6.0 * n * n * (nx - 3 * n + 1)));
+}
+
+/*
+ * Calculate the maximum time interval error in windows of n + 1
+ * offsets, keeping the indices of the window's extremes in monotonic
+ * queues.
+ */
+static double replay_mtie(double *x, unsigned int nx, unsigned int n,
+			  unsigned int *maxq, unsigned int *minq)
+{
+	unsigned int i, max_head = 0, max_tail = 0, min_head = 0, min_tail = 0;
+	double mtie = 0.0;
+
+	for (i = 0; i < nx; i++) {
+		while (max_tail > max_head && x[maxq[max_tail - 1]] <= x[i])
+			max_tail--;
+		maxq[max_tail++] = i;
+		while (min_tail > min_head && x[minq[min_tail - 1]] >= x[i])
+			min_tail--;
+		minq[min_tail++] = i;
+
+		if (maxq[max_head] + n < i)
+			max_head++;
+		if (minq[min_head] + n < i)
+			min_head++;
+
+		if (i >= n && x[maxq[max_head]] - x[minq[min_head]] > mtie)
+			mtie = x[maxq[max_head]] - x[minq[min_head]];
+	}
+	return mtie;
+}
+
+int replay_result(struct replay *r, struct replay_result *result)
+{
+	unsigned int i, n, *maxq, *minq;
+	double *s;
+
+	memset(result, 0, sizeof(*result));
+	if (!r->updates)
+		return -1;
+
+	result->updates = r->updates;
+	result->locked = r->nx;
+	result->jumps = r->jumps;
+	result->interval = r->interval;
+	stats_get_result(r->offset, &result->offset);
+	stats_get_result(r->freq, &result->freq);
+	stats_get_result(r->delay, &result->delay);
+
+	if (r->nx < 3)
+		return 0;
+
+	s = malloc((r->nx + 1) * sizeof(*s));
+	maxq = malloc(r->nx * sizeof(*maxq));
+	minq = malloc(r->nx * sizeof(*minq));
+	if (!s || !maxq || !minq) {
+		pr_err("low memory, skipping TDEV and MTIE");
+		goto out;
+	}
+	s[0] = 0.0;
+	for (i = 0; i < r->nx; i++)
+		s[i + 1] = s[i] + r->x[i];
+
+	for (n = 1; 3 * n <= r->nx && result->n_tau < REPLAY_MAX_TAU; n *= 2) {
+		result->tau[result->n_tau] = n * r->interval;
+		result->tdev[result->n_tau] = replay_tdev(s, r->nx, n);
+		result->mtie[result->n_tau] = replay_mtie(r->x, r->nx, n,
+							  maxq, minq);
+		result->n_tau++;
+	}
+out:
+	free(s);
+	free(maxq);
+	free(minq);
+	return 0;
+}
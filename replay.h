@@ -0,0 +1,105 @@
+/**
+ * @file replay.h
+ * @brief Replays time stamp traces through the time stamp processor and servo.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_REPLAY_H
+#define HAVE_REPLAY_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "servo.h"
+#include "stats.h"
+#include "trace.h"
+
+#define REPLAY_MAX_TAU 32
+
+/** Opaque type */
+struct replay;
+
+/**
+ * Describes one update of the servo.
+ */
+struct replay_update {
+	double time;       /* seconds since the first record */
+	int64_t offset;    /* measured offset from the master in ns */
+	double freq;       /* frequency adjustment of the servo in ppb */
+	int64_t delay;     /* current path delay in ns */
+	enum servo_state state;
+};
+
+/**
+ * Summarizes the replay of a trace.
+ */
+struct replay_result {
+	unsigned int updates;  /* number of servo updates */
+	unsigned int locked;   /* number of updates in the locked state */
+	unsigned int jumps;    /* number of clock steps */
+	struct stats_result offset;
+	struct stats_result freq;
+	struct stats_result delay;
+	double interval;       /* servo update interval in seconds */
+	int n_tau;
+	double tau[REPLAY_MAX_TAU];  /* observation intervals in seconds */
+	double tdev[REPLAY_MAX_TAU]; /* time deviation in ns */
+	double mtie[REPLAY_MAX_TAU]; /* maximum time interval error in ns */
+};
+
+/**
+ * Create a new replay, with a servo and a time stamp processor
+ * configured in the same way as by ptp4l.
+ * @param cfg        The configuration of the servo and the time stamp
+ *                   processor.
+ * @param utc_offset Offset in seconds subtracted from the origin time
+ *                   stamps, for traces of a clock running in UTC.
+ * @return A pointer to a new replay on success, NULL otherwise.
+ */
+struct replay *replay_create(struct config *cfg, int utc_offset);
+
+/**
+ * Destroy a replay.
+ * @param r Pointer obtained via @ref replay_create().
+ */
+void replay_destroy(struct replay *r);
+
+/**
+ * Feed one trace record into a replay.
+ *
+ * The recorded clock was steered by the servo which was running when
+ * the trace was taken, as described by the offset, frequency and state
+ * in the records.  The replay simulates a clock driven by its own
+ * servo instead, by accumulating the difference of the two frequency
+ * adjustments into the local time stamps.
+ *
+ * @param r      Pointer obtained via @ref replay_create().
+ * @param rec    The record.
+ * @param update Returns the servo update, if any.
+ * @return 1 if the servo was updated, 0 otherwise.
+ */
+int replay_record(struct replay *r, struct trace_record *rec,
+		  struct replay_update *update);
+
+/**
+ * Obtain the statistics of a replay.
+ * @param r      Pointer obtained via @ref replay_create().
+ * @param result Returns the statistics.
+ * @return Zero on success, non-zero if the servo was never updated.
+ */
+int replay_result(struct replay *r, struct replay_result *result);
+
+#endif
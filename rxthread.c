@@ -0,0 +1,221 @@
+/**
+ * @file rxthread.c
+ * @brief Receives messages on a socket from a dedicated thread.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "rxthread.h"
+#include "sk.h"
+
+/* How often a blocked thread checks whether it should stop. */
+#define RXTHREAD_STOP_CHECK_MS 100
+
+#define CACHE_LINE 64
+
+/*
+ * The ring is written only by the receive thread, advancing 'head', and
+ * read only by the clock thread, advancing 'tail'. The two indices live
+ * on separate cache lines.
+ */
+struct rxthread {
+	pthread_t thread;
+	rxthread_recv_fn recv;
+	void *ctx;
+	int fd;
+	int efd;
+	atomic_int stop;
+	atomic_int failed;
+	atomic_uint_fast64_t drops;
+	atomic_uint head __attribute__((aligned(CACHE_LINE)));
+	atomic_uint tail __attribute__((aligned(CACHE_LINE)));
+	struct ptp_message *ring[RXTHREAD_RING_SIZE]
+		__attribute__((aligned(CACHE_LINE)));
+};
+
+static int rxthread_push(struct rxthread *rt, struct ptp_message *m)
+{
+	unsigned int head, tail;
+
+	head = atomic_load_explicit(&rt->head, memory_order_relaxed);
+	tail = atomic_load_explicit(&rt->tail, memory_order_acquire);
+	if (head - tail == RXTHREAD_RING_SIZE) {
+		return -1;
+	}
+	rt->ring[head % RXTHREAD_RING_SIZE] = m;
+	atomic_store_explicit(&rt->head, head + 1, memory_order_release);
+	return 0;
+}
+
+static void rxthread_signal(struct rxthread *rt)
+{
+	uint64_t one = 1;
+
+	if (write(rt->efd, &one, sizeof(one)) != sizeof(one)) {
+		pr_err("rx thread: eventfd write failed: %m");
+	}
+}
+
+static void *rxthread_run(void *arg)
+{
+	struct ptp_message *msg[SK_RX_BATCH_MAX];
+	struct rxthread *rt = arg;
+	int i, n, pushed;
+	char peek;
+
+	while (!atomic_load(&rt->stop)) {
+		/*
+		 * Wait for a message without consuming it. Unlike poll(),
+		 * this ignores the transmit time stamps in the error queue,
+		 * which the clock thread collects.
+		 */
+		if (recv(rt->fd, &peek, sizeof(peek), MSG_PEEK) < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				continue;
+			}
+			pr_err("rx thread: recv failed: %m");
+			break;
+		}
+		n = rt->recv(rt->ctx, rt->fd, msg, SK_RX_BATCH_MAX);
+		if (n < 0) {
+			break;
+		}
+		for (pushed = 0, i = 0; i < n; i++) {
+			if (rxthread_push(rt, msg[i])) {
+				atomic_fetch_add(&rt->drops, 1);
+				msg_put(msg[i]);
+			} else {
+				pushed++;
+			}
+		}
+		if (pushed) {
+			rxthread_signal(rt);
+		}
+	}
+
+	if (!atomic_load(&rt->stop)) {
+		atomic_store(&rt->failed, 1);
+		rxthread_signal(rt);
+	}
+	return NULL;
+}
+
+struct rxthread *rxthread_create(int fd, int cpu, rxthread_recv_fn recv,
+				 void *ctx)
+{
+	struct timeval tmo = { 0, RXTHREAD_STOP_CHECK_MS * 1000 };
+	struct rxthread *rt;
+	cpu_set_t cpus;
+	int err;
+
+	if (posix_memalign((void **) &rt, CACHE_LINE, sizeof(*rt))) {
+		return NULL;
+	}
+	memset(rt, 0, sizeof(*rt));
+	rt->fd = fd;
+	rt->recv = recv;
+	rt->ctx = ctx;
+
+	rt->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (rt->efd < 0) {
+		pr_err("rx thread: eventfd failed: %m");
+		goto no_efd;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo))) {
+		pr_err("rx thread: setsockopt SO_RCVTIMEO failed: %m");
+		goto no_thread;
+	}
+	err = pthread_create(&rt->thread, NULL, rxthread_run, rt);
+	if (err) {
+		pr_err("rx thread: pthread_create failed: %s", strerror(err));
+		goto no_thread;
+	}
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		err = pthread_setaffinity_np(rt->thread, sizeof(cpus), &cpus);
+		if (err) {
+			pr_warning("rx thread: failed to pin to CPU %d: %s",
+				   cpu, strerror(err));
+		}
+	}
+	return rt;
+
+no_thread:
+	close(rt->efd);
+no_efd:
+	free(rt);
+	return NULL;
+}
+
+void rxthread_destroy(struct rxthread *rt)
+{
+	struct ptp_message *m;
+
+	atomic_store(&rt->stop, 1);
+	pthread_join(rt->thread, NULL);
+
+	while ((m = rxthread_pop(rt)) != NULL) {
+		msg_put(m);
+	}
+	close(rt->efd);
+	free(rt);
+}
+
+int rxthread_fd(struct rxthread *rt)
+{
+	return rt->efd;
+}
+
+int rxthread_ack(struct rxthread *rt)
+{
+	uint64_t cnt;
+
+	if (read(rt->efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) {
+		pr_err("rx thread: eventfd read failed: %m");
+	}
+	return atomic_load(&rt->failed);
+}
+
+struct ptp_message *rxthread_pop(struct rxthread *rt)
+{
+	struct ptp_message *m;
+	unsigned int head, tail;
+
+	tail = atomic_load_explicit(&rt->tail, memory_order_relaxed);
+	head = atomic_load_explicit(&rt->head, memory_order_acquire);
+	if (head == tail) {
+		return NULL;
+	}
+	m = rt->ring[tail % RXTHREAD_RING_SIZE];
+	atomic_store_explicit(&rt->tail, tail + 1, memory_order_release);
+	return m;
+}
+
+uint64_t rxthread_drops(struct rxthread *rt)
+{
+	return atomic_load(&rt->drops);
+}
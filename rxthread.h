@@ -0,0 +1,93 @@
+/**
+ * @file rxthread.h
+ * @brief Receives messages on a socket from a dedicated thread.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_RXTHREAD_H
+#define HAVE_RXTHREAD_H
+
+#include <stdint.h>
+
+#include "msg.h"
+
+/** Number of messages a receive thread can hand off without a reader. */
+#define RXTHREAD_RING_SIZE 256
+
+struct rxthread;
+
+/**
+ * Receives messages from a socket that has data ready to be read.
+ * This function is called from the receive thread.
+ * @param ctx  The context passed to @ref rxthread_create().
+ * @param fd   The socket to read.
+ * @param msg  Array to hold the received messages.
+ * @param n    Number of entries in 'msg'.
+ * @return     The number of messages to hand off, or negative on failure,
+ *             in which case the thread stops.
+ */
+typedef int (*rxthread_recv_fn)(void *ctx, int fd, struct ptp_message **msg,
+				int n);
+
+/**
+ * Starts a new receive thread.
+ * @param fd    The socket to read.
+ * @param cpu   The CPU to run the thread on, or -1 for any CPU.
+ * @param recv  Function that reads from the socket.
+ * @param ctx   Context passed to 'recv'.
+ * @return      A pointer to a new receive thread on success, NULL otherwise.
+ */
+struct rxthread *rxthread_create(int fd, int cpu, rxthread_recv_fn recv,
+				 void *ctx);
+
+/**
+ * Stops a receive thread and releases the messages it still holds.
+ * @param rt  A thread obtained via @ref rxthread_create().
+ */
+void rxthread_destroy(struct rxthread *rt);
+
+/**
+ * Obtains a descriptor that becomes readable when the thread has handed
+ * off new messages or has failed.
+ * @param rt  The receive thread.
+ * @return    An eventfd descriptor.
+ */
+int rxthread_fd(struct rxthread *rt);
+
+/**
+ * Acknowledges a wake up on the descriptor from @ref rxthread_fd().
+ * Call this before draining the thread with @ref rxthread_pop().
+ * @param rt  The receive thread.
+ * @return    Zero while the thread is running, or non-zero if it has
+ *            stopped because of a receive failure.
+ */
+int rxthread_ack(struct rxthread *rt);
+
+/**
+ * Takes the next message handed off by a receive thread.
+ * @param rt  The receive thread.
+ * @return    A message, owned by the caller, or NULL if none is pending.
+ */
+struct ptp_message *rxthread_pop(struct rxthread *rt);
+
+/**
+ * Obtains the number of messages dropped because the ring was full.
+ * @param rt  The receive thread.
+ * @return    The number of dropped messages.
+ */
+uint64_t rxthread_drops(struct rxthread *rt);
+
+#endif
@@ -35,6 +35,7 @@ enum servo_type {
 	CLOCK_SERVO_LINREG,
 	CLOCK_SERVO_NTPSHM,
 	CLOCK_SERVO_NULLF,
+	CLOCK_SERVO_KALMAN,
 };
 
 /**
@@ -59,6 +60,17 @@ enum servo_state {
 	SERVO_LOCKED,
 };
 
+/**
+ * Describes the current operation of a clock servo.
+ */
+struct servo_status {
+	double kp;            /* proportional gain, zero if not a PI servo */
+	double ki;            /* integral gain, zero if not a PI servo */
+	double gain_scale;    /* factor applied to the configured gains */
+	double offset_stddev; /* standard deviation of the locked offset in ns */
+	double freq_stddev;   /* standard deviation of the frequency in ppb */
+};
+
 /**
  * Create a new instance of a clock servo.
  * @param type    The type of the servo to create.
@@ -123,4 +135,12 @@ double servo_rate_ratio(struct servo *servo);
  */
 void servo_leap(struct servo *servo, int leap);
 
+/**
+ * Obtain the current status of a clock servo.
+ * @param servo   Pointer to a servo obtained via @ref servo_create().
+ * @param status  Returns the status. Servos which do not track their
+ *                gains and lock quality report all zeros.
+ */
+void servo_status(struct servo *servo, struct servo_status *status);
+
 #endif
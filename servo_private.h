@@ -40,6 +40,8 @@ struct servo {
 	double (*rate_ratio)(struct servo *servo);
 
 	void (*leap)(struct servo *servo, int leap);
+
+	void (*status)(struct servo *servo, struct servo_status *status);
 };
 
 #endif
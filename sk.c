@@ -18,11 +18,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <errno.h>
+#include <linux/filter.h>
 #include <linux/net_tstamp.h>
 #include <linux/sockios.h>
 #include <linux/ethtool.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netpacket/packet.h>
+#include <time.h>
+#include <linux/errqueue.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
@@ -40,6 +44,7 @@
 
 int sk_tx_timeout = 1;
 int sk_check_fupsync;
+int sk_tx_async;
 
 /* private methods */
 
@@ -284,15 +289,70 @@ int sk_interface_addr(const char *name, int family, struct address *addr)
 static short sk_events = POLLPRI;
 static short sk_revents = POLLPRI;
 
+static int sk_parse_cmsg(struct msghdr *msg, struct hw_timestamp *hwts,
+			 uint32_t *key)
+{
+	struct sock_extended_err *err;
+	struct timespec *sw, *ts = NULL;
+	int level, type;
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		level = cm->cmsg_level;
+		type  = cm->cmsg_type;
+		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
+			if (cm->cmsg_len < sizeof(*ts) * 3) {
+				pr_warning("short SO_TIMESTAMPING message");
+				return -1;
+			}
+			ts = (struct timespec *) CMSG_DATA(cm);
+		}
+		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
+			if (cm->cmsg_len < sizeof(*sw)) {
+				pr_warning("short SO_TIMESTAMPNS message");
+				return -1;
+			}
+			sw = (struct timespec *) CMSG_DATA(cm);
+			hwts->sw = timespec_to_tmv(*sw);
+		}
+		if (key && ((SOL_IP == level && IP_RECVERR == type) ||
+			    (SOL_IPV6 == level && IPV6_RECVERR == type) ||
+			    (SOL_PACKET == level && PACKET_TX_TIMESTAMP == type))) {
+			err = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (err->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+				*key = err->ee_data;
+			}
+		}
+	}
+
+	if (!ts) {
+		memset(&hwts->ts, 0, sizeof(hwts->ts));
+		return 0;
+	}
+
+	switch (hwts->type) {
+	case TS_SOFTWARE:
+		hwts->ts = timespec_to_tmv(ts[0]);
+		break;
+	case TS_HARDWARE:
+	case TS_ONESTEP:
+	case TS_P2P1STEP:
+		hwts->ts = timespec_to_tmv(ts[2]);
+		break;
+	case TS_LEGACY_HW:
+		hwts->ts = timespec_to_tmv(ts[1]);
+		break;
+	}
+	return 0;
+}
+
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags)
 {
 	char control[256];
-	int cnt = 0, res = 0, level, type;
-	struct cmsghdr *cm;
+	int cnt = 0, res = 0;
 	struct iovec iov = { buf, buflen };
 	struct msghdr msg;
-	struct timespec *sw, *ts = NULL;
 
 	memset(control, 0, sizeof(control));
 	memset(&msg, 0, sizeof(msg));
@@ -325,50 +385,170 @@ int sk_receive(int fd, void *buf, int buflen,
 		pr_err("recvmsg%sfailed: %m",
 		       flags == MSG_ERRQUEUE ? " tx timestamp " : " ");
 
-	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
-		level = cm->cmsg_level;
-		type  = cm->cmsg_type;
-		if (SOL_SOCKET == level && SO_TIMESTAMPING == type) {
-			if (cm->cmsg_len < sizeof(*ts) * 3) {
-				pr_warning("short SO_TIMESTAMPING message");
-				return -1;
-			}
-			ts = (struct timespec *) CMSG_DATA(cm);
-		}
-		if (SOL_SOCKET == level && SO_TIMESTAMPNS == type) {
-			if (cm->cmsg_len < sizeof(*sw)) {
-				pr_warning("short SO_TIMESTAMPNS message");
-				return -1;
-			}
-			sw = (struct timespec *) CMSG_DATA(cm);
-			hwts->sw = timespec_to_tmv(*sw);
-		}
+	if (sk_parse_cmsg(&msg, hwts, NULL)) {
+		return -1;
 	}
 
 	if (addr)
 		addr->len = msg.msg_namelen;
 
-	if (!ts) {
-		memset(&hwts->ts, 0, sizeof(hwts->ts));
+	return cnt;
+}
+
+int sk_receive_batch(int fd, struct sk_rx *rx, int n)
+{
+	char control[SK_RX_BATCH_MAX][256];
+	struct mmsghdr msgs[SK_RX_BATCH_MAX];
+	struct iovec iov[SK_RX_BATCH_MAX];
+	struct msghdr *msg;
+	int cnt, i;
+
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	memset(msgs, 0, n * sizeof(msgs[0]));
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = rx[i].buf;
+		iov[i].iov_len = rx[i].buflen;
+		msg = &msgs[i].msg_hdr;
+		if (rx[i].addr) {
+			msg->msg_name = &rx[i].addr->ss;
+			msg->msg_namelen = sizeof(rx[i].addr->ss);
+		}
+		msg->msg_iov = &iov[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = control[i];
+		msg->msg_controllen = sizeof(control[i]);
+	}
+
+	cnt = recvmmsg(fd, msgs, n, MSG_WAITFORONE, NULL);
+	if (cnt < 1) {
+		pr_err("recvmmsg failed: %m");
 		return cnt;
 	}
 
-	switch (hwts->type) {
-	case TS_SOFTWARE:
-		hwts->ts = timespec_to_tmv(ts[0]);
-		break;
-	case TS_HARDWARE:
-	case TS_ONESTEP:
-	case TS_P2P1STEP:
-		hwts->ts = timespec_to_tmv(ts[2]);
-		break;
-	case TS_LEGACY_HW:
-		hwts->ts = timespec_to_tmv(ts[1]);
-		break;
+	for (i = 0; i < cnt; i++) {
+		msg = &msgs[i].msg_hdr;
+		rx[i].cnt = msgs[i].msg_len;
+		if (sk_parse_cmsg(msg, rx[i].hwts, NULL)) {
+			rx[i].cnt = -1;
+		}
+		if (rx[i].addr) {
+			rx[i].addr->len = msg->msg_namelen;
+		}
 	}
 	return cnt;
 }
 
+int sk_send_batch(int fd, struct sk_tx *tx, int n)
+{
+	struct mmsghdr msgs[SK_TX_BATCH_MAX];
+	struct iovec iov[SK_TX_BATCH_MAX];
+	struct msghdr *msg;
+	int cnt, i, sent = 0;
+
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	memset(msgs, 0, n * sizeof(msgs[0]));
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = tx[i].buf;
+		iov[i].iov_len = tx[i].len;
+		msg = &msgs[i].msg_hdr;
+		if (tx[i].addr) {
+			msg->msg_name = &tx[i].addr->sa;
+			msg->msg_namelen = tx[i].addr->len;
+		}
+		msg->msg_iov = &iov[i];
+		msg->msg_iovlen = 1;
+	}
+
+	/* A partial transfer leaves the rest of the batch to retry. */
+	while (sent < n) {
+		cnt = sendmmsg(fd, msgs + sent, n - sent, 0);
+		if (cnt < 1) {
+			pr_err("sendmmsg failed: %m");
+			return sent ? sent : cnt;
+		}
+		sent += cnt;
+	}
+	return sent;
+}
+
+int sk_poll_txts(struct pollfd *pfd, int n, int timeout)
+{
+	int cnt, i, ready = 0;
+
+	for (i = 0; i < n; i++) {
+		pfd[i].events = sk_events;
+		pfd[i].revents = 0;
+	}
+	cnt = poll(pfd, n, timeout);
+	if (cnt < 1) {
+		if (cnt < 0) {
+			pr_err("poll for tx timestamp failed: %m");
+		}
+		return cnt;
+	}
+	for (i = 0; i < n; i++) {
+		pfd[i].revents &= sk_revents;
+		if (pfd[i].revents) {
+			ready++;
+		}
+	}
+	return ready;
+}
+
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key)
+{
+	char control[256];
+	unsigned char junk[1600];
+	struct iovec iov = { junk, sizeof(junk) };
+	struct msghdr msg;
+	int cnt;
+
+	memset(control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	cnt = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+	if (cnt < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		pr_err("recvmsg tx timestamp failed: %m");
+		return cnt;
+	}
+
+	*key = 0;
+	if (sk_parse_cmsg(&msg, hwts, key)) {
+		return -1;
+	}
+	return 1;
+}
+
+int sk_set_domain_filter(int fd, int offset, int domain)
+{
+	struct sock_filter filter[] = {
+		{BPF_LD  | BPF_B | BPF_ABS, 0, 0, offset + 4}, /*domainNumber*/
+		{BPF_JMP | BPF_JEQ | BPF_K, 0, 1, domain},
+		{BPF_RET | BPF_K,           0, 0, 0xffff},  /*accept*/
+		{BPF_RET | BPF_K,           0, 0, 0},       /*reject*/
+	};
+	struct sock_fprog prg = { 4, filter };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prg, sizeof(prg))) {
+		pr_err("setsockopt SO_ATTACH_FILTER failed: %m");
+		return -1;
+	}
+	return 0;
+}
+
 int sk_set_priority(int fd, uint8_t dscp)
 {
 	int tos;
@@ -419,6 +599,10 @@ int sk_timestamping_init(int fd, const char *device, enum timestamp_type type,
 		return -1;
 	}
 
+	if (sk_tx_async) {
+		flags |= SOF_TIMESTAMPING_OPT_ID;
+	}
+
 	if (type != TS_SOFTWARE) {
 		filter1 = HWTSTAMP_FILTER_PTP_V2_EVENT;
 		switch (type) {
@@ -20,6 +20,8 @@
 #ifndef HAVE_SK_H
 #define HAVE_SK_H
 
+#include <poll.h>
+
 #include "address.h"
 #include "transport.h"
 
@@ -39,6 +41,38 @@ struct sk_ts_info {
 	unsigned int rx_filters;
 };
 
+/**
+ * Describes one message buffer for sk_receive_batch().
+ * @buf:     Buffer to receive the message.
+ * @buflen:  Size of 'buf' in bytes.
+ * @addr:    Receives the message's source address. May be NULL.
+ * @hwts:    Receives the message's time stamp.
+ * @cnt:     Returns the length of the received message.
+ */
+struct sk_rx {
+	void *buf;
+	int buflen;
+	struct address *addr;
+	struct hw_timestamp *hwts;
+	int cnt;
+};
+
+#define SK_RX_BATCH_MAX 32
+
+/**
+ * Describes one message for sk_send_batch().
+ * @buf:     The message to send.
+ * @len:     Length of 'buf' in bytes.
+ * @addr:    Destination address, or NULL for a connected socket.
+ */
+struct sk_tx {
+	void *buf;
+	int len;
+	struct address *addr;
+};
+
+#define SK_TX_BATCH_MAX 32
+
 /**
  * Obtains a socket suitable for use with sk_interface_index().
  * @return  An open socket on success, -1 otherwise.
@@ -99,6 +133,61 @@ int sk_interface_addr(const char *name, int family, struct address *addr);
 int sk_receive(int fd, void *buf, int buflen,
 	       struct address *addr, struct hw_timestamp *hwts, int flags);
 
+/**
+ * Read as many as 'n' messages from a socket using a single system call.
+ * The call waits for the first message, and then takes whatever else is
+ * already queued on the socket.
+ * @param fd   An open socket.
+ * @param rx   Array of buffers to receive the messages.
+ * @param n    Number of entries in 'rx', at most SK_RX_BATCH_MAX.
+ * @return     The number of messages received, or negative on failure.
+ */
+int sk_receive_batch(int fd, struct sk_rx *rx, int n);
+
+/**
+ * Send as many as 'n' messages on a socket using a single system call.
+ * No transmit time stamps are collected.
+ * @param fd   An open socket.
+ * @param tx   Array of messages to send.
+ * @param n    Number of entries in 'tx', at most SK_TX_BATCH_MAX.
+ * @return     The number of messages sent, or negative on failure.
+ */
+int sk_send_batch(int fd, struct sk_tx *tx, int n);
+
+/**
+ * Wait for transmit time stamps to arrive on a set of sockets.
+ * @param pfd      Array of descriptors to wait on. The caller fills in
+ *                 the 'fd' fields. On return, 'revents' is non-zero for
+ *                 each socket having a time stamp in its error queue.
+ * @param n        Number of entries in 'pfd'.
+ * @param timeout  Maximum time to wait, in milliseconds.
+ * @return         The number of ready sockets, zero on timeout, or
+ *                 negative on failure.
+ */
+int sk_poll_txts(struct pollfd *pfd, int n, int timeout);
+
+/**
+ * Fetch one transmit time stamp from a socket's error queue without
+ * blocking. The socket must have been prepared by sk_timestamping_init()
+ * while sk_tx_async was set.
+ * @param fd      An open socket.
+ * @param hwts    Pointer to a buffer to receive the time stamp.
+ * @param key     Returns the SO_TIMESTAMPING OPT_ID key of the packet.
+ * @return        One if a time stamp was read, zero if the error queue
+ *                is empty, and negative on failure.
+ */
+int sk_receive_txts(int fd, struct hw_timestamp *hwts, uint32_t *key);
+
+/**
+ * Attach a socket filter that only accepts PTP messages of one domain.
+ * @param fd      An open socket.
+ * @param offset  Offset of the PTP header within the packets seen by
+ *                the filter, for example the size of the UDP header.
+ * @param domain  The domainNumber to accept.
+ * @return Zero on success, negative on failure
+ */
+int sk_set_domain_filter(int fd, int offset, int domain);
+
 /**
  * Set DSCP value for socket.
  * @param fd    An open socket.
@@ -131,4 +220,10 @@ extern int sk_tx_timeout;
  */
 extern int sk_check_fupsync;
 
+/**
+ * Requests the SO_TIMESTAMPING OPT_ID key on transmit time stamps, so
+ * that they may be collected asynchronously using sk_receive_txts().
+ */
+extern int sk_tx_async;
+
 #endif
@@ -0,0 +1,207 @@
+/**
+ * @file status.c
+ * @brief Publishes the status of a clock in shared memory.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "status.h"
+
+#define STATUS_READ_RETRIES 100
+/* The writer updates the snapshot on every pass of its event loop. */
+#define STATUS_STALE_NS 5000000000ULL
+
+struct status {
+	struct status_header *hdr;
+	struct status_data *data;
+	char *path;
+	size_t size;
+	int writer;
+};
+
+static struct status *status_map(const char *path, int fd, int writer)
+{
+	struct status *s;
+	void *map;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->path = strdup(path);
+	if (!s->path) {
+		free(s);
+		return NULL;
+	}
+	s->size = sizeof(*s->hdr) + sizeof(*s->data);
+	s->writer = writer;
+
+	map = mmap(NULL, s->size, writer ? PROT_READ | PROT_WRITE : PROT_READ,
+		   MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		pr_err("failed to map status file %s: %m", path);
+		free(s->path);
+		free(s);
+		return NULL;
+	}
+	s->hdr = map;
+	s->data = (struct status_data *) (s->hdr + 1);
+	return s;
+}
+
+struct status *status_create(const char *path)
+{
+	struct status *s;
+	int fd;
+
+	/*
+	 * Replace the file rather than truncating it, as readers may
+	 * still map the file of a previous instance.
+	 */
+	unlink(path);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0) {
+		pr_err("failed to create status file %s: %m", path);
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(struct status_header) +
+		      sizeof(struct status_data))) {
+		pr_err("failed to resize status file %s: %m", path);
+		close(fd);
+		unlink(path);
+		return NULL;
+	}
+	s = status_map(path, fd, 1);
+	close(fd);
+	if (!s) {
+		unlink(path);
+		return NULL;
+	}
+
+	s->hdr->version = STATUS_VERSION;
+	s->hdr->size = sizeof(*s->data);
+	s->hdr->sequence = 0;
+	s->hdr->pid = getpid();
+	__atomic_store_n(&s->hdr->magic, STATUS_MAGIC, __ATOMIC_RELEASE);
+	return s;
+}
+
+struct status *status_open(const char *path)
+{
+	struct status *s;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			pr_err("failed to open status file %s: %m", path);
+		return NULL;
+	}
+	if (fstat(fd, &st) || st.st_size < sizeof(struct status_header) +
+	    sizeof(struct status_data)) {
+		close(fd);
+		return NULL;
+	}
+	s = status_map(path, fd, 0);
+	close(fd);
+	if (!s)
+		return NULL;
+
+	if (s->hdr->version != STATUS_VERSION ||
+	    s->hdr->size != sizeof(*s->data)) {
+		pr_err("unsupported status file %s", path);
+		status_destroy(s);
+		return NULL;
+	}
+	return s;
+}
+
+void status_destroy(struct status *s)
+{
+	if (s->writer) {
+		__atomic_store_n(&s->hdr->magic, 0, __ATOMIC_RELEASE);
+		unlink(s->path);
+	}
+	munmap(s->hdr, s->size);
+	free(s->path);
+	free(s);
+}
+
+void status_write(struct status *s, struct status_data *d)
+{
+	uint32_t seq = s->hdr->sequence;
+
+	__atomic_store_n(&s->hdr->sequence, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(s->data, d, sizeof(*d));
+	__atomic_store_n(&s->hdr->sequence, seq + 2, __ATOMIC_RELEASE);
+}
+
+int status_orphaned(struct status *s)
+{
+	pid_t pid;
+
+	if (__atomic_load_n(&s->hdr->magic, __ATOMIC_ACQUIRE) != STATUS_MAGIC)
+		return 0;
+	pid = __atomic_load_n(&s->hdr->pid, __ATOMIC_RELAXED);
+	return kill(pid, 0) && errno == ESRCH;
+}
+
+static uint64_t status_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int status_read(struct status *s, struct status_data *d)
+{
+	uint32_t seq;
+	int i;
+
+	for (i = 0; i < STATUS_READ_RETRIES; i++) {
+		if (__atomic_load_n(&s->hdr->magic, __ATOMIC_ACQUIRE) !=
+		    STATUS_MAGIC)
+			return -1;
+		seq = __atomic_load_n(&s->hdr->sequence, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(d, s->data, sizeof(*d));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&s->hdr->sequence, __ATOMIC_RELAXED) != seq)
+			continue;
+		/* The file may have been written by anyone. */
+		if (d->num_ports > STATUS_MAX_PORTS)
+			d->num_ports = STATUS_MAX_PORTS;
+		/* Only look for the writer once its updates have stopped. */
+		if (status_now() - d->update > STATUS_STALE_NS &&
+		    status_orphaned(s))
+			return -1;
+		return seq ? 0 : -1;
+	}
+	return -1;
+}
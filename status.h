@@ -0,0 +1,133 @@
+/**
+ * @file status.h
+ * @brief Publishes the status of a clock in shared memory.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_STATUS_H
+#define HAVE_STATUS_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ddt.h"
+
+/*
+ * The status file holds a header followed by one snapshot of the
+ * status, protected by a sequence lock.  The writer makes the sequence
+ * odd while it updates the snapshot, and even again when it is done.
+ * Readers copy the snapshot and retry if the sequence was odd or has
+ * changed in the meantime, so they never block the writer.  All of the
+ * fields are stored in host byte order.
+ */
+
+#define STATUS_MAGIC	0x50545353 /* "PTSS" */
+#define STATUS_VERSION	1
+#define STATUS_MAX_PORTS 32
+
+struct status_header {
+	uint32_t magic;    /* zero once the writer has gone away */
+	uint16_t version;
+	uint16_t size;     /* size of the snapshot */
+	uint32_t sequence;
+	uint32_t pid;      /* process ID of the writer */
+};
+
+struct status_port {
+	uint16_t number;
+	uint8_t  state;        /* enum port_state */
+	uint8_t  timestamping; /* enum timestamp_type */
+	uint32_t reserved;
+	int64_t  peer_delay;   /* ns, with the peer delay mechanism */
+	char     name[MAX_IFNAME_SIZE + 1];
+};
+
+struct status_data {
+	uint64_t update;            /* CLOCK_MONOTONIC time of the update */
+	int64_t  master_offset;     /* ns */
+	int64_t  ingress_time;      /* ns, of the last Sync */
+	int64_t  path_delay;        /* ns */
+	double   freq;              /* frequency adjustment in ppb */
+	struct ClockIdentity clock_identity;
+	struct ClockIdentity grandmaster_identity;
+	uint16_t steps_removed;
+	int16_t  current_utc_offset;
+	uint8_t  time_flags;        /* flags of the timePropertiesDS */
+	uint8_t  time_source;
+	uint8_t  servo_state;       /* enum servo_state */
+	uint8_t  domain;
+	uint8_t  clock_class;
+	uint8_t  clock_accuracy;
+	uint8_t  gm_present;
+	uint8_t  reserved;
+	uint16_t num_ports;
+	struct status_port port[STATUS_MAX_PORTS];
+};
+
+/** Opaque type */
+struct status;
+
+/**
+ * Create a status file for writing.  Any existing file is replaced.
+ * @param path  The path of the file.
+ * @return A pointer to a new status on success, NULL otherwise.
+ */
+struct status *status_create(const char *path);
+
+/**
+ * Open an existing status file for reading.
+ * @param path  The path of the file.
+ * @return A pointer to a new status on success, NULL otherwise.
+ */
+struct status *status_open(const char *path);
+
+/**
+ * Close a status file.  The writer marks the snapshot as invalid and
+ * removes the file.
+ * @param s Pointer obtained via @ref status_create() or @ref status_open().
+ */
+void status_destroy(struct status *s);
+
+/**
+ * Publish a new snapshot.
+ * @param s Pointer obtained via @ref status_create().
+ * @param d The new snapshot.
+ */
+void status_write(struct status *s, struct status_data *d);
+
+/**
+ * Obtain a consistent copy of the current snapshot.  The number of
+ * ports is limited to STATUS_MAX_PORTS, so that the caller may index
+ * the ports without checking it again.
+ * @param s Pointer obtained via @ref status_open().
+ * @param d Returns the snapshot.
+ * @return Zero on success, non-zero if the writer has gone away or
+ *         no consistent snapshot could be obtained.  A snapshot which
+ *         has not been updated for a few seconds is refused when its
+ *         writer is no longer running.
+ */
+int status_read(struct status *s, struct status_data *d);
+
+/**
+ * Check whether a status file was left behind by a writer which died
+ * without closing it.  Such a file keeps its last snapshot until the
+ * writer is started again.
+ * @param s Pointer obtained via @ref status_open().
+ * @return Non-zero if the file is orphaned, zero otherwise.
+ */
+int status_orphaned(struct status *s);
+
+#endif
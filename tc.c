@@ -17,7 +17,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335 USA.
  */
 #include <stdlib.h>
+#include <string.h>
 
+#include "arena.h"
 #include "port.h"
 #include "print.h"
 #include "tc.h"
@@ -30,7 +32,19 @@ enum tc_match {
 	TC_DELAY_REQRESP,
 };
 
-static TAILQ_HEAD(tc_pool, tc_txd) tc_pool = TAILQ_HEAD_INITIALIZER(tc_pool);
+enum tc_class {
+	TC_CLASS_SYFUP,
+	TC_CLASS_DELAY,
+};
+
+static struct arena *tc_arena;
+
+/* Egress ports awaiting a transmit time stamp in tc_fwd_event(). */
+static struct {
+	struct pollfd *pfd;
+	struct port **port;
+	int size;
+} tc_egress;
 
 static int tc_match_delay(int ingress_port, struct ptp_message *resp,
 			  struct tc_txd *txd);
@@ -38,17 +52,62 @@ static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
 			  struct tc_txd *txd);
 static void tc_recycle(struct tc_txd *txd);
 
+static struct arena *tc_pool(void)
+{
+	if (!tc_arena) {
+		tc_arena = arena_create("TC", sizeof(struct tc_txd), 0, 0);
+	}
+	return tc_arena;
+}
+
 static struct tc_txd *tc_allocate(void)
 {
-	struct tc_txd *txd = TAILQ_FIRST(&tc_pool);
+	struct arena *pool = tc_pool();
 
-	if (txd) {
-		TAILQ_REMOVE(&tc_pool, txd, list);
-		memset(txd, 0, sizeof(*txd));
-		return txd;
+	return pool ? arena_alloc(pool) : NULL;
+}
+
+/*
+ * Descriptors are hashed by ingress port, the identity of the port that
+ * originated the Sync or Delay_Req, sequence ID, and message class, so
+ * that both halves of a Sync/Follow_Up or Delay_Req/Delay_Resp pair land
+ * in the same bucket. The sequence ID is used in network byte order.
+ */
+static struct tch *tc_bucket(struct port *p, int ingress_port,
+			     struct PortIdentity *pid, UInteger16 seqid,
+			     enum tc_class class)
+{
+	uint32_t h = 2166136261u;
+	unsigned int i;
+
+	for (i = 0; i < sizeof(pid->clockIdentity.id); i++) {
+		h = (h ^ pid->clockIdentity.id[i]) * 16777619u;
 	}
-	txd = calloc(1, sizeof(*txd));
-	return txd;
+	h = (h ^ pid->portNumber) * 16777619u;
+	h = (h ^ seqid) * 16777619u;
+	h = (h ^ ingress_port) * 16777619u;
+	h = (h ^ class) * 16777619u;
+
+	return &p->tc_hash[h % TC_HASH_SIZE];
+}
+
+static void tc_insert(struct port *p, struct tc_txd *txd, enum tc_class class)
+{
+	struct ptp_message *m = txd->msg;
+	struct tch *bucket;
+
+	bucket = tc_bucket(p, txd->ingress_port, &m->header.sourcePortIdentity,
+			   m->header.sequenceId, class);
+	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	LIST_INSERT_HEAD(bucket, txd, hash);
+}
+
+static void tc_remove(struct port *p, struct tc_txd *txd)
+{
+	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
+	LIST_REMOVE(txd, hash);
+	msg_put(txd->msg);
+	tc_recycle(txd);
 }
 
 static int tc_blocked(struct port *q, struct port *p, struct ptp_message *m)
@@ -134,14 +193,14 @@ static void tc_complete_request(struct port *q, struct port *p,
 	txd->msg = req;
 	txd->residence = residence;
 	txd->ingress_port = portnum(q);
-	TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+	tc_insert(p, txd, TC_CLASS_DELAY);
 }
 
 static void tc_complete_response(struct port *q, struct port *p,
 				 struct ptp_message *resp, tmv_t residence)
 {
-	enum tc_match type = TC_MISMATCH;
-	struct tc_txd *txd;
+	struct tc_txd *txd, *tmp = NULL;
+	struct tch *bucket;
 	Integer64 c1, c2;
 	int cnt;
 
@@ -149,16 +208,21 @@ static void tc_complete_response(struct port *q, struct port *p,
 	pr_err("complete delay response from port %hd to %hd seqid %hu",
 	       portnum(q), portnum(p), ntohs(resp->header.sequenceId));
 #endif
-	TAILQ_FOREACH(txd, &q->tc_transmitted, list) {
-		type = tc_match_delay(portnum(p), resp, txd);
-		if (type == TC_DELAY_REQRESP) {
-			residence = txd->residence;
-			break;
+	bucket = tc_bucket(q, portnum(p), &resp->delay_resp.requestingPortIdentity,
+			   resp->header.sequenceId, TC_CLASS_DELAY);
+
+	/* The bucket is newest first. Match the oldest entry. */
+	LIST_FOREACH(txd, bucket, hash) {
+		if (tc_match_delay(portnum(p), resp, txd) == TC_DELAY_REQRESP) {
+			tmp = txd;
 		}
 	}
-	if (type != TC_DELAY_REQRESP) {
+	if (!tmp) {
 		return;
 	}
+	txd = tmp;
+	residence = txd->residence;
+
 	c1 = net2host64(resp->header.correction);
 	c2 = c1 + tmv_to_TimeInterval(residence);
 	resp->header.correction = host2net64(c2);
@@ -169,40 +233,46 @@ static void tc_complete_response(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	resp->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_remove(q, txd);
 }
 
 static void tc_complete_syfup(struct port *q, struct port *p,
 			      struct ptp_message *msg, tmv_t residence)
 {
-	enum tc_match type = TC_MISMATCH;
+	enum tc_match match, type = TC_MISMATCH;
+	struct tc_txd *txd, *tmp = NULL;
 	struct ptp_message *fup;
-	struct tc_txd *txd;
+	struct tch *bucket;
 	Integer64 c1, c2;
 	int cnt;
 
-	TAILQ_FOREACH(txd, &p->tc_transmitted, list) {
-		type = tc_match_syfup(portnum(q), msg, txd);
-		switch (type) {
-		case TC_MISMATCH:
-			break;
-		case TC_SYNC_FUP:
-			fup = msg;
-			residence = txd->residence;
-			break;
-		case TC_FUP_SYNC:
-			fup = txd->msg;
-			break;
-		case TC_DELAY_REQRESP:
-			pr_err("tc: unexpected match of delay request - sync!");
-			return;
-		}
-		if (type != TC_MISMATCH) {
-			break;
+	bucket = tc_bucket(p, portnum(q), &msg->header.sourcePortIdentity,
+			   msg->header.sequenceId, TC_CLASS_SYFUP);
+
+	/* The bucket is newest first. Match the oldest entry. */
+	LIST_FOREACH(txd, bucket, hash) {
+		match = tc_match_syfup(portnum(q), msg, txd);
+		if (match != TC_MISMATCH) {
+			type = match;
+			tmp = txd;
 		}
 	}
+	txd = tmp;
+
+	switch (type) {
+	case TC_MISMATCH:
+		break;
+	case TC_SYNC_FUP:
+		fup = msg;
+		residence = txd->residence;
+		break;
+	case TC_FUP_SYNC:
+		fup = txd->msg;
+		break;
+	case TC_DELAY_REQRESP:
+		pr_err("tc: unexpected match of delay request - sync!");
+		return;
+	}
 
 	if (type == TC_MISMATCH) {
 		txd = tc_allocate();
@@ -214,7 +284,7 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 		txd->msg = msg;
 		txd->residence = residence;
 		txd->ingress_port = portnum(q);
-		TAILQ_INSERT_TAIL(&p->tc_transmitted, txd, list);
+		tc_insert(p, txd, TC_CLASS_SYFUP);
 		return;
 	}
 
@@ -230,9 +300,7 @@ static void tc_complete_syfup(struct port *q, struct port *p,
 	}
 	/* Restore original correction value for next egress port. */
 	fup->header.correction = host2net64(c1);
-	TAILQ_REMOVE(&p->tc_transmitted, txd, list);
-	msg_put(txd->msg);
-	tc_recycle(txd);
+	tc_remove(p, txd);
 }
 
 static void tc_complete(struct port *q, struct port *p,
@@ -263,12 +331,77 @@ static int tc_current(struct ptp_message *m, struct timespec now)
 	return t2 - t1 < tmo;
 }
 
+static int tc_egress_grow(void)
+{
+	struct pollfd *pfd;
+	struct port **port;
+	int n = tc_egress.size ? 2 * tc_egress.size : 8;
+
+	pfd = realloc(tc_egress.pfd, n * sizeof(*pfd));
+	if (!pfd) {
+		return -1;
+	}
+	tc_egress.pfd = pfd;
+	port = realloc(tc_egress.port, n * sizeof(*port));
+	if (!port) {
+		return -1;
+	}
+	tc_egress.port = port;
+	tc_egress.size = n;
+	return 0;
+}
+
+static int64_t tc_now_ms(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/*
+ * Fetches the transmit time stamp of 'msg' from the egress port in slot
+ * 'i' and completes the forwarding on that port.
+ */
+static void tc_fwd_txts(struct port *q, int i, struct ptp_message *msg,
+			tmv_t ingress)
+{
+	struct port *p = tc_egress.port[i];
+	tmv_t egress, residence;
+	uint32_t key;
+	double rr;
+	int cnt;
+
+	cnt = transport_txts_async(p->trp, &p->fda, &msg->hwts, &key);
+	if (!cnt) {
+		/* Spurious wake up, keep waiting. */
+		return;
+	}
+	tc_egress.port[i] = NULL;
+
+	if (cnt < 0 || !msg_sots_valid(msg)) {
+		pr_err("failed to fetch txts on port %hd to %hd event",
+			portnum(q), portnum(p));
+		p->tc_txts_failures++;
+		port_dispatch(p, EV_FAULT_DETECTED, 0);
+		return;
+	}
+	ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
+	egress = msg->hwts.ts;
+	residence = tmv_sub(egress, ingress);
+	rr = clock_rate_ratio(q->clock);
+	if (rr != 1.0) {
+		residence = dbl_tmv(tmv_dbl(residence) * rr);
+	}
+	tc_complete(q, p, msg, residence);
+}
+
 static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 {
-	tmv_t egress, ingress = msg->hwts.ts, residence;
+	tmv_t ingress = msg->hwts.ts;
+	int cnt, err = 0, i, n = 0, pending;
+	int64_t deadline, tmo;
 	struct port *p;
-	int cnt, err;
-	double rr;
 
 	clock_gettime(CLOCK_MONOTONIC, &msg->ts.host);
 
@@ -282,29 +415,56 @@ static int tc_fwd_event(struct port *q, struct ptp_message *msg)
 			pr_err("failed to forward event from port %hd to %hd",
 				portnum(q), portnum(p));
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
-		}
-	}
-
-	/* Go back and gather the transmit time stamps. */
-	for (p = clock_first_port(q->clock); p; p = LIST_NEXT(p, list)) {
-		if (tc_blocked(q, p, msg)) {
 			continue;
 		}
-		err = transport_txts(p->trp, &p->fda, msg);
-		if (err || !msg_sots_valid(msg)) {
-			pr_err("failed to fetch txts on port %hd to %hd event",
-				portnum(q), portnum(p));
+		if (n == tc_egress.size && tc_egress_grow()) {
+			pr_err("failed to allocate tc egress table");
 			port_dispatch(p, EV_FAULT_DETECTED, 0);
 			continue;
 		}
-		ts_add(&msg->hwts.ts, p->tx_timestamp_offset);
-		egress = msg->hwts.ts;
-		residence = tmv_sub(egress, ingress);
-		rr = clock_rate_ratio(q->clock);
-		if (rr != 1.0) {
-			residence = dbl_tmv(tmv_dbl(residence) * rr);
+		tc_egress.port[n] = p;
+		tc_egress.pfd[n].fd = p->fda.fd[FD_EVENT];
+		n++;
+	}
+
+	/*
+	 * Gather the transmit time stamps from all of the egress ports at
+	 * once, completing each port as soon as its time stamp arrives.
+	 */
+	deadline = tc_now_ms() + sk_tx_timeout;
+	for (pending = n; pending; ) {
+		tmo = deadline - tc_now_ms();
+		cnt = sk_poll_txts(tc_egress.pfd, n, tmo > 0 ? tmo : 0);
+		if (cnt < 1) {
+			err = cnt;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			if (!tc_egress.port[i] || !tc_egress.pfd[i].revents) {
+				continue;
+			}
+			tc_fwd_txts(q, i, msg, ingress);
+			if (!tc_egress.port[i]) {
+				/* Stop polling this port. */
+				tc_egress.pfd[i].fd = -1;
+				pending--;
+			}
 		}
-		tc_complete(q, p, msg, residence);
+	}
+
+	for (i = 0; pending && i < n; i++) {
+		p = tc_egress.port[i];
+		if (!p) {
+			continue;
+		}
+		if (err) {
+			p->tc_txts_failures++;
+		} else {
+			pr_err("timed out while polling for tx timestamp "
+			       "on port %hd to %hd event", portnum(q), portnum(p));
+			p->tc_txts_timeouts++;
+		}
+		port_dispatch(p, EV_FAULT_DETECTED, 0);
 	}
 
 	return 0;
@@ -354,18 +514,40 @@ static int tc_match_syfup(int ingress_port, struct ptp_message *msg,
 
 static void tc_recycle(struct tc_txd *txd)
 {
-	TAILQ_INSERT_HEAD(&tc_pool, txd, list);
+	arena_free(tc_arena, txd);
 }
 
 /* public methods */
 
 void tc_cleanup(void)
 {
-	struct tc_txd *txd;
+	free(tc_egress.pfd);
+	free(tc_egress.port);
+	memset(&tc_egress, 0, sizeof(tc_egress));
+
+	if (tc_arena) {
+		arena_destroy(tc_arena);
+		tc_arena = NULL;
+	}
+}
+
+int tc_pool_init(unsigned int count, int hugepages)
+{
+	if (tc_arena) {
+		arena_destroy(tc_arena);
+	}
+	tc_arena = arena_create("TC", sizeof(struct tc_txd), count, hugepages);
+	return tc_arena ? 0 : -1;
+}
+
+void tc_pool_stats(struct arena_stats *stats)
+{
+	struct arena *pool = tc_pool();
 
-	while ((txd = TAILQ_FIRST(&tc_pool)) != NULL) {
-		TAILQ_REMOVE(&tc_pool, txd, list);
-		free(txd);
+	if (pool) {
+		arena_stats(pool, stats);
+	} else {
+		memset(stats, 0, sizeof(*stats));
 	}
 }
 
@@ -374,9 +556,7 @@ void tc_flush(struct port *q)
 	struct tc_txd *txd;
 
 	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_remove(q, txd);
 	}
 }
 
@@ -503,12 +683,11 @@ void tc_prune(struct port *q)
 
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
+	/* Entries are queued in order of transmission, oldest first. */
 	while ((txd = TAILQ_FIRST(&q->tc_transmitted)) != NULL) {
 		if (tc_current(txd->msg, now)) {
 			break;
 		}
-		TAILQ_REMOVE(&q->tc_transmitted, txd, list);
-		msg_put(txd->msg);
-		tc_recycle(txd);
+		tc_remove(q, txd);
 	}
 }
@@ -35,8 +35,15 @@
 
 uint8_t ieee8021_id[3] = { IEEE_802_1_COMMITTEE };
 
-static TAILQ_HEAD(tlv_pool, tlv_extra) tlv_pool =
-	TAILQ_HEAD_INITIALIZER(tlv_pool);
+static struct arena *tlv_arena;
+
+static struct arena *tlv_pool(void)
+{
+	if (!tlv_arena) {
+		tlv_arena = arena_create("TLV", sizeof(struct tlv_extra), 0, 0);
+	}
+	return tlv_arena;
+}
 
 static void scaled_ns_n2h(ScaledNs *sns)
 {
@@ -52,6 +59,24 @@ static void scaled_ns_h2n(ScaledNs *sns)
 	sns->fractional_nanoseconds = htons(sns->fractional_nanoseconds);
 }
 
+static void pool_usage_n2h(struct pool_usage_np *pu)
+{
+	pu->size = ntohl(pu->size);
+	pu->total = ntohl(pu->total);
+	pu->in_use = ntohl(pu->in_use);
+	pu->high_water = ntohl(pu->high_water);
+	pu->failures = ntohl(pu->failures);
+}
+
+static void pool_usage_h2n(struct pool_usage_np *pu)
+{
+	pu->size = htonl(pu->size);
+	pu->total = htonl(pu->total);
+	pu->in_use = htonl(pu->in_use);
+	pu->high_water = htonl(pu->high_water);
+	pu->failures = htonl(pu->failures);
+}
+
 static uint16_t flip16(uint16_t *p)
 {
 	uint16_t v;
@@ -91,9 +116,14 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 	struct time_status_np *tsn;
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
+	struct pool_stats_np *psn;
+	struct servo_status_np *ssn;
+	struct holdover_status_np *hsn;
 	struct port_properties_np *ppn;
+	struct unicast_master_table_np *umt;
 	struct mgmt_clock_description *cd;
-	int extra_len = 0, len;
+	int extra_len = 0, i, len;
+	struct PortAddress *pa;
 	uint8_t *buf;
 	uint16_t u16;
 	switch (m->id) {
@@ -278,6 +308,33 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		sen = (struct subscribe_events_np *)m->data;
 		sen->duration = ntohs(sen->duration);
 		break;
+	case TLV_POOL_STATS_NP:
+		if (data_len != sizeof(struct pool_stats_np))
+			goto bad_length;
+		psn = (struct pool_stats_np *) m->data;
+		pool_usage_n2h(&psn->message);
+		pool_usage_n2h(&psn->tlv);
+		pool_usage_n2h(&psn->tc);
+		break;
+	case TLV_SERVO_STATUS_NP:
+		if (data_len != sizeof(struct servo_status_np))
+			goto bad_length;
+		ssn = (struct servo_status_np *) m->data;
+		ssn->kp = net2host64(ssn->kp);
+		ssn->ki = net2host64(ssn->ki);
+		ssn->gain_scale = net2host64(ssn->gain_scale);
+		ssn->offset_stddev = net2host64(ssn->offset_stddev);
+		ssn->freq_stddev = net2host64(ssn->freq_stddev);
+		break;
+	case TLV_HOLDOVER_STATUS_NP:
+		if (data_len != sizeof(struct holdover_status_np))
+			goto bad_length;
+		hsn = (struct holdover_status_np *) m->data;
+		hsn->freq = net2host64(hsn->freq);
+		hsn->aging = net2host64(hsn->aging);
+		hsn->time_error = net2host64(hsn->time_error);
+		hsn->duration = ntohl(hsn->duration);
+		break;
 	case TLV_PORT_PROPERTIES_NP:
 		if (data_len < sizeof(struct port_properties_np))
 			goto bad_length;
@@ -286,6 +343,32 @@ static int mgt_post_recv(struct management_tlv *m, uint16_t data_len,
 		extra_len = sizeof(struct port_properties_np);
 		extra_len += ppn->interface.length;
 		break;
+	case TLV_UNICAST_MASTER_TABLE:
+		if (data_len < sizeof(struct unicast_master_table_np))
+			goto bad_length;
+		umt = (struct unicast_master_table_np *) m->data;
+		buf = umt->unicastMasterTable;
+		len = data_len - sizeof(*umt);
+		umt->actualTableSize = ntohs(umt->actualTableSize);
+		u16 = umt->actualTableSize;
+		for (i = 0; i < u16; i++) {
+			pa = (struct PortAddress *) buf;
+			buf += sizeof(*pa);
+			len -= sizeof(*pa);
+			if (len < 0)
+				goto bad_length;
+			pa->networkProtocol = ntohs(pa->networkProtocol);
+			pa->addressLength = ntohs(pa->addressLength);
+			extra_len = pa->addressLength;
+			if (extra_len > TRANSPORT_ADDR_LEN)
+				goto bad_length;
+			buf += extra_len;
+			len -= extra_len;
+			if (len < 0)
+				goto bad_length;
+		}
+		extra_len = 0;
+		break;
 	case TLV_SAVE_IN_NON_VOLATILE_STORAGE:
 	case TLV_RESET_NON_VOLATILE_STORAGE:
 	case TLV_INITIALIZE:
@@ -318,8 +401,15 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 	struct time_status_np *tsn;
 	struct grandmaster_settings_np *gsn;
 	struct subscribe_events_np *sen;
+	struct pool_stats_np *psn;
+	struct servo_status_np *ssn;
+	struct holdover_status_np *hsn;
 	struct port_properties_np *ppn;
+	struct unicast_master_table_np *umt;
 	struct mgmt_clock_description *cd;
+	struct PortAddress *pa;
+	uint16_t i, len, n;
+	uint8_t *buf;
 	switch (m->id) {
 	case TLV_CLOCK_DESCRIPTION:
 		if (extra) {
@@ -387,10 +477,44 @@ static void mgt_pre_send(struct management_tlv *m, struct tlv_extra *extra)
 		sen = (struct subscribe_events_np *)m->data;
 		sen->duration = htons(sen->duration);
 		break;
+	case TLV_POOL_STATS_NP:
+		psn = (struct pool_stats_np *) m->data;
+		pool_usage_h2n(&psn->message);
+		pool_usage_h2n(&psn->tlv);
+		pool_usage_h2n(&psn->tc);
+		break;
+	case TLV_SERVO_STATUS_NP:
+		ssn = (struct servo_status_np *) m->data;
+		ssn->kp = host2net64(ssn->kp);
+		ssn->ki = host2net64(ssn->ki);
+		ssn->gain_scale = host2net64(ssn->gain_scale);
+		ssn->offset_stddev = host2net64(ssn->offset_stddev);
+		ssn->freq_stddev = host2net64(ssn->freq_stddev);
+		break;
+	case TLV_HOLDOVER_STATUS_NP:
+		hsn = (struct holdover_status_np *) m->data;
+		hsn->freq = host2net64(hsn->freq);
+		hsn->aging = host2net64(hsn->aging);
+		hsn->time_error = host2net64(hsn->time_error);
+		hsn->duration = htonl(hsn->duration);
+		break;
 	case TLV_PORT_PROPERTIES_NP:
 		ppn = (struct port_properties_np *)m->data;
 		ppn->portIdentity.portNumber = htons(ppn->portIdentity.portNumber);
 		break;
+	case TLV_UNICAST_MASTER_TABLE:
+		umt = (struct unicast_master_table_np *) m->data;
+		buf = umt->unicastMasterTable;
+		n = umt->actualTableSize;
+		for (i = 0; i < n; i++) {
+			pa = (struct PortAddress *) buf;
+			len = pa->addressLength;
+			pa->networkProtocol = htons(pa->networkProtocol);
+			pa->addressLength = htons(len);
+			buf += sizeof(*pa) + len;
+		}
+		umt->actualTableSize = htons(n);
+		break;
 	}
 }
 
@@ -546,30 +670,54 @@ static void org_pre_send(struct organization_tlv *org)
 
 struct tlv_extra *tlv_extra_alloc(void)
 {
-	struct tlv_extra *extra = TAILQ_FIRST(&tlv_pool);
+	struct arena *pool = tlv_pool();
 
-	if (extra) {
-		TAILQ_REMOVE(&tlv_pool, extra, list);
-	} else {
-		extra = calloc(1, sizeof(*extra));
-	}
-	return extra;
+	return pool ? arena_alloc(pool) : NULL;
 }
 
 void tlv_extra_cleanup(void)
 {
-	struct tlv_extra *extra;
+	if (tlv_arena) {
+		arena_destroy(tlv_arena);
+		tlv_arena = NULL;
+	}
+}
+
+int tlv_extra_pool_init(unsigned int count, int hugepages)
+{
+	if (tlv_arena) {
+		arena_destroy(tlv_arena);
+	}
+	tlv_arena = arena_create("TLV", sizeof(struct tlv_extra),
+				 count, hugepages);
+	return tlv_arena ? 0 : -1;
+}
+
+int tlv_extra_pool_share(void)
+{
+	struct arena *pool = tlv_pool();
+
+	if (!pool) {
+		return -1;
+	}
+	arena_share(pool);
+	return 0;
+}
+
+void tlv_extra_pool_stats(struct arena_stats *stats)
+{
+	struct arena *pool = tlv_pool();
 
-	while ((extra = TAILQ_FIRST(&tlv_pool)) != NULL) {
-		TAILQ_REMOVE(&tlv_pool, extra, list);
-		free(extra);
+	if (pool) {
+		arena_stats(pool, stats);
+	} else {
+		memset(stats, 0, sizeof(*stats));
 	}
 }
 
 void tlv_extra_recycle(struct tlv_extra *extra)
 {
-	memset(extra, 0, sizeof(*extra));
-	TAILQ_INSERT_HEAD(&tlv_pool, extra, list);
+	arena_free(tlv_arena, extra);
 }
 
 int tlv_post_recv(struct tlv_extra *extra)
@@ -579,6 +727,8 @@ int tlv_post_recv(struct tlv_extra *extra)
 	struct management_error_status *mes;
 	struct TLV *tlv = extra->tlv;
 	struct path_trace_tlv *ptt;
+	struct request_unicast_xmit_tlv *req;
+	struct grant_unicast_xmit_tlv *grant;
 
 	switch (tlv->type) {
 	case TLV_MANAGEMENT:
@@ -602,9 +752,21 @@ int tlv_post_recv(struct tlv_extra *extra)
 		result = org_post_recv((struct organization_tlv *) tlv);
 		break;
 	case TLV_REQUEST_UNICAST_TRANSMISSION:
+		if (TLV_LENGTH_INVALID(tlv, request_unicast_xmit_tlv))
+			goto bad_length;
+		req = (struct request_unicast_xmit_tlv *) tlv;
+		req->durationField = ntohl(req->durationField);
+		break;
 	case TLV_GRANT_UNICAST_TRANSMISSION:
+		if (TLV_LENGTH_INVALID(tlv, grant_unicast_xmit_tlv))
+			goto bad_length;
+		grant = (struct grant_unicast_xmit_tlv *) tlv;
+		grant->durationField = ntohl(grant->durationField);
+		break;
 	case TLV_CANCEL_UNICAST_TRANSMISSION:
 	case TLV_ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION:
+		if (TLV_LENGTH_INVALID(tlv, cancel_unicast_xmit_tlv))
+			goto bad_length;
 		break;
 	case TLV_PATH_TRACE:
 		ptt = (struct path_trace_tlv *) tlv;
@@ -634,6 +796,8 @@ void tlv_pre_send(struct TLV *tlv, struct tlv_extra *extra)
 {
 	struct management_tlv *mgt;
 	struct management_error_status *mes;
+	struct request_unicast_xmit_tlv *req;
+	struct grant_unicast_xmit_tlv *grant;
 
 	switch (tlv->type) {
 	case TLV_MANAGEMENT:
@@ -651,7 +815,13 @@ void tlv_pre_send(struct TLV *tlv, struct tlv_extra *extra)
 		org_pre_send((struct organization_tlv *) tlv);
 		break;
 	case TLV_REQUEST_UNICAST_TRANSMISSION:
+		req = (struct request_unicast_xmit_tlv *) tlv;
+		req->durationField = htonl(req->durationField);
+		break;
 	case TLV_GRANT_UNICAST_TRANSMISSION:
+		grant = (struct grant_unicast_xmit_tlv *) tlv;
+		grant->durationField = htonl(grant->durationField);
+		break;
 	case TLV_CANCEL_UNICAST_TRANSMISSION:
 	case TLV_ACKNOWLEDGE_CANCEL_UNICAST_TRANSMISSION:
 	case TLV_PATH_TRACE:
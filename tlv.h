@@ -22,6 +22,7 @@
 
 #include <sys/queue.h>
 
+#include "arena.h"
 #include "ddt.h"
 #include "ds.h"
 
@@ -84,6 +85,9 @@ enum management_action {
 #define TLV_TIME_STATUS_NP				0xC000
 #define TLV_GRANDMASTER_SETTINGS_NP			0xC001
 #define TLV_SUBSCRIBE_EVENTS_NP				0xC003
+#define TLV_POOL_STATS_NP				0xC005
+#define TLV_SERVO_STATUS_NP				0xC006
+#define TLV_HOLDOVER_STATUS_NP				0xC007
 
 /* Port management ID values */
 #define TLV_NULL_MANAGEMENT				0x0000
@@ -136,6 +140,38 @@ struct management_error_status {
 	Octet         data[0];
 } PACKED;
 
+/* Flags of the GRANT_UNICAST_TRANSMISSION TLV */
+#define GRANT_UNICAST_RENEWAL_INVITED	(1<<0)
+
+/* Flags of the CANCEL_UNICAST_TRANSMISSION TLV */
+#define CANCEL_UNICAST_MAINTAIN_REQUEST	(1<<0)
+#define CANCEL_UNICAST_MAINTAIN_GRANT	(1<<1)
+
+struct request_unicast_xmit_tlv {
+	Enumeration16   type;
+	UInteger16      length;
+	uint8_t         message_type; /* in the upper nibble */
+	Integer8        logInterMessagePeriod;
+	UInteger32      durationField;
+} PACKED;
+
+struct grant_unicast_xmit_tlv {
+	Enumeration16   type;
+	UInteger16      length;
+	uint8_t         message_type; /* in the upper nibble */
+	Integer8        logInterMessagePeriod;
+	UInteger32      durationField;
+	uint8_t         reserved;
+	uint8_t         flags;
+} PACKED;
+
+struct cancel_unicast_xmit_tlv {
+	Enumeration16   type;
+	UInteger16      length;
+	uint8_t         message_type_flags; /* type in the upper nibble */
+	uint8_t         reserved;
+} PACKED;
+
 struct nsm_resp_tlv_head {
 	Enumeration16           type;
 	UInteger16              length;
@@ -218,6 +254,41 @@ struct port_ds_np {
 } PACKED;
 
 
+struct pool_usage_np {
+	UInteger32    size;
+	UInteger32    total;
+	UInteger32    in_use;
+	UInteger32    high_water;
+	UInteger32    failures;
+} PACKED;
+
+struct pool_stats_np {
+	struct pool_usage_np message;
+	struct pool_usage_np tlv;
+	struct pool_usage_np tc;
+} PACKED;
+
+/* The gains, gain scale and frequency deviation are scaled by 1e9. */
+struct servo_status_np {
+	Integer64     kp;
+	Integer64     ki;
+	Integer64     gain_scale;
+	Integer64     offset_stddev; /*nanoseconds*/
+	Integer64     freq_stddev;   /*ppb*/
+	UInteger8     servo_state;
+	UInteger8     reserved;
+} PACKED;
+
+/* The frequency and the aging are scaled by 1e9. */
+struct holdover_status_np {
+	Integer64     freq;       /*ppb*/
+	Integer64     aging;      /*ppb per second*/
+	Integer64     time_error; /*nanoseconds*/
+	UInteger32    duration;   /*seconds*/
+	UInteger8     state;
+	UInteger8     reserved;
+} PACKED;
+
 #define EVENT_BITMASK_CNT 64
 
 struct subscribe_events_np {
@@ -232,6 +303,13 @@ struct port_properties_np {
 	struct PTPText interface;
 } PACKED;
 
+struct unicast_master_table_np {
+	Integer8   logQueryInterval;
+	UInteger16 actualTableSize;
+	/* followed by actualTableSize variable length PortAddress fields */
+	uint8_t    unicastMasterTable[0];
+} PACKED;
+
 #define PROFILE_ID_LEN 6
 
 struct mgmt_clock_description {
@@ -266,6 +344,27 @@ struct tlv_extra *tlv_extra_alloc(void);
  */
 void tlv_extra_cleanup(void);
 
+/**
+ * Replace the tlv_extra cache with a preallocated one of fixed size.
+ * @param count      The number of descriptors to preallocate, or zero
+ *                   for an unbounded cache.
+ * @param hugepages  Non-zero to back the cache with huge pages.
+ * @return           Zero on success, non-zero otherwise.
+ */
+int tlv_extra_pool_init(unsigned int count, int hugepages);
+
+/**
+ * Make the tlv_extra cache safe to use from several threads.
+ * @return  Zero on success, non-zero otherwise.
+ */
+int tlv_extra_pool_share(void);
+
+/**
+ * Obtain the usage counters of the tlv_extra cache.
+ * @param stats  Buffer to hold the result.
+ */
+void tlv_extra_pool_stats(struct arena_stats *stats);
+
 /**
  * Frees a tlv_extra structure.
  * @param extra  Pointer to the structure to free.
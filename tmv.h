@@ -38,7 +38,137 @@
  * to a finer representation later on. In that way, we can make use of
  * the fractional nanosecond parts of the correction fields, if and
  * when people start asking for them.
+ *
+ * When built with TMV_FRACTIONAL_NS defined, the time value is a 128 bit
+ * signed integer containing nanoseconds scaled by 2^16, the same units
+ * as the correction field, so that the fractional nanoseconds survive
+ * the arithmetic of the transparent clocks and the filters.
  */
+#ifdef TMV_FRACTIONAL_NS
+
+#ifndef __SIZEOF_INT128__
+#error "TMV_FRACTIONAL_NS requires a compiler with 128 bit integers"
+#endif
+
+#define TMV_FRAC_BITS 16
+
+/* Messages only guarantee 64 bit alignment for the embedded time values. */
+typedef __int128 tmv_scaled_t __attribute__((aligned(8)));
+
+typedef struct {
+	tmv_scaled_t sns;
+} tmv_t;
+
+static inline tmv_t tmv_add(tmv_t a, tmv_t b)
+{
+	tmv_t t;
+	t.sns = a.sns + b.sns;
+	return t;
+}
+
+static inline tmv_t tmv_div(tmv_t a, int divisor)
+{
+	tmv_t t;
+	/* Avoid the slow 128 bit division for intervals. */
+	if ((int64_t) a.sns == a.sns)
+		t.sns = (int64_t) a.sns / divisor;
+	else
+		t.sns = a.sns / divisor;
+	return t;
+}
+
+static inline int tmv_cmp(tmv_t a, tmv_t b)
+{
+	return a.sns == b.sns ? 0 : a.sns > b.sns ? +1 : -1;
+}
+
+static inline int tmv_sign(tmv_t x)
+{
+	return x.sns == 0 ? 0 : x.sns > 0 ? +1 : -1;
+}
+
+static inline int tmv_is_zero(tmv_t x)
+{
+	return x.sns == 0 ? 1 : 0;
+}
+
+static inline tmv_t tmv_sub(tmv_t a, tmv_t b)
+{
+	tmv_t t;
+	t.sns = a.sns - b.sns;
+	return t;
+}
+
+static inline tmv_t tmv_zero(void)
+{
+	tmv_t t = { 0 };
+	return t;
+}
+
+static inline tmv_t correction_to_tmv(Integer64 c)
+{
+	tmv_t t;
+	t.sns = c;
+	return t;
+}
+
+static inline double tmv_dbl(tmv_t x)
+{
+	return (double) x.sns / (1 << TMV_FRAC_BITS);
+}
+
+static inline tmv_t dbl_tmv(double x)
+{
+	tmv_t t;
+	t.sns = x * (1 << TMV_FRAC_BITS);
+	return t;
+}
+
+/* Rounds to the nearest nanosecond. */
+static inline int64_t tmv_to_nanoseconds(tmv_t x)
+{
+	return (x.sns + (1 << (TMV_FRAC_BITS - 1))) >> TMV_FRAC_BITS;
+}
+
+static inline TimeInterval tmv_to_TimeInterval(tmv_t x)
+{
+	return x.sns;
+}
+
+static inline struct Timestamp tmv_to_Timestamp(tmv_t x)
+{
+	struct Timestamp result;
+	uint64_t sec, nsec;
+	int64_t ns;
+
+	ns = tmv_to_nanoseconds(x);
+	sec  = ns / 1000000000ULL;
+	nsec = ns % 1000000000ULL;
+
+	result.seconds_lsb = sec & 0xFFFFFFFF;
+	result.seconds_msb = (sec >> 32) & 0xFFFF;
+	result.nanoseconds = nsec;
+
+	return result;
+}
+
+static inline tmv_t timespec_to_tmv(struct timespec ts)
+{
+	tmv_t t;
+	t.sns = (__int128) (ts.tv_sec * NS_PER_SEC + ts.tv_nsec) <<
+		TMV_FRAC_BITS;
+	return t;
+}
+
+static inline tmv_t timestamp_to_tmv(struct timestamp ts)
+{
+	tmv_t t;
+	t.sns = (__int128) (ts.sec * NS_PER_SEC + ts.nsec) << TMV_FRAC_BITS;
+	return t;
+}
+
+#else /* TMV_FRACTIONAL_NS */
+
 typedef struct {
 	int64_t ns;
 } tmv_t;
@@ -143,4 +273,6 @@ static inline tmv_t timestamp_to_tmv(struct timestamp ts)
 	return t;
 }
 
+#endif /* TMV_FRACTIONAL_NS */
+
 #endif
@@ -0,0 +1,210 @@
+/**
+ * @file tmv_bench.c
+ * @brief Measures the cost of the time value arithmetic on the hot path,
+ *        one full exchange through the time stamp processor per sample.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "tmv.h"
+#include "tsproc.h"
+
+#define NS_PER_INTERVAL	(NS_PER_SEC / 16)
+#define FILTER_LENGTH	10
+
+#ifdef TMV_FRACTIONAL_NS
+#define REPRESENTATION	"fractional"
+#else
+#define REPRESENTATION	"integer"
+#endif
+
+/*
+ * The time stamps and the correction fields of one exchange, in the
+ * form in which the port receives them.
+ */
+struct exchange {
+	struct timestamp t1;
+	struct timespec t2;
+	struct timespec t3;
+	struct timestamp t4;
+	Integer64 c1;
+	Integer64 c4;
+};
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+static int jitter(int range)
+{
+	rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (rng_state >> 33) % range;
+}
+
+static struct timestamp ns_to_timestamp(int64_t ns)
+{
+	struct timestamp ts;
+
+	ts.sec = ns / NS_PER_SEC;
+	ts.nsec = ns % NS_PER_SEC;
+	return ts;
+}
+
+static struct timespec ns_to_timespec(int64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / NS_PER_SEC;
+	ts.tv_nsec = ns % NS_PER_SEC;
+	return ts;
+}
+
+/*
+ * A slave 1.5 us ahead of its master over a 5 us path, with a few
+ * hundred ns of noise and correction fields with fractional parts, as
+ * left by a transparent clock.
+ */
+static void generate(struct exchange *ex, int n)
+{
+	int64_t t = 1500000000LL * NS_PER_SEC, offset = 1500, delay = 5000;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		ex[i].c1 = ((Integer64) (800 + jitter(200)) << 16) + jitter(65536);
+		ex[i].c4 = ((Integer64) (800 + jitter(200)) << 16) + jitter(65536);
+		ex[i].t1 = ns_to_timestamp(t);
+		ex[i].t2 = ns_to_timespec(t + offset + delay + jitter(400));
+		ex[i].t3 = ns_to_timespec(t + NS_PER_INTERVAL / 2);
+		ex[i].t4 = ns_to_timestamp(t + NS_PER_INTERVAL / 2 - offset +
+					   delay + jitter(400));
+		t += NS_PER_INTERVAL;
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Mirrors the conversions of port_synchronize() and process_delay_resp(). */
+static double run(struct tsproc *tsp, struct exchange *ex, int n, int loops,
+		  double *mean_offset)
+{
+	tmv_t t1, t2, t3, t4, offset, delay;
+	TimeInterval sum = 0;
+	double weight, t;
+	int i, j;
+
+	t = now_ns();
+	for (j = 0; j < loops; j++) {
+		for (i = 0; i < n; i++) {
+			t1 = tmv_add(timestamp_to_tmv(ex[i].t1),
+				     correction_to_tmv(ex[i].c1));
+			t2 = timespec_to_tmv(ex[i].t2);
+			t3 = timespec_to_tmv(ex[i].t3);
+			t4 = tmv_sub(timestamp_to_tmv(ex[i].t4),
+				     correction_to_tmv(ex[i].c4));
+
+			tsproc_up_ts(tsp, t3, t4);
+			tsproc_update_delay(tsp, &delay);
+			tsproc_down_ts(tsp, t1, t2);
+			if (tsproc_update_offset(tsp, &offset, &weight))
+				continue;
+			sum += tmv_to_TimeInterval(offset);
+		}
+	}
+	t = now_ns() - t;
+	*mean_offset = (double) sum / 65536.0 / ((double) n * loops);
+	return t / ((double) n * loops);
+}
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\n"
+		"usage: %s [options]\n\n"
+		" -n [num]  number of exchanges, default 4096\n"
+		" -l [num]  timing loops over the exchanges, default 256\n"
+		" -h        prints this message and exits\n"
+		"\n"
+		"Rebuild from clean with EXTRA_CFLAGS=-DTMV_FRACTIONAL_NS\n"
+		"in order to measure the fractional time values.\n"
+		"\n",
+		progname);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, loops = 256, n = 4096;
+	double cost, mean_offset;
+	struct exchange *ex;
+	struct tsproc *tsp;
+	char *progname;
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1 + progname : argv[0];
+	while (EOF != (c = getopt(argc, argv, "n:l:h"))) {
+		switch (c) {
+		case 'n':
+			n = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'h':
+			usage(progname);
+			return 0;
+		default:
+			usage(progname);
+			return -1;
+		}
+	}
+	if (n < 1 || loops < 1) {
+		usage(progname);
+		return -1;
+	}
+	print_set_syslog(0);
+	print_set_verbose(1);
+
+	ex = calloc(n, sizeof(*ex));
+	if (!ex) {
+		fprintf(stderr, "low memory\n");
+		return -1;
+	}
+	generate(ex, n);
+
+	tsp = tsproc_create(TSPROC_FILTER, FILTER_MOVING_MEDIAN,
+			    FILTER_LENGTH, 0);
+	if (!tsp) {
+		fprintf(stderr, "failed to create the time stamp processor\n");
+		free(ex);
+		return -1;
+	}
+	cost = run(tsp, ex, n, loops, &mean_offset);
+	tsproc_destroy(tsp);
+	free(ex);
+
+	printf("%s time values: %.1f ns per exchange, mean offset %.3f ns\n",
+	       REPRESENTATION, cost, mean_offset);
+	return 0;
+}
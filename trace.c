@@ -0,0 +1,94 @@
+/**
+ * @file trace.c
+ * @brief Writes binary time stamp traces.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "print.h"
+#include "trace.h"
+
+struct trace {
+	struct trace_header *hdr;
+	struct trace_record *records;
+	size_t size;
+	uint64_t count;
+	uint32_t capacity;
+};
+
+struct trace *trace_create(const char *path, unsigned int capacity)
+{
+	struct trace *t;
+	void *map;
+	int fd;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->capacity = capacity;
+	t->size = sizeof(*t->hdr) + (size_t) capacity * sizeof(*t->records);
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		pr_err("failed to open trace file %s: %m", path);
+		goto no_file;
+	}
+	if (ftruncate(fd, t->size)) {
+		pr_err("failed to resize trace file %s: %m", path);
+		goto no_map;
+	}
+	map = mmap(NULL, t->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		pr_err("failed to map trace file %s: %m", path);
+		goto no_map;
+	}
+	close(fd);
+
+	t->hdr = map;
+	t->records = (struct trace_record *) (t->hdr + 1);
+	t->hdr->magic = TRACE_MAGIC;
+	t->hdr->version = TRACE_VERSION;
+	t->hdr->record_size = sizeof(*t->records);
+	t->hdr->capacity = capacity;
+	t->hdr->count = 0;
+	return t;
+
+no_map:
+	close(fd);
+no_file:
+	free(t);
+	return NULL;
+}
+
+void trace_destroy(struct trace *t)
+{
+	munmap(t->hdr, t->size);
+	free(t);
+}
+
+void trace_add(struct trace *t, struct trace_record *rec)
+{
+	memcpy(&t->records[t->count % t->capacity], rec, sizeof(*rec));
+	t->count++;
+	/* A reader of the live file must see the record before the count. */
+	__atomic_store_n(&t->hdr->count, t->count, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,114 @@
+/**
+ * @file trace.h
+ * @brief Defines the format of the binary time stamp traces.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_TRACE_H
+#define HAVE_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * A trace file starts with a header, followed by a ring of fixed size
+ * records.  All of the fields are stored in host byte order.  Once the
+ * ring is full, the oldest record is overwritten, so the oldest record
+ * is found at the index (count % capacity).
+ */
+
+#define TRACE_MAGIC	0x50545452 /* "PTTR" */
+#define TRACE_VERSION	1
+
+/* The port of a TRACE_PHC2SYS record whose clock has no known PHC index. */
+#define TRACE_NO_PHC	0xffff
+
+struct trace_header {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t capacity;  /* number of records in the ring */
+	uint32_t reserved;
+	uint64_t count;     /* number of records ever written */
+};
+
+/**
+ * Defines the kinds of trace records.
+ */
+enum trace_type {
+	/** t1 origin, t2 ingress, correction of the Sync and Follow_Up. */
+	TRACE_SYNC,
+	/** t3 Delay_Req egress, t4 master ingress, correction of the
+	    Delay_Resp (to be subtracted from t4). */
+	TRACE_DELAY,
+	/** t1 to t4 of a peer delay measurement, correction of the
+	    Pdelay_Resp and Pdelay_Resp_Follow_Up. */
+	TRACE_PDELAY,
+	/** t1 reference time, t2 time of the clock, as read by phc2sys. */
+	TRACE_PHC2SYS,
+};
+
+/*
+ * The time stamps and the correction are in nanoseconds.  The offset
+ * and frequency are those of the servo after the sample, i.e. freq is
+ * the frequency adjustment of the clock in ppb until the next sample.
+ * The servo state is only set in the TRACE_SYNC and TRACE_PHC2SYS
+ * records which updated the servo, and SERVO_UNLOCKED otherwise.  The
+ * port is the port number, except in the TRACE_PHC2SYS records, where
+ * it is the index of the PTP hardware clock, or TRACE_NO_PHC for
+ * CLOCK_REALTIME and for clocks given by their device path.
+ */
+struct trace_record {
+	int64_t  t1;
+	int64_t  t2;
+	int64_t  t3;
+	int64_t  t4;
+	int64_t  correction;
+	int64_t  offset;
+	double   freq;
+	uint16_t port;
+	uint8_t  type;
+	uint8_t  state;
+	int8_t   log_interval;
+	uint8_t  timestamping;
+	uint8_t  reserved[2];
+};
+
+/** Opaque type */
+struct trace;
+
+/**
+ * Create a trace file.  Any existing file is overwritten.
+ * @param path     The path of the file.
+ * @param capacity The number of records kept in the ring.
+ * @return A pointer to a new trace on success, NULL otherwise.
+ */
+struct trace *trace_create(const char *path, unsigned int capacity);
+
+/**
+ * Close a trace file.
+ * @param t Pointer obtained via @ref trace_create().
+ */
+void trace_destroy(struct trace *t);
+
+/**
+ * Append a record to a trace, overwriting the oldest one if the ring
+ * is full.  This only writes to the mapped file.
+ * @param t   Pointer obtained via @ref trace_create().
+ * @param rec The record to append.
+ */
+void trace_add(struct trace *t, struct trace_record *rec);
+
+#endif
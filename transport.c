@@ -19,6 +19,7 @@
 
 #include <arpa/inet.h>
 
+#include "msg.h"
 #include "transport.h"
 #include "transport_private.h"
 #include "raw.h"
@@ -42,6 +43,32 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg)
 	return t->recv(t, fd, msg, sizeof(msg->data), &msg->address, &msg->hwts);
 }
 
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n)
+{
+	struct sk_rx rx[SK_RX_BATCH_MAX];
+	int i, num;
+
+	if (!t->recv_batch || n < 2) {
+		cnt[0] = transport_recv(t, fd, msg[0]);
+		return cnt[0] > 0 ? 1 : cnt[0];
+	}
+	if (n > SK_RX_BATCH_MAX) {
+		n = SK_RX_BATCH_MAX;
+	}
+	for (i = 0; i < n; i++) {
+		rx[i].buf = msg[i];
+		rx[i].buflen = sizeof(msg[i]->data);
+		rx[i].addr = &msg[i]->address;
+		rx[i].hwts = &msg[i]->hwts;
+	}
+	num = t->recv_batch(t, fd, rx, n);
+	for (i = 0; i < num; i++) {
+		cnt[i] = rx[i].cnt;
+	}
+	return num;
+}
+
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg)
 {
@@ -66,6 +93,37 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 	return t->send(t, fda, event, 0, msg, len, &msg->address, &msg->hwts);
 }
 
+int transport_send_batch(struct transport *t, struct fdarray *fda,
+			 struct ptp_message **msg, int n)
+{
+	struct sk_tx tx[SK_TX_BATCH_MAX];
+	int cnt, i, unicast;
+
+	if (!t->send_batch) {
+		for (i = 0; i < n; i++) {
+			if (msg[i]->header.flagField[0] & UNICAST) {
+				cnt = transport_sendto(t, fda, TRANS_GENERAL, msg[i]);
+			} else {
+				cnt = transport_send(t, fda, TRANS_GENERAL, msg[i]);
+			}
+			if (cnt <= 0) {
+				return i ? i : cnt;
+			}
+		}
+		return n;
+	}
+	if (n > SK_TX_BATCH_MAX) {
+		n = SK_TX_BATCH_MAX;
+	}
+	for (i = 0; i < n; i++) {
+		unicast = msg[i]->header.flagField[0] & UNICAST;
+		tx[i].buf = msg[i];
+		tx[i].len = ntohs(msg[i]->header.messageLength);
+		tx[i].addr = unicast ? &msg[i]->address : NULL;
+	}
+	return t->send_batch(t, fda, tx, n);
+}
+
 int transport_txts(struct transport *t, struct fdarray *fda,
 		   struct ptp_message *msg)
 {
@@ -77,6 +135,12 @@ int transport_txts(struct transport *t, struct fdarray *fda,
 	return cnt > 0 ? 0 : cnt;
 }
 
+int transport_txts_async(struct transport *t, struct fdarray *fda,
+			 struct hw_timestamp *hwts, uint32_t *key)
+{
+	return sk_receive_txts(fda->fd[FD_EVENT], hwts, key);
+}
+
 int transport_physical_addr(struct transport *t, uint8_t *addr)
 {
 	if (t->physical_addr) {
@@ -123,10 +187,16 @@ struct transport *transport_create(struct config *cfg,
 	if (t) {
 		t->type = type;
 		t->cfg = cfg;
+		t->domain = -1;
 	}
 	return t;
 }
 
+void transport_set_domain(struct transport *t, int domain)
+{
+	t->domain = domain;
+}
+
 void transport_destroy(struct transport *t)
 {
 	t->release(t);
@@ -75,6 +75,22 @@ int transport_recv(struct transport *t, int fd, struct ptp_message *msg);
 int transport_send(struct transport *t, struct fdarray *fda,
 		   enum transport_event event, struct ptp_message *msg);
 
+/**
+ * Receives a burst of messages using a single system call, when the
+ * transport supports it. Otherwise a single message is received.
+ *
+ * @param t	The transport.
+ * @param fd	The descriptor to read from.
+ * @param msg	Array of messages obtained using msg_allocate(), whose
+ *		hwts.type fields have been set.
+ * @param cnt	Returns the length of each message received.
+ * @param n	The number of entries in 'msg' and 'cnt'.
+ * @return	The number of messages received, or non-positive in case
+ *		of an error.
+ */
+int transport_recv_batch(struct transport *t, int fd,
+			 struct ptp_message **msg, int *cnt, int n);
+
 /**
  * Sends the PTP message using the given transport. The message is sent to
  * the address used for p2p delay measurements (usually a multicast
@@ -101,6 +117,23 @@ int transport_peer(struct transport *t, struct fdarray *fda,
 int transport_sendto(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, struct ptp_message *msg);
 
+/**
+ * Sends a group of general messages using a single system call, when
+ * the transport supports it. Messages having the UNICAST flag set are
+ * sent to the address in their address field, as with
+ * transport_sendto(), and the others to the default destination, as with
+ * transport_send(). No transmit time stamps are collected.
+ *
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param msg	The messages to send, in network byte order.
+ * @param n	The number of entries in 'msg'.
+ * @return	The number of messages sent, or negative value in case of
+ *		an error.
+ */
+int transport_send_batch(struct transport *t, struct fdarray *fda,
+			 struct ptp_message **msg, int n);
+
 /**
  * Fetches the transmit time stamp for a PTP message that was sent
  * with the TRANS_DEFER_EVENT flag.
@@ -114,6 +147,21 @@ int transport_sendto(struct transport *t, struct fdarray *fda,
 int transport_txts(struct transport *t, struct fdarray *fda,
 		   struct ptp_message *msg);
 
+/**
+ * Collects one pending transmit time stamp without waiting. Used in
+ * place of transport_txts() when the event socket's error queue is
+ * serviced from the main poll loop.
+ *
+ * @param t	The transport.
+ * @param fda	The array of descriptors filled in by transport_open.
+ * @param hwts	Receives the time stamp. The type field must be set.
+ * @param key	Receives the SO_TIMESTAMPING OPT_ID key of the packet.
+ * @return	One if a time stamp was collected, zero if none is
+ *		pending, or negative value in case of an error.
+ */
+int transport_txts_async(struct transport *t, struct fdarray *fda,
+			 struct hw_timestamp *hwts, uint32_t *key);
+
 /**
  * Returns the transport's type.
  */
@@ -148,6 +196,16 @@ int transport_protocol_addr(struct transport *t, uint8_t *addr);
 struct transport *transport_create(struct config *cfg,
 				   enum transport_type type);
 
+/**
+ * Restrict the reception of a transport to the messages of a single
+ * PTP domain, so that the messages of other domains are dropped by
+ * the kernel. This only takes effect on the next call to
+ * transport_open(), and transports without a socket filter ignore it.
+ * @param t       Pointer obtained by calling transport_create().
+ * @param domain  The domainNumber to accept, or -1 to accept all domains.
+ */
+void transport_set_domain(struct transport *t, int domain);
+
 /**
  * Free an instance of a transport.
  * @param t Pointer obtained by calling transport_create().
@@ -24,11 +24,13 @@
 
 #include "address.h"
 #include "fd.h"
+#include "sk.h"
 #include "transport.h"
 
 struct transport {
 	enum transport_type type;
 	struct config *cfg;
+	int domain;
 
 	int (*close)(struct transport *t, struct fdarray *fda);
 
@@ -38,10 +40,15 @@ struct transport {
 	int (*recv)(struct transport *t, int fd, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*recv_batch)(struct transport *t, int fd, struct sk_rx *rx, int n);
+
 	int (*send)(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int buflen,
 		    struct address *addr, struct hw_timestamp *hwts);
 
+	int (*send_batch)(struct transport *t, struct fdarray *fda,
+			  struct sk_tx *tx, int n);
+
 	void (*release)(struct transport *t);
 
 	int (*physical_addr)(struct transport *t, uint8_t *addr);
@@ -45,6 +45,11 @@ struct tsproc {
 
 	/* Delay filter */
 	struct filter *delay_filter;
+
+	/* Selection of the least delayed Sync in each window */
+	struct filter *select_filter;
+	int select_length;
+	int select_count;
 };
 
 static int weighting(struct tsproc *tsp)
@@ -52,6 +57,7 @@ static int weighting(struct tsproc *tsp)
 	switch (tsp->mode) {
 	case TSPROC_FILTER:
 	case TSPROC_RAW:
+	case TSPROC_SELECT:
 		return 0;
 	case TSPROC_FILTER_WEIGHT:
 	case TSPROC_RAW_WEIGHT:
@@ -61,7 +67,8 @@ static int weighting(struct tsproc *tsp)
 }
 
 struct tsproc *tsproc_create(enum tsproc_mode mode,
-			     enum filter_type delay_filter, int filter_length)
+			     enum filter_type delay_filter, int filter_length,
+			     int percentile)
 {
 	struct tsproc *tsp;
 
@@ -74,6 +81,7 @@ struct tsproc *tsproc_create(enum tsproc_mode mode,
 	case TSPROC_RAW:
 	case TSPROC_FILTER_WEIGHT:
 	case TSPROC_RAW_WEIGHT:
+	case TSPROC_SELECT:
 		tsp->mode = mode;
 		break;
 	default:
@@ -81,19 +89,23 @@ struct tsproc *tsproc_create(enum tsproc_mode mode,
 		return NULL;
 	}
 
-	tsp->delay_filter = filter_create(delay_filter, filter_length);
+	tsp->delay_filter = filter_create(delay_filter, filter_length,
+					  percentile);
 	if (!tsp->delay_filter) {
 		free(tsp);
 		return NULL;
 	}
 
 	tsp->clock_rate_ratio = 1.0;
+	tsp->select_length = 1;
 
 	return tsp;
 }
 
 void tsproc_destroy(struct tsproc *tsp)
 {
+	if (tsp->select_filter)
+		filter_destroy(tsp->select_filter);
 	filter_destroy(tsp->delay_filter);
 	free(tsp);
 }
@@ -121,6 +133,48 @@ void tsproc_set_delay(struct tsproc *tsp, tmv_t delay)
 	tsp->filtered_delay_valid = 1;
 }
 
+int tsproc_set_selection(struct tsproc *tsp, int length, int percentile)
+{
+	struct filter *filter;
+
+	if (tsp->mode != TSPROC_SELECT)
+		return 0;
+
+	filter = filter_create(FILTER_MOVING_PERCENTILE, length, percentile);
+	if (!filter)
+		return -1;
+
+	if (tsp->select_filter)
+		filter_destroy(tsp->select_filter);
+	tsp->select_filter = filter;
+	tsp->select_length = length;
+	tsp->select_count = 0;
+	return 0;
+}
+
+int tsproc_window(struct tsproc *tsp)
+{
+	return tsp->select_length;
+}
+
+/*
+ * Feeds the master to slave difference of the latest Sync measurement
+ * into the selection window. Returns zero at the end of each window,
+ * having stored the difference at the wanted percentile in 't21'.
+ */
+static int select_sync(struct tsproc *tsp, tmv_t *t21)
+{
+	*t21 = filter_sample(tsp->select_filter, tmv_sub(tsp->t2, tsp->t1));
+
+	if (++tsp->select_count < tsp->select_length)
+		return -1;
+
+	tsp->select_count = 0;
+	pr_debug("selected t2 - t1 %10" PRId64 " of %d",
+		 tmv_to_nanoseconds(*t21), tsp->select_length);
+	return 0;
+}
+
 tmv_t get_raw_delay(struct tsproc *tsp)
 {
 	tmv_t t23, t41, delay;
@@ -167,6 +221,7 @@ int tsproc_update_delay(struct tsproc *tsp, tmv_t *delay)
 	switch (tsp->mode) {
 	case TSPROC_FILTER:
 	case TSPROC_FILTER_WEIGHT:
+	case TSPROC_SELECT:
 		*delay = tsp->filtered_delay;
 		break;
 	case TSPROC_RAW:
@@ -180,11 +235,13 @@ int tsproc_update_delay(struct tsproc *tsp, tmv_t *delay)
 
 int tsproc_update_offset(struct tsproc *tsp, tmv_t *offset, double *weight)
 {
-	tmv_t delay = tmv_zero(), raw_delay = tmv_zero();
+	tmv_t delay = tmv_zero(), raw_delay = tmv_zero(), t21;
 
 	if (tmv_is_zero(tsp->t1) || tmv_is_zero(tsp->t2))
 		return -1;
 
+	t21 = tmv_sub(tsp->t2, tsp->t1);
+
 	switch (tsp->mode) {
 	case TSPROC_FILTER:
 		if (!tsp->filtered_delay_valid) {
@@ -207,10 +264,17 @@ int tsproc_update_offset(struct tsproc *tsp, tmv_t *offset, double *weight)
 		raw_delay = get_raw_delay(tsp);
 		delay = tsp->filtered_delay;
 		break;
+	case TSPROC_SELECT:
+		if (!tsp->select_filter || select_sync(tsp, &t21) ||
+		    !tsp->filtered_delay_valid) {
+			return -1;
+		}
+		delay = tsp->filtered_delay;
+		break;
 	}
 
 	/* offset = t2 - t1 - delay */
-	*offset = tmv_sub(tmv_sub(tsp->t2, tsp->t1), delay);
+	*offset = tmv_sub(t21, delay);
 
 	if (!weight)
 		return 0;
@@ -234,6 +298,12 @@ void tsproc_reset(struct tsproc *tsp, int full)
 	tsp->t3 = tmv_zero();
 	tsp->t4 = tmv_zero();
 
+	/* The window is useless after a step or a change of master. */
+	if (tsp->select_filter) {
+		filter_reset(tsp->select_filter);
+		tsp->select_count = 0;
+	}
+
 	if (full) {
 		tsp->clock_rate_ratio = 1.0;
 		filter_reset(tsp->delay_filter);
@@ -33,6 +33,7 @@ enum tsproc_mode {
 	TSPROC_RAW,
 	TSPROC_FILTER_WEIGHT,
 	TSPROC_RAW_WEIGHT,
+	TSPROC_SELECT,
 };
 
 /**
@@ -40,10 +41,12 @@ enum tsproc_mode {
  * @param mode           Time stamp processing mode.
  * @param delay_filter   Type of the filter that will be applied to delay.
  * @param filter_length  Length of the filter.
+ * @param percentile     Percentile picked by a moving percentile filter.
  * @return               A pointer to a new tsproc on success, NULL otherwise.
  */
 struct tsproc *tsproc_create(enum tsproc_mode mode,
-			     enum filter_type delay_filter, int filter_length);
+			     enum filter_type delay_filter, int filter_length,
+			     int percentile);
 
 /**
  * Destroy a time stamp processor.
@@ -82,6 +85,25 @@ void tsproc_set_clock_rate_ratio(struct tsproc *tsp, double clock_rate_ratio);
  */
 void tsproc_set_delay(struct tsproc *tsp, tmv_t delay);
 
+/**
+ * Configure the Sync selection of the TSPROC_SELECT mode. In this mode
+ * one offset is produced for each window of Sync measurements, from the
+ * measurement at the given percentile of the master to slave time
+ * stamp differences, so that the least delayed messages are used.
+ * @param tsp         Pointer obtained via @ref tsproc_create().
+ * @param length      Number of Sync measurements in a window.
+ * @param percentile  The percentile to select, 0 for the smallest delay.
+ * @return            0 on success, -1 on failure.
+ */
+int tsproc_set_selection(struct tsproc *tsp, int length, int percentile);
+
+/**
+ * Obtain the number of Sync measurements consumed for each offset.
+ * @param tsp    Pointer obtained via @ref tsproc_create().
+ * @return       The selection window length, or 1 when not selecting.
+ */
+int tsproc_window(struct tsproc *tsp);
+
 /**
  * Update delay in a time stamp processor using new measurements.
  * @param tsp    Pointer obtained via @ref tsproc_create().
@@ -0,0 +1,319 @@
+/**
+ * @file tsreplay.c
+ * @brief Replays recorded time stamps through the clock servo.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "print.h"
+#include "replay.h"
+#include "trace.h"
+#include "util.h"
+#include "version.h"
+
+#define CSV_FIELDS 7
+
+static int show_updates;
+
+static void usage(char *progname)
+{
+	fprintf(stderr,
+		"\nusage: %s [options] trace\n\n"
+		" -f [file] read configuration from 'file'\n"
+		" -E [pi|linreg|kalman]\n"
+		"           clock servo (pi)\n"
+		" -O [offset]\n"
+		"           UTC offset subtracted from the origin time stamps (0)\n"
+		" -u        print every servo update\n"
+		" -l [num]  set the logging level to 'num'\n"
+		" -v        prints the software version and exits\n"
+		" -h        prints this message and exits\n"
+		"\n"
+		" The trace is either a binary trace written by ptp4l or\n"
+		" phc2sys with the trace_file option, or a text file with one Sync per line, with the fields\n"
+		" t1 t2 t3 t4 correction logSyncInterval [freq]\n"
+		" in nanoseconds, separated by commas or white space.\n"
+		"\n",
+		progname);
+}
+
+static void replay_one(struct replay *r, struct trace_record *rec)
+{
+	struct replay_update u;
+
+	if (!replay_record(r, rec, &u) || !show_updates)
+		return;
+
+	printf("%.9f %" PRId64 " %+.3f %d %" PRId64 "\n",
+	       u.time, u.offset, u.freq, u.state, u.delay);
+}
+
+static int replay_binary(struct replay *r, int fd, off_t size)
+{
+	struct trace_header *hdr;
+	struct trace_record rec;
+	uint64_t i, n, first;
+	unsigned char *map;
+	size_t len;
+
+	if (size < sizeof(*hdr)) {
+		fprintf(stderr, "trace too short\n");
+		return -1;
+	}
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "mmap failed: %m\n");
+		return -1;
+	}
+	hdr = (struct trace_header *) map;
+	if (hdr->version != TRACE_VERSION ||
+	    hdr->record_size < sizeof(rec) || !hdr->capacity) {
+		fprintf(stderr, "unsupported trace version %hu\n", hdr->version);
+		munmap(map, size);
+		return -1;
+	}
+	len = sizeof(*hdr) + (size_t) hdr->capacity * hdr->record_size;
+	if (size < len) {
+		fprintf(stderr, "trace truncated\n");
+		munmap(map, size);
+		return -1;
+	}
+
+	/* The oldest record is overwritten once the ring is full. */
+	if (hdr->count > hdr->capacity) {
+		n = hdr->capacity;
+		first = hdr->count % hdr->capacity;
+	} else {
+		n = hdr->count;
+		first = 0;
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(&rec, map + sizeof(*hdr) +
+		       ((first + i) % hdr->capacity) * hdr->record_size,
+		       sizeof(rec));
+		replay_one(r, &rec);
+	}
+
+	munmap(map, size);
+	return 0;
+}
+
+static int parse_line(char *line, int64_t *val)
+{
+	char *end;
+	int n;
+
+	for (n = 0; n < CSV_FIELDS; n++) {
+		while (*line == ' ' || *line == '\t' || *line == ',')
+			line++;
+		if (*line == '\n' || *line == '\0')
+			break;
+		errno = 0;
+		val[n] = strtoll(line, &end, 0);
+		if (errno || end == line)
+			return -1;
+		line = end;
+	}
+	return n;
+}
+
+static int replay_text(struct replay *r, FILE *fp)
+{
+	struct trace_record sync, delay;
+	int64_t val[CSV_FIELDS];
+	unsigned int lineno = 0;
+	char line[512];
+	int n;
+
+	memset(&sync, 0, sizeof(sync));
+	memset(&delay, 0, sizeof(delay));
+	sync.type = TRACE_SYNC;
+	delay.type = TRACE_DELAY;
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		n = parse_line(line, val);
+		if (n < CSV_FIELDS - 1) {
+			fprintf(stderr, "bad trace line %u\n", lineno);
+			return -1;
+		}
+		sync.t1 = val[0];
+		sync.t2 = val[1];
+		sync.correction = val[4];
+		sync.log_interval = val[5];
+		sync.freq = n == CSV_FIELDS ? val[6] : 0.0;
+		replay_one(r, &sync);
+
+		if (!val[2] && !val[3])
+			continue;
+		/* The t4 of the text format is already corrected. */
+		delay.t3 = val[2];
+		delay.t4 = val[3];
+		delay.freq = sync.freq;
+		replay_one(r, &delay);
+	}
+	return 0;
+}
+
+static void show_result(struct replay *r)
+{
+	struct replay_result res;
+	int i;
+
+	if (replay_result(r, &res)) {
+		fprintf(stderr, "the servo was never updated\n");
+		return;
+	}
+	printf("updates %u locked %u jumps %u interval %.6f\n",
+	       res.updates, res.locked, res.jumps, res.interval);
+	if (!res.locked)
+		return;
+	printf("offset rms %.1f max %.0f mean %+.1f stddev %.1f\n",
+	       res.offset.rms, res.offset.max_abs, res.offset.mean,
+	       res.offset.stddev);
+	printf("freq mean %+.3f stddev %.3f\n",
+	       res.freq.mean, res.freq.stddev);
+	printf("delay mean %.1f stddev %.1f\n",
+	       res.delay.mean, res.delay.stddev);
+	if (res.n_tau)
+		printf("%12s %12s %12s\n", "tau", "tdev", "mtie");
+	for (i = 0; i < res.n_tau; i++) {
+		printf("%12.3f %12.3f %12.0f\n",
+		       res.tau[i], res.tdev[i], res.mtie[i]);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char *config = NULL, *progname;
+	int c, err = -1, fd, index, print_level, utc_offset = 0;
+	struct replay *r = NULL;
+	struct config *cfg;
+	struct option *opts;
+	struct stat st;
+	uint32_t magic;
+	FILE *fp;
+
+	cfg = config_create();
+	if (!cfg) {
+		return -1;
+	}
+	opts = config_long_options(cfg);
+
+	progname = strrchr(argv[0], '/');
+	progname = progname ? 1+progname : argv[0];
+	while (EOF != (c = getopt_long(argc, argv, "f:E:O:ul:vh",
+				       opts, &index))) {
+		switch (c) {
+		case 0:
+			if (config_parse_option(cfg, opts[index].name, optarg))
+				goto out;
+			break;
+		case 'f':
+			config = optarg;
+			break;
+		case 'E':
+			if (config_parse_option(cfg, "clock_servo", optarg))
+				goto out;
+			break;
+		case 'O':
+			if (get_arg_val_i(c, optarg, &utc_offset,
+					  INT_MIN, INT_MAX))
+				goto out;
+			break;
+		case 'u':
+			show_updates = 1;
+			break;
+		case 'l':
+			if (get_arg_val_i(c, optarg, &print_level,
+					  PRINT_LEVEL_MIN, PRINT_LEVEL_MAX))
+				goto out;
+			config_set_int(cfg, "logging_level", print_level);
+			break;
+		case 'v':
+			version_show(stdout);
+			config_destroy(cfg);
+			return 0;
+		case 'h':
+			usage(progname);
+			config_destroy(cfg);
+			return 0;
+		default:
+			usage(progname);
+			goto out;
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(progname);
+		goto out;
+	}
+	if (config && config_read(config, cfg)) {
+		goto out;
+	}
+
+	print_set_progname(progname);
+	print_set_verbose(1);
+	print_set_syslog(0);
+	print_set_level(config_get_int(cfg, NULL, "logging_level"));
+
+	r = replay_create(cfg, utc_offset);
+	if (!r) {
+		fprintf(stderr, "failed to create the servo\n");
+		goto out;
+	}
+
+	fp = fopen(argv[optind], "r");
+	if (!fp) {
+		fprintf(stderr, "failed to open %s: %m\n", argv[optind]);
+		goto out;
+	}
+	fd = fileno(fp);
+	if (fstat(fd, &st)) {
+		fprintf(stderr, "failed to stat %s: %m\n", argv[optind]);
+		fclose(fp);
+		goto out;
+	}
+	if (st.st_size >= sizeof(magic) &&
+	    pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) &&
+	    magic == TRACE_MAGIC) {
+		err = replay_binary(r, fd, st.st_size);
+	} else {
+		err = replay_text(r, fp);
+	}
+	fclose(fp);
+
+	if (!err)
+		show_result(r);
+out:
+	if (r)
+		replay_destroy(r);
+	config_destroy(cfg);
+	return err;
+}
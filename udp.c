@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -187,6 +188,11 @@ static int udp_open(struct transport *t, struct interface *iface,
 	if (sk_general_init(gfd))
 		goto no_timestamping;
 
+	if (t->domain >= 0 &&
+	    (sk_set_domain_filter(efd, sizeof(struct udphdr), t->domain) ||
+	     sk_set_domain_filter(gfd, sizeof(struct udphdr), t->domain)))
+		goto no_timestamping;
+
 	event_dscp = config_get_int(t->cfg, NULL, "dscp_event");
 	general_dscp = config_get_int(t->cfg, NULL, "dscp_general");
 
@@ -215,6 +221,11 @@ static int udp_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, 0);
 }
 
+static int udp_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n);
+}
+
 static int udp_send(struct transport *t, struct fdarray *fda,
 		    enum transport_event event, int peer, void *buf, int len,
 		    struct address *addr, struct hw_timestamp *hwts)
@@ -266,6 +277,27 @@ static int udp_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp_send_batch(struct transport *t, struct fdarray *fda,
+			  struct sk_tx *tx, int n)
+{
+	struct address mcast;
+	int i;
+
+	memset(&mcast, 0, sizeof(mcast));
+	mcast.sin.sin_family = AF_INET;
+	mcast.sin.sin_addr = mcast_addr[MC_PRIMARY];
+	mcast.len = sizeof(mcast.sin);
+
+	for (i = 0; i < n; i++) {
+		if (!tx[i].addr) {
+			tx[i].addr = &mcast;
+		}
+		tx[i].addr->sin.sin_port = htons(GENERAL_PORT);
+		tx[i].addr->len = sizeof(tx[i].addr->sin);
+	}
+	return sk_send_batch(fda->fd[FD_GENERAL], tx, n);
+}
+
 static void udp_release(struct transport *t)
 {
 	struct udp *udp = container_of(t, struct udp, t);
@@ -304,7 +336,9 @@ struct transport *udp_transport_create(void)
 	udp->t.close = udp_close;
 	udp->t.open  = udp_open;
 	udp->t.recv  = udp_recv;
+	udp->t.recv_batch = udp_recv_batch;
 	udp->t.send  = udp_send;
+	udp->t.send_batch = udp_send_batch;
 	udp->t.release = udp_release;
 	udp->t.physical_addr = udp_physical_addr;
 	udp->t.protocol_addr = udp_protocol_addr;
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -197,6 +198,11 @@ static int udp6_open(struct transport *t, struct interface *iface,
 	if (sk_general_init(gfd))
 		goto no_timestamping;
 
+	if (t->domain >= 0 &&
+	    (sk_set_domain_filter(efd, sizeof(struct udphdr), t->domain) ||
+	     sk_set_domain_filter(gfd, sizeof(struct udphdr), t->domain)))
+		goto no_timestamping;
+
 	event_dscp = config_get_int(t->cfg, NULL, "dscp_event");
 	general_dscp = config_get_int(t->cfg, NULL, "dscp_general");
 
@@ -225,6 +231,11 @@ static int udp6_recv(struct transport *t, int fd, void *buf, int buflen,
 	return sk_receive(fd, buf, buflen, addr, hwts, 0);
 }
 
+static int udp6_recv_batch(struct transport *t, int fd, struct sk_rx *rx, int n)
+{
+	return sk_receive_batch(fd, rx, n);
+}
+
 static int udp6_send(struct transport *t, struct fdarray *fda,
 		     enum transport_event event, int peer, void *buf, int len,
 		     struct address *addr, struct hw_timestamp *hwts)
@@ -274,6 +285,32 @@ static int udp6_send(struct transport *t, struct fdarray *fda,
 	return event == TRANS_EVENT ? sk_receive(fd, junk, len, NULL, hwts, MSG_ERRQUEUE) : cnt;
 }
 
+static int udp6_send_batch(struct transport *t, struct fdarray *fda,
+			   struct sk_tx *tx, int n)
+{
+	struct udp6 *udp6 = container_of(t, struct udp6, t);
+	struct address mcast;
+	int i;
+
+	memset(&mcast, 0, sizeof(mcast));
+	mcast.sin6.sin6_family = AF_INET6;
+	mcast.sin6.sin6_addr = mc6_addr[MC_PRIMARY];
+	if (is_link_local(&mcast.sin6.sin6_addr))
+		mcast.sin6.sin6_scope_id = udp6->index;
+	mcast.len = sizeof(mcast.sin6);
+
+	for (i = 0; i < n; i++) {
+		if (!tx[i].addr) {
+			tx[i].addr = &mcast;
+		}
+		tx[i].addr->sin6.sin6_port = htons(GENERAL_PORT);
+		tx[i].addr->len = sizeof(tx[i].addr->sin6);
+		/* Extend the payload by two, for UDP checksum corrections. */
+		tx[i].len += 2;
+	}
+	return sk_send_batch(fda->fd[FD_GENERAL], tx, n);
+}
+
 static void udp6_release(struct transport *t)
 {
 	struct udp6 *udp6 = container_of(t, struct udp6, t);
@@ -313,7 +350,9 @@ struct transport *udp6_transport_create(void)
 	udp6->t.close   = udp6_close;
 	udp6->t.open    = udp6_open;
 	udp6->t.recv    = udp6_recv;
+	udp6->t.recv_batch = udp6_recv_batch;
 	udp6->t.send    = udp6_send;
+	udp6->t.send_batch = udp6_send_batch;
 	udp6->t.release = udp6_release;
 	udp6->t.physical_addr = udp6_physical_addr;
 	udp6->t.protocol_addr = udp6_protocol_addr;
@@ -0,0 +1,453 @@
+/**
+ * @file unicast_client.c
+ * @brief Unicast negotiation on the slave side of a port.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "port.h"
+#include "port_private.h"
+#include "print.h"
+#include "unicast_client.h"
+#include "util.h"
+
+/*
+ * Announce messages are requested from every master in the table, so
+ * that the BMCA always has a current data set for each of them.  Only
+ * the master which the port tracks is asked for Sync and Delay_Resp.
+ * When that master fails, the port selects the next best one from the
+ * foreign master records it already has, and the client only needs to
+ * request the two event message streams from it.
+ */
+
+enum {
+	UC_ANNOUNCE,
+	UC_SYNC,
+	UC_DELAY_RESP,
+	UC_N_STREAMS,
+};
+
+#define UC_MASK(s)	(1U << (s))
+#define UC_EVENT_MASK	(UC_MASK(UC_SYNC) | UC_MASK(UC_DELAY_RESP))
+#define UC_ALL_MASK	(UC_MASK(UC_N_STREAMS) - 1)
+
+struct unicast_grant {
+	time_t expires;      /* zero while no grant is held */
+	UInteger32 duration; /* of the current grant */
+};
+
+struct unicast_master {
+	struct address address;
+	struct unicast_grant grant[UC_N_STREAMS];
+};
+
+struct unicast_client {
+	struct port *port;
+	struct unicast_master *master;
+	struct unicast_master *selected;
+	enum transport_type type;
+	unsigned int n_masters;
+	UInteger32 duration;
+	int log_query_interval;
+	int running;
+};
+
+static const uint8_t stream_type[UC_N_STREAMS] = {
+	[UC_ANNOUNCE] = ANNOUNCE,
+	[UC_SYNC] = SYNC,
+	[UC_DELAY_RESP] = DELAY_RESP,
+};
+
+static time_t unicast_client_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static int stream_index(uint8_t message_type)
+{
+	int i;
+
+	for (i = 0; i < UC_N_STREAMS; i++) {
+		if (stream_type[i] == message_type >> 4) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static Integer8 stream_log_period(struct port *p, int stream)
+{
+	switch (stream) {
+	case UC_ANNOUNCE:
+		return p->logAnnounceInterval;
+	case UC_SYNC:
+		return p->logSyncInterval;
+	default:
+		return p->logMinDelayReqInterval;
+	}
+}
+
+static struct unicast_master *master_find(struct unicast_client *uc,
+					  struct address *address)
+{
+	unsigned int i;
+
+	for (i = 0; i < uc->n_masters; i++) {
+		if (addreq(uc->type, &uc->master[i].address, address)) {
+			return &uc->master[i];
+		}
+	}
+	return NULL;
+}
+
+static unsigned int master_wanted(struct unicast_client *uc,
+				  struct unicast_master *m)
+{
+	unsigned int mask = UC_MASK(UC_ANNOUNCE);
+
+	if (m == uc->selected) {
+		mask |= UC_MASK(UC_SYNC);
+		if (uc->port->delayMechanism != DM_P2P) {
+			mask |= UC_MASK(UC_DELAY_RESP);
+		}
+	}
+	return mask;
+}
+
+/*
+ * A grant is renewed once half of its duration has passed, and a
+ * missing grant is requested again on every query.
+ */
+static unsigned int master_due(struct unicast_client *uc,
+			       struct unicast_master *m, time_t now)
+{
+	unsigned int mask = 0, wanted = master_wanted(uc, m);
+	struct unicast_grant *g;
+	int i;
+
+	for (i = 0; i < UC_N_STREAMS; i++) {
+		if (!(wanted & UC_MASK(i))) {
+			continue;
+		}
+		g = &m->grant[i];
+		if (!g->expires || now + g->duration / 2 >= g->expires) {
+			mask |= UC_MASK(i);
+		}
+	}
+	return mask;
+}
+
+static int master_signal(struct unicast_client *uc, struct unicast_master *m,
+			 unsigned int mask, int cancel)
+{
+	struct request_unicast_xmit_tlv *req;
+	struct cancel_unicast_xmit_tlv *cnl;
+	struct port *p = uc->port;
+	struct PortIdentity wildcard;
+	struct ptp_message *msg;
+	struct tlv_extra *extra;
+	int err, i;
+
+	memset(&wildcard, 0xff, sizeof(wildcard));
+	msg = port_signaling_construct(p, &m->address, &wildcard);
+	if (!msg) {
+		return -1;
+	}
+	for (i = 0; i < UC_N_STREAMS; i++) {
+		if (!(mask & UC_MASK(i))) {
+			continue;
+		}
+		if (cancel) {
+			extra = msg_tlv_append(msg, sizeof(*cnl));
+			if (!extra) {
+				goto failed;
+			}
+			cnl = (struct cancel_unicast_xmit_tlv *) extra->tlv;
+			cnl->type = TLV_CANCEL_UNICAST_TRANSMISSION;
+			cnl->length = sizeof(*cnl) - sizeof(cnl->type) -
+				sizeof(cnl->length);
+			cnl->message_type_flags = stream_type[i] << 4;
+			cnl->reserved = 0;
+		} else {
+			extra = msg_tlv_append(msg, sizeof(*req));
+			if (!extra) {
+				goto failed;
+			}
+			req = (struct request_unicast_xmit_tlv *) extra->tlv;
+			req->type = TLV_REQUEST_UNICAST_TRANSMISSION;
+			req->length = sizeof(*req) - sizeof(req->type) -
+				sizeof(req->length);
+			req->message_type = stream_type[i] << 4;
+			req->logInterMessagePeriod = stream_log_period(p, i);
+			req->durationField = uc->duration;
+		}
+	}
+	err = port_prepare_and_send(p, msg, TRANS_GENERAL);
+	if (err) {
+		pr_err("port %hu: send unicast %s failed", portnum(p),
+		       cancel ? "cancel" : "request");
+	}
+	msg_put(msg);
+	return err;
+failed:
+	msg_put(msg);
+	return -1;
+}
+
+static void master_cancel(struct unicast_client *uc, struct unicast_master *m,
+			  unsigned int mask)
+{
+	unsigned int granted = 0;
+	int i;
+
+	for (i = 0; i < UC_N_STREAMS; i++) {
+		if (mask & UC_MASK(i) && m->grant[i].expires) {
+			granted |= UC_MASK(i);
+		}
+		if (mask & UC_MASK(i)) {
+			m->grant[i].expires = 0;
+			m->grant[i].duration = 0;
+		}
+	}
+	if (granted) {
+		master_signal(uc, m, granted, 1);
+	}
+}
+
+static int unicast_client_query(struct unicast_client *uc)
+{
+	time_t now = unicast_client_now();
+	unsigned int i, mask;
+	int err = 0;
+
+	for (i = 0; i < uc->n_masters; i++) {
+		mask = master_due(uc, &uc->master[i], now);
+		if (mask && master_signal(uc, &uc->master[i], mask, 0)) {
+			err = -1;
+		}
+	}
+	return err;
+}
+
+struct unicast_client *unicast_client_create(struct port *p,
+					     struct unicast_master_table *table,
+					     unsigned int duration)
+{
+	struct unicast_master_address *address;
+	struct unicast_client *uc;
+
+	uc = calloc(1, sizeof(*uc));
+	if (!uc) {
+		return NULL;
+	}
+	uc->master = calloc(table->count, sizeof(*uc->master));
+	if (table->count && !uc->master) {
+		free(uc);
+		return NULL;
+	}
+	uc->port = p;
+	uc->type = transport_type(p->trp);
+	uc->duration = duration;
+	uc->log_query_interval = table->logQueryInterval;
+
+	STAILQ_FOREACH(address, &table->addrs, list) {
+		if (address->type != uc->type) {
+			pr_warning("port %hu: skipping unicast master of "
+				   "another transport", portnum(p));
+			continue;
+		}
+		uc->master[uc->n_masters++].address = address->address;
+	}
+	if (!uc->n_masters) {
+		pr_warning("port %hu: unicast master table %d is empty",
+			   portnum(p), table->table_id);
+	}
+	return uc;
+}
+
+void unicast_client_destroy(struct unicast_client *uc)
+{
+	free(uc->master);
+	free(uc);
+}
+
+void unicast_client_enable(struct unicast_client *uc)
+{
+	struct port *p = uc->port;
+
+	uc->running = 1;
+	unicast_client_query(uc);
+	set_tmo_log(port_tmo(p, FD_UNICAST_REQ_TIMER), 1, uc->log_query_interval);
+}
+
+void unicast_client_disable(struct unicast_client *uc)
+{
+	unsigned int i;
+
+	if (uc->running) {
+		for (i = 0; i < uc->n_masters; i++) {
+			master_cancel(uc, &uc->master[i], UC_ALL_MASK);
+		}
+	}
+	uc->selected = NULL;
+	uc->running = 0;
+}
+
+void unicast_client_state_changed(struct unicast_client *uc)
+{
+	struct unicast_master *best = NULL;
+	struct port *p = uc->port;
+	struct ptp_message *msg;
+
+	if (!uc->running) {
+		return;
+	}
+	switch (p->state) {
+	case PS_UNCALIBRATED:
+	case PS_SLAVE:
+		if (p->best) {
+			msg = p->best->latest;
+			if (msg) {
+				best = master_find(uc, &msg->address);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+	if (best == uc->selected) {
+		return;
+	}
+	if (uc->selected) {
+		master_cancel(uc, uc->selected, UC_EVENT_MASK);
+	}
+	uc->selected = best;
+	if (best) {
+		/* Do not wait for the next query to start the failover. */
+		master_signal(uc, best, master_due(uc, best,
+						   unicast_client_now()), 0);
+	}
+}
+
+void unicast_client_grant(struct unicast_client *uc, struct ptp_message *m,
+			  struct grant_unicast_xmit_tlv *grant)
+{
+	struct port *p = uc->port;
+	struct unicast_master *master;
+	struct unicast_grant *g;
+	int i;
+
+	if (!uc->running) {
+		return;
+	}
+	master = master_find(uc, &m->address);
+	i = stream_index(grant->message_type);
+	if (!master || i < 0) {
+		return;
+	}
+	g = &master->grant[i];
+
+	if (!grant->durationField) {
+		pl_info(60, "port %hu: unicast %s denied by %s", portnum(p),
+			msg_type_string(stream_type[i]),
+			pid2str(&m->header.sourcePortIdentity));
+		g->expires = 0;
+		g->duration = 0;
+		return;
+	}
+	g->expires = unicast_client_now() + grant->durationField;
+	g->duration = grant->durationField;
+
+	/* A late grant from a master which is no longer selected. */
+	if (!(master_wanted(uc, master) & UC_MASK(i))) {
+		master_cancel(uc, master, UC_MASK(i));
+	}
+}
+
+void unicast_client_cancel(struct unicast_client *uc, struct ptp_message *m,
+			   struct cancel_unicast_xmit_tlv *cancel)
+{
+	struct unicast_master *master;
+	int i;
+
+	master = master_find(uc, &m->address);
+	i = stream_index(cancel->message_type_flags);
+	if (!master || i < 0) {
+		return;
+	}
+	/* The stream will be requested again on the next query. */
+	master->grant[i].expires = 0;
+	master->grant[i].duration = 0;
+}
+
+int unicast_client_timer(struct unicast_client *uc)
+{
+	struct port *p = uc->port;
+
+	set_tmo_log(port_tmo(p, FD_UNICAST_REQ_TIMER), 1, uc->log_query_interval);
+	return unicast_client_query(uc);
+}
+
+int unicast_client_table(struct unicast_client *uc,
+			 struct unicast_master_table_np *umt, int space)
+{
+	struct PortAddress *pa;
+	const void *address;
+	unsigned int i;
+	uint8_t *buf;
+	int len;
+
+	umt->logQueryInterval = uc->log_query_interval;
+	umt->actualTableSize = 0;
+	buf = umt->unicastMasterTable;
+	space -= sizeof(*umt);
+
+	for (i = 0; i < uc->n_masters; i++) {
+		switch (uc->type) {
+		case TRANS_UDP_IPV4:
+			address = &uc->master[i].address.sin.sin_addr;
+			len = sizeof(uc->master[i].address.sin.sin_addr);
+			break;
+		case TRANS_UDP_IPV6:
+			address = &uc->master[i].address.sin6.sin6_addr;
+			len = sizeof(uc->master[i].address.sin6.sin6_addr);
+			break;
+		case TRANS_IEEE_802_3:
+			address = uc->master[i].address.sll.sll_addr;
+			len = MAC_LEN;
+			break;
+		default:
+			return buf - (uint8_t *) umt;
+		}
+		if (space < (int) sizeof(*pa) + len) {
+			break;
+		}
+		pa = (struct PortAddress *) buf;
+		pa->networkProtocol = uc->type;
+		pa->addressLength = len;
+		memcpy(pa->address, address, len);
+		buf += sizeof(*pa) + len;
+		space -= sizeof(*pa) + len;
+		umt->actualTableSize++;
+	}
+	return buf - (uint8_t *) umt;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file unicast_client.h
+ * @brief Unicast negotiation on the slave side of a port.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_UNICAST_CLIENT_H
+#define HAVE_UNICAST_CLIENT_H
+
+#include "config.h"
+#include "msg.h"
+#include "tlv.h"
+
+struct port;
+
+/** Opaque type */
+struct unicast_client;
+
+/**
+ * Create the unicast client of a port.
+ * @param p         The port using the masters.
+ * @param table     The table of masters to negotiate with.
+ * @param duration  The duration in seconds to request for each grant.
+ * @return A pointer to a new client on success, NULL otherwise.
+ */
+struct unicast_client *unicast_client_create(struct port *p,
+					     struct unicast_master_table *table,
+					     unsigned int duration);
+
+/**
+ * Destroy the unicast client of a port.
+ * @param uc  Pointer obtained via @ref unicast_client_create().
+ */
+void unicast_client_destroy(struct unicast_client *uc);
+
+/**
+ * Start the negotiation after the port has been initialized.  Announce
+ * messages are requested from all of the masters in the table.
+ * @param uc  Pointer obtained via @ref unicast_client_create().
+ */
+void unicast_client_enable(struct unicast_client *uc);
+
+/**
+ * Cancel all of the grants before the port is disabled.
+ * @param uc  Pointer obtained via @ref unicast_client_create().
+ */
+void unicast_client_disable(struct unicast_client *uc);
+
+/**
+ * Follow a change of the port state or of the best master.  Sync and
+ * Delay_Resp messages are only requested from the master which the
+ * port tracks in the UNCALIBRATED and SLAVE states.
+ * @param uc  Pointer obtained via @ref unicast_client_create().
+ */
+void unicast_client_state_changed(struct unicast_client *uc);
+
+/**
+ * Handle a GRANT_UNICAST_TRANSMISSION TLV from a master.
+ * @param uc     Pointer obtained via @ref unicast_client_create().
+ * @param m      The signaling message carrying the grant.
+ * @param grant  The grant.
+ */
+void unicast_client_grant(struct unicast_client *uc, struct ptp_message *m,
+			  struct grant_unicast_xmit_tlv *grant);
+
+/**
+ * Handle a CANCEL_UNICAST_TRANSMISSION TLV from a master.
+ * @param uc      Pointer obtained via @ref unicast_client_create().
+ * @param m       The signaling message carrying the cancellation.
+ * @param cancel  The cancellation.
+ */
+void unicast_client_cancel(struct unicast_client *uc, struct ptp_message *m,
+			   struct cancel_unicast_xmit_tlv *cancel);
+
+/**
+ * Renew the grants which are about to expire and repeat the requests
+ * which have not been granted.  Called when the query timer expires.
+ * @param uc  Pointer obtained via @ref unicast_client_create().
+ * @return Zero on success, non-zero otherwise.
+ */
+int unicast_client_timer(struct unicast_client *uc);
+
+/**
+ * Fill in the UNICAST_MASTER_TABLE management data set.
+ * @param uc     Pointer obtained via @ref unicast_client_create().
+ * @param umt    Buffer to hold the data set.
+ * @param space  The size of the buffer in bytes.
+ * @return The length of the data set in bytes.
+ */
+int unicast_client_table(struct unicast_client *uc,
+			 struct unicast_master_table_np *umt, int space);
+
+#endif
@@ -0,0 +1,489 @@
+/**
+ * @file unicast_service.c
+ * @brief Unicast service on the master side of a port.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "port.h"
+#include "port_private.h"
+#include "print.h"
+#include "unicast_service.h"
+
+/*
+ * The grants are kept in a hash table keyed by the network address and
+ * the port identity of the client.  The transmissions and the expiry
+ * of the grants of all clients are scheduled from a single timing
+ * wheel, whose tick is the shortest period which may be granted.  A
+ * stream sits in the slot of its next transmission, or of the end of
+ * its grant if that comes first.  Streams with periods longer than the
+ * wheel are simply skipped until their tick comes.
+ */
+
+#define UNICAST_HASH_SIZE	1024
+#define UNICAST_WHEEL_SIZE	256
+#define UNICAST_LOG_TICK	-7 /* 128 messages per second */
+#define UNICAST_MAX_LOG_PERIOD	7
+#define UNICAST_MAX_DURATION	1000
+#define UNICAST_TICK_NS		(NS_PER_SEC >> -UNICAST_LOG_TICK)
+
+enum {
+	US_ANNOUNCE,
+	US_SYNC,
+	US_DELAY_RESP,
+	US_N_STREAMS,
+};
+
+struct unicast_client;
+
+struct unicast_stream {
+	LIST_ENTRY(unicast_stream) slot;
+	struct unicast_client *client;
+	uint64_t due;        /* tick of the next transmission or expiry */
+	uint64_t next;       /* tick of the next transmission */
+	uint64_t expires;    /* tick at which the grant ends */
+	uint32_t period;     /* in ticks, zero for Delay_Resp */
+	UInteger16 sequence_id;
+	Integer8 log_period;
+	int active;
+};
+
+struct unicast_client {
+	LIST_ENTRY(unicast_client) list;
+	struct address address;
+	struct PortIdentity portIdentity;
+	uint32_t hash;
+	int n_active;
+	struct unicast_stream stream[US_N_STREAMS];
+};
+
+struct unicast_service {
+	struct port *port;
+	LIST_HEAD(uc_hash, unicast_client) hash[UNICAST_HASH_SIZE];
+	LIST_HEAD(uc_slot, unicast_stream) wheel[UNICAST_WHEEL_SIZE];
+	uint64_t tick;       /* last tick serviced */
+	unsigned int n_clients;
+	unsigned int max_clients;
+	unsigned int n_streams;
+	int running;
+};
+
+static const uint8_t stream_type[US_N_STREAMS] = {
+	[US_ANNOUNCE] = ANNOUNCE,
+	[US_SYNC] = SYNC,
+	[US_DELAY_RESP] = DELAY_RESP,
+};
+
+static uint64_t unicast_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * NS_PER_SEC + ts.tv_nsec) / UNICAST_TICK_NS;
+}
+
+/*
+ * The source port of a UDP message depends on the message class, so
+ * only the network address identifies the client.
+ */
+static int addr_key(struct address *a, const unsigned char **key)
+{
+	switch (a->sa.sa_family) {
+	case AF_INET:
+		*key = (const unsigned char *) &a->sin.sin_addr;
+		return sizeof(a->sin.sin_addr);
+	case AF_INET6:
+		*key = (const unsigned char *) &a->sin6.sin6_addr;
+		return sizeof(a->sin6.sin6_addr);
+	case AF_PACKET:
+		*key = a->sll.sll_addr;
+		return a->sll.sll_halen;
+	}
+	*key = (const unsigned char *) &a->sa;
+	return a->len;
+}
+
+static uint32_t fnv1a(uint32_t h, const unsigned char *p, int len)
+{
+	while (len--) {
+		h ^= *p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+static uint32_t client_hash(struct address *a, struct PortIdentity *pid)
+{
+	const unsigned char *key;
+	uint32_t h = 2166136261;
+	int len;
+
+	len = addr_key(a, &key);
+	h = fnv1a(h, key, len);
+	return fnv1a(h, (const unsigned char *) pid, sizeof(*pid));
+}
+
+static int client_match(struct unicast_client *c, uint32_t hash,
+			struct address *a, struct PortIdentity *pid)
+{
+	const unsigned char *k1, *k2;
+	int len1, len2;
+
+	if (c->hash != hash || !pid_eq(&c->portIdentity, pid))
+		return 0;
+	len1 = addr_key(&c->address, &k1);
+	len2 = addr_key(a, &k2);
+	return len1 == len2 && !memcmp(k1, k2, len1);
+}
+
+static struct unicast_client *client_find(struct unicast_service *us,
+					  struct ptp_message *m)
+{
+	struct PortIdentity *pid = &m->header.sourcePortIdentity;
+	struct unicast_client *c;
+	uint32_t hash;
+
+	hash = client_hash(&m->address, pid);
+	LIST_FOREACH(c, &us->hash[hash % UNICAST_HASH_SIZE], list) {
+		if (client_match(c, hash, &m->address, pid))
+			return c;
+	}
+	return NULL;
+}
+
+static int unicast_timer_arm(struct unicast_service *us, int on)
+{
+	struct wheel_timer *t = port_tmo(us->port, FD_UNICAST_TIMER);
+
+	if (on) {
+		wheel_timer_set(t, UNICAST_TICK_NS);
+	} else {
+		wheel_timer_clear(t);
+	}
+	us->running = on;
+	return 0;
+}
+
+static void stream_schedule(struct unicast_service *us,
+			    struct unicast_stream *s)
+{
+	/* Wake up at the expiry when it comes before the transmission. */
+	s->due = s->next < s->expires ? s->next : s->expires;
+	LIST_INSERT_HEAD(&us->wheel[s->due % UNICAST_WHEEL_SIZE], s, slot);
+}
+
+static void client_remove(struct unicast_service *us, struct unicast_client *c)
+{
+	LIST_REMOVE(c, list);
+	free(c);
+	us->n_clients--;
+}
+
+static void stream_stop(struct unicast_service *us, struct unicast_stream *s)
+{
+	struct unicast_client *c = s->client;
+
+	if (!s->active)
+		return;
+	LIST_REMOVE(s, slot);
+	s->active = 0;
+	us->n_streams--;
+	if (!--c->n_active)
+		client_remove(us, c);
+	if (!us->n_streams && us->running)
+		unicast_timer_arm(us, 0);
+}
+
+struct unicast_service *unicast_service_create(struct port *p,
+					       int max_clients)
+{
+	struct unicast_service *us;
+	int i;
+
+	us = calloc(1, sizeof(*us));
+	if (!us)
+		return NULL;
+	us->port = p;
+	us->max_clients = max_clients;
+	for (i = 0; i < UNICAST_HASH_SIZE; i++)
+		LIST_INIT(&us->hash[i]);
+	for (i = 0; i < UNICAST_WHEEL_SIZE; i++)
+		LIST_INIT(&us->wheel[i]);
+	return us;
+}
+
+void unicast_service_destroy(struct unicast_service *us)
+{
+	unicast_service_clear(us);
+	free(us);
+}
+
+static int stream_index(uint8_t message_type)
+{
+	int i;
+
+	for (i = 0; i < US_N_STREAMS; i++) {
+		if (stream_type[i] == message_type)
+			return i;
+	}
+	return -1;
+}
+
+void unicast_service_add(struct unicast_service *us, struct ptp_message *m,
+			 struct request_unicast_xmit_tlv *req,
+			 struct grant_unicast_xmit_tlv *grant)
+{
+	struct unicast_client *c;
+	struct unicast_stream *s;
+	uint32_t duration;
+	int i, renew = 0;
+	uint64_t now;
+
+	grant->type = TLV_GRANT_UNICAST_TRANSMISSION;
+	grant->length = sizeof(*grant) - sizeof(grant->type) -
+		sizeof(grant->length);
+	grant->message_type = req->message_type & 0xf0;
+	grant->logInterMessagePeriod = req->logInterMessagePeriod;
+	grant->durationField = 0;
+	grant->reserved = 0;
+	grant->flags = 0;
+
+	switch (port_state(us->port)) {
+	case PS_MASTER:
+	case PS_GRAND_MASTER:
+		break;
+	default:
+		return;
+	}
+	i = stream_index(req->message_type >> 4);
+	if (i < 0 ||
+	    req->logInterMessagePeriod < UNICAST_LOG_TICK ||
+	    req->logInterMessagePeriod > UNICAST_MAX_LOG_PERIOD) {
+		return;
+	}
+	duration = req->durationField;
+	if (duration > UNICAST_MAX_DURATION)
+		duration = UNICAST_MAX_DURATION;
+	if (!duration)
+		return;
+
+	c = client_find(us, m);
+	if (!c) {
+		if (us->n_clients >= us->max_clients) {
+			pr_debug("port %hu: unicast client table full",
+				 portnum(us->port));
+			return;
+		}
+		c = calloc(1, sizeof(*c));
+		if (!c)
+			return;
+		c->address = m->address;
+		c->portIdentity = m->header.sourcePortIdentity;
+		c->hash = client_hash(&c->address, &c->portIdentity);
+		LIST_INSERT_HEAD(&us->hash[c->hash % UNICAST_HASH_SIZE], c, list);
+		us->n_clients++;
+	}
+
+	now = unicast_now();
+	if (!us->running) {
+		us->tick = now;
+		if (unicast_timer_arm(us, 1)) {
+			pr_err("port %hu: failed to arm unicast timer: %m",
+			       portnum(us->port));
+			if (!c->n_active)
+				client_remove(us, c);
+			return;
+		}
+	}
+
+	s = &c->stream[i];
+	if (s->active) {
+		/* A renewal keeps the phase of the stream. */
+		LIST_REMOVE(s, slot);
+		renew = s->log_period == req->logInterMessagePeriod;
+	} else {
+		s->client = c;
+		s->active = 1;
+		c->n_active++;
+		us->n_streams++;
+	}
+	s->log_period = req->logInterMessagePeriod;
+	s->expires = now + (uint64_t) duration * (1 << -UNICAST_LOG_TICK);
+	if (i == US_DELAY_RESP) {
+		s->period = 0;
+		s->next = s->expires;
+	} else if (!renew) {
+		s->period = 1 << (s->log_period - UNICAST_LOG_TICK);
+		/* Spread the clients over the period to avoid bursts. */
+		s->next = now + 1 + c->hash % s->period;
+	}
+	stream_schedule(us, s);
+
+	grant->durationField = duration;
+	grant->flags = GRANT_UNICAST_RENEWAL_INVITED;
+}
+
+void unicast_service_remove(struct unicast_service *us, struct ptp_message *m,
+			    struct cancel_unicast_xmit_tlv *cancel)
+{
+	struct unicast_client *c;
+	int i;
+
+	i = stream_index(cancel->message_type_flags >> 4);
+	if (i < 0)
+		return;
+	c = client_find(us, m);
+	if (c)
+		stream_stop(us, &c->stream[i]);
+}
+
+void unicast_service_clear(struct unicast_service *us)
+{
+	struct unicast_client *c;
+	int i, k;
+
+	for (i = 0; i < UNICAST_HASH_SIZE; i++) {
+		while ((c = LIST_FIRST(&us->hash[i])) != NULL) {
+			for (k = 0; k < US_N_STREAMS; k++) {
+				if (c->stream[k].active) {
+					LIST_REMOVE(&c->stream[k], slot);
+					us->n_streams--;
+				}
+			}
+			client_remove(us, c);
+		}
+	}
+	if (us->running)
+		unicast_timer_arm(us, 0);
+}
+
+int unicast_service_delay_resp(struct unicast_service *us,
+			       struct ptp_message *m, Integer8 *log_period)
+{
+	struct unicast_client *c;
+	struct unicast_stream *s;
+
+	c = client_find(us, m);
+	if (!c)
+		return 0;
+	s = &c->stream[US_DELAY_RESP];
+	if (!s->active)
+		return 0;
+	*log_period = s->log_period;
+	return 1;
+}
+
+static int stream_transmit(struct unicast_service *us,
+			   struct unicast_stream *s, int i)
+{
+	struct port *p = us->port;
+	UInteger16 seqnum;
+	int err;
+
+	/* Each client sees its own sequence of messages. */
+	switch (i) {
+	case US_ANNOUNCE:
+		seqnum = p->seqnum.announce;
+		p->seqnum.announce = s->sequence_id;
+		err = port_tx_announce(p, &s->client->address);
+		s->sequence_id = p->seqnum.announce;
+		p->seqnum.announce = seqnum;
+		break;
+	case US_SYNC:
+		seqnum = p->seqnum.sync;
+		p->seqnum.sync = s->sequence_id;
+		err = port_tx_sync(p, &s->client->address);
+		s->sequence_id = p->seqnum.sync;
+		p->seqnum.sync = seqnum;
+		break;
+	default:
+		err = 0;
+		break;
+	}
+	return err;
+}
+
+static int unicast_service_slot(struct unicast_service *us, uint64_t now,
+				unsigned int index)
+{
+	struct uc_slot pending;
+	struct unicast_stream *s;
+	int err = 0, i;
+
+	/* Streams may go back into the same slot, so take the list first. */
+	LIST_INIT(&pending);
+	while ((s = LIST_FIRST(&us->wheel[index])) != NULL) {
+		LIST_REMOVE(s, slot);
+		LIST_INSERT_HEAD(&pending, s, slot);
+	}
+
+	while ((s = LIST_FIRST(&pending)) != NULL) {
+		LIST_REMOVE(s, slot);
+		if (s->due > now) {
+			stream_schedule(us, s);
+			continue;
+		}
+		if (now >= s->expires) {
+			/* stream_stop() unlinks the stream once more. */
+			LIST_INSERT_HEAD(&pending, s, slot);
+			stream_stop(us, s);
+			continue;
+		}
+		i = s - s->client->stream;
+		if (stream_transmit(us, s, i))
+			err = -1;
+		while (s->next <= now)
+			s->next += s->period;
+		stream_schedule(us, s);
+	}
+	return err;
+}
+
+int unicast_service_timer(struct unicast_service *us)
+{
+	uint64_t now, t;
+	int err = 0;
+
+	if (!us->running)
+		return 0;
+
+	now = unicast_now();
+	t = us->tick + 1;
+	if (now - us->tick > UNICAST_WHEEL_SIZE) {
+		/* Far behind, every slot is due at most once. */
+		t = now - UNICAST_WHEEL_SIZE + 1;
+	}
+	for (; t <= now && us->running; t++) {
+		if (unicast_service_slot(us, now, t % UNICAST_WHEEL_SIZE))
+			err = -1;
+	}
+	us->tick = now;
+	if (us->running)
+		wheel_timer_set(port_tmo(us->port, FD_UNICAST_TIMER),
+				UNICAST_TICK_NS);
+	return err;
+}
+
+unsigned int unicast_service_clients(struct unicast_service *us)
+{
+	return us->n_clients;
+}
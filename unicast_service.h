@@ -0,0 +1,101 @@
+/**
+ * @file unicast_service.h
+ * @brief Unicast service on the master side of a port.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_UNICAST_SERVICE_H
+#define HAVE_UNICAST_SERVICE_H
+
+#include "msg.h"
+#include "tlv.h"
+
+struct port;
+
+/** Opaque type */
+struct unicast_service;
+
+/**
+ * Create the unicast service of a port.
+ * @param p            The port offering the service.
+ * @param max_clients  The number of clients which may hold grants at once.
+ * @return A pointer to a new service on success, NULL otherwise.
+ */
+struct unicast_service *unicast_service_create(struct port *p,
+					       int max_clients);
+
+/**
+ * Destroy the unicast service of a port.
+ * @param us  Pointer obtained via @ref unicast_service_create().
+ */
+void unicast_service_destroy(struct unicast_service *us);
+
+/**
+ * Handle a request for unicast transmission.  A new grant is added to
+ * the table, or an existing one renewed.  Requests from new clients are
+ * denied while the table holds the maximum number of clients.
+ * @param us     Pointer obtained via @ref unicast_service_create().
+ * @param m      The signaling message carrying the request.
+ * @param req    The REQUEST_UNICAST_TRANSMISSION TLV.
+ * @param grant  Returns the response to the request.  A duration of
+ *               zero means that the request was denied.
+ */
+void unicast_service_add(struct unicast_service *us, struct ptp_message *m,
+			 struct request_unicast_xmit_tlv *req,
+			 struct grant_unicast_xmit_tlv *grant);
+
+/**
+ * Cancel a grant.
+ * @param us      Pointer obtained via @ref unicast_service_create().
+ * @param m       The signaling message carrying the cancellation.
+ * @param cancel  The CANCEL_UNICAST_TRANSMISSION TLV.
+ */
+void unicast_service_remove(struct unicast_service *us, struct ptp_message *m,
+			    struct cancel_unicast_xmit_tlv *cancel);
+
+/**
+ * Cancel all of the grants, for example when the port leaves the
+ * master state.
+ * @param us  Pointer obtained via @ref unicast_service_create().
+ */
+void unicast_service_clear(struct unicast_service *us);
+
+/**
+ * Test whether a unicast Delay_Req may be answered.
+ * @param us          Pointer obtained via @ref unicast_service_create().
+ * @param m           The Delay_Req message.
+ * @param log_period  Returns the granted logInterMessagePeriod.
+ * @return One if the sender holds a Delay_Resp grant, zero otherwise.
+ */
+int unicast_service_delay_resp(struct unicast_service *us,
+			       struct ptp_message *m, Integer8 *log_period);
+
+/**
+ * Transmit the Announce and Sync messages which are due, and expire
+ * old grants.  Called when the service timer expires.
+ * @param us  Pointer obtained via @ref unicast_service_create().
+ * @return Zero on success, non-zero if a message could not be sent.
+ */
+int unicast_service_timer(struct unicast_service *us);
+
+/**
+ * Obtain the number of clients holding a grant.
+ * @param us  Pointer obtained via @ref unicast_service_create().
+ * @return The number of clients.
+ */
+unsigned int unicast_service_clients(struct unicast_service *us);
+
+#endif
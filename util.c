@@ -152,6 +152,57 @@ int str2mac(const char *s, unsigned char mac[MAC_LEN])
 	return 0;
 }
 
+int str2addr(enum transport_type type, const char *s, struct address *addr)
+{
+	unsigned char mac[MAC_LEN];
+
+	memset(addr, 0, sizeof(*addr));
+
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		if (inet_pton(AF_INET, s, &addr->sin.sin_addr) != 1) {
+			return -1;
+		}
+		addr->sin.sin_family = AF_INET;
+		addr->len = sizeof(addr->sin);
+		break;
+	case TRANS_UDP_IPV6:
+		if (inet_pton(AF_INET6, s, &addr->sin6.sin6_addr) != 1) {
+			return -1;
+		}
+		addr->sin6.sin6_family = AF_INET6;
+		addr->len = sizeof(addr->sin6);
+		break;
+	case TRANS_IEEE_802_3:
+		if (str2mac(s, mac)) {
+			return -1;
+		}
+		addr->sll.sll_family = AF_PACKET;
+		addr->sll.sll_halen = MAC_LEN;
+		memcpy(addr->sll.sll_addr, mac, MAC_LEN);
+		addr->len = sizeof(addr->sll);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+int addreq(enum transport_type type, struct address *a, struct address *b)
+{
+	switch (type) {
+	case TRANS_UDP_IPV4:
+		return a->sin.sin_addr.s_addr == b->sin.sin_addr.s_addr;
+	case TRANS_UDP_IPV6:
+		return !memcmp(&a->sin6.sin6_addr, &b->sin6.sin6_addr,
+			       sizeof(a->sin6.sin6_addr));
+	case TRANS_IEEE_802_3:
+		return !memcmp(a->sll.sll_addr, b->sll.sll_addr, MAC_LEN);
+	default:
+		return a->len == b->len && !memcmp(&a->sa, &b->sa, a->len);
+	}
+}
+
 int str2pid(const char *s, struct PortIdentity *result)
 {
 	struct PortIdentity pid;
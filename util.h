@@ -23,8 +23,10 @@
 #include <string.h>
 #include <time.h>
 
+#include "address.h"
 #include "ddt.h"
 #include "ether.h"
+#include "transport.h"
 
 #define MAX_PRINT_BYTES 16
 #define BIN_BUF_SIZE (MAX_PRINT_BYTES * 3 + 1)
@@ -89,6 +91,27 @@ char *portaddr2str(struct PortAddress *addr);
  */
 int str2mac(const char *s, unsigned char mac[MAC_LEN]);
 
+/**
+ * Scan a string containing a network address and convert it into
+ * binary form.
+ *
+ * @param type    The network transport type of the address.
+ * @param s       String in human readable form.
+ * @param addr    Pointer to a buffer to hold the result.
+ * @return Zero on success, or -1 if the string is incorrectly formatted.
+ */
+int str2addr(enum transport_type type, const char *s, struct address *addr);
+
+/**
+ * Compare two network addresses, ignoring the UDP port numbers.
+ *
+ * @param type    The network transport type of the addresses.
+ * @param a       The first address.
+ * @param b       The second address.
+ * @return One if the addresses are equal, zero otherwise.
+ */
+int addreq(enum transport_type type, struct address *a, struct address *b);
+
 /**
  * Scan a string containing a port identity and convert it into binary form.
  *
@@ -0,0 +1,315 @@
+/**
+ * @file wheel.c
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "missing.h"
+#include "print.h"
+#include "tmv.h"
+#include "wheel.h"
+
+/*
+ * Each level has WHEEL_SIZE slots, and one slot on level N spans all
+ * of the slots on level N-1.  With a tick of about one millisecond,
+ * the four levels cover some fifty days.  Timers further out than that
+ * are parked in the last slot of the top level until they come in
+ * range.
+ */
+#define WHEEL_BITS	8
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_WORDS	(WHEEL_SIZE / 64)
+
+LIST_HEAD(wheel_slot, wheel_timer);
+
+struct wheel {
+	struct wheel_slot slot[WHEEL_LEVELS][WHEEL_SIZE];
+	uint64_t occupied[WHEEL_LEVELS][WHEEL_WORDS];
+	uint64_t now;	/* the next tick to be run */
+	uint64_t armed;	/* the tick programmed into the timerfd, or zero */
+	unsigned int count;
+	int fd;
+};
+
+static uint64_t wheel_monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+static uint64_t wheel_ticks(void)
+{
+	return wheel_monotonic_ns() >> WHEEL_TICK_SHIFT;
+}
+
+/*
+ * Returns the first occupied slot at or after 'start', wrapping around
+ * the end of the level, or -1 if the level is empty.
+ */
+static int wheel_find(uint64_t *map, int start)
+{
+	uint64_t word;
+	int i, n;
+
+	for (i = 0; i < WHEEL_SIZE; i += 64 - n % 64) {
+		n = (start + i) & WHEEL_MASK;
+		word = map[n / 64] >> (n % 64);
+		if (word) {
+			return n + __builtin_ctzll(word);
+		}
+	}
+	return -1;
+}
+
+static void wheel_place(struct wheel *w, struct wheel_timer *t)
+{
+	uint64_t delta = t->expires - w->now;
+	int level, index, shift;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta >> (WHEEL_BITS * (level + 1)) == 0) {
+			break;
+		}
+	}
+	shift = WHEEL_BITS * level;
+	if (delta >> shift >= WHEEL_SIZE) {
+		index = ((w->now >> shift) + WHEEL_MASK) & WHEEL_MASK;
+	} else {
+		index = (t->expires >> shift) & WHEEL_MASK;
+	}
+	LIST_INSERT_HEAD(&w->slot[level][index], t, list);
+	w->occupied[level][index / 64] |= 1ULL << (index % 64);
+	t->level = level;
+	t->index = index;
+	w->count++;
+}
+
+static void wheel_unlink(struct wheel *w, struct wheel_timer *t)
+{
+	LIST_REMOVE(t, list);
+	if (LIST_EMPTY(&w->slot[t->level][t->index])) {
+		w->occupied[t->level][t->index / 64] &= ~(1ULL << (t->index % 64));
+	}
+	t->level = -1;
+	w->count--;
+}
+
+/*
+ * Called at the start of each block of level zero.  Moves the timers
+ * from the current slot of the higher levels down to where they now
+ * belong.
+ */
+static void wheel_cascade(struct wheel *w)
+{
+	struct wheel_slot tmp;
+	struct wheel_timer *t;
+	int level, index;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		index = (w->now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+		LIST_INIT(&tmp);
+		while ((t = LIST_FIRST(&w->slot[level][index]))) {
+			wheel_unlink(w, t);
+			LIST_INSERT_HEAD(&tmp, t, list);
+		}
+		while ((t = LIST_FIRST(&tmp))) {
+			LIST_REMOVE(t, list);
+			wheel_place(w, t);
+		}
+		if (index) {
+			break;
+		}
+	}
+}
+
+/*
+ * Returns the first tick on which a timer might expire or cascade.
+ */
+static uint64_t wheel_next(struct wheel *w)
+{
+	uint64_t block, offset, tick, next = UINT64_MAX;
+	int level, cur, n, shift, done;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		shift = WHEEL_BITS * level;
+		block = w->now >> shift;
+		cur = block & WHEEL_MASK;
+		/* The current slot of a higher level may be behind us. */
+		done = level && (w->now & ((1ULL << shift) - 1));
+		n = wheel_find(w->occupied[level], done ? (cur + 1) & WHEEL_MASK : cur);
+		if (n < 0) {
+			continue;
+		}
+		offset = (n - cur) & WHEEL_MASK;
+		if (!offset && done) {
+			offset = WHEEL_SIZE;
+		}
+		tick = (block + offset) << shift;
+		if (tick < next) {
+			next = tick;
+		}
+	}
+	return next;
+}
+
+struct wheel *wheel_create(void)
+{
+	struct wheel *w;
+	int i, j;
+
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		return NULL;
+	}
+	for (i = 0; i < WHEEL_LEVELS; i++) {
+		for (j = 0; j < WHEEL_SIZE; j++) {
+			LIST_INIT(&w->slot[i][j]);
+		}
+	}
+	w->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (w->fd < 0) {
+		pr_err("timerfd_create failed: %m");
+		free(w);
+		return NULL;
+	}
+	w->now = wheel_ticks();
+	return w;
+}
+
+void wheel_destroy(struct wheel *w)
+{
+	close(w->fd);
+	free(w);
+}
+
+int wheel_fd(struct wheel *w)
+{
+	return w->fd;
+}
+
+void wheel_arm(struct wheel *w)
+{
+	struct itimerspec tmo = {
+		{0, 0}, {0, 0}
+	};
+	uint64_t ns, next;
+
+	next = w->count ? wheel_next(w) : 0;
+	if (next == w->armed) {
+		return;
+	}
+	if (next) {
+		ns = next << WHEEL_TICK_SHIFT;
+		tmo.it_value.tv_sec = ns / NS_PER_SEC;
+		tmo.it_value.tv_nsec = ns % NS_PER_SEC;
+	}
+	if (timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &tmo, NULL)) {
+		pr_err("timerfd_settime failed: %m");
+		return;
+	}
+	w->armed = next;
+}
+
+void wheel_run(struct wheel *w, void (*expire)(void *ctx, uint64_t data),
+	       void *ctx)
+{
+	struct wheel_timer *t;
+	uint64_t target, skip, count;
+	int index, n;
+
+	if (read(w->fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		pr_err("failed to read the wheel timer: %m");
+	}
+	w->armed = 0;
+
+	target = wheel_ticks();
+	while (w->now <= target) {
+		if (!w->count) {
+			w->now = target + 1;
+			break;
+		}
+		index = w->now & WHEEL_MASK;
+		if (!index) {
+			wheel_cascade(w);
+		}
+		/* Skip the empty slots up to the end of the block. */
+		n = wheel_find(w->occupied[0], index);
+		if (n != index) {
+			skip = n > index ? n - index : WHEEL_SIZE - index;
+			if (skip > target + 1 - w->now) {
+				skip = target + 1 - w->now;
+			}
+			w->now += skip;
+			continue;
+		}
+		/*
+		 * Advance first, so that a timer restarted from the
+		 * callback lands in a later slot.
+		 */
+		w->now++;
+		while ((t = LIST_FIRST(&w->slot[0][index]))) {
+			wheel_unlink(w, t);
+			expire(ctx, t->data);
+		}
+	}
+}
+
+void wheel_timer_init(struct wheel_timer *t, struct wheel *w, uint64_t data)
+{
+	t->wheel = w;
+	t->data = data;
+	t->expires = 0;
+	t->level = -1;
+	t->index = 0;
+}
+
+void wheel_timer_set(struct wheel_timer *t, uint64_t ns)
+{
+	struct wheel *w = t->wheel;
+	uint64_t expires, now;
+
+	if (wheel_timer_pending(t)) {
+		wheel_unlink(w, t);
+	}
+	now = wheel_monotonic_ns();
+	if (!w->count && now >> WHEEL_TICK_SHIFT > w->now) {
+		/* Catch up after an idle spell without walking the slots. */
+		w->now = now >> WHEEL_TICK_SHIFT;
+	}
+	ns += now;
+	expires = (ns + (1ULL << WHEEL_TICK_SHIFT) - 1) >> WHEEL_TICK_SHIFT;
+	if (expires < w->now) {
+		expires = w->now;
+	}
+	t->expires = expires;
+	wheel_place(w, t);
+}
+
+void wheel_timer_clear(struct wheel_timer *t)
+{
+	if (wheel_timer_pending(t)) {
+		wheel_unlink(t->wheel, t);
+	}
+}
@@ -0,0 +1,120 @@
+/**
+ * @file wheel.h
+ * @brief Implements a hierarchical timer wheel driven by a single timerfd.
+ * @note Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef HAVE_WHEEL_H
+#define HAVE_WHEEL_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+/** The resolution of the wheel is 2^WHEEL_TICK_SHIFT nanoseconds. */
+#define WHEEL_TICK_SHIFT 20
+
+struct wheel;
+
+/**
+ * A one shot timer.  The fields are private to the wheel.
+ * @list:     Links the timer into its slot while it is pending.
+ * @wheel:    The wheel running the timer.
+ * @expires:  The tick on which the timer expires.
+ * @data:     Identifies the timer to the expiry callback.
+ * @level:    Level of the slot holding the timer, or -1 when idle.
+ * @index:    Index of the slot holding the timer.
+ */
+struct wheel_timer {
+	LIST_ENTRY(wheel_timer) list;
+	struct wheel *wheel;
+	uint64_t expires;
+	uint64_t data;
+	int level;
+	int index;
+};
+
+/**
+ * Create a new timer wheel.
+ * @return  A pointer to a new wheel on success, NULL otherwise.
+ */
+struct wheel *wheel_create(void);
+
+/**
+ * Destroy a timer wheel.  Any pending timers are forgotten.
+ * @param w  Pointer obtained via @ref wheel_create().
+ */
+void wheel_destroy(struct wheel *w);
+
+/**
+ * Obtain the file descriptor of the wheel.  It becomes readable when
+ * @ref wheel_run() has work to do.
+ * @param w  Pointer obtained via @ref wheel_create().
+ * @return   A timerfd suitable for poll(2) or epoll(7).
+ */
+int wheel_fd(struct wheel *w);
+
+/**
+ * Program the timerfd of the wheel for the earliest pending timer.
+ * The timerfd is only touched when that time has changed, so this may
+ * be called once per pass of the main loop at little cost.
+ * @param w  Pointer obtained via @ref wheel_create().
+ */
+void wheel_arm(struct wheel *w);
+
+/**
+ * Expire all of the timers which are due.  Each timer is idle again
+ * by the time its callback runs and may be restarted from it.
+ * @param w       Pointer obtained via @ref wheel_create().
+ * @param expire  Called with 'ctx' and the data of each expired timer.
+ * @param ctx     Passed through to 'expire'.
+ */
+void wheel_run(struct wheel *w, void (*expire)(void *ctx, uint64_t data),
+	       void *ctx);
+
+/**
+ * Prepare a timer for use.  This must be called once before any of the
+ * other timer functions.
+ * @param t     The timer to prepare.
+ * @param w     The wheel to run the timer on.
+ * @param data  Passed to the expiry callback of the wheel.
+ */
+void wheel_timer_init(struct wheel_timer *t, struct wheel *w, uint64_t data);
+
+/**
+ * Start a timer, or restart it if it is already pending.  The timer
+ * expires on the first tick at or after the given interval.
+ * @param t   A timer prepared with @ref wheel_timer_init().
+ * @param ns  The interval from now in nanoseconds.
+ */
+void wheel_timer_set(struct wheel_timer *t, uint64_t ns);
+
+/**
+ * Stop a timer.  Stopping an idle timer has no effect.
+ * @param t  A timer prepared with @ref wheel_timer_init().
+ */
+void wheel_timer_clear(struct wheel_timer *t);
+
+/**
+ * Test whether a timer is running.
+ * @param t  A timer prepared with @ref wheel_timer_init().
+ * @return   One if the timer is pending, zero otherwise.
+ */
+static inline int wheel_timer_pending(struct wheel_timer *t)
+{
+	return t->level >= 0;
+}
+
+#endif